@@ -0,0 +1,80 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Arduino.h>
+#include <chrono>
+
+// Small timing harness for the native benchmarks.
+//
+// run() calls `fn` (which performs `ops` operations per call) until at least
+// Bench::min_ms have passed, after one untimed warm-up call, and prints the
+// time per operation. Results are wall-clock on the build machine: compare
+// them against a baseline from the same machine, not against the ESP32.
+namespace Bench {
+
+inline uint32_t min_ms = 300;
+inline const char* filter = nullptr;    // Only run names containing this
+
+struct Result {
+    const char* name;
+    uint64_t ops;
+    double ns_per_op;
+};
+
+// Keeps a value alive so the optimizer cannot drop the work producing it
+template<typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+inline bool selected(const char* name) {
+    return filter == nullptr || strstr(name, filter) != nullptr;
+}
+
+inline void printHeader() {
+    printf("%-32s %14s %12s %12s\n", "benchmark", "ops", "ns/op", "Mops/s");
+}
+
+inline void print(const Result& result) {
+    printf("%-32s %14llu %12.2f %12.2f\n", result.name,
+                  static_cast<unsigned long long>(result.ops), result.ns_per_op,
+                  result.ns_per_op > 0 ? 1000.0 / result.ns_per_op : 0.0);
+}
+
+template<typename Fn>
+bool run(const char* name, uint32_t ops, Fn fn) {
+    if (!selected(name)) {
+        return false;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    fn();
+
+    uint64_t calls = 0;
+    uint64_t batch = 1;
+    Clock::duration elapsed{};
+    const auto limit = std::chrono::milliseconds(min_ms);
+    while (elapsed < limit) {
+        Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < batch; i++) {
+            fn();
+        }
+        Clock::duration taken = Clock::now() - start;
+        elapsed += taken;
+        calls += batch;
+        if (taken < std::chrono::milliseconds(10)) {
+            batch *= 2;     // Fewer clock reads for short calls
+        }
+    }
+
+    Result result;
+    result.name = name;
+    result.ops = calls * ops;
+    result.ns_per_op = std::chrono::duration<double, std::nano>(elapsed).count() / result.ops;
+    print(result);
+    return true;
+}
+
+} // namespace Bench
+
+#endif // BENCH_H
@@ -0,0 +1,341 @@
+/**
+ * Host-native benchmarks of the CAN hot path
+ *
+ * Build and run with PlatformIO:
+ *   pio run -e native
+ *   .pio/build/native/program                     # microbenchmarks
+ *   .pio/build/native/program canlog.csv ...      # replay captured logs
+ *
+ * Options:
+ *   --filter <text>      Only microbenchmarks whose name contains <text>
+ *   --min-ms <ms>        Minimum time per benchmark / replay (default 300)
+ *   --protocol <name>    Replay protocol: dpower (default), generic, legacy
+ *   --min-rate <fps>     Exit with status 1 if a replay is slower than this
+ *   --verbose            Keep the firmware's own Serial output
+ *
+ * See bench/README.md.
+ */
+
+#include <Arduino.h>
+#include "bench.h"
+#include "replay.h"
+#include "../src/can/builtin_protocols.h"
+#include "../src/can/can_parser.h"
+#include "../src/can/can_log_format.h"
+#include "../src/can/can_log_codec.h"
+#include "../src/network/ws_protocol.h"
+#include "../src/utils/ring_buffer.h"
+#include "../src/utils/spsc_queue.h"
+
+// Distinct payloads cycled through, so the decode cache only hits where a
+// benchmark means it to
+static constexpr size_t PAYLOADS = 256;
+
+static uint32_t lcg_state = 12345;
+
+static uint8_t nextByte() {
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return static_cast<uint8_t>(lcg_state >> 24);
+}
+
+// Frames of the given IDs with random payloads; uint16 at byte 0 and 2 kept
+// in the protocols' valid ranges where `plausible`
+static void makeFrames(CANMessage* out, size_t count, const uint32_t* ids, size_t id_count,
+                       bool plausible) {
+    for (size_t i = 0; i < count; i++) {
+        CANMessage& msg = out[i];
+        msg.id = ids[i % id_count];
+        msg.dlc = 8;
+        msg.extended = false;
+        msg.rtr = false;
+        msg.timestamp = static_cast<uint32_t>(i * 10);
+        for (uint8_t b = 0; b < 8; b++) {
+            msg.data[b] = nextByte();
+        }
+        if (plausible) {
+            uint16_t millivolts = 48000 + (nextByte() << 4);
+            msg.data[0] = static_cast<uint8_t>(millivolts);
+            msg.data[1] = static_cast<uint8_t>(millivolts >> 8);
+        }
+    }
+}
+
+static const Protocol::Field* builtinField(Protocol::BuiltinId id, uint32_t can_id, uint8_t index) {
+    const Protocol::Definition* protocol = Protocol::getBuiltinProtocol(id);
+    const Protocol::Message* message = protocol ? protocol->findMessage(can_id) : nullptr;
+    return message && index < message->field_count ? &message->fields[index] : nullptr;
+}
+
+static void benchProtocol() {
+    static CANMessage frames[PAYLOADS];
+    static const uint32_t ids[] = { 0x202 };
+    makeFrames(frames, PAYLOADS, ids, 1, true);
+
+    const Protocol::Field* u16 = builtinField(Protocol::BuiltinId::DPOWER_48V_13S, 0x202, 0);
+    const Protocol::Field* u8 = builtinField(Protocol::BuiltinId::DPOWER_48V_13S, 0x204, 0);
+    const Protocol::Field* i16 = builtinField(Protocol::BuiltinId::GENERIC_BMS, 0x100, 1);
+
+    const Protocol::Field* fields[] = { u16, u8, i16 };
+    const char* names[] = { "field/extract_uint16_le", "field/extract_uint8", "field/extract_int16_le" };
+    for (size_t f = 0; f < 3; f++) {
+        const Protocol::Field* field = fields[f];
+        if (field == nullptr) {
+            continue;
+        }
+        Bench::run(names[f], PAYLOADS, [field] {
+            float sum = 0;
+            for (size_t i = 0; i < PAYLOADS; i++) {
+                sum += field->extractValue(frames[i].data);
+            }
+            Bench::keep(sum);
+        });
+    }
+}
+
+static void benchParser(const char* name, const Protocol::Definition* protocol,
+                        const uint32_t* ids, size_t id_count, bool repeat) {
+    if (!Bench::selected(name)) {
+        return;
+    }
+
+    static CANMessage frames[PAYLOADS];
+    makeFrames(frames, PAYLOADS, ids, id_count, true);
+    if (repeat) {
+        // One payload per ID: after the first frame every one is a cache hit
+        for (size_t i = id_count; i < PAYLOADS; i++) {
+            memcpy(frames[i].data, frames[i % id_count].data, 8);
+        }
+    }
+
+    CANParser* parser = new CANParser();
+    parser->setProtocol(protocol);
+    Bench::run(name, PAYLOADS, [parser] {
+        CANBatteryData data;
+        uint32_t ok = 0;
+        for (size_t i = 0; i < PAYLOADS; i++) {
+            ok += parser->parseMessage(frames[i], data);
+        }
+        Bench::keep(ok);
+        Bench::keep(data);
+    });
+    delete parser;
+}
+
+static void benchParsers() {
+    const Protocol::Definition* dpower = Protocol::getBuiltinProtocol(Protocol::BuiltinId::DPOWER_48V_13S);
+    const Protocol::Definition* generic = Protocol::getBuiltinProtocol(Protocol::BuiltinId::GENERIC_BMS);
+
+    static const uint32_t dpower_ids[] = { 0x202, 0x203, 0x204 };
+    static const uint32_t generic_ids[] = { 0x100 };
+    static const uint32_t unknown_ids[] = { 0x123, 0x456, 0x7DF };
+
+    benchParser("parser/dpower", dpower, dpower_ids, 3, false);
+    benchParser("parser/dpower_cached", dpower, dpower_ids, 3, true);
+    if (generic != nullptr) {
+        benchParser("parser/generic", generic, generic_ids, 1, false);
+        benchParser("parser/generic_cached", generic, generic_ids, 1, true);
+    }
+    benchParser("parser/unknown_id", dpower, unknown_ids, 3, false);
+}
+
+static void benchQueues() {
+    static CANMessage frames[PAYLOADS];
+    static const uint32_t ids[] = { 0x202, 0x203, 0x204 };
+    makeFrames(frames, PAYLOADS, ids, 3, false);
+
+    // Logger memory buffer / recent-frame history
+    static RingBuffer<CANMessage, 128> ring;
+    Bench::run("ring_buffer/push_pop", PAYLOADS, [] {
+        CANMessage msg;
+        for (size_t i = 0; i < PAYLOADS; i += 32) {
+            for (size_t j = 0; j < 32; j++) ring.push(frames[i + j]);
+            for (size_t j = 0; j < 32; j++) ring.pop(msg);
+        }
+        Bench::keep(msg);
+    });
+    Bench::run("ring_buffer/push_overwrite", PAYLOADS, [] {
+        for (size_t i = 0; i < PAYLOADS; i++) ring.push(frames[i]);
+    });
+
+    // The driver's RX ring, with the pack/unpack on either side
+    static SpscQueue<CANFrame, 128> rx;
+    Bench::run("rx_ring/pack_push_pop", PAYLOADS, [] {
+        CANFrame frame;
+        CANMessage msg;
+        for (size_t i = 0; i < PAYLOADS; i += 32) {
+            for (size_t j = 0; j < 32; j++) rx.push(CANFrame::fromMessage(frames[i + j]));
+            while (rx.pop(frame)) msg = frame.toMessage();
+        }
+        Bench::keep(msg);
+    });
+}
+
+static void benchLogger() {
+    static CANMessage frames[PAYLOADS];
+    static const uint32_t ids[] = { 0x202, 0x203, 0x204, 0x18FF50E5 };
+    makeFrames(frames, PAYLOADS, ids, 4, false);
+    for (size_t i = 3; i < PAYLOADS; i += 4) {
+        frames[i].extended = true;
+    }
+
+    Bench::run("logger/format_csv", PAYLOADS, [] {
+        char line[72];
+        for (size_t i = 0; i < PAYLOADS; i++) {
+            CANLogFormat::formatCSV(frames[i], line, sizeof(line));
+            Bench::keep(line);
+        }
+    });
+
+    static CANLogFormat::Record records[PAYLOADS];
+    Bench::run("logger/encode_record", PAYLOADS, [] {
+        for (size_t i = 0; i < PAYLOADS; i++) {
+            CANLogFormat::encodeFrame(records[i], CANFrame::fromMessage(frames[i]), 10);
+        }
+        Bench::keep(records);
+    });
+
+    // One write block of BMS-like traffic, few bytes changing per frame
+    static CANLogFormat::Record block[CAN_LOG_BLOCK_SIZE / sizeof(CANLogFormat::Record)];
+    static uint8_t packed[CAN_LOG_BLOCK_SIZE];
+    const size_t block_records = sizeof(block) / sizeof(block[0]);
+    for (size_t i = 0; i < block_records; i++) {
+        CANMessage msg = frames[i % 4];
+        msg.data[0] = static_cast<uint8_t>(i);
+        CANLogFormat::encodeFrame(block[i], msg, 10);
+    }
+    Bench::run("logger/pack_block", block_records, [block_records] {
+        size_t len = CANLogCodec::encodeBlock(block, block_records, packed, sizeof(packed));
+        Bench::keep(len);
+    });
+}
+
+static void benchWebSocket() {
+    // A full-rate flush: as many frames as one batch holds
+    static constexpr size_t BATCH_FRAMES = (WS_CAN_BATCH_BYTES - 2) / (4 + 1 + 8 + 4);
+    static CANFrame frames[BATCH_FRAMES];
+    static CANMessage messages[BATCH_FRAMES];
+    static const uint32_t ids[] = { 0x202, 0x203, 0x204, 0x300, 0x301 };
+    makeFrames(messages, BATCH_FRAMES, ids, 5, false);
+    for (size_t i = 0; i < BATCH_FRAMES; i++) {
+        frames[i] = CANFrame::fromMessage(messages[i]);
+    }
+    static uint8_t buffer[WS_CAN_BATCH_BYTES];
+
+    static WSProtocol::CANSubscription all;
+    memset(&all, 0, sizeof(all));
+    Bench::run("websocket/can_batch", BATCH_FRAMES, [] {
+        size_t size = WSProtocol::canBatchSize(all, frames, BATCH_FRAMES);
+        size_t count = WSProtocol::encodeCANBatch(all, frames, BATCH_FRAMES, buffer);
+        Bench::keep(size);
+        Bench::keep(count);
+    });
+
+    static WSProtocol::CANSubscription filtered;
+    memset(&filtered, 0, sizeof(filtered));
+    filtered.filter_count = 2;
+    filtered.ids[0] = 0x200;
+    filtered.masks[0] = 0x7F0;
+    filtered.ids[1] = 0x300;
+    filtered.masks[1] = 0x7FF;
+    Bench::run("websocket/can_batch_filtered", BATCH_FRAMES, [] {
+        size_t size = WSProtocol::canBatchSize(filtered, frames, BATCH_FRAMES);
+        size_t count = WSProtocol::encodeCANBatch(filtered, frames, BATCH_FRAMES, buffer);
+        Bench::keep(size);
+        Bench::keep(count);
+    });
+}
+
+static const Protocol::Definition* protocolByName(const char* name, bool& ok) {
+    ok = true;
+    if (strcmp(name, "dpower") == 0) {
+        return Protocol::getBuiltinProtocol(Protocol::BuiltinId::DPOWER_48V_13S);
+    }
+    if (strcmp(name, "generic") == 0) {
+        const Protocol::Definition* generic = Protocol::getBuiltinProtocol(Protocol::BuiltinId::GENERIC_BMS);
+        ok = generic != nullptr;
+        return generic;
+    }
+    ok = strcmp(name, "legacy") == 0;
+    return nullptr;
+}
+
+static void printReplay(const char* path, const ReplayResult& result) {
+    printf("%s\n", path);
+    printf("  frames:          %zu (%zu other lines skipped)\n", result.frames, result.skipped);
+    printf("  passes:          %u\n", result.passes);
+    printf("  decoded:         %.1f%% (%llu battery updates)\n",
+                  result.processed > 0 ? result.decoded * 100.0 / result.processed : 0.0,
+                  static_cast<unsigned long long>(result.battery_updates));
+    printf("  cache hits:      %u of %u\n", result.cache_hits,
+                  result.cache_hits + result.cache_misses);
+    printf("  time per frame:  %.1f ns\n",
+                  result.processed > 0 ? result.seconds * 1e9 / result.processed : 0.0);
+    printf("  throughput:      %.0f frames/s\n", result.frames_per_sec);
+}
+
+int main(int argc, char** argv) {
+    const char* protocol_name = "dpower";
+    double min_rate = 0;
+    bool verbose = false;
+    const char* files[32];
+    size_t file_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (strcmp(arg, "--filter") == 0 && has_value) {
+            Bench::filter = argv[++i];
+        } else if (strcmp(arg, "--min-ms") == 0 && has_value) {
+            Bench::min_ms = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(arg, "--protocol") == 0 && has_value) {
+            protocol_name = argv[++i];
+        } else if (strcmp(arg, "--min-rate") == 0 && has_value) {
+            min_rate = strtod(argv[++i], nullptr);
+        } else if (strcmp(arg, "--verbose") == 0) {
+            verbose = true;
+        } else if (arg[0] == '-' || file_count >= sizeof(files) / sizeof(files[0])) {
+            printf("Usage: %s [--filter text] [--min-ms ms] [--protocol dpower|generic|legacy] "
+                   "[--min-rate fps] [--verbose] [canlog.csv ...]\n", argv[0]);
+            return 2;
+        } else {
+            files[file_count++] = arg;
+        }
+    }
+
+    // Parser and battery setup messages would break up the results
+    if (!verbose) {
+        Serial.end();
+    }
+
+    if (file_count == 0) {
+        Bench::printHeader();
+        benchProtocol();
+        benchParsers();
+        benchQueues();
+        benchLogger();
+        benchWebSocket();
+        return 0;
+    }
+
+    bool known;
+    const Protocol::Definition* protocol = protocolByName(protocol_name, known);
+    if (!known) {
+        printf("Unknown protocol '%s'\n", protocol_name);
+        return 2;
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < file_count; i++) {
+        ReplayResult result;
+        if (!replayCSV(files[i], protocol, Bench::min_ms, result)) {
+            status = 1;
+            continue;
+        }
+        printReplay(files[i], result);
+        if (result.frames_per_sec < min_rate) {
+            printf("  FAIL: below --min-rate %.0f frames/s\n", min_rate);
+            status = 1;
+        }
+    }
+    return status;
+}
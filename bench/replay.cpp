@@ -0,0 +1,157 @@
+#include "replay.h"
+#include "../src/can/can_parser.h"
+#include "../src/battery/battery_module.h"
+#include "../src/battery/battery_history.h"
+#include "../src/utils/spsc_queue.h"
+#include <chrono>
+#include <vector>
+
+// Same depth as the driver's RX ring (CANDriver::RX_QUEUE_SIZE)
+static constexpr size_t RX_RING_SIZE = 128;
+
+bool parseCSVLine(const char* line, CANMessage& msg) {
+    char* end;
+    unsigned long timestamp = strtoul(line, &end, 10);
+    if (end == line || *end != ',') {
+        return false;
+    }
+
+    const char* p = end + 1;
+    unsigned long id = strtoul(p, &end, 16);     // "0x202"
+    if (end == p || *end != ',' || id > CANFrame::ID_MASK) {
+        return false;
+    }
+
+    p = end + 1;
+    unsigned long dlc = strtoul(p, &end, 10);
+    if (end == p || *end != ',' || dlc > 8) {
+        return false;
+    }
+
+    memset(msg.data, 0, sizeof(msg.data));
+    p = end + 1;
+    for (unsigned long i = 0; i < dlc; i++) {
+        while (*p == ' ') p++;
+        unsigned long byte = strtoul(p, &end, 16);
+        if (end == p || byte > 0xFF) {
+            return false;
+        }
+        msg.data[i] = static_cast<uint8_t>(byte);
+        p = end;
+    }
+    if (*p != ',') {
+        return false;
+    }
+
+    // Extended and RTR; missing flags in hand-made files count as 0
+    p++;
+    bool extended = *p == '1';
+    const char* comma = strchr(p, ',');
+    bool rtr = comma != nullptr && comma[1] == '1';
+
+    msg.timestamp = static_cast<uint32_t>(timestamp);
+    msg.id = static_cast<uint32_t>(id);
+    msg.dlc = static_cast<uint8_t>(dlc);
+    msg.extended = extended || id > 0x7FF;
+    msg.rtr = rtr;
+    return true;
+}
+
+static bool loadCSV(const char* path, std::vector<CANMessage>& frames, size_t& skipped) {
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        printf("Replay: Cannot open %s\n", path);
+        return false;
+    }
+
+    char line[128];
+    CANMessage msg;
+    skipped = 0;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        if (parseCSVLine(line, msg)) {
+            frames.push_back(msg);
+        } else {
+            skipped++;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+bool replayCSV(const char* path, const Protocol::Definition* protocol, uint32_t min_ms,
+               ReplayResult& out) {
+    memset(&out, 0, sizeof(out));
+
+    std::vector<CANMessage> frames;
+    if (!loadCSV(path, frames, out.skipped)) {
+        return false;
+    }
+    out.frames = frames.size();
+    if (frames.empty()) {
+        printf("Replay: No frames in %s\n", path);
+        return false;
+    }
+
+    // One pack fed by the parser, as with a single-battery configuration
+    // (the router only adds an ID offset for further packs)
+    CANParser* parser = new CANParser();
+    parser->setProtocol(protocol);
+    BatteryModule* batteries = new BatteryModule[MAX_BATTERY_MODULES];
+    for (uint8_t i = 0; i < MAX_BATTERY_MODULES; i++) {
+        batteries[i].begin(i, "replay");
+    }
+    BatteryHistory* history = new BatteryHistory();
+    history->begin(MAX_BATTERY_MODULES);
+    SpscQueue<CANFrame, RX_RING_SIZE>* ring = new SpscQueue<CANFrame, RX_RING_SIZE>();
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::duration elapsed{};
+    DecodedFrame decoded;
+    CANFrame frame;
+
+    // Later passes continue the clock, so the history sees time move on
+    uint32_t span = frames.back().timestamp - frames.front().timestamp + 1000;
+    do {
+        uint32_t offset = out.passes * span;
+        Clock::time_point start = Clock::now();
+        size_t next = 0;
+        while (next < frames.size()) {
+            // RX task: pack and queue a burst, then the CAN task drains it
+            while (next < frames.size()) {
+                CANMessage msg = frames[next];
+                msg.timestamp += offset;
+                if (!ring->push(CANFrame::fromMessage(msg))) {
+                    break;
+                }
+                next++;
+            }
+            while (ring->pop(frame)) {
+                CANMessage msg = frame.toMessage();
+                if (parser->decode(msg, decoded)) {
+                    out.decoded++;
+                    const CANBatteryData& data = decoded.battery;
+                    if (data.valid && data.battery_id < MAX_BATTERY_MODULES) {
+                        batteries[data.battery_id].updateFromCAN(data, msg.timestamp);
+                        history->record(data.battery_id, batteries[data.battery_id], data.present, msg.timestamp);
+                        out.battery_updates++;
+                    }
+                }
+                parser->getDecodedBus().publish(decoded);
+            }
+        }
+        elapsed += Clock::now() - start;
+        out.passes++;
+    } while (elapsed < std::chrono::milliseconds(min_ms));
+
+    out.processed = static_cast<uint64_t>(out.frames) * out.passes;
+    out.cache_hits = parser->getCacheHits();
+    out.cache_misses = parser->getCacheMisses();
+    out.seconds = std::chrono::duration<double>(elapsed).count();
+    out.frames_per_sec = out.seconds > 0 ? out.processed / out.seconds : 0;
+
+    delete ring;
+    delete history;
+    delete[] batteries;
+    delete parser;
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef BENCH_REPLAY_H
+#define BENCH_REPLAY_H
+
+#include <Arduino.h>
+#include "../src/can/can_message.h"
+#include "../src/can/protocol.h"
+
+// Replay of a captured canlog.csv (the /api/can/logs export, or a CSV
+// segment file) through the CAN task's per-frame path: pack into a CANFrame,
+// RX ring, unpack, CANParser::decode(), BatteryModule::updateFromCAN(),
+// BatteryHistory::record() and the decoded-frame bus (no consumers).
+// The file is read and parsed up front; only the pipeline is timed.
+struct ReplayResult {
+    size_t frames;              // Frames in the file
+    size_t skipped;             // Lines that were not a frame (header, garbage)
+    uint32_t passes;            // Times the frames went through the pipeline
+    uint64_t processed;         // frames * passes
+    uint64_t decoded;
+    uint64_t battery_updates;
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+    double seconds;             // Pipeline time over all passes
+    double frames_per_sec;
+};
+
+// Parse one line: Timestamp,ID,DLC,Data,Extended,RTR (Data = hex bytes
+// separated by spaces). False for the header or a malformed line.
+bool parseCSVLine(const char* line, CANMessage& msg);
+
+// Replays the file until at least min_ms of pipeline time (at least one
+// pass). protocol = nullptr uses the parser's legacy decoders.
+bool replayCSV(const char* path, const Protocol::Definition* protocol, uint32_t min_ms,
+               ReplayResult& out);
+
+#endif // BENCH_REPLAY_H
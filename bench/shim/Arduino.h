@@ -0,0 +1,55 @@
+#ifndef BENCH_SHIM_ARDUINO_H
+#define BENCH_SHIM_ARDUINO_H
+
+// Just enough of the ESP32 Arduino core for the hardware-independent
+// sources (protocol, parser, log formats, battery model, logger) to build
+// and run on a PC. See bench/README.md for what is and is not covered.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#define IRAM_ATTR
+
+// As in the ESP32 core
+using std::min;
+using std::max;
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Since process start, like the ESP32 counters since boot
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+
+// Serial is stdout; output is discarded between end() and begin()
+class NativeSerial {
+public:
+    void begin(unsigned long) { enabled_ = true; }
+    void end() { enabled_ = false; }
+    size_t print(const char* text) { return enabled_ && fputs(text, stdout) >= 0 ? strlen(text) : 0; }
+    size_t println(const char* text = "") { return print(text) + print("\n"); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    void flush() { fflush(stdout); }
+
+private:
+    bool enabled_ = true;
+};
+
+extern NativeSerial Serial;
+
+// newlib has these, glibc only from 2.38
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+size_t strlcpy(char* dst, const char* src, size_t size);
+size_t strlcat(char* dst, const char* src, size_t size);
+#endif
+
+#endif // BENCH_SHIM_ARDUINO_H
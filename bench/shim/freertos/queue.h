@@ -0,0 +1,16 @@
+#ifndef BENCH_SHIM_FREERTOS_QUEUE_H
+#define BENCH_SHIM_FREERTOS_QUEUE_H
+
+#include "FreeRTOS.h"
+
+// Fixed-size item queues (mutex and condition variable)
+typedef struct NativeQueue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+#define xQueueSendToBack xQueueSend
+
+#endif // BENCH_SHIM_FREERTOS_QUEUE_H
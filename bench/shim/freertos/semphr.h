@@ -0,0 +1,14 @@
+#ifndef BENCH_SHIM_FREERTOS_SEMPHR_H
+#define BENCH_SHIM_FREERTOS_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+// Mutexes only
+typedef struct NativeMutex* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+void vSemaphoreDelete(SemaphoreHandle_t mutex);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
+
+#endif // BENCH_SHIM_FREERTOS_SEMPHR_H
@@ -0,0 +1,16 @@
+#ifndef BENCH_SHIM_FREERTOS_TASK_H
+#define BENCH_SHIM_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+// Tasks are detached threads; priority and core are ignored
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_size,
+                                   void* parameter, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+
+#endif // BENCH_SHIM_FREERTOS_TASK_H
@@ -7,6 +7,7 @@ class BatteryMonitor {
     this.reconnectInterval = null;
     this.config = {};
     this.batteries = [];
+    this.textDecoder = new TextDecoder();
 
     // CAN monitor state
     this.canMonitor = {
@@ -14,6 +15,11 @@ class BatteryMonitor {
       messageCount: 0,
       maxMessages: 1000,
       filter: null,
+      serverFilter: null, // {id, mask} sent with the subscription
+      totals: new Map(), // Frames seen per ID, to expand summary totals
+      subscribeTimer: null,
+      statsVisible: false,
+      statsTimer: null, // Polls /api/can/analytics while the stats view is open
     };
 
     this.init();
@@ -22,6 +28,7 @@ class BatteryMonitor {
   init() {
     this.setupEventListeners();
     this.loadConfig();
+    this.loadCANFilterState();
     this.connectWebSocket();
     this.startPeriodicUpdates();
   }
@@ -120,6 +127,18 @@ class BatteryMonitor {
     document.getElementById("canFilterInput").addEventListener("input", (e) => {
       this.setCANFilter(e.target.value.trim());
     });
+
+    document.getElementById("canPromiscuousToggle").addEventListener("change", (e) => {
+      this.setCANPromiscuous(e.target.checked);
+    });
+
+    document.getElementById("canStatsBtn").addEventListener("click", () => {
+      this.toggleCANStats();
+    });
+
+    document.getElementById("canStatsResetBtn").addEventListener("click", () => {
+      this.resetCANStats();
+    });
   }
 
   // WebSocket Management
@@ -151,6 +170,13 @@ class BatteryMonitor {
         console.log("WebSocket connected");
         this.showToast("Connected", "success");
         this.clearReconnectInterval();
+
+        // Ask for binary battery/system updates; older firmware ignores
+        // this and keeps sending JSON, which is still handled below
+        this.ws.send(
+          JSON.stringify({ cmd: "format", format: "binary", version: 1 }),
+        );
+        this.sendSubscription();
       };
 
       this.ws.onmessage = (event) => {
@@ -286,6 +312,9 @@ class BatteryMonitor {
           const timestamp = view.getUint32(offset, true);
           offset += 4;
 
+          const total = this.canMonitor.totals.get(id);
+          if (total !== undefined) this.canMonitor.totals.set(id, total + 1);
+
           const idHex = "0x" + id.toString(16).toUpperCase().padStart(3, "0");
           const dataHex = Array.from(data)
             .map((b) => b.toString(16).toUpperCase().padStart(2, "0"))
@@ -299,6 +328,14 @@ class BatteryMonitor {
             timestamp: timestamp,
           });
         }
+      } else if (type === 0x05) {
+        this.handleCANSummary(view);
+      } else if (type === 0x03) {
+        const data = this.decodeBatterySnapshot(view);
+        if (data) this.updateBatteries(data);
+      } else if (type === 0x04) {
+        const data = this.decodeSystemStatus(view);
+        if (data) this.updateSystemStatus(data);
       } else {
         console.warn("Unknown binary message type:", type);
       }
@@ -307,6 +344,162 @@ class BatteryMonitor {
     }
   }
 
+  // Latest frame of each changed ID when the device can't send every
+  // frame (type 0x05): the per-ID totals tell how many were folded
+  handleCANSummary(view) {
+    if (view.byteLength < 12 || view.getUint8(1) !== 2) return;
+
+    const count = view.getUint8(2);
+    const frames = view.getUint32(4, true);
+    const dropped = view.getUint32(8, true);
+
+    let offset = 12;
+    for (let i = 0; i < count; i++) {
+      if (offset + 5 > view.byteLength) break;
+
+      const id = view.getUint32(offset, true);
+      const dlc = view.getUint8(offset + 4);
+      offset += 5;
+      if (dlc > 8 || offset + dlc + 8 > view.byteLength) break;
+
+      const data = new Uint8Array(view.buffer, view.byteOffset + offset, dlc);
+      offset += dlc;
+      const timestamp = view.getUint32(offset, true);
+      const total = view.getUint32(offset + 4, true);
+      offset += 8;
+
+      // First sight of an ID (or a restarted count) only sets the baseline
+      const seen = this.canMonitor.totals.get(id);
+      const repeat = seen !== undefined && total > seen ? total - seen : 1;
+      this.canMonitor.totals.set(id, total);
+      this.canMonitor.folded = (this.canMonitor.folded || 0) + repeat - 1;
+
+      this.handleCANMessage({
+        type: "can_message",
+        id: "0x" + id.toString(16).toUpperCase().padStart(3, "0"),
+        dlc: dlc,
+        data: Array.from(data)
+          .map((b) => b.toString(16).toUpperCase().padStart(2, "0"))
+          .join(""),
+        timestamp: timestamp,
+        repeat: repeat,
+      });
+    }
+
+    this.updateCANDropStats({ frames, dropped, folded: this.canMonitor.folded || 0 });
+  }
+
+  updateCANDropStats(stats) {
+    const el = document.getElementById("canDropIndicator");
+    if (!el) return;
+
+    if (stats.folded === 0 && stats.dropped === 0) {
+      el.style.display = "none";
+      return;
+    }
+    el.textContent = `Bus busy: ${this.formatNumber(stats.folded)} folded, ${this.formatNumber(stats.dropped)} dropped of ${this.formatNumber(stats.frames)}`;
+    el.style.display = "inline";
+  }
+
+  // Streams this page wants (see src/network/ws_protocol.h). The CAN
+  // stream is dropped while the monitor is paused, and an exact filter
+  // ("0x351" or "0x350/0x7F0") is applied on the device.
+  sendSubscription() {
+    if (!this.ws || this.ws.readyState !== WebSocket.OPEN) return;
+
+    const streams = ["battery", "system", "logs"];
+    const can = {};
+    if (!this.canMonitor.paused) {
+      streams.push("can");
+      if (this.canMonitor.serverFilter) can.filters = [this.canMonitor.serverFilter];
+    }
+
+    // The device restarts this client's CAN view with a full summary
+    this.canMonitor.totals.clear();
+    this.ws.send(JSON.stringify({ cmd: "subscribe", streams, can }));
+  }
+
+  // Binary battery snapshot (type 0x03, see src/network/ws_protocol.h);
+  // returns the same shape as the JSON battery_update data
+  decodeBatterySnapshot(view) {
+    if (view.byteLength < 20 || view.getUint8(1) !== 1) {
+      console.warn("Unsupported battery snapshot version");
+      return null;
+    }
+
+    const count = view.getUint8(2);
+    const data = {
+      timestamp: view.getUint32(4, true),
+      total_power: view.getFloat32(8, true),
+      total_current: view.getFloat32(12, true),
+      average_voltage: view.getFloat32(16, true),
+      batteries: [],
+    };
+
+    let offset = 20;
+    for (let i = 0; i < count; i++) {
+      if (offset + 24 > view.byteLength) break;
+      const flags = view.getUint8(offset + 1);
+      const nameLen = view.getUint8(offset + 3);
+      if (offset + 24 + nameLen > view.byteLength) break;
+
+      data.batteries.push({
+        id: view.getUint8(offset),
+        soc: view.getUint8(offset + 2),
+        has_error: (flags & 0x01) !== 0,
+        has_can_data: (flags & 0x02) !== 0,
+        data_fresh: (flags & 0x04) !== 0,
+        voltage: view.getFloat32(offset + 4, true),
+        current: view.getFloat32(offset + 8, true),
+        power: view.getFloat32(offset + 12, true),
+        temp1: view.getFloat32(offset + 16, true),
+        temp2: view.getFloat32(offset + 20, true),
+        name: this.textDecoder.decode(
+          new Uint8Array(view.buffer, view.byteOffset + offset + 24, nameLen),
+        ),
+      });
+      offset += 24 + nameLen;
+    }
+
+    return data;
+  }
+
+  // Binary system status (type 0x04); same field names as system_status
+  decodeSystemStatus(view) {
+    if (view.byteLength < 46 || view.getUint8(1) !== 1) {
+      console.warn("Unsupported system status version");
+      return null;
+    }
+
+    const connected = (view.getUint8(2) & 0x01) !== 0;
+    const data = {
+      wifi_connected: connected,
+      uptime_ms: view.getUint32(4, true),
+      free_heap: view.getUint32(8, true),
+      min_free_heap: view.getUint32(12, true),
+      can_message_count: view.getUint32(16, true),
+      can_dropped_count: view.getUint32(20, true),
+      can_log_bytes_per_sec: view.getUint32(24, true),
+      can_log_flush_us: view.getUint32(28, true),
+      http_requests: view.getUint32(32, true),
+      ws_messages_sent: view.getUint32(36, true),
+      ws_clients: view.getUint8(44),
+    };
+
+    if (connected) {
+      const ssidLen = view.getUint8(45);
+      data.wifi_rssi = view.getInt8(3);
+      data.wifi_ip = [40, 41, 42, 43].map((i) => view.getUint8(i)).join(".");
+      if (46 + ssidLen <= view.byteLength) {
+        data.wifi_ssid = this.textDecoder.decode(
+          new Uint8Array(view.buffer, view.byteOffset + 46, ssidLen),
+        );
+      }
+    }
+
+    return data;
+  }
+
   scheduleReconnect() {
     if (this.reconnectInterval) {
       console.log("Reconnect already scheduled");
@@ -557,6 +750,12 @@ class BatteryMonitor {
       this.config.can_log_enabled !== false;
     document.getElementById("mqttCanmsgEnabled").checked =
       this.config.mqtt_canmsg_enabled !== false;
+    document.getElementById("mqttCanFormat").value =
+      this.config.mqtt_can_format !== undefined
+        ? String(this.config.mqtt_can_format)
+        : "1";
+    document.getElementById("mqttCanBatchMs").value =
+      this.config.mqtt_can_batch_ms || 1000;
   }
 
   async saveWiFiConfig() {
@@ -650,8 +849,10 @@ class BatteryMonitor {
   async saveCANLoggingConfig() {
     const canLogEl = document.getElementById("canLogEnabled");
     const mqttCanmsgEl = document.getElementById("mqttCanmsgEnabled");
+    const mqttCanFormatEl = document.getElementById("mqttCanFormat");
+    const mqttCanBatchMsEl = document.getElementById("mqttCanBatchMs");
 
-    if (!canLogEl || !mqttCanmsgEl) {
+    if (!canLogEl || !mqttCanmsgEl || !mqttCanFormatEl || !mqttCanBatchMsEl) {
       this.showToast("Error: form elements not found", "error");
       return;
     }
@@ -659,6 +860,8 @@ class BatteryMonitor {
     const config = {
       can_log_enabled: canLogEl.checked,
       mqtt_canmsg_enabled: mqttCanmsgEl.checked,
+      mqtt_can_format: parseInt(mqttCanFormatEl.value, 10),
+      mqtt_can_batch_ms: parseInt(mqttCanBatchMsEl.value, 10) || 1000,
     };
 
     try {
@@ -802,8 +1005,8 @@ class BatteryMonitor {
     // console.log("CAN message received:", message);
     if (this.canMonitor.paused) return;
 
-    // Apply filter if set
-    if (this.canMonitor.filter) {
+    // Apply filter if set (exact filters were already applied by the device)
+    if (this.canMonitor.filter && !this.canMonitor.serverFilter) {
       const msgId = message.id.toLowerCase();
       const filter = this.canMonitor.filter.toLowerCase();
       if (!msgId.includes(filter)) return;
@@ -816,8 +1019,9 @@ class BatteryMonitor {
     const now = new Date();
     const timestamp = now.toLocaleTimeString() + "." + now.getMilliseconds().toString().padStart(3, "0");
 
-    // Format message line
-    const line = `[${timestamp}] ID:${message.id} DLC:${message.dlc} Data:${message.data}\n`;
+    // Format message line (repeat > 1: latest of that many frames)
+    const repeat = message.repeat > 1 ? ` (x${message.repeat})` : "";
+    const line = `[${timestamp}] ID:${message.id} DLC:${message.dlc} Data:${message.data}${repeat}\n`;
 
     // Append to viewer
     viewer.value += line;
@@ -850,6 +1054,7 @@ class BatteryMonitor {
       btn.style.background = "";
       indicator.style.display = "none";
     }
+    this.sendSubscription();
   }
 
   clearCANMonitor() {
@@ -880,9 +1085,127 @@ class BatteryMonitor {
 
   setCANFilter(value) {
     this.canMonitor.filter = value || null;
+
+    const exact = /^0x([0-9a-f]{1,8})(?:\/0x([0-9a-f]{1,8}))?$/i.exec(value || "");
+    this.canMonitor.serverFilter = exact
+      ? { id: parseInt(exact[1], 16), mask: exact[2] ? parseInt(exact[2], 16) : 0x1fffffff }
+      : null;
+
+    // Resubscribe once typing settles
+    clearTimeout(this.canMonitor.subscribeTimer);
+    this.canMonitor.subscribeTimer = setTimeout(() => this.sendSubscription(), 300);
     const filterText = value ? ` (filtered by ${value})` : "";
     console.log(`CAN filter ${value ? "set to: " + value : "cleared"}`);
   }
+
+  // Per-ID timing and bus load, computed on the device (/api/can/analytics)
+  toggleCANStats() {
+    this.canMonitor.statsVisible = !this.canMonitor.statsVisible;
+    const visible = this.canMonitor.statsVisible;
+    document.getElementById("canStatsView").style.display = visible ? "flex" : "none";
+    document.getElementById("canLogViewer").style.display = visible ? "none" : "";
+    document.getElementById("canStatsBtn").textContent = visible ? "Log" : "Stats";
+
+    clearInterval(this.canMonitor.statsTimer);
+    this.canMonitor.statsTimer = null;
+    if (visible) {
+      this.loadCANStats();
+      this.canMonitor.statsTimer = setInterval(() => {
+        if (!document.hidden) this.loadCANStats();
+      }, 2000);
+    }
+  }
+
+  async loadCANStats() {
+    try {
+      const response = await fetch("/api/can/analytics");
+      if (response.ok) {
+        this.renderCANStats(await response.json());
+      }
+    } catch (error) {
+      console.error("Error loading CAN analytics:", error);
+    }
+  }
+
+  renderCANStats(stats) {
+    document.getElementById("canBusLoad").textContent =
+      `Bus load: ${stats.utilization.toFixed(1)}% (peak ${stats.peak_utilization.toFixed(1)}%) · ` +
+      `${this.formatNumber(stats.frames_per_sec)} frames/s at ${stats.bitrate / 1000} kbps` +
+      (stats.untracked > 0 ? ` · ${this.formatNumber(stats.untracked)} untracked` : "");
+
+    const ids = stats.ids.slice().sort((a, b) => parseInt(a.id, 16) - parseInt(b.id, 16));
+    const fmt = (value, digits, unit) => (value === undefined ? "-" : `${value.toFixed(digits)}${unit}`);
+
+    const rows = ids.map((entry) => {
+      const silent = entry.count === 0 || (entry.expected_ms && entry.age_ms > entry.expected_ms * 3);
+      const late = !silent && entry.deviation_pct !== undefined && Math.abs(entry.deviation_pct) > 50;
+      return `<tr class="${silent ? "silent" : late ? "late" : ""}">` +
+        `<td>${entry.id}</td>` +
+        `<td>${this.formatNumber(entry.count)}</td>` +
+        `<td>${fmt(entry.rate_hz, 1, " Hz")}</td>` +
+        `<td>${fmt(entry.interval_ms, 1, " ms")}</td>` +
+        `<td>${fmt(entry.jitter_ms, 2, " ms")}</td>` +
+        `<td>${entry.expected_ms ? entry.expected_ms + " ms" : "-"}</td>` +
+        `<td>${fmt(entry.deviation_pct, 1, "%")}</td>` +
+        `<td>${entry.missed !== undefined ? this.formatNumber(entry.missed) : "-"}</td>` +
+        `<td>${fmt(entry.load_pct, 2, "%")}</td>` +
+        `</tr>`;
+    });
+    document.getElementById("canStatsBody").innerHTML = rows.join("");
+  }
+
+  async resetCANStats() {
+    try {
+      const response = await fetch("/api/can/analytics/reset", { method: "POST" });
+      if (response.ok) {
+        this.showToast("CAN statistics reset", "success");
+        this.loadCANStats();
+      }
+    } catch (error) {
+      console.error("Error resetting CAN analytics:", error);
+      this.showToast("Network error - check connection", "error");
+    }
+  }
+
+  async loadCANFilterState() {
+    try {
+      const response = await fetch("/api/can/filter");
+      if (response.ok) {
+        const state = await response.json();
+        document.getElementById("canPromiscuousToggle").checked =
+          state.promiscuous === true;
+      }
+    } catch (error) {
+      console.error("Error loading CAN filter state:", error);
+    }
+  }
+
+  async setCANPromiscuous(enabled) {
+    const toggle = document.getElementById("canPromiscuousToggle");
+
+    try {
+      const response = await fetch("/api/can/promiscuous", {
+        method: "POST",
+        headers: {
+          "Content-Type": "application/json",
+        },
+        body: JSON.stringify({ enabled: enabled }),
+      });
+
+      const result = await response.json();
+
+      if (response.ok && result.success) {
+        this.showToast(result.message, "success");
+      } else {
+        toggle.checked = !enabled;
+        this.showToast(result.message || "Failed to change CAN filter", "error");
+      }
+    } catch (error) {
+      console.error("Error setting promiscuous mode:", error);
+      toggle.checked = !enabled;
+      this.showToast("Network error - check connection", "error");
+    }
+  }
 }
 
 // Initialize app when DOM is ready
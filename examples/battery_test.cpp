@@ -70,10 +70,11 @@ void setup() {
     canData.temp1 = 25.5f;
     canData.temp2 = 27.0f;
     canData.status_flags = CANStatusFlags::DISCHARGING;
+    canData.present = CANBatteryFields::ALL;
     canData.valid = true;
 
     if (frontBattery) {
-        frontBattery->updateFromCAN(canData);
+        frontBattery->updateFromCAN(canData, millis());
         Serial.printf("✓ Front battery CAN update: SOC=%d%%, Temp1=%.1f°C, Temp2=%.1f°C\n",
                      frontBattery->getSOC(),
                      frontBattery->getTemp1(),
@@ -171,9 +172,10 @@ void loop() {
             canData.temp1 = temp1;
             canData.temp2 = temp2;
             canData.status_flags = CANStatusFlags::DISCHARGING;
+            canData.present = CANBatteryFields::ALL;
             canData.valid = true;
 
-            frontBatt->updateFromCAN(canData);
+            frontBatt->updateFromCAN(canData, millis());
         }
 
         // Update rear battery (slightly different values)
@@ -190,9 +192,10 @@ void loop() {
             canData.temp1 = temp1 + 1.0f;
             canData.temp2 = temp2 + 1.0f;
             canData.status_flags = CANStatusFlags::DISCHARGING;
+            canData.present = CANBatteryFields::ALL;
             canData.valid = true;
 
-            rearBatt->updateFromCAN(canData);
+            rearBatt->updateFromCAN(canData, millis());
         }
 
         lastUpdate = millis();
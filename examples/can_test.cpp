@@ -30,7 +30,7 @@ void setup() {
 
     // Test 1: Initialize CAN logger
     Serial.println("Test 1: Initializing CAN logger...");
-    if (canLogger.begin("/canlog.csv")) {
+    if (canLogger.begin("/canlog", CANLogMode::BINARY, 500000)) {
         Serial.println("✓ CAN logger initialized");
     } else {
         Serial.println("✗ CAN logger initialization failed");
@@ -0,0 +1,55 @@
+"""Pre-compress the web UI for SPIFFS.
+
+Writes a gzip copy next to each asset in data/web and a build hash of the
+uncompressed files to data/web/assets.etag; the web server sends the .gz
+variant to clients that accept gzip and uses the hash as a strong ETag.
+Runs before every PlatformIO build (extra_scripts), or stand-alone:
+
+    python3 scripts/compress_web.py
+"""
+
+import gzip
+import hashlib
+import os
+
+ASSETS = ("index.html", "app.js", "style.css")
+
+
+def write_if_changed(path, data):
+    if os.path.exists(path):
+        with open(path, "rb") as f:
+            if f.read() == data:
+                return False
+    with open(path, "wb") as f:
+        f.write(data)
+    return True
+
+
+def compress(web_dir):
+    digest = hashlib.sha1()
+    total = 0
+    packed_total = 0
+    for name in ASSETS:
+        path = os.path.join(web_dir, name)
+        if not os.path.exists(path):
+            continue
+        with open(path, "rb") as f:
+            data = f.read()
+        digest.update(name.encode() + b"\0" + data)
+
+        # mtime=0 keeps the output identical for identical input
+        packed = gzip.compress(data, compresslevel=9, mtime=0)
+        write_if_changed(path + ".gz", packed)
+        total += len(data)
+        packed_total += len(packed)
+
+    etag = digest.hexdigest()[:16]
+    write_if_changed(os.path.join(web_dir, "assets.etag"), etag.encode() + b"\n")
+    print("Web assets: %d -> %d bytes gzipped, ETag %s" % (total, packed_total, etag))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    compress(os.path.join(env.subst("$PROJECT_DATA_DIR"), "web"))  # noqa: F821
+except NameError:
+    compress(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "data", "web"))
@@ -0,0 +1,296 @@
+#include "battery_history.h"
+#include "battery_module.h"
+#include "../can/can_message.h"
+#include <math.h>
+#include <new>
+
+static const char* const METRIC_NAMES[] = { "voltage", "current", "power", "soc", "temp" };
+static const float METRIC_SCALES[] = { 0.01f, 0.01f, 1.0f, 1.0f, 0.1f };
+static const char* const RESOLUTION_NAMES[] = { "1s", "1m", "15m" };
+static const uint32_t BUCKET_MS[] = { 1000, 60000, 900000 };
+static const size_t CAPACITY[] = { HISTORY_1S_POINTS, HISTORY_1M_POINTS, HISTORY_15M_POINTS };
+
+static constexpr size_t POINTS_PER_PACK = HISTORY_1S_POINTS + HISTORY_1M_POINTS + HISTORY_15M_POINTS;
+static_assert(POINTS_PER_PACK * 3 * static_cast<size_t>(BatteryHistory::Metric::COUNT) * sizeof(int16_t) *
+              MAX_BATTERY_MODULES <= HISTORY_HEAP_BUDGET, "History rings exceed HISTORY_HEAP_BUDGET");
+
+// Clamped so a reading never turns into NO_DATA
+static int16_t toFixed(float value, float scale) {
+    long fixed = lroundf(value / scale);
+    return static_cast<int16_t>(constrain(fixed, -32767L, 32767L));
+}
+
+BatteryHistory::BatteryHistory()
+    : packs_(nullptr), pack_count_(0), mux_(portMUX_INITIALIZER_UNLOCKED) {
+}
+
+BatteryHistory::~BatteryHistory() {
+    releaseRings();
+}
+
+bool BatteryHistory::begin(uint8_t num_batteries) {
+    releaseRings();
+
+    packs_ = new (std::nothrow) Pack[num_batteries];
+    if (packs_ == nullptr) {
+        Serial.println("BatteryHistory: Out of memory");
+        return false;
+    }
+    memset(packs_, 0, num_batteries * sizeof(Pack));
+    pack_count_ = num_batteries;
+
+    // A pack whose rings don't fit goes without history; the others keep theirs
+    uint8_t allocated = 0;
+    for (uint8_t i = 0; i < pack_count_; i++) {
+        if (allocatePack(packs_[i])) {
+            allocated++;
+        } else {
+            Serial.printf("BatteryHistory: Out of memory, no history for pack %d\n", i);
+        }
+    }
+
+    size_t pack_bytes = POINTS_PER_PACK * sizeof(Bucket);
+    Serial.printf("BatteryHistory: %u of %u pack(s), %u points each, %u bytes total\n",
+                 (unsigned)allocated, (unsigned)pack_count_, (unsigned)POINTS_PER_PACK,
+                 (unsigned)(allocated * pack_bytes + pack_count_ * sizeof(Pack)));
+    return allocated == pack_count_;
+}
+
+bool BatteryHistory::allocatePack(Pack& pack) {
+    for (uint8_t level = 0; level < LEVELS; level++) {
+        pack.rings[level].buckets = new (std::nothrow) Bucket[CAPACITY[level]];
+        if (pack.rings[level].buckets == nullptr) {
+            for (uint8_t i = 0; i < level; i++) {
+                delete[] pack.rings[i].buckets;
+                pack.rings[i].buckets = nullptr;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+void BatteryHistory::releaseRings() {
+    if (packs_ != nullptr) {
+        for (uint8_t i = 0; i < pack_count_; i++) {
+            for (uint8_t level = 0; level < LEVELS; level++) {
+                delete[] packs_[i].rings[level].buckets;
+            }
+        }
+        delete[] packs_;
+    }
+    packs_ = nullptr;
+    pack_count_ = 0;
+}
+
+static constexpr uint8_t metricBit(BatteryHistory::Metric metric) {
+    return 1U << static_cast<uint8_t>(metric);
+}
+
+void BatteryHistory::record(uint8_t battery_id, const BatteryModule& battery, uint8_t updated,
+                            uint32_t timestamp_ms) {
+    if (battery_id >= pack_count_ || packs_[battery_id].rings[0].buckets == nullptr) return;
+
+    BatterySnapshot snap = battery.snapshot();
+    if (!snap.enabled) return;
+
+    // Power needs both halves, one of them from this frame
+    const uint8_t power_fields = CANBatteryFields::VOLTAGE | CANBatteryFields::CURRENT;
+    const uint8_t temp_fields = CANBatteryFields::TEMP1 | CANBatteryFields::TEMP2;
+    uint8_t metrics = 0;
+    if (updated & CANBatteryFields::VOLTAGE) metrics |= metricBit(Metric::VOLTAGE);
+    if (updated & CANBatteryFields::CURRENT) metrics |= metricBit(Metric::CURRENT);
+    if ((updated & power_fields) && (snap.reported & power_fields) == power_fields) {
+        metrics |= metricBit(Metric::POWER);
+    }
+    if (updated & CANBatteryFields::SOC) metrics |= metricBit(Metric::SOC);
+    if (updated & temp_fields) metrics |= metricBit(Metric::TEMP);
+    if (metrics == 0) return;
+
+    // Hotter of the sensors the pack reports
+    float temp = (snap.reported & temp_fields) == temp_fields ? max(snap.temp1, snap.temp2)
+               : (snap.reported & CANBatteryFields::TEMP1) ? snap.temp1 : snap.temp2;
+
+    float values[METRICS];
+    values[static_cast<uint8_t>(Metric::VOLTAGE)] = snap.voltage;
+    values[static_cast<uint8_t>(Metric::CURRENT)] = snap.current;
+    values[static_cast<uint8_t>(Metric::POWER)] = snap.power();
+    values[static_cast<uint8_t>(Metric::SOC)] = snap.soc;
+    values[static_cast<uint8_t>(Metric::TEMP)] = temp;
+
+    int16_t fixed[METRICS];
+    float avg[METRICS];
+    for (uint8_t m = 0; m < METRICS; m++) {
+        fixed[m] = toFixed(values[m], METRIC_SCALES[m]);
+        avg[m] = fixed[m];
+    }
+
+    portENTER_CRITICAL(&mux_);
+    add(packs_[battery_id], 0, timestamp_ms / BUCKET_MS[0], metrics, fixed, fixed, avg);
+    portEXIT_CRITICAL(&mux_);
+}
+
+void BatteryHistory::add(Pack& pack, uint8_t level, uint32_t slot, uint8_t metrics,
+                         const int16_t* lo, const int16_t* hi, const float* avg) {
+    Accumulator& acc = pack.open[level];
+
+    if (!acc.started || slot != acc.slot) {
+        if (acc.started) {
+            close(pack, level);
+
+            // Gap points for the buckets nobody reported in (none when
+            // millis() wrapped)
+            if (slot > acc.slot) {
+                uint32_t missing = min(slot - acc.slot - 1, static_cast<uint32_t>(CAPACITY[level]));
+                Bucket gap;
+                for (uint8_t m = 0; m < METRICS; m++) {
+                    gap.min[m] = gap.max[m] = gap.avg[m] = NO_DATA;
+                }
+                for (uint32_t i = 0; i < missing; i++) {
+                    push(pack.rings[level], level, gap);
+                }
+            }
+        }
+        acc.started = true;
+        acc.slot = slot;
+        acc.count = 0;
+        memset(acc.counts, 0, sizeof(acc.counts));
+    }
+
+    for (uint8_t m = 0; m < METRICS; m++) {
+        if (!(metrics & (1U << m))) continue;
+        if (acc.counts[m] == 0) {
+            acc.min[m] = lo[m];
+            acc.max[m] = hi[m];
+            acc.sum[m] = 0.0f;
+        } else {
+            if (lo[m] < acc.min[m]) acc.min[m] = lo[m];
+            if (hi[m] > acc.max[m]) acc.max[m] = hi[m];
+        }
+        acc.sum[m] += avg[m];
+        acc.counts[m]++;
+    }
+    acc.count++;
+}
+
+void BatteryHistory::close(Pack& pack, uint8_t level) {
+    Accumulator& acc = pack.open[level];
+    if (acc.count == 0) return;
+
+    Bucket bucket;
+    float avg[METRICS];
+    uint8_t metrics = 0;
+    for (uint8_t m = 0; m < METRICS; m++) {
+        if (acc.counts[m] == 0) {
+            bucket.min[m] = bucket.max[m] = bucket.avg[m] = NO_DATA;
+            continue;
+        }
+        bucket.min[m] = acc.min[m];
+        bucket.max[m] = acc.max[m];
+        avg[m] = acc.sum[m] / acc.counts[m];
+        bucket.avg[m] = static_cast<int16_t>(lroundf(avg[m]));
+        metrics |= 1U << m;
+    }
+    push(pack.rings[level], level, bucket);
+    acc.count = 0;
+    memset(acc.counts, 0, sizeof(acc.counts));
+
+    // Roll up into the next coarser resolution
+    if (level + 1 < LEVELS) {
+        uint32_t slot = static_cast<uint32_t>(
+            static_cast<uint64_t>(acc.slot) * BUCKET_MS[level] / BUCKET_MS[level + 1]);
+        add(pack, level + 1, slot, metrics, bucket.min, bucket.max, avg);
+    }
+}
+
+void BatteryHistory::push(Ring& ring, uint8_t level, const Bucket& bucket) {
+    ring.buckets[ring.head] = bucket;
+    ring.head = (ring.head + 1) % CAPACITY[level];
+    if (ring.count < CAPACITY[level]) {
+        ring.count++;
+    }
+}
+
+size_t BatteryHistory::read(uint8_t battery_id, Metric metric, Resolution res,
+                            Point* out, size_t max_points, uint32_t& end_ms) const {
+    end_ms = 0;
+    uint8_t m = static_cast<uint8_t>(metric);
+    uint8_t level = static_cast<uint8_t>(res);
+    if (battery_id >= pack_count_ || m >= METRICS || level >= LEVELS || max_points == 0 ||
+        packs_[battery_id].rings[level].buckets == nullptr) {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&mux_);
+    const Ring& ring = packs_[battery_id].rings[level];
+    const Accumulator& acc = packs_[battery_id].open[level];
+
+    size_t partial = acc.count > 0 ? 1 : 0;
+    size_t closed = min(static_cast<size_t>(ring.count), max_points - partial);
+    size_t start = (ring.head + CAPACITY[level] - closed) % CAPACITY[level];
+
+    for (size_t i = 0; i < closed; i++) {
+        const Bucket& bucket = ring.buckets[(start + i) % CAPACITY[level]];
+        out[i].min = bucket.min[m];
+        out[i].max = bucket.max[m];
+        out[i].avg = bucket.avg[m];
+    }
+    if (partial && acc.counts[m] == 0) {
+        out[closed].min = out[closed].max = out[closed].avg = NO_DATA;
+    } else if (partial) {
+        out[closed].min = acc.min[m];
+        out[closed].max = acc.max[m];
+        out[closed].avg = static_cast<int16_t>(lroundf(acc.sum[m] / acc.counts[m]));
+    }
+    if (acc.started) {
+        end_ms = (acc.slot + 1) * BUCKET_MS[level];
+    }
+    portEXIT_CRITICAL(&mux_);
+
+    return closed + partial;
+}
+
+float BatteryHistory::scale(Metric metric) {
+    uint8_t m = static_cast<uint8_t>(metric);
+    return m < METRICS ? METRIC_SCALES[m] : 1.0f;
+}
+
+uint32_t BatteryHistory::bucketMs(Resolution res) {
+    uint8_t level = static_cast<uint8_t>(res);
+    return level < LEVELS ? BUCKET_MS[level] : 0;
+}
+
+size_t BatteryHistory::capacity(Resolution res) {
+    uint8_t level = static_cast<uint8_t>(res);
+    return level < LEVELS ? CAPACITY[level] : 0;
+}
+
+const char* BatteryHistory::metricName(Metric metric) {
+    uint8_t m = static_cast<uint8_t>(metric);
+    return m < METRICS ? METRIC_NAMES[m] : "unknown";
+}
+
+const char* BatteryHistory::resolutionName(Resolution res) {
+    uint8_t level = static_cast<uint8_t>(res);
+    return level < LEVELS ? RESOLUTION_NAMES[level] : "unknown";
+}
+
+bool BatteryHistory::parseMetric(const char* name, Metric& metric) {
+    for (uint8_t m = 0; m < METRICS; m++) {
+        if (strcmp(name, METRIC_NAMES[m]) == 0) {
+            metric = static_cast<Metric>(m);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BatteryHistory::parseResolution(const char* name, Resolution& res) {
+    for (uint8_t level = 0; level < LEVELS; level++) {
+        if (strcmp(name, RESOLUTION_NAMES[level]) == 0) {
+            res = static_cast<Resolution>(level);
+            return true;
+        }
+    }
+    return false;
+}
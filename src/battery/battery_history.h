@@ -0,0 +1,119 @@
+#ifndef BATTERY_HISTORY_H
+#define BATTERY_HISTORY_H
+
+#include <Arduino.h>
+#include "../config/config.h"
+
+class BatteryModule;
+
+// Downsampled per-pack history for charts.
+//
+// Every CAN reading goes into a 1 s bucket; closed buckets roll up into
+// 1 min buckets and those into 15 min buckets. Each resolution is a fixed
+// ring (HISTORY_*_POINTS) holding min/max/avg of every metric as int16 fixed
+// point (see scale()). A reading only counts for the metrics its frame
+// updated; seconds without readings, and metrics nothing updated within a
+// bucket, become gap points (NO_DATA).
+//
+// record() runs in the CAN task and read() in the web server; both take a
+// short critical section.
+class BatteryHistory {
+public:
+    enum class Metric : uint8_t {
+        VOLTAGE = 0,    // 0.01 V
+        CURRENT,        // 0.01 A
+        POWER,          // 1 W
+        SOC,            // 1 %
+        TEMP,           // 0.1 °C, hotter of the two sensors
+        COUNT
+    };
+
+    enum class Resolution : uint8_t {
+        SEC_1 = 0,
+        MIN_1,
+        MIN_15,
+        COUNT
+    };
+
+    struct Point {
+        int16_t min;
+        int16_t max;
+        int16_t avg;            // NO_DATA for a gap
+    };
+
+    static_assert(sizeof(Point) == 6, "Point is sent as is in binary history responses");
+
+    static constexpr int16_t NO_DATA = INT16_MIN;
+
+    BatteryHistory();
+    ~BatteryHistory();
+
+    // Allocate the rings of the first num_batteries packs; false if any pack
+    // is left without history (those packs record and read nothing)
+    bool begin(uint8_t num_batteries);
+
+    // Add the pack's current values of the metrics behind updated
+    // (CANBatteryFields the frame carried), read at timestamp_ms (millis())
+    void record(uint8_t battery_id, const BatteryModule& battery, uint8_t updated,
+                uint32_t timestamp_ms);
+
+    // Newest max_points points of one metric, oldest first, the last one
+    // possibly still filling. end_ms is where the newest point ends (its
+    // start plus bucketMs()). Returns the number of points copied.
+    size_t read(uint8_t battery_id, Metric metric, Resolution res,
+                Point* out, size_t max_points, uint32_t& end_ms) const;
+
+    static float scale(Metric metric);
+    static uint32_t bucketMs(Resolution res);
+    static size_t capacity(Resolution res);
+    static const char* metricName(Metric metric);
+    static const char* resolutionName(Resolution res);
+    static bool parseMetric(const char* name, Metric& metric);
+    static bool parseResolution(const char* name, Resolution& res);    // "1s", "1m", "15m"
+
+private:
+    static constexpr uint8_t METRICS = static_cast<uint8_t>(Metric::COUNT);
+    static constexpr uint8_t LEVELS = static_cast<uint8_t>(Resolution::COUNT);
+
+    struct Bucket {
+        int16_t min[METRICS];
+        int16_t max[METRICS];
+        int16_t avg[METRICS];
+    };
+
+    // Bucket being filled at one resolution
+    struct Accumulator {
+        bool started;           // slot is meaningful
+        uint32_t slot;          // timestamp / bucketMs()
+        uint16_t count;         // Inputs so far (0 = nothing since the last close)
+        uint16_t counts[METRICS];   // ... per metric
+        int16_t min[METRICS];
+        int16_t max[METRICS];
+        float sum[METRICS];
+    };
+
+    struct Ring {
+        Bucket* buckets;
+        uint16_t head;          // Next write
+        uint16_t count;
+    };
+
+    struct Pack {
+        Ring rings[LEVELS];
+        Accumulator open[LEVELS];
+    };
+
+    Pack* packs_;
+    uint8_t pack_count_;
+    mutable portMUX_TYPE mux_;
+
+    // metrics: bit per Metric present in lo/hi/avg
+    void add(Pack& pack, uint8_t level, uint32_t slot, uint8_t metrics,
+             const int16_t* lo, const int16_t* hi, const float* avg);
+    void close(Pack& pack, uint8_t level);
+    void push(Ring& ring, uint8_t level, const Bucket& bucket);
+    bool allocatePack(Pack& pack);     // All rings or none
+    void releaseRings();
+};
+
+#endif // BATTERY_HISTORY_H
@@ -1,6 +1,11 @@
 #include "battery_manager.h"
+#include <Preferences.h>
 
-BatteryManager::BatteryManager() : active_count(0) {
+// NVS instance for statistics checkpoints
+static Preferences stats_prefs;
+
+BatteryManager::BatteryManager() : active_count(0), last_checkpoint(0) {
+    memset(saved_samples, 0, sizeof(saved_samples));
 }
 
 void BatteryManager::begin(uint8_t num_batteries) {
@@ -24,64 +29,145 @@ void BatteryManager::begin(uint8_t num_batteries) {
         batteries[i].begin(i, default_name);
     }
 
+    history.begin(active_count);
+    loadStats();
+    last_checkpoint = millis();
+
     Serial.printf("BatteryManager: Initialized with %d battery module(s)\n", active_count);
 }
 
 void BatteryManager::update() {
-    // This function can be used for periodic maintenance tasks
-    // Currently, updates are handled via sensor readings and CAN messages
+    // Readings arrive via sensors and CAN; only the statistics checkpoint runs here
+    if (millis() - last_checkpoint >= BATTERY_STATS_CHECKPOINT_MS) {
+        saveStats();
+        last_checkpoint = millis();
+    }
 }
 
-BatteryModule* BatteryManager::getBattery(uint8_t index) {
+bool BatteryManager::getStats(uint8_t index, BatteryStats& out) const {
     if (!isValidIndex(index)) {
-        return nullptr;
+        return false;
     }
-    return &batteries[index];
+    batteries[index].getStats(out);
+    return true;
 }
 
-const BatteryModule* BatteryManager::getBattery(uint8_t index) const {
+void BatteryManager::resetStats(uint8_t index) {
     if (!isValidIndex(index)) {
-        return nullptr;
+        Serial.printf("BatteryManager: Invalid battery index %d\n", index);
+        return;
     }
-    return &batteries[index];
+
+    batteries[index].resetStats();
+    saved_samples[index] = UINT32_MAX;  // Make the next checkpoint store the reset
+    Serial.printf("BatteryManager: Battery %d statistics reset\n", index);
 }
 
-float BatteryManager::getTotalPower() const {
-    float total = 0.0f;
+void BatteryManager::loadStats() {
+    if (!stats_prefs.begin(BATTERY_STATS_NAMESPACE, true)) {  // Missing until the first checkpoint
+        return;
+    }
 
-    for (uint8_t i = 0; i < active_count; i++) {
-        if (batteries[i].isEnabled() && batteries[i].isDataFresh()) {
-            total += batteries[i].getPower();
+    if (stats_prefs.getUShort("version", 0) == BatteryStats::VERSION) {
+        for (uint8_t i = 0; i < active_count; i++) {
+            char key[8];
+            snprintf(key, sizeof(key), "pack%u", i);
+
+            BatteryStats stats;
+            if (stats_prefs.getBytes(key, &stats, sizeof(stats)) == sizeof(stats)) {
+                batteries[i].setStats(stats);
+                saved_samples[i] = stats.samples;
+                Serial.printf("BatteryManager: Battery %d statistics restored (%.2f Ah out, %.2f Ah in)\n",
+                             i, stats.dischargeAh(), stats.chargeAh());
+            }
         }
     }
 
-    return total;
+    stats_prefs.end();
 }
 
-float BatteryManager::getTotalCurrent() const {
-    float total = 0.0f;
+bool BatteryManager::saveStats() {
+    // Take copies first; NVS writes can stall for milliseconds
+    BatteryStats stats[MAX_BATTERY_MODULES];
+    bool changed = false;
+    for (uint8_t i = 0; i < active_count; i++) {
+        batteries[i].getStats(stats[i]);
+        changed |= stats[i].samples != saved_samples[i];
+    }
+    if (!changed) {
+        return true;
+    }
 
+    if (!stats_prefs.begin(BATTERY_STATS_NAMESPACE, false)) {
+        Serial.println("BatteryManager: Failed to open statistics NVS namespace");
+        return false;
+    }
+
+    bool ok = stats_prefs.putUShort("version", BatteryStats::VERSION) > 0;
     for (uint8_t i = 0; i < active_count; i++) {
-        if (batteries[i].isEnabled() && batteries[i].isDataFresh()) {
-            total += batteries[i].getCurrent();
+        if (stats[i].samples == saved_samples[i]) {
+            continue;
+        }
+
+        char key[8];
+        snprintf(key, sizeof(key), "pack%u", i);
+        if (stats_prefs.putBytes(key, &stats[i], sizeof(stats[i])) == sizeof(stats[i])) {
+            saved_samples[i] = stats[i].samples;
+        } else {
+            ok = false;
         }
     }
 
-    return total;
+    stats_prefs.end();
+
+    if (!ok) {
+        Serial.println("BatteryManager: Failed to checkpoint statistics");
+    }
+    return ok;
 }
 
-float BatteryManager::getAverageVoltage() const {
-    float total = 0.0f;
-    uint8_t count = 0;
+BatteryModule* BatteryManager::getBattery(uint8_t index) {
+    if (!isValidIndex(index)) {
+        return nullptr;
+    }
+    return &batteries[index];
+}
+
+const BatteryModule* BatteryManager::getBattery(uint8_t index) const {
+    if (!isValidIndex(index)) {
+        return nullptr;
+    }
+    return &batteries[index];
+}
+
+uint8_t BatteryManager::snapshotAll(BatterySnapshot* out, Totals* totals) const {
+    uint32_t now = millis();
+    Totals sum = {0.0f, 0.0f, 0.0f, 0};
 
     for (uint8_t i = 0; i < active_count; i++) {
-        if (batteries[i].isEnabled() && batteries[i].isDataFresh()) {
-            total += batteries[i].getVoltage();
-            count++;
+        out[i] = batteries[i].snapshot();
+        if (out[i].isFresh(5000, now)) {
+            sum.power += out[i].power();
+            sum.current += out[i].current;
+            sum.average_voltage += out[i].voltage;
+            sum.fresh_count++;
         }
     }
 
-    return (count > 0) ? (total / count) : 0.0f;
+    if (totals != nullptr) {
+        if (sum.fresh_count > 0) {
+            sum.average_voltage /= sum.fresh_count;
+        }
+        *totals = sum;
+    }
+    return active_count;
+}
+
+BatteryManager::Totals BatteryManager::getTotals() const {
+    BatterySnapshot packs[MAX_BATTERY_MODULES];
+    Totals totals;
+    snapshotAll(packs, &totals);
+    return totals;
 }
 
 void BatteryManager::enableBattery(uint8_t index, bool enabled) {
@@ -126,16 +212,18 @@ void BatteryManager::calibrateCurrent(uint8_t index) {
 }
 
 bool BatteryManager::allBatteriesHealthy() const {
+    uint32_t now = millis();
+
     for (uint8_t i = 0; i < active_count; i++) {
-        if (batteries[i].isEnabled()) {
+        BatterySnapshot battery = batteries[i].snapshot();
+        if (battery.enabled) {
             // Check if battery has errors or stale data
-            if (batteries[i].hasError() || !batteries[i].isDataFresh(10000)) {
+            if (battery.error || !battery.isFresh(10000, now)) {
                 return false;
             }
 
             // Check for error flags in status
-            uint8_t flags = batteries[i].getStatusFlags();
-            if (flags & CANStatusFlags::ERROR) {
+            if (battery.status_flags & CANStatusFlags::ERROR) {
                 return false;
             }
         }
@@ -145,21 +233,22 @@ bool BatteryManager::allBatteriesHealthy() const {
 }
 
 uint8_t BatteryManager::getErrorCount() const {
+    uint32_t now = millis();
     uint8_t count = 0;
 
     for (uint8_t i = 0; i < active_count; i++) {
-        if (batteries[i].isEnabled()) {
-            if (batteries[i].hasError() || !batteries[i].isDataFresh(10000)) {
+        BatterySnapshot battery = batteries[i].snapshot();
+        if (battery.enabled) {
+            if (battery.error || !battery.isFresh(10000, now)) {
                 count++;
             }
 
             // Check for error flags
-            uint8_t flags = batteries[i].getStatusFlags();
-            if (flags & (CANStatusFlags::ERROR |
-                        CANStatusFlags::OVER_VOLTAGE |
-                        CANStatusFlags::UNDER_VOLTAGE |
-                        CANStatusFlags::OVER_CURRENT |
-                        CANStatusFlags::TEMP_WARNING)) {
+            if (battery.status_flags & (CANStatusFlags::ERROR |
+                                        CANStatusFlags::OVER_VOLTAGE |
+                                        CANStatusFlags::UNDER_VOLTAGE |
+                                        CANStatusFlags::OVER_CURRENT |
+                                        CANStatusFlags::TEMP_WARNING)) {
                 count++;
             }
         }
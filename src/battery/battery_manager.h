@@ -3,6 +3,7 @@
 
 #include <Arduino.h>
 #include "battery_module.h"
+#include "battery_history.h"
 #include "../config/config.h"
 
 // Multi-battery orchestration
@@ -21,10 +22,22 @@ public:
     const BatteryModule* getBattery(uint8_t index) const;
     uint8_t getActiveBatteryCount() const { return active_count; }
 
-    // Aggregate calculations
-    float getTotalPower() const;
-    float getTotalCurrent() const;
-    float getAverageVoltage() const;
+    // Aggregate calculations (enabled packs with data fresher than 5 s)
+    struct Totals {
+        float power;
+        float current;
+        float average_voltage;
+        uint8_t fresh_count;
+    };
+
+    // Snapshot of every active pack into out[] (room for MAX_BATTERY_MODULES)
+    // and, if asked, totals computed from exactly those copies; returns the
+    // number of packs
+    uint8_t snapshotAll(BatterySnapshot* out, Totals* totals = nullptr) const;
+    Totals getTotals() const;
+    float getTotalPower() const { return getTotals().power; }
+    float getTotalCurrent() const { return getTotals().current; }
+    float getAverageVoltage() const { return getTotals().average_voltage; }
 
     // Configuration
     void enableBattery(uint8_t index, bool enabled);
@@ -35,9 +48,24 @@ public:
     bool allBatteriesHealthy() const;
     uint8_t getErrorCount() const;
 
+    // Downsampled history of every pack (fed from the CAN task)
+    BatteryHistory& getHistory() { return history; }
+    const BatteryHistory& getHistory() const { return history; }
+
+    // Pack statistics, restored in begin() and checkpointed to NVS by update()
+    bool getStats(uint8_t index, BatteryStats& out) const;
+    void resetStats(uint8_t index);
+    bool saveStats();
+
 private:
     BatteryModule batteries[MAX_BATTERY_MODULES];
     uint8_t active_count;
+    BatteryHistory history;
+
+    uint32_t saved_samples[MAX_BATTERY_MODULES];    // stats.samples at the last checkpoint
+    uint32_t last_checkpoint;
+
+    void loadStats();
 
     // Validation
     bool isValidIndex(uint8_t index) const {
@@ -1,63 +1,150 @@
 #include "battery_module.h"
+#include "../config/settings.h"
+#include <math.h>
 
 BatteryModule::BatteryModule()
-    : id(0),
-      enabled(false),
-      voltage(0.0f),
-      current(0.0f),
-      soc(0),
-      temp1(0.0f),
-      temp2(0.0f),
-      status_flags(0),
-      pack_identifier(0),
-      has_can_data(false),
-      error(false),
-      last_update(0) {
+    : seq(0),
+      mux(portMUX_INITIALIZER_UNLOCKED),
+      stats_time(0),
+      stats_fields(0) {
     memset(name, 0, sizeof(name));
+    memset(&data, 0, sizeof(data));
+    stats.reset();
+    memset(&published, 0, sizeof(published));
 }
 
 void BatteryModule::begin(uint8_t id, const char* name) {
-    this->id = id;
     setName(name);
-    enabled = true;
-    last_update = millis();
+
+    beginWrite();
+    data.id = id;
+    data.enabled = true;
+    data.last_update = millis();
+    endWrite();
 
     Serial.printf("BatteryModule %d (%s): Initialized\n", id, this->name);
 }
 
+void BatteryModule::beginWrite() {
+    portENTER_CRITICAL(&mux);
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void BatteryModule::endWrite() {
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    portEXIT_CRITICAL(&mux);
+}
+
+BatterySnapshot BatteryModule::snapshot() const {
+    // Writers hold the critical section, so a reader on the writer's core
+    // never sees a write in progress; one on the other core retries
+    BatterySnapshot copy;
+    uint32_t before;
+    uint32_t after;
+    do {
+        before = seq.load(std::memory_order_acquire);
+        memcpy(&copy, &data, sizeof(copy));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = seq.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    return copy;
+}
+
 void BatteryModule::updateVoltage(float voltage) {
-    if (!enabled) return;
+    if (!data.enabled) return;
 
-    this->voltage = voltage;
-    last_update = millis();
+    beginWrite();
+    data.voltage = voltage;
+    data.reported |= CANBatteryFields::VOLTAGE;
+    data.last_update = millis();
+    endWrite();
 }
 
 void BatteryModule::updateCurrent(float current) {
-    if (!enabled) return;
+    if (!data.enabled) return;
 
-    this->current = current;
-    last_update = millis();
+    beginWrite();
+    data.current = current;
+    data.reported |= CANBatteryFields::CURRENT;
+    data.last_update = millis();
+    endWrite();
 }
 
-void BatteryModule::updateFromCAN(const CANBatteryData& can_data) {
-    if (!enabled) return;
+void BatteryModule::updateFromCAN(const CANBatteryData& can_data, uint32_t timestamp_ms) {
+    if (!data.enabled) return;
 
-    // Update all fields from CAN data
-    voltage = can_data.pack_voltage;
-    current = can_data.pack_current;
-    soc = can_data.soc;
-    temp1 = can_data.temp1;
-    temp2 = can_data.temp2;
-    status_flags = can_data.status_flags;
-    pack_identifier = can_data.pack_identifier;
+    uint32_t now = millis();
+    beginWrite();
 
-    has_can_data = can_data.valid;
-    last_update = millis();
+    float prev_voltage = data.voltage;
+    float prev_current = data.current;
+
+    // Only the values this frame carried; the rest keep their last reading
+    uint8_t present = can_data.present;
+    if (present & CANBatteryFields::VOLTAGE) data.voltage = can_data.pack_voltage;
+    if (present & CANBatteryFields::CURRENT) data.current = can_data.pack_current;
+    if (present & CANBatteryFields::SOC) data.soc = can_data.soc;
+    if (present & CANBatteryFields::TEMP1) data.temp1 = can_data.temp1;
+    if (present & CANBatteryFields::TEMP2) data.temp2 = can_data.temp2;
+    if (present & CANBatteryFields::STATUS_FLAGS) data.status_flags = can_data.status_flags;
+    if (present & CANBatteryFields::IDENTIFIER) data.pack_identifier = can_data.pack_identifier;
+
+    // Integrate from the previous CAN reading of the same quantities unless
+    // the pack was silent too long
+    uint8_t fields = ((present & CANBatteryFields::VOLTAGE) ? BatteryStats::VOLTAGE : 0) |
+                     ((present & CANBatteryFields::CURRENT) ? BatteryStats::CURRENT : 0);
+    if (fields != 0) {
+        uint32_t dt = timestamp_ms - stats_time;
+        if (!data.has_can_data || stats_fields != fields || dt > BATTERY_STATS_MAX_GAP_MS) {
+            dt = 0;
+        }
+        stats.add(fields, data.voltage, data.current, prev_voltage, prev_current, dt);
+        stats_time = timestamp_ms;
+        stats_fields = fields;
+    }
+
+    data.can_fields |= present;
+    data.reported |= present;
+    data.has_can_data = can_data.valid;
+    data.last_update = now;
 
     // Clear error if we're receiving valid data
     if (can_data.valid) {
-        error = false;
+        data.error = false;
     }
+
+    endWrite();
+}
+
+void BatteryModule::setEnabled(bool enable) {
+    beginWrite();
+    data.enabled = enable;
+    endWrite();
+}
+
+void BatteryModule::setError(bool err) {
+    beginWrite();
+    data.error = err;
+    endWrite();
+}
+
+void BatteryModule::getStats(BatteryStats& out) const {
+    portENTER_CRITICAL(&mux);
+    out = stats;
+    portEXIT_CRITICAL(&mux);
+}
+
+void BatteryModule::setStats(const BatteryStats& restored) {
+    portENTER_CRITICAL(&mux);
+    stats = restored;
+    portEXIT_CRITICAL(&mux);
+}
+
+void BatteryModule::resetStats() {
+    portENTER_CRITICAL(&mux);
+    stats.reset();
+    portEXIT_CRITICAL(&mux);
 }
 
 void BatteryModule::setName(const char* new_name) {
@@ -67,10 +154,54 @@ void BatteryModule::setName(const char* new_name) {
 }
 
 bool BatteryModule::isDataFresh(uint32_t timeout_ms) const {
-    if (!enabled) {
-        return false;
+    return snapshot().isFresh(timeout_ms, millis());
+}
+
+uint8_t BatteryModule::changedSincePublish(const BatterySnapshot& current, const TelemetryDeadband& deadband,
+                                           bool fresh, uint32_t now) const {
+    if (!published.valid) {
+        return CHANGED_STATUS;  // First report
+    }
+
+    // A deadband of 0 reports any change; otherwise moving the full deadband
+    // does. Only values the pack (or an analog input) reports are compared
+    const BatterySnapshot& last = published.values;
+    uint8_t reported = current.reported;
+    uint8_t changed = 0;
+    auto moved = [reported](uint8_t field, float value, float previous, float band) {
+        if (!(reported & field)) return false;
+        float delta = fabsf(value - previous);
+        return band > 0.0f ? delta >= band : delta > 0.0f;
+    };
+    if (moved(CANBatteryFields::VOLTAGE, current.voltage, last.voltage, deadband.voltage)) {
+        changed |= CHANGED_VOLTAGE;
+    }
+    if (moved(CANBatteryFields::CURRENT, current.current, last.current, deadband.current)) {
+        changed |= CHANGED_CURRENT;
+    }
+    if (moved(CANBatteryFields::SOC, current.soc, last.soc, deadband.soc)) changed |= CHANGED_SOC;
+    if (moved(CANBatteryFields::TEMP1, current.temp1, last.temp1, deadband.temp) ||
+        moved(CANBatteryFields::TEMP2, current.temp2, last.temp2, deadband.temp)) {
+        changed |= CHANGED_TEMP;
+    }
+
+    // Faults and state changes always go out
+    bool flags_changed = (reported & CANBatteryFields::STATUS_FLAGS) &&
+                         current.status_flags != last.status_flags;
+    if (flags_changed || current.error != last.error ||
+        fresh != published.fresh || current.has_can_data != last.has_can_data) {
+        changed |= CHANGED_STATUS;
+    }
+
+    if (now - published.time >= static_cast<uint32_t>(deadband.heartbeat_s) * 1000) {
+        changed |= CHANGED_HEARTBEAT;
     }
+    return changed;
+}
 
-    uint32_t age = millis() - last_update;
-    return age < timeout_ms;
+void BatteryModule::markPublished(const BatterySnapshot& sent, bool fresh, uint32_t now) {
+    published.valid = true;
+    published.fresh = fresh;
+    published.time = now;
+    published.values = sent;
 }
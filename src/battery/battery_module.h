@@ -2,9 +2,42 @@
 #define BATTERY_MODULE_H
 
 #include <Arduino.h>
+#include <atomic>
 #include "../can/can_message.h"
+#include "battery_stats.h"
 
-// Single battery module data and state
+struct TelemetryDeadband;
+
+// Consistent copy of a pack's readings, taken with BatteryModule::snapshot()
+struct BatterySnapshot {
+    uint8_t id;
+    bool enabled;
+    float voltage;              // Volts
+    float current;              // Amps
+    uint8_t soc;                // State of charge (%)
+    float temp1;                // Temperature 1 (°C)
+    float temp2;                // Temperature 2 (°C)
+    uint8_t status_flags;       // Status bits from CAN
+    uint32_t pack_identifier;   // Manufacturing date/serial (YYDDMMSSSS format)
+    bool has_can_data;
+    uint8_t can_fields;         // CANBatteryFields the pack has reported
+    uint8_t reported;           // CANBatteryFields holding a reading (CAN or analog)
+    bool error;
+    uint32_t last_update;       // Timestamp of last data update
+
+    float power() const { return voltage * current; }
+    bool isFresh(uint32_t timeout_ms, uint32_t now) const {
+        return enabled && now - last_update < timeout_ms;
+    }
+};
+
+// Single battery module data and state.
+//
+// Readings are written by one task at a time (CAN, sensors, config) and read
+// from any task. Values that belong together should be read with
+// snapshot(): a seqlock copy that never blocks the writer and retries
+// instead of returning a half-updated set. The single-value getters are
+// fine on their own.
 class BatteryModule {
 public:
     BatteryModule();
@@ -15,50 +48,78 @@ public:
     // Update sensor readings
     void updateVoltage(float voltage);
     void updateCurrent(float current);
-    void updateFromCAN(const CANBatteryData& can_data);
+    void updateFromCAN(const CANBatteryData& can_data, uint32_t timestamp_ms);
+
+    // All readings at one point in time
+    BatterySnapshot snapshot() const;
 
     // Getters
-    uint8_t getId() const { return id; }
+    uint8_t getId() const { return data.id; }
     const char* getName() const { return name; }
-    bool isEnabled() const { return enabled; }
-    float getVoltage() const { return voltage; }
-    float getCurrent() const { return current; }
-    float getPower() const { return voltage * current; }
-    uint8_t getSOC() const { return soc; }
-    float getTemp1() const { return temp1; }
-    float getTemp2() const { return temp2; }
-    uint8_t getStatusFlags() const { return status_flags; }
-    uint32_t getPackIdentifier() const { return pack_identifier; }
-    uint32_t getLastUpdate() const { return last_update; }
-    bool hasError() const { return error; }
+    bool isEnabled() const { return data.enabled; }
+    float getVoltage() const { return data.voltage; }
+    float getCurrent() const { return data.current; }
+    float getPower() const { return snapshot().power(); }
+    uint8_t getSOC() const { return data.soc; }
+    float getTemp1() const { return data.temp1; }
+    float getTemp2() const { return data.temp2; }
+    uint8_t getStatusFlags() const { return data.status_flags; }
+    uint32_t getPackIdentifier() const { return data.pack_identifier; }
+    uint32_t getLastUpdate() const { return data.last_update; }
+    bool hasError() const { return data.error; }
 
     // Setters
-    void setEnabled(bool enable) { enabled = enable; }
+    void setEnabled(bool enable);
     void setName(const char* new_name);
-    void setError(bool err) { error = err; }
+    void setError(bool err);
 
     // Status checks
     bool isDataFresh(uint32_t timeout_ms = 5000) const;
-    bool hasCANData() const { return has_can_data; }
+    bool hasCANData() const { return data.has_can_data; }
+    bool hasCANField(uint8_t field) const { return (data.can_fields & field) != 0; }
+
+    // Running statistics (min/max/mean, Ah and Wh), fed by updateFromCAN();
+    // copies are consistent with concurrent updates
+    void getStats(BatteryStats& out) const;
+    void setStats(const BatteryStats& stats);
+    void resetStats();
+
+    // Report-by-exception publishing: what changed beyond the deadbands since
+    // markPublished() (0 = nothing worth sending yet). Values no source has
+    // reported are not compared
+    static constexpr uint8_t CHANGED_VOLTAGE = 0x01;
+    static constexpr uint8_t CHANGED_CURRENT = 0x02;
+    static constexpr uint8_t CHANGED_SOC = 0x04;
+    static constexpr uint8_t CHANGED_TEMP = 0x08;
+    static constexpr uint8_t CHANGED_STATUS = 0x10;     // Flags, error, freshness or CAN presence
+    static constexpr uint8_t CHANGED_HEARTBEAT = 0x20;
+    uint8_t changedSincePublish(const BatterySnapshot& current, const TelemetryDeadband& deadband,
+                                bool fresh, uint32_t now) const;
+    void markPublished(const BatterySnapshot& sent, bool fresh, uint32_t now);
 
 private:
-    uint8_t id;
     char name[16];
-    bool enabled;
 
-    // Sensor data
-    float voltage;              // Volts
-    float current;              // Amps
-    uint8_t soc;                // State of charge (%)
-    float temp1;                // Temperature 1 (°C)
-    float temp2;                // Temperature 2 (°C)
-    uint8_t status_flags;       // Status bits from CAN
-    uint32_t pack_identifier;   // Manufacturing date/serial (YYDDMMSSSS format)
+    BatterySnapshot data;
+    std::atomic<uint32_t> seq;  // Odd while a write is in progress
+    mutable portMUX_TYPE mux;   // Serializes writers (and guards stats)
 
-    // State
-    bool has_can_data;
-    bool error;
-    uint32_t last_update;       // Timestamp of last data update
+    BatteryStats stats;
+    uint32_t stats_time;        // Frame timestamp of the last reading in stats
+    uint8_t stats_fields;       // BatteryStats fields of that reading
+
+    // Values as last published to MQTT
+    struct Published {
+        bool valid;             // Anything published yet
+        bool fresh;
+        uint32_t time;          // millis() of that publish
+        BatterySnapshot values;
+    };
+    Published published;
+
+    // Bracket every change to data
+    void beginWrite();
+    void endWrite();
 };
 
 #endif // BATTERY_MODULE_H
@@ -0,0 +1,84 @@
+#include "battery_stats.h"
+#include <math.h>
+
+void BatteryStats::reset() {
+    memset(this, 0, sizeof(*this));
+}
+
+void BatteryStats::add(uint8_t fields, float voltage, float current, float prev_voltage, float prev_current,
+                       uint32_t dt_ms) {
+    bool has_voltage = fields & VOLTAGE;
+    bool has_current = fields & CURRENT;
+    if (!has_voltage && !has_current) {
+        return;
+    }
+
+    if (has_voltage) {
+        if (voltage_samples == 0) {
+            voltage_min = voltage_max = voltage;
+        } else {
+            if (voltage < voltage_min) voltage_min = voltage;
+            if (voltage > voltage_max) voltage_max = voltage;
+        }
+        voltage_samples++;
+    }
+    if (has_current) {
+        if (current_samples == 0) {
+            current_min = current_max = current;
+        } else {
+            if (current < current_min) current_min = current;
+            if (current > current_max) current_max = current;
+        }
+        current_samples++;
+    }
+    samples++;
+
+    if (dt_ms == 0) {
+        return;
+    }
+
+    // Trapezoid over the step, rounded to whole mV/mA/mW before scaling by
+    // the step length so the integrals stay exact integers
+    integrated_ms += dt_ms;
+    if (has_voltage) {
+        int64_t mv = lroundf((voltage + prev_voltage) * 500.0f);
+        voltage_ms += dt_ms;
+        voltage_mv_ms += mv * dt_ms;
+    }
+    if (has_current) {
+        int64_t ma = lroundf((current + prev_current) * 500.0f);
+        current_ms += dt_ms;
+        if (ma >= 0) {
+            discharge_ma_ms += ma * dt_ms;
+        } else {
+            charge_ma_ms -= ma * dt_ms;
+        }
+    }
+    if (has_voltage && has_current) {
+        int64_t mw = lroundf((voltage * current + prev_voltage * prev_current) * 500.0f);
+        if (mw >= 0) {
+            discharge_mw_ms += mw * dt_ms;
+        } else {
+            charge_mw_ms -= mw * dt_ms;
+        }
+    }
+}
+
+float BatteryStats::voltageMean() const {
+    if (voltage_ms == 0) {
+        return 0.0f;
+    }
+    return static_cast<float>(voltage_mv_ms / static_cast<int64_t>(voltage_ms)) / 1000.0f;
+}
+
+float BatteryStats::currentMean() const {
+    if (current_ms == 0) {
+        return 0.0f;
+    }
+    int64_t net = discharge_ma_ms - charge_ma_ms;
+    return static_cast<float>(net / static_cast<int64_t>(current_ms)) / 1000.0f;
+}
+
+float BatteryStats::peakCurrent() const {
+    return fabsf(current_min) > fabsf(current_max) ? current_min : current_max;
+}
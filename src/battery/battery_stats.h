@@ -0,0 +1,59 @@
+#ifndef BATTERY_STATS_H
+#define BATTERY_STATS_H
+
+#include <Arduino.h>
+
+// Running statistics of one pack, updated in O(1) per sample.
+//
+// Charge, energy and the voltage mean are integrated over the sample
+// timestamps with the trapezoid rule, in fixed point (mA·ms, mW·ms, mV·ms)
+// so small steps don't vanish into a large total. Positive current is
+// discharge. Means are time-weighted over the integrated time.
+//
+// A sample carries voltage, current or both; only what it carries is
+// counted. Energy needs both in the same reading, so a pack that reports
+// only voltage over CAN has no Ah or Wh.
+//
+// Plain data: BatteryManager checkpoints it to NVS as one blob, so bump
+// VERSION when the layout changes.
+struct BatteryStats {
+    static constexpr uint16_t VERSION = 2;
+
+    // add() field bits
+    static constexpr uint8_t VOLTAGE = 0x01;
+    static constexpr uint8_t CURRENT = 0x02;
+
+    uint32_t samples;
+    uint32_t voltage_samples;
+    uint32_t current_samples;
+    float voltage_min;
+    float voltage_max;
+    float current_min;          // Most negative (charging)
+    float current_max;          // Most positive (discharging)
+    uint64_t integrated_ms;     // Time covered by any integral below
+    uint64_t voltage_ms;        // Time covered by voltage_mv_ms
+    uint64_t current_ms;        // Time covered by the charge integrals
+    int64_t voltage_mv_ms;
+    int64_t charge_ma_ms;
+    int64_t discharge_ma_ms;
+    int64_t charge_mw_ms;
+    int64_t discharge_mw_ms;
+
+    void reset();
+
+    // New reading of the quantities in fields; dt_ms is the time since the
+    // previous reading of the same quantities (prev_*), or 0 to only count
+    // it (first reading, or after a gap)
+    void add(uint8_t fields, float voltage, float current, float prev_voltage, float prev_current,
+             uint32_t dt_ms);
+
+    float voltageMean() const;
+    float currentMean() const;
+    float peakCurrent() const;
+    float chargeAh() const { return charge_ma_ms / 3.6e9; }
+    float dischargeAh() const { return discharge_ma_ms / 3.6e9; }
+    float chargeWh() const { return charge_mw_ms / 3.6e9; }
+    float dischargeWh() const { return discharge_mw_ms / 3.6e9; }
+};
+
+#endif // BATTERY_STATS_H
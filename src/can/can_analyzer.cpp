@@ -0,0 +1,270 @@
+#include "can_analyzer.h"
+
+// Multiplicative hashing: the top bits of id * 2^32/phi pick the home slot
+static constexpr uint32_t HASH_MULTIPLIER = 2654435761u;
+static constexpr uint32_t HASH_SHIFT = 32 - __builtin_ctz(CAN_ANALYZER_TABLE_SIZE);
+
+// Frame timestamps are ms or us (CAN_FRAME_TIMESTAMP_US); convert deltas
+static uint32_t deltaUs(uint32_t from, uint32_t to) {
+#if CAN_FRAME_TIMESTAMP_US
+    return to - from;
+#else
+    uint32_t ms = to - from;
+    return ms < UINT32_MAX / 1000 ? ms * 1000 : UINT32_MAX;
+#endif
+}
+
+static uint32_t deltaMs(uint32_t from, uint32_t to) {
+#if CAN_FRAME_TIMESTAMP_US
+    return (to - from) / 1000;
+#else
+    return to - from;
+#endif
+}
+
+CANAnalyzer::CANAnalyzer()
+    : used_(0),
+      bitrate_(0),
+      window_start_(0),
+      window_bits_(0),
+      window_frames_(0),
+      utilization_(0),
+      peak_utilization_(0),
+      frames_per_sec_(0),
+      frames_(0),
+      untracked_(0),
+      mux_(portMUX_INITIALIZER_UNLOCKED) {
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+        clearSlot(slots_[i], EMPTY_KEY);
+    }
+}
+
+uint32_t CANAnalyzer::frameBits(bool extended, bool rtr, uint8_t dlc) {
+    // SOF, arbitration, control, CRC + delimiter, ACK, EOF and IFS: 47 bits
+    // with an 11-bit ID, 67 with a 29-bit one; remote frames carry no data
+    uint32_t bits = extended ? 67 : 47;
+    if (!rtr) {
+        bits += 8 * (dlc > 8 ? 8 : dlc);
+    }
+    return bits;
+}
+
+void CANAnalyzer::setBitrate(uint32_t bitrate) {
+    portENTER_CRITICAL(&mux_);
+    bitrate_ = bitrate;
+    portEXIT_CRITICAL(&mux_);
+}
+
+bool CANAnalyzer::setExpectedPeriod(uint32_t id, bool extended, uint16_t period_ms) {
+    uint32_t key = (id & CANFrame::ID_MASK) | (extended ? CANFrame::FLAG_EXTENDED : 0);
+
+    portENTER_CRITICAL(&mux_);
+    Slot* slot = findSlot(key, true);
+    if (slot != nullptr) {
+        slot->expected_ms = period_ms;
+    }
+    portEXIT_CRITICAL(&mux_);
+    return slot != nullptr;
+}
+
+void CANAnalyzer::record(const CANFrame& frame) {
+    uint32_t key = frame.id_flags & KEY_MASK;
+    uint32_t ts = frame.timestamp;
+    uint8_t dlc = frame.dlc();
+    bool rtr = frame.rtr();
+
+    portENTER_CRITICAL(&mux_);
+
+    if (frames_ == 0) {
+        window_start_ = ts;
+    } else if (deltaMs(window_start_, ts) >= CAN_ANALYZER_WINDOW_MS) {
+        closeWindow(ts);
+    }
+    frames_++;
+    window_frames_++;
+    window_bits_ += frameBits(key & CANFrame::FLAG_EXTENDED, rtr, dlc);
+
+    Slot* slot = findSlot(key, true);
+    if (slot == nullptr) {
+        untracked_++;
+        portEXIT_CRITICAL(&mux_);
+        return;
+    }
+
+    if (slot->count > 0) {
+        uint32_t interval = deltaUs(slot->last_ts, ts);
+        float x = static_cast<float>(interval);
+
+        // Welford's running mean and variance over count - 1 intervals
+        float n = static_cast<float>(slot->count);
+        float delta = x - slot->mean_us;
+        slot->mean_us += delta / n;
+        slot->m2 += delta * (x - slot->mean_us);
+
+        slot->average_us = slot->count == 1 ? x : slot->average_us + (x - slot->average_us) / 8.0f;
+        if (interval < slot->min_us) slot->min_us = interval;
+        if (interval > slot->max_us) slot->max_us = interval;
+
+        if (slot->expected_ms > 0) {
+            uint32_t period_us = slot->expected_ms * 1000UL;
+            if (interval > period_us + period_us / 2) {
+                slot->late++;
+                slot->missed += (interval + period_us / 2) / period_us - 1;
+            }
+        }
+    }
+
+    slot->count++;
+    slot->last_ts = ts;
+    slot->dlc = dlc;
+    slot->rtr = rtr;
+
+    portEXIT_CRITICAL(&mux_);
+}
+
+void CANAnalyzer::closeWindow(uint32_t now) {
+    uint32_t elapsed_ms = deltaMs(window_start_, now);
+    if (bitrate_ > 0 && elapsed_ms > 0) {
+        utilization_ = window_bits_ * 100000.0f / (static_cast<float>(bitrate_) * elapsed_ms);
+        if (utilization_ > peak_utilization_) {
+            peak_utilization_ = utilization_;
+        }
+    }
+    frames_per_sec_ = elapsed_ms > 0 ? (uint64_t)window_frames_ * 1000 / elapsed_ms : 0;
+
+    window_start_ = now;
+    window_bits_ = 0;
+    window_frames_ = 0;
+}
+
+CANAnalyzer::Slot* CANAnalyzer::findSlot(uint32_t key, bool insert) {
+    uint32_t index = (key * HASH_MULTIPLIER) >> HASH_SHIFT;
+    for (size_t probe = 0; probe < TABLE_SIZE; probe++) {
+        Slot& slot = slots_[index];
+        if (slot.key == key) {
+            return &slot;
+        }
+        if (slot.key == EMPTY_KEY) {
+            // Slots are never freed one at a time, so the first empty one
+            // ends the probe sequence
+            if (!insert || used_ >= MAX_IDS) {
+                return nullptr;
+            }
+            clearSlot(slot, key);
+            used_++;
+            return &slot;
+        }
+        index = (index + 1) & (TABLE_SIZE - 1);
+    }
+    return nullptr;
+}
+
+void CANAnalyzer::clearSlot(Slot& slot, uint32_t key) {
+    memset(&slot, 0, sizeof(slot));
+    slot.key = key;
+    slot.min_us = UINT32_MAX;
+}
+
+void CANAnalyzer::reset() {
+    uint32_t keys[MAX_IDS];
+    uint16_t periods[MAX_IDS];
+
+    portENTER_CRITICAL(&mux_);
+    size_t kept = 0;
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+        if (slots_[i].key != EMPTY_KEY && slots_[i].expected_ms > 0 && kept < MAX_IDS) {
+            keys[kept] = slots_[i].key;
+            periods[kept] = slots_[i].expected_ms;
+            kept++;
+        }
+        clearSlot(slots_[i], EMPTY_KEY);
+    }
+    used_ = 0;
+    for (size_t i = 0; i < kept; i++) {
+        findSlot(keys[i], true)->expected_ms = periods[i];
+    }
+
+    window_bits_ = 0;
+    window_frames_ = 0;
+    utilization_ = 0;
+    peak_utilization_ = 0;
+    frames_per_sec_ = 0;
+    frames_ = 0;
+    untracked_ = 0;
+    portEXIT_CRITICAL(&mux_);
+}
+
+size_t CANAnalyzer::getIdStats(IdStats* out, size_t max) const {
+    if (out == nullptr) {
+        return 0;
+    }
+
+    uint32_t now = CANFrame::now();
+    uint32_t bitrate;
+    portENTER_CRITICAL(&mux_);
+    bitrate = bitrate_;
+    portEXIT_CRITICAL(&mux_);
+
+    size_t count = 0;
+    for (size_t i = 0; i < TABLE_SIZE && count < max; i++) {
+        // One slot per critical section keeps the RX task's wait short
+        Slot slot;
+        portENTER_CRITICAL(&mux_);
+        slot = slots_[i];
+        portEXIT_CRITICAL(&mux_);
+        if (slot.key == EMPTY_KEY) {
+            continue;
+        }
+
+        IdStats& stats = out[count++];
+        stats.id = slot.key & CANFrame::ID_MASK;
+        stats.extended = (slot.key & CANFrame::FLAG_EXTENDED) != 0;
+        stats.dlc = slot.dlc;
+        stats.count = slot.count;
+        stats.expected_ms = slot.expected_ms;
+        stats.late = slot.late;
+        stats.missed = slot.missed;
+        stats.age_ms = slot.count > 0 ? deltaMs(slot.last_ts, now) : UINT32_MAX;
+
+        uint32_t intervals = slot.count > 1 ? slot.count - 1 : 0;
+        stats.interval_ms = intervals > 0 ? slot.mean_us / 1000.0f : 0;
+        stats.jitter_ms = intervals > 1 ? sqrtf(slot.m2 / (intervals - 1)) / 1000.0f : 0;
+        stats.min_interval_ms = intervals > 0 ? slot.min_us / 1000.0f : 0;
+        stats.max_interval_ms = intervals > 0 ? slot.max_us / 1000.0f : 0;
+
+        // A silent ID's rate falls off as its age outgrows the usual interval
+        stats.rate_hz = 0;
+        if (intervals > 0) {
+            float age_us = deltaUs(slot.last_ts, now);
+            float interval_us = slot.average_us > age_us ? slot.average_us : age_us;
+            stats.rate_hz = interval_us > 0 ? 1000000.0f / interval_us : 0;
+        }
+
+        stats.deviation_pct = intervals > 0 && slot.expected_ms > 0
+                            ? (slot.average_us / (slot.expected_ms * 1000.0f) - 1.0f) * 100.0f : 0;
+        stats.load_pct = bitrate > 0
+                       ? stats.rate_hz * frameBits(stats.extended, slot.rtr, slot.dlc) * 100.0f / bitrate : 0;
+    }
+    return count;
+}
+
+void CANAnalyzer::getBusStats(BusStats& out) const {
+    uint32_t now = CANFrame::now();
+
+    portENTER_CRITICAL(&mux_);
+    out.bitrate = bitrate_;
+    out.utilization = utilization_;
+    out.peak_utilization = peak_utilization_;
+    out.frames_per_sec = frames_per_sec_;
+    out.frames = frames_;
+    out.untracked = untracked_;
+    out.ids = used_;
+    bool stale = frames_ == 0 || deltaMs(window_start_, now) >= 2 * CAN_ANALYZER_WINDOW_MS;
+    portEXIT_CRITICAL(&mux_);
+
+    // Windows only close on a new frame; a quiet bus has no load
+    if (stale) {
+        out.utilization = 0;
+        out.frames_per_sec = 0;
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef CAN_ANALYZER_H
+#define CAN_ANALYZER_H
+
+#include <Arduino.h>
+#include "can_message.h"
+#include "../config/config.h"
+
+// Per-ID timing and bus load, kept incrementally as frames arrive.
+//
+// The RX task calls record() for every received frame. Each CAN ID has a
+// slot in a fixed open-addressing table (CAN_ANALYZER_TABLE_SIZE, linear
+// probing), so an update is a hash, usually one probe and a few arithmetic
+// operations:
+//
+//   rate      - from a moving average of the inter-arrival time
+//   interval  - mean and standard deviation (jitter) since the last reset
+//   deviation - recent interval vs the protocol's period_ms, with counts of
+//               late frames (> 1.5 periods) and the periods they skipped
+//
+// Bus load counts the nominal bits of every frame (header, DLC bytes, CRC,
+// ACK, EOF and interframe space, no stuff bits) against the bitrate over
+// CAN_ANALYZER_WINDOW_MS. Stuffing adds up to ~20% on a real bus. Frames we
+// transmit are not received back, so they are not included.
+//
+// IDs with a known period are registered up front and show up even before
+// (or if never) they are seen. Once 3/4 of the slots are taken, frames of
+// new IDs are only counted as untracked.
+class CANAnalyzer {
+public:
+    static constexpr size_t TABLE_SIZE = CAN_ANALYZER_TABLE_SIZE;
+    static constexpr size_t MAX_IDS = TABLE_SIZE * 3 / 4;
+
+    struct IdStats {
+        uint32_t id;
+        bool extended;
+        uint8_t dlc;                // Of the last frame
+        uint32_t count;
+        float rate_hz;              // Recent; decays while the ID is silent
+        float interval_ms;          // Mean since reset
+        float jitter_ms;            // Standard deviation of the interval
+        float min_interval_ms;
+        float max_interval_ms;
+        uint16_t expected_ms;       // Protocol period (0 = unknown)
+        float deviation_pct;        // Recent interval vs expected_ms
+        uint32_t late;              // Intervals over 1.5 periods
+        uint32_t missed;            // Periods those intervals skipped
+        uint32_t age_ms;            // Since the last frame (UINT32_MAX = never seen)
+        float load_pct;             // Share of the bus at the recent rate
+    };
+
+    struct BusStats {
+        uint32_t bitrate;
+        float utilization;          // Percent, last complete window
+        float peak_utilization;
+        uint32_t frames_per_sec;    // Last complete window
+        uint32_t frames;            // Since reset
+        uint32_t untracked;         // Frames of IDs that found no free slot
+        uint16_t ids;               // Slots in use
+    };
+
+    CANAnalyzer();
+
+    // Setup; safe while frames are being recorded
+    void setBitrate(uint32_t bitrate);
+    bool setExpectedPeriod(uint32_t id, bool extended, uint16_t period_ms);
+
+    // RX task only
+    void record(const CANFrame& frame);
+
+    // Drop all counts and unregistered IDs (expected periods are kept)
+    void reset();
+
+    // Copy up to max slots in table order; returns the number copied
+    size_t getIdStats(IdStats* out, size_t max) const;
+    void getBusStats(BusStats& out) const;
+
+    // Nominal bits on the wire for one frame, without stuff bits
+    static uint32_t frameBits(bool extended, bool rtr, uint8_t dlc);
+
+private:
+    static_assert((TABLE_SIZE & (TABLE_SIZE - 1)) == 0, "CAN_ANALYZER_TABLE_SIZE must be a power of two");
+    static constexpr uint32_t EMPTY_KEY = 0xFFFFFFFF;
+    static constexpr uint32_t KEY_MASK = CANFrame::ID_MASK | CANFrame::FLAG_EXTENDED;
+
+    struct Slot {
+        uint32_t key;               // id | FLAG_EXTENDED, EMPTY_KEY if unused
+        uint32_t count;
+        uint32_t last_ts;           // Frame timestamp (CANFrame time base)
+        float mean_us;              // Welford mean/M2 of the count - 1 intervals
+        float m2;
+        float average_us;           // Moving average (1/8) of the interval
+        uint32_t min_us;
+        uint32_t max_us;
+        uint32_t late;
+        uint32_t missed;
+        uint16_t expected_ms;
+        uint8_t dlc;
+        bool rtr;
+    };
+
+    Slot slots_[TABLE_SIZE];
+    uint16_t used_;
+
+    uint32_t bitrate_;
+    uint32_t window_start_;         // Frame time base
+    uint32_t window_bits_;
+    uint32_t window_frames_;
+    float utilization_;
+    float peak_utilization_;
+    uint32_t frames_per_sec_;
+    uint32_t frames_;
+    uint32_t untracked_;
+
+    mutable portMUX_TYPE mux_;
+
+    // Lock held; nullptr if the ID is new and the table is full
+    Slot* findSlot(uint32_t key, bool insert);
+    void clearSlot(Slot& slot, uint32_t key);
+    void closeWindow(uint32_t now);
+};
+
+#endif // CAN_ANALYZER_H
@@ -9,13 +9,21 @@ CANDriver canDriver;
 CANDriver::CANDriver()
     : status(CANStatus::UNINITIALIZED),
       msg_callback(nullptr),
+      rx_waiter(nullptr),
       is_initialized(false),
       current_bitrate(0),
+      promiscuous(false),
+      filter_mux(portMUX_INITIALIZER_UNLOCKED),
+      installed_loopback(false),
+      loopback_hold(false),
+      reconfig_pending(false),
       rx_task_handle(nullptr),
-      ping_enabled(false),
-      ping_interval_ms(1000),
-      last_ping_time(0),
-      ping_counter(0) {
+      ping_handle(-1),
+      ping_counter(0),
+      last_status_poll(0),
+      last_status_log(0),
+      last_drop_logged(0),
+      last_tx_failed_logged(0) {
 }
 
 bool CANDriver::begin(uint32_t bitrate) {
@@ -26,18 +34,59 @@ bool CANDriver::begin(uint32_t bitrate) {
 
     LOG_INFO("CANDriver: Initializing at %d bps...", bitrate);
 
-    // General configuration
+    current_bitrate = bitrate;
+    if (!installDriver(wantedFilter())) {
+        return false;
+    }
+
+    is_initialized = true;
+    status = CANStatus::RUNNING;
+    resetStats();
+    analyzer.setBitrate(current_bitrate);
+
+    // Create RX task
+    xTaskCreatePinnedToCore(
+        rxTaskFunc,
+        "CAN RX Task",
+        4096,
+        this,
+        2,
+        &rx_task_handle,
+        0
+    );
+
+    // Transmit queue service, so senders never wait on the controller
+    tx_scheduler.begin(current_bitrate, &stats);
+
+    LOG_INFO("CANDriver: Initialized successfully at %d bps", current_bitrate);
+    return true;
+}
+
+bool CANDriver::installDriver(const CANFilter& wanted) {
+    // General configuration; a loopback load test needs self-test mode,
+    // where our own frames count as sent without an ACK
+    bool loopback = load_test.loopbackWanted();
     twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(
         (gpio_num_t)PIN_CAN_TX,
         (gpio_num_t)PIN_CAN_RX,
-        TWAI_MODE_NORMAL
+        loopback ? TWAI_MODE_NO_ACK : TWAI_MODE_NORMAL
     );
     g_config.rx_queue_len = CAN_RX_QUEUE_SIZE;
     g_config.tx_queue_len = CAN_TX_QUEUE_SIZE;
 
+    // RX task sleeps in twai_read_alerts() and wakes on these events
+    // (TX alerts are handed on to the TX scheduler)
+    g_config.alerts_enabled = TWAI_ALERT_RX_DATA |
+                              TWAI_ALERT_RX_QUEUE_FULL |
+                              TWAI_ALERT_TX_SUCCESS |
+                              TWAI_ALERT_TX_FAILED |
+                              TWAI_ALERT_ERR_PASS |
+                              TWAI_ALERT_BUS_OFF |
+                              TWAI_ALERT_BUS_RECOVERED;
+
     // Timing configuration for specified bitrate
     twai_timing_config_t t_config;
-    switch (bitrate) {
+    switch (current_bitrate) {
         case 500000:
             t_config = TWAI_TIMING_CONFIG_500KBITS();
             break;
@@ -54,14 +103,20 @@ bool CANDriver::begin(uint32_t bitrate) {
             t_config = TWAI_TIMING_CONFIG_1MBITS();
             break;
         default:
-            LOG_WARN("CANDriver: Unsupported bitrate %d, using 500kbps", bitrate);
+            LOG_WARN("CANDriver: Unsupported bitrate %d, using 500kbps", current_bitrate);
             t_config = TWAI_TIMING_CONFIG_500KBITS();
-            bitrate = 500000;
+            current_bitrate = 500000;
             break;
     }
 
-    // Filter configuration - accept all messages
-    twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+    // Filter configuration - loopback overrides it, as its foreign IDs must
+    // come back
+    CANFilter active = loopback ? CANFilter::acceptAll() : wanted;
+    installed_loopback = loopback;  // Even on failure, so a failed switch isn't retried every pass
+    twai_filter_config_t f_config;
+    f_config.acceptance_code = active.acceptance_code;
+    f_config.acceptance_mask = active.acceptance_mask;
+    f_config.single_filter = active.single_filter;
 
     // Install TWAI driver
     esp_err_t err = twai_driver_install(&g_config, &t_config, &f_config);
@@ -78,23 +133,13 @@ bool CANDriver::begin(uint32_t bitrate) {
         return false;
     }
 
-    is_initialized = true;
-    current_bitrate = bitrate;
-    status = CANStatus::RUNNING;
-    resetStats();
-
-    // Create RX task
-    xTaskCreatePinnedToCore(
-        rxTaskFunc,
-        "CAN RX Task",
-        4096,
-        this,
-        2,
-        &rx_task_handle,
-        0
-    );
+    portENTER_CRITICAL(&filter_mux);
+    installed_filter = active;
+    portEXIT_CRITICAL(&filter_mux);
 
-    LOG_INFO("CANDriver: Initialized successfully at %d bps", bitrate);
+    char desc[64];
+    active.describe(desc, sizeof(desc));
+    LOG_INFO("CANDriver: Acceptance filter %s", desc);
     return true;
 }
 
@@ -105,6 +150,8 @@ void CANDriver::end() {
 
     LOG_INFO("CANDriver: Shutting down...");
 
+    tx_scheduler.end();
+
     // Delete RX task
     if (rx_task_handle != nullptr) {
         vTaskDelete(rx_task_handle);
@@ -121,63 +168,46 @@ void CANDriver::end() {
     LOG_INFO("CANDriver: Shutdown complete");
 }
 
-bool CANDriver::sendMessage(const CANMessage& msg) {
+bool CANDriver::sendMessage(const CANMessage& msg, TxPriority priority) {
     if (!is_initialized) {
-        LOG_ERROR("CAN TX failed: driver not initialized");
         return false;
     }
 
-    if (status != CANStatus::RUNNING) {
-        LOG_ERROR("CAN TX failed: bus status is %d (not RUNNING)", static_cast<int>(status));
+    // Failures are counted by the scheduler and reported once per status poll
+    return tx_scheduler.submit(msg, priority);
+}
+
+bool CANDriver::receiveMessage(CANMessage& msg, uint32_t timeout_ms) {
+    CANFrame frame;
+    if (!receiveFrame(frame, timeout_ms)) {
         return false;
     }
+    msg = frame.toMessage();
+    return true;
+}
 
-    // Convert our message format to TWAI format
-    twai_message_t twai_msg;
-    twai_msg.identifier = msg.id;
-    twai_msg.data_length_code = msg.dlc;
-    twai_msg.rtr = msg.rtr ? 1 : 0;
-    twai_msg.extd = msg.extended ? 1 : 0;
-    memcpy(twai_msg.data, msg.data, msg.dlc);
-
-    // Try to send (non-blocking with 10ms timeout)
-    esp_err_t err = twai_transmit(&twai_msg, pdMS_TO_TICKS(10));
-    if (err == ESP_OK) {
-        stats.tx_count++;
+bool CANDriver::receiveFrame(CANFrame& frame, uint32_t timeout_ms) {
+    // Try to get from our queue first
+    if (rx_queue.pop(frame)) {
         return true;
-    } else {
-        stats.tx_failed++;
+    }
 
-        // Log specific error
-        if (err == ESP_ERR_TIMEOUT) {
-            LOG_WARN("CAN TX timeout: TX queue full (increase CAN_TX_QUEUE_SIZE)");
-        } else if (err == ESP_ERR_INVALID_STATE) {
-            LOG_ERROR("CAN TX failed: invalid state (bus-off or not started)");
-        } else {
-            LOG_ERROR("CAN TX failed: error code %d", err);
-        }
+    if (timeout_ms == 0) {
         return false;
     }
-}
 
-bool CANDriver::receiveMessage(CANMessage& msg, uint32_t timeout_ms) {
-    // Try to get from our ring buffer first
-    if (rx_queue.pop(msg)) {
-        return true;
-    }
+    // Block until the RX task signals new frames (or timeout)
+    rx_waiter.store(xTaskGetCurrentTaskHandle());
 
-    // If timeout is specified, wait a bit
-    if (timeout_ms > 0) {
-        uint32_t start = millis();
-        while (millis() - start < timeout_ms) {
-            if (rx_queue.pop(msg)) {
-                return true;
-            }
-            vTaskDelay(pdMS_TO_TICKS(1));
-        }
+    // Re-check after registering so a frame queued in between isn't missed
+    if (!rx_queue.pop(frame)) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+        rx_waiter.store(nullptr);
+        return rx_queue.pop(frame);
     }
 
-    return false;
+    rx_waiter.store(nullptr);
+    return true;
 }
 
 size_t CANDriver::available() const {
@@ -214,59 +244,188 @@ bool CANDriver::recoverBusOff() {
 }
 
 bool CANDriver::setFilter(uint32_t id, uint32_t mask, bool extended) {
-    // Note: TWAI filters must be set before driver installation
-    // This function is a placeholder for future dynamic filter support
-    LOG_WARN("CANDriver: Dynamic filters not yet implemented");
-    return false;
+    return setFilter(CANFilter::fromIdMask(id, mask, extended));
+}
+
+bool CANDriver::setFilter(const CANFilter& new_filter) {
+    portENTER_CRITICAL(&filter_mux);
+    filter = new_filter;
+    portEXIT_CRITICAL(&filter_mux);
+    return requestReconfigure();
+}
+
+CANFilter CANDriver::getFilter() const {
+    portENTER_CRITICAL(&filter_mux);
+    CANFilter copy = filter;
+    portEXIT_CRITICAL(&filter_mux);
+    return copy;
 }
 
 void CANDriver::clearFilters() {
-    // Placeholder - filters are set during initialization
+    setFilter(CANFilter::acceptAll());
 }
 
-void CANDriver::setMessageCallback(MessageCallback callback) {
-    msg_callback = callback;
+bool CANDriver::setPromiscuous(bool enabled) {
+    portENTER_CRITICAL(&filter_mux);
+    bool changed = promiscuous != enabled;
+    promiscuous = enabled;
+    portEXIT_CRITICAL(&filter_mux);
+    if (!changed) {
+        return true;
+    }
+
+    LOG_INFO("CANDriver: Promiscuous mode %s", enabled ? "enabled" : "disabled");
+    return requestReconfigure();
 }
 
-bool CANDriver::sendPing() {
-    if (!is_initialized || status != CANStatus::RUNNING) {
+bool CANDriver::isPromiscuous() const {
+    portENTER_CRITICAL(&filter_mux);
+    bool enabled = promiscuous;
+    portEXIT_CRITICAL(&filter_mux);
+    return enabled;
+}
+
+CANFilter CANDriver::wantedFilter() const {
+    portENTER_CRITICAL(&filter_mux);
+    CANFilter wanted = promiscuous ? CANFilter::acceptAll() : filter;
+    portEXIT_CRITICAL(&filter_mux);
+    return wanted;
+}
+
+static bool sameFilter(const CANFilter& a, const CANFilter& b) {
+    return a.acceptance_code == b.acceptance_code &&
+           a.acceptance_mask == b.acceptance_mask &&
+           a.single_filter == b.single_filter;
+}
+
+bool CANDriver::requestReconfigure() {
+    // Not running yet: the filter is picked up by begin()
+    if (!is_initialized) {
+        return true;
+    }
+
+    portENTER_CRITICAL(&filter_mux);
+    bool installed = sameFilter(promiscuous ? CANFilter::acceptAll() : filter, installed_filter);
+    portEXIT_CRITICAL(&filter_mux);
+    if (installed) {
+        return true;
+    }
+
+    // The RX task owns the driver handle, so it performs the reinstall
+    // between alert waits rather than racing twai_read_alerts() here
+    reconfig_pending.store(true);
+    return true;
+}
+
+bool CANDriver::reconfigure() {
+    reconfig_pending.store(false);
+
+    // The TX task calls into TWAI on its own: park it before the driver
+    // goes away, or try again on the next pass
+    if (!tx_scheduler.hold()) {
+        reconfig_pending.store(true);
         return false;
     }
 
-    CANMessage ping_msg;
-    ping_msg.id = 0x404;  // Ping message ID
-    ping_msg.dlc = 8;
-    ping_msg.extended = false;
-    ping_msg.rtr = false;
+    const char* reason = load_test.loopbackWanted() == installed_loopback ? "apply acceptance filter"
+                       : installed_loopback ? "leave load test loopback" : "enter load test loopback";
+    LOG_INFO("CANDriver: Reinstalling driver to %s...", reason);
+
+    // Hand over whatever the driver already queued, and keep senders out
+    // while the driver is gone
+    processReceivedMessages();
+    status = CANStatus::UNINITIALIZED;
+
+    twai_stop();
+    twai_driver_uninstall();
+
+    // Install from a copy: setFilter()/setPromiscuous() may change the
+    // request meanwhile, which is caught below
+    CANFilter wanted = wantedFilter();
+    if (!installDriver(wanted)) {
+        // Fall back to accept-all so the bus isn't left dead
+        if (!installDriver(CANFilter::acceptAll())) {
+            LOG_ERROR("CANDriver: Reinstall failed, CAN bus is down");
+            status = CANStatus::ERROR;
+            releaseAfterReinstall();
+            return true;
+        }
+        LOG_WARN("CANDriver: Filter rejected, running accept-all");
+    }
+
+    // A request that came in during the reinstall compared itself against
+    // the old filter; apply it on the next pass
+    if (!sameFilter(wantedFilter(), wanted)) {
+        reconfig_pending.store(true);
+    }
+
+    status = CANStatus::RUNNING;
+    releaseAfterReinstall();
+    return true;
+}
+
+void CANDriver::releaseAfterReinstall() {
+    // Self-test mode keeps the TX scheduler held until the driver leaves
+    // it, so its completion alerts only ever see our frames
+    if (installed_loopback && !loopback_hold) {
+        loopback_hold = true;       // Keep this reinstall's hold
+        return;
+    }
+    if (!installed_loopback && loopback_hold) {
+        tx_scheduler.release();     // The one kept when entering
+        loopback_hold = false;
+    }
+    tx_scheduler.release();
+}
+
+void CANDriver::setMessageCallback(MessageCallback callback) {
+    msg_callback = callback;
+}
+
+void CANDriver::fillPing(CANMessage& msg, uint32_t sequence) {
+    msg.id = CAN_PING_ID;
+    msg.dlc = 8;
+    msg.extended = false;
+    msg.rtr = false;
 
     // Create alternating F0F0 pattern
-    // Use ping_counter to alternate between F0 and 0F on odd/even pings
-    uint8_t pattern = (ping_counter & 1) ? 0xF0 : 0x0F;
+    // Use the sequence to alternate between F0 and 0F on odd/even pings
+    uint8_t pattern = (sequence & 1) ? 0xF0 : 0x0F;
     for (int i = 0; i < 8; i++) {
-        ping_msg.data[i] = pattern;
+        msg.data[i] = pattern;
         pattern = ~pattern;  // Alternate for each byte
     }
+}
 
-    ping_counter++;
-
-    if (sendMessage(ping_msg)) {
-        LOG_DEBUG("[CAN] Ping sent: ID=0x404, counter=%d", ping_counter);
-        return true;
-    } else {
-        LOG_WARN("[CAN] Ping failed to send");
+bool CANDriver::sendPing() {
+    if (!is_initialized || status != CANStatus::RUNNING) {
         return false;
     }
+
+    CANMessage ping_msg;
+    fillPing(ping_msg, ping_counter++);
+    return sendMessage(ping_msg, TxPriority::BACKGROUND);
 }
 
 void CANDriver::enablePeriodicPing(uint32_t interval_ms) {
-    ping_enabled = true;
-    ping_interval_ms = interval_ms;
-    last_ping_time = millis();
+    disablePeriodicPing();
+
+    CANMessage ping_msg;
+    fillPing(ping_msg, 0);
+    ping_handle = tx_scheduler.addPeriodic(ping_msg, interval_ms, TxPriority::BACKGROUND, fillPing);
+    if (ping_handle < 0) {
+        LOG_WARN("[CAN] No periodic TX slot left for the ping");
+        return;
+    }
     LOG_INFO("[CAN] Periodic ping enabled (interval: %d ms)", interval_ms);
 }
 
 void CANDriver::disablePeriodicPing() {
-    ping_enabled = false;
+    if (ping_handle < 0) {
+        return;
+    }
+    tx_scheduler.removePeriodic(ping_handle);
+    ping_handle = -1;
     LOG_INFO("[CAN] Periodic ping disabled");
 }
 
@@ -275,103 +434,229 @@ void CANDriver::rxTaskFunc(void* parameter) {
 
     LOG_INFO("CANDriver: RX task started");
 
+    driver->last_status_poll = millis();
+
     while (true) {
-        driver->processReceivedMessages();
-        vTaskDelay(pdMS_TO_TICKS(1));
+        // Sleep until the controller raises an alert, but never longer than
+        // the housekeeping interval so ping/status polling keeps its cadence
+        uint32_t elapsed = millis() - driver->last_status_poll;
+        uint32_t wait_ms = elapsed < CAN_STATUS_POLL_INTERVAL_MS
+                         ? CAN_STATUS_POLL_INTERVAL_MS - elapsed : 0;
+        if (wait_ms > 1 && driver->load_test.isActive()) {
+            wait_ms = 1;    // Load test frames are generated every tick
+        }
+
+        uint32_t alerts = 0;
+        if (twai_read_alerts(&alerts, pdMS_TO_TICKS(wait_ms)) == ESP_OK) {
+            driver->processAlerts(alerts);
+        }
+
+        if (driver->reconfig_pending.load()) {
+            driver->reconfigure();
+        }
+
+        // Load test generation, plus one pass after a loopback run to
+        // switch the controller back to normal mode
+        if (driver->load_test.isActive() || driver->installed_loopback) {
+            driver->runLoadTest();
+        }
+
+        if (millis() - driver->last_status_poll >= CAN_STATUS_POLL_INTERVAL_MS) {
+            driver->checkBusStatus();
+            driver->last_status_poll = millis();
+        }
     }
 }
 
-void CANDriver::processReceivedMessages() {
-    // Handle periodic ping if enabled (only if bus is RUNNING)
-    if (ping_enabled && status == CANStatus::RUNNING) {
-        uint32_t now = millis();
-        if (now - last_ping_time >= ping_interval_ms) {
-            sendPing();
-            last_ping_time = now;
-        }
+void CANDriver::processAlerts(uint32_t alerts) {
+    tx_scheduler.onAlerts(alerts);
+
+    if (alerts & TWAI_ALERT_RX_DATA) {
+        processReceivedMessages();
     }
 
-    // Periodic status check (every 10 seconds)
-    static uint32_t last_status_log = 0;
-    uint32_t now = millis();
-    if (now - last_status_log >= 10000) {
-        twai_status_info_t status_info;
-        if (twai_get_status_info(&status_info) == ESP_OK) {
-            if (status_info.state != TWAI_STATE_RUNNING) {
-                LOG_WARN("CAN Bus State: %s, TX Errors: %u, RX Errors: %u, Queued: %u",
-                    status_info.state == TWAI_STATE_BUS_OFF ? "BUS_OFF" :
-                    status_info.state == TWAI_STATE_RECOVERING ? "RECOVERING" :
-                    status_info.state == TWAI_STATE_STOPPED ? "STOPPED" : "UNKNOWN",
-                    status_info.tx_error_counter,
-                    status_info.rx_error_counter,
-                    status_info.msgs_to_tx);
-            } else {
-                LOG_DEBUG("CAN Bus: RUNNING, TX:%u RX:%u Errors:TX=%u,RX=%u",
-                    stats.tx_count, stats.rx_count,
-                    status_info.tx_error_counter,
-                    status_info.rx_error_counter);
+    if (alerts & TWAI_ALERT_RX_QUEUE_FULL) {
+        // Driver queue overflowed before we drained it; the exact count is
+        // picked up from rx_missed_count on the next status poll
+        processReceivedMessages();
+    }
+
+    if (alerts & TWAI_ALERT_ERR_PASS) {
+        LOG_WARN("CANDriver: Controller entered error-passive state");
+    }
+
+    if (alerts & TWAI_ALERT_BUS_OFF) {
+        if (status != CANStatus::BUS_OFF) {
+            twai_status_info_t status_info;
+            if (twai_get_status_info(&status_info) == ESP_OK) {
+                LOG_ERROR("CANDriver: Bus-off detected! TX errors=%u, RX errors=%u",
+                    status_info.tx_error_counter, status_info.rx_error_counter);
             }
+            LOG_ERROR("This usually means: no termination resistor, no other CAN device, or wrong bitrate");
+            status = CANStatus::BUS_OFF;
+            handleBusError();
         }
-        last_status_log = now;
     }
 
+    if (alerts & TWAI_ALERT_BUS_RECOVERED) {
+        if (status == CANStatus::BUS_OFF) {
+            LOG_INFO("CANDriver: Bus recovered to RUNNING state");
+            status = CANStatus::RUNNING;
+        }
+    }
+}
+
+void CANDriver::processReceivedMessages() {
     twai_message_t twai_msg;
 
-    // Read all available messages
+    // Drain everything the driver has queued
     uint32_t msgs_this_cycle = 0;
     while (twai_receive(&twai_msg, 0) == ESP_OK) {
         msgs_this_cycle++;
+        stats.rx_count++;
 
-        // Convert to our message format
-        CANMessage msg;
-        msg.id = twai_msg.identifier;
-        msg.dlc = twai_msg.data_length_code;
-        msg.extended = twai_msg.extd;
-        msg.rtr = twai_msg.rtr;
-        msg.timestamp = millis();
-        memcpy(msg.data, twai_msg.data, twai_msg.data_length_code);
-
-        // Add to ring buffer
-        if (!rx_queue.push(msg)) {
-            stats.rx_dropped++;
-            LOG_WARN("CAN RX buffer full, dropped message ID=0x%03X", msg.id);
-        } else {
-            stats.rx_count++;
-
-            // Log first few messages to confirm reception
-            if (stats.rx_count <= 5) {
-                LOG_INFO("CAN RX #%u: ID=0x%03X DLC=%u", stats.rx_count, msg.id, msg.dlc);
-            }
+        // Convert to our packed frame format
+        CANFrame frame = CANFrame::make(twai_msg.identifier, twai_msg.extd, twai_msg.rtr,
+                                        twai_msg.data_length_code, twai_msg.data, CANFrame::now());
 
-            // Call callback if registered
-            if (msg_callback != nullptr) {
-                msg_callback(msg);
-            }
+        // Log first few messages to confirm reception
+        if (stats.rx_count <= 5) {
+            LOG_INFO("CAN RX #%u: ID=0x%03X DLC=%u", stats.rx_count, frame.id(), frame.dlc());
         }
+
+        deliverFrame(frame);
+    }
+
+    if (msgs_this_cycle > 0) {
+        wakeReceiver();
     }
 
     // Log burst activity
     if (msgs_this_cycle > 10) {
         LOG_DEBUG("CAN: Processed %u messages in one cycle", msgs_this_cycle);
     }
+}
+
+void CANDriver::deliverFrame(const CANFrame& frame) {
+    // Hand off to the consumer; a full queue is counted, never overwritten
+    if (!rx_queue.push(frame)) {
+        stats.rx_dropped++;
+    }
+    analyzer.record(frame);
+
+    // Fan out to frame bus consumers (enqueue only)
+    frame_bus.publish(frame);
+
+    // Call callback if registered
+    if (msg_callback != nullptr) {
+        msg_callback(frame.toMessage());
+    }
+}
+
+void CANDriver::wakeReceiver() {
+    TaskHandle_t waiter = rx_waiter.load();
+    if (waiter != nullptr) {
+        xTaskNotifyGive(waiter);
+    }
+}
 
-    // Check for bus errors
+void CANDriver::runLoadTest() {
+    bool generating = load_test.poll(millis());
+
+    // Self-test mode comes and goes with a reinstall (which holds the TX
+    // scheduler for the whole run); retried next pass if it couldn't happen
+    bool loopback = load_test.loopbackWanted();
+    if (loopback != installed_loopback && !reconfigure()) {
+        return;
+    }
+
+    if (!generating) {
+        return;
+    }
+    uint32_t owed = load_test.due(micros());
+    if (owed == 0) {
+        return;
+    }
+
+    CANFrame frame;
+    if (!installed_loopback) {
+        // Straight into the RX path, as if twai_receive() had returned them
+        for (uint32_t i = 0; i < owed; i++) {
+            load_test.next(frame);
+            deliverFrame(frame);
+        }
+        load_test.sent(owed);
+        wakeReceiver();
+        return;
+    }
+
+    // Through the controller: received back via the RX_DATA alert
+    uint32_t sent = 0;
+    twai_message_t twai_msg;
+    for (; sent < owed; sent++) {
+        load_test.next(frame);
+        twai_msg.flags = 0;
+        twai_msg.identifier = frame.id();
+        twai_msg.extd = frame.extended() ? 1 : 0;
+        twai_msg.self = 1;
+        twai_msg.data_length_code = frame.dlc();
+        memcpy(twai_msg.data, frame.data, frame.dlc());
+        if (twai_transmit(&twai_msg, 0) != ESP_OK) {
+            break;      // TX queue full: the bus is the limit
+        }
+    }
+    load_test.sent(sent);
+    load_test.skip(owed - sent);
+}
+
+void CANDriver::checkBusStatus() {
     twai_status_info_t status_info;
-    if (twai_get_status_info(&status_info) == ESP_OK) {
-        if (status_info.state == TWAI_STATE_BUS_OFF) {
-            if (status != CANStatus::BUS_OFF) {
-                LOG_ERROR("CANDriver: Bus-off detected! TX errors=%u, RX errors=%u",
-                    status_info.tx_error_counter, status_info.rx_error_counter);
-                LOG_ERROR("This usually means: no termination resistor, no other CAN device, or wrong bitrate");
-                status = CANStatus::BUS_OFF;
-                handleBusError();
-            }
-        } else if (status_info.state == TWAI_STATE_RUNNING) {
-            if (status == CANStatus::BUS_OFF) {
-                LOG_INFO("CANDriver: Bus recovered to RUNNING state");
-                status = CANStatus::RUNNING;
-            }
+    if (twai_get_status_info(&status_info) != ESP_OK) {
+        return;
+    }
+
+    stats.rx_missed = status_info.rx_missed_count + status_info.rx_overrun_count;
+
+    // Report queue drops once per poll instead of once per frame
+    if (stats.rx_dropped != last_drop_logged) {
+        LOG_WARN("CAN RX queue full, dropped %u message(s) (total %u)",
+                 stats.rx_dropped - last_drop_logged, stats.rx_dropped);
+        last_drop_logged = stats.rx_dropped;
+    }
+
+    // Likewise for frames nobody acknowledged (no other node, bus-off)
+    uint32_t tx_failed = stats.tx_failed;
+    if (tx_failed != last_tx_failed_logged) {
+        LOG_WARN("CAN TX failed for %u frame(s) (total %u)",
+                 tx_failed - last_tx_failed_logged, tx_failed);
+        last_tx_failed_logged = tx_failed;
+    }
+
+    // Fallback in case a bus-off alert was missed
+    if (status_info.state == TWAI_STATE_BUS_OFF && status != CANStatus::BUS_OFF) {
+        processAlerts(TWAI_ALERT_BUS_OFF);
+    } else if (status_info.state == TWAI_STATE_RUNNING && status == CANStatus::BUS_OFF) {
+        processAlerts(TWAI_ALERT_BUS_RECOVERED);
+    }
+
+    // Periodic status log (every 10 seconds)
+    uint32_t now = millis();
+    if (now - last_status_log >= 10000) {
+        if (status_info.state != TWAI_STATE_RUNNING) {
+            LOG_WARN("CAN Bus State: %s, TX Errors: %u, RX Errors: %u, Queued: %u",
+                status_info.state == TWAI_STATE_BUS_OFF ? "BUS_OFF" :
+                status_info.state == TWAI_STATE_RECOVERING ? "RECOVERING" :
+                status_info.state == TWAI_STATE_STOPPED ? "STOPPED" : "UNKNOWN",
+                status_info.tx_error_counter,
+                status_info.rx_error_counter,
+                status_info.msgs_to_tx);
+        } else {
+            LOG_DEBUG("CAN Bus: RUNNING, TX:%u RX:%u Errors:TX=%u,RX=%u",
+                stats.tx_count, stats.rx_count,
+                status_info.tx_error_counter,
+                status_info.rx_error_counter);
         }
+        last_status_log = now;
     }
 }
 
@@ -404,16 +689,27 @@ bool CANDriver::getDiagnostics(char* buffer, size_t size) const {
     twai_status_info_t status_info;
     bool has_status = (twai_get_status_info(&status_info) == ESP_OK);
 
+    portENTER_CRITICAL(&filter_mux);
+    CANFilter installed = installed_filter;
+    bool is_promiscuous = promiscuous;
+    portEXIT_CRITICAL(&filter_mux);
+
+    char filter_desc[64];
+    installed.describe(filter_desc, sizeof(filter_desc));
+
     snprintf(buffer, size,
         "CAN Driver Status:\n"
         "  Initialized: %s\n"
         "  Status: %s\n"
         "  Bitrate: %u bps\n"
+        "  Filter: %s%s\n"
         "\n"
         "Statistics:\n"
         "  RX Count: %u\n"
         "  TX Count: %u\n"
         "  RX Dropped: %u\n"
+        "  RX Missed (HW): %u\n"
+        "  RX Ring: %u/%u\n"
         "  TX Failed: %u\n"
         "  Bus-off Count: %u\n"
         "  Error Count: %u\n"
@@ -428,9 +724,12 @@ bool CANDriver::getDiagnostics(char* buffer, size_t size) const {
         is_initialized ? "Yes" : "No",
         getStatusString(),
         current_bitrate,
+        filter_desc, is_promiscuous ? " (promiscuous)" : "",
         stats.rx_count,
         stats.tx_count,
         stats.rx_dropped,
+        stats.rx_missed,
+        rx_queue.size(), rx_queue.capacity(),
         stats.tx_failed,
         stats.bus_off_count,
         stats.error_count,
@@ -445,5 +744,30 @@ bool CANDriver::getDiagnostics(char* buffer, size_t size) const {
         has_status ? status_info.bus_error_count : 0
     );
 
+    CANTxScheduler::Stats tx;
+    tx_scheduler.getStats(tx);
+    size_t tx_len = strlen(buffer);
+    snprintf(buffer + tx_len, size - tx_len,
+        "\n"
+        "TX Scheduler:\n"
+        "  Pending: %u (%u periodic), queue %u/%u\n"
+        "  Sent: %u, Failed: %u, Expired: %u, Rejected: %u\n"
+        "  Rate Limited: %u, Budget Waits: %u, Skipped Periods: %u\n"
+        "  Max Latency: %u us\n",
+        tx.pending, tx.periodic,
+        (unsigned)tx_scheduler.getQueueDepth(), (unsigned)tx_scheduler.getQueueCapacity(),
+        tx.sent, tx.failed, tx.expired, tx.rejected,
+        tx.rate_limited, tx.budget_waits, tx.periodic_skipped,
+        tx.max_latency_us);
+
+    if (frame_bus.getConsumerCount() > 0) {
+        size_t len = strlen(buffer);
+        int n = snprintf(buffer + len, size - len, "\nFrame Bus Consumers:\n");
+        if (n > 0 && len + n < size) {
+            len += n;
+            frame_bus.getDiagnostics(buffer + len, size - len);
+        }
+    }
+
     return true;
 }
@@ -3,7 +3,12 @@
 
 #include <Arduino.h>
 #include "can_message.h"
-#include "../utils/ring_buffer.h"
+#include "can_filter.h"
+#include "can_frame_bus.h"
+#include "can_analyzer.h"
+#include "can_tx_scheduler.h"
+#include "can_load_test.h"
+#include "../utils/spsc_queue.h"
 
 // CAN driver status
 enum class CANStatus {
@@ -17,13 +22,14 @@ enum class CANStatus {
 struct CANStats {
     uint32_t rx_count;
     uint32_t tx_count;
-    uint32_t rx_dropped;
+    uint32_t rx_dropped;        // Frames rejected because rx_queue was full
+    uint32_t rx_missed;         // Frames lost in the TWAI controller/driver queue
     uint32_t tx_failed;
     uint32_t bus_off_count;
     uint32_t error_count;
     uint32_t last_error_code;
 
-    CANStats() : rx_count(0), tx_count(0), rx_dropped(0), tx_failed(0),
+    CANStats() : rx_count(0), tx_count(0), rx_dropped(0), rx_missed(0), tx_failed(0),
                  bus_off_count(0), error_count(0), last_error_code(0) {}
 };
 
@@ -37,9 +43,15 @@ public:
     void end();
 
     // Message operations
-    bool sendMessage(const CANMessage& msg);
-    bool receiveMessage(CANMessage& msg, uint32_t timeout_ms = 0);
+    // sendMessage() queues the frame for the TX task and returns at once;
+    // false only if the driver is down or the submit queue is full
+    bool sendMessage(const CANMessage& msg, TxPriority priority = TxPriority::NORMAL);
+    bool receiveFrame(CANFrame& frame, uint32_t timeout_ms = 0);
+    bool receiveMessage(CANMessage& msg, uint32_t timeout_ms = 0);  // receiveFrame() + conversion
     size_t available() const;
+    size_t getRxQueueHighWater() const { return rx_queue.highWater(); }
+    size_t getRxQueueCapacity() const { return rx_queue.capacity(); }
+    TaskHandle_t getTaskHandle() const { return rx_task_handle; }
 
     // Status and control
     CANStatus getStatus() const { return status; }
@@ -53,15 +65,41 @@ public:
     // Recovery
     bool recoverBusOff();
 
-    // Message filtering (hardware filters)
-    bool setFilter(uint32_t id, uint32_t mask, bool extended = false);
+    // Message filtering (hardware acceptance filters)
+    // Before begin() the filter is simply stored; once running, the RX task
+    // applies it with a stop/reinstall/start cycle (a few ms without RX).
+    bool setFilter(uint32_t id, uint32_t mask, bool extended = false);  // mask: 1 = must match
+    bool setFilter(const CANFilter& filter);
     void clearFilters();
+    CANFilter getFilter() const;
+
+    // Promiscuous mode bypasses the configured filter (sniffer/logging use)
+    bool setPromiscuous(bool enabled);
+    bool isPromiscuous() const;
 
     // Callbacks for received messages
+    // Runs inside the RX task - keep it short; prefer a frame bus consumer
     typedef void (*MessageCallback)(const CANMessage& msg);
     void setMessageCallback(MessageCallback callback);
 
-    // Test/Ping functions
+    // Fan-out of received frames to consumers running in their own tasks
+    CANFrameBus& getFrameBus() { return frame_bus; }
+    const CANFrameBus& getFrameBus() const { return frame_bus; }
+
+    // Prioritized, rate-limited transmit (periodic frames, completion stats)
+    CANTxScheduler& getTxScheduler() { return tx_scheduler; }
+    const CANTxScheduler& getTxScheduler() const { return tx_scheduler; }
+
+    // Per-ID timing and bus load of received frames
+    CANAnalyzer& getAnalyzer() { return analyzer; }
+    const CANAnalyzer& getAnalyzer() const { return analyzer; }
+
+    // Synthetic RX traffic at stepped rates (see can_load_test.h); runs in
+    // the RX task, which then wakes every 1 ms
+    CANLoadTest& getLoadTest() { return load_test; }
+    const CANLoadTest& getLoadTest() const { return load_test; }
+
+    // Test/Ping functions (queued at low priority like any other frame)
     bool sendPing();  // Send a test message to verify transceiver is working
     void enablePeriodicPing(uint32_t interval_ms);
     void disablePeriodicPing();
@@ -71,27 +109,68 @@ private:
     CANStats stats;
     MessageCallback msg_callback;
 
-    // Internal message queue
-    static constexpr size_t RX_QUEUE_SIZE = 100;
-    RingBuffer<CANMessage, RX_QUEUE_SIZE> rx_queue;
+    // Internal frame queue (RX task produces, receiveFrame() consumes)
+    static constexpr size_t RX_QUEUE_SIZE = 128;
+    SpscQueue<CANFrame, RX_QUEUE_SIZE> rx_queue;
+
+    // Task blocked in receiveFrame(), woken when new frames are queued
+    std::atomic<TaskHandle_t> rx_waiter;
+
+    // Other consumers (logger, web, MQTT, ...)
+    CANFrameBus frame_bus;
+
+    // Bus analytics, fed by the RX task
+    CANAnalyzer analyzer;
+
+    // Transmit queue, run by its own task
+    CANTxScheduler tx_scheduler;
+
+    // Load test generator, run by the RX task
+    CANLoadTest load_test;
 
     // TWAI driver state
     bool is_initialized;
     uint32_t current_bitrate;
 
+    // Acceptance filter: requested config, and what the controller runs now
+    // (any task, under filter_mux; the RX task installs from a copy)
+    CANFilter filter;
+    CANFilter installed_filter;
+    bool promiscuous;
+    mutable portMUX_TYPE filter_mux;
+    bool installed_loopback;    // TWAI self-test mode for a load test
+    bool loopback_hold;         // TX scheduler hold kept while in self-test mode
+    std::atomic<bool> reconfig_pending;
+
+    CANFilter wantedFilter() const;     // filter, or accept-all when promiscuous
+    bool installDriver(const CANFilter& wanted);
+    bool requestReconfigure();
+    bool reconfigure();         // false if the driver was left as it was
+    void releaseAfterReinstall();
+
     // Internal handlers
     static void rxTaskFunc(void* parameter);
     void processReceivedMessages();
+    void deliverFrame(const CANFrame& frame);
+    void wakeReceiver();
+    void runLoadTest();
+    void processAlerts(uint32_t alerts);
+    void checkBusStatus();
     void handleBusError();
 
     // Task handle
     TaskHandle_t rx_task_handle;
 
     // Ping/heartbeat state
-    bool ping_enabled;
-    uint32_t ping_interval_ms;
-    uint32_t last_ping_time;
-    uint8_t ping_counter;
+    int ping_handle;            // Periodic TX slot (-1 = off)
+    uint8_t ping_counter;       // One-shot sendPing() calls
+    static void fillPing(CANMessage& msg, uint32_t sequence);
+
+    // Slow housekeeping (ping, status poll) timer
+    uint32_t last_status_poll;
+    uint32_t last_status_log;
+    uint32_t last_drop_logged;
+    uint32_t last_tx_failed_logged;
 };
 
 // Global CAN driver instance
@@ -0,0 +1,208 @@
+#include "can_filter.h"
+
+namespace {
+    constexpr uint32_t STD_ID_MASK = 0x7FF;
+    constexpr uint32_t EXT_ID_MASK = 0x1FFFFFFF;
+
+    // Largest ID list considered when computing a filter
+    constexpr size_t MAX_FILTER_IDS = 64;
+
+    // Bits of the filter word that never carry ID/RTR information
+    constexpr uint32_t STD_SINGLE_UNUSED = 0x000FFFFF;   // Data bytes 1-2
+    constexpr uint32_t STD_DUAL_UNUSED = 0x000F000F;     // Data byte 1 (filter 1 only)
+    constexpr uint32_t EXT_SINGLE_UNUSED = 0x00000003;
+
+    // Smallest code/"don't care" cube covering a set of IDs
+    struct IdCube {
+        uint32_t code;
+        uint32_t dont_care;
+
+        uint32_t size() const { return 1UL << __builtin_popcount(dont_care); }
+    };
+
+    IdCube coverIds(const uint32_t* ids, size_t count, uint32_t id_mask) {
+        IdCube cube = { ids[0], 0 };
+        for (size_t i = 1; i < count; i++) {
+            cube.dont_care |= (ids[i] ^ ids[0]);
+        }
+        cube.dont_care &= id_mask;
+        cube.code &= ~cube.dont_care & id_mask;
+        return cube;
+    }
+
+    // Number of IDs passed by either of two cubes (exact, counts overlap once)
+    uint32_t unionSize(const IdCube& a, const IdCube& b) {
+        uint32_t total = a.size() + b.size();
+        if (((a.code ^ b.code) & ~(a.dont_care | b.dont_care)) == 0) {
+            total -= 1UL << __builtin_popcount(a.dont_care & b.dont_care);
+        }
+        return total;
+    }
+
+    // Frame ID/RTR as they line up against a single-filter acceptance word
+    uint32_t frameWord(uint32_t id, bool extended, bool rtr) {
+        if (extended) {
+            return ((id & EXT_ID_MASK) << 3) | (rtr ? (1UL << 2) : 0);
+        }
+        return ((id & STD_ID_MASK) << 21) | (rtr ? (1UL << 20) : 0);
+    }
+}
+
+bool CANFilter::accepts(uint32_t id, bool is_extended, bool rtr) const {
+    if (acceptsAll()) {
+        return true;
+    }
+
+    uint32_t frame = frameWord(id, is_extended, rtr);
+    uint32_t care = ~acceptance_mask;
+
+    if (single_filter) {
+        return ((frame ^ acceptance_code) & care) == 0;
+    }
+
+    // Dual filter: filter 1 compares the high half-word, filter 2 the low one
+    uint32_t f1_bits = is_extended ? 0xFFFF0000 : 0xFFF00000;
+    uint32_t f2_bits = is_extended ? 0x0000FFFF : 0x0000FFF0;
+    bool f1 = ((frame ^ acceptance_code) & care & f1_bits) == 0;
+    bool f2 = (((frame >> 16) ^ acceptance_code) & care & f2_bits) == 0;
+    return f1 || f2;
+}
+
+void CANFilter::describe(char* buffer, size_t size) const {
+    if (!buffer || size == 0) return;
+
+    if (acceptsAll()) {
+        snprintf(buffer, size, "accept-all");
+        return;
+    }
+
+    snprintf(buffer, size, "%s%s 0x%08X/0x%08X (%u IDs)",
+             single_filter ? "single" : "dual",
+             extended ? " ext" : "",
+             acceptance_code, acceptance_mask, accepted_ids);
+}
+
+CANFilter CANFilter::acceptAll() {
+    return CANFilter();
+}
+
+CANFilter CANFilter::fromIdMask(uint32_t id, uint32_t mask, bool extended) {
+    CANFilter f;
+    f.single_filter = true;
+    f.extended = extended;
+
+    // RTR is always compared: only data frames are of interest
+    if (extended) {
+        uint32_t dont_care = ~mask & EXT_ID_MASK;
+        f.acceptance_code = ((id & ~dont_care) & EXT_ID_MASK) << 3;
+        f.acceptance_mask = (dont_care << 3) | EXT_SINGLE_UNUSED;
+        f.accepted_ids = dont_care == EXT_ID_MASK ? 0 : (1UL << __builtin_popcount(dont_care));
+    } else {
+        uint32_t dont_care = ~mask & STD_ID_MASK;
+        f.acceptance_code = ((id & ~dont_care) & STD_ID_MASK) << 21;
+        f.acceptance_mask = (dont_care << 21) | STD_SINGLE_UNUSED;
+        f.accepted_ids = 1UL << __builtin_popcount(dont_care);
+    }
+
+    return f;
+}
+
+CANFilter CANFilter::forIds(const uint32_t* ids, size_t count) {
+    return forIds(ids, nullptr, count);
+}
+
+CANFilter CANFilter::forIds(const uint32_t* ids, const bool* extended, size_t count) {
+    if (!ids || count == 0) {
+        return acceptAll();
+    }
+
+    // Frame formats can't be mixed within one filter configuration
+    bool ext = extended ? extended[0] : false;
+    for (size_t i = 1; i < count; i++) {
+        if ((extended ? extended[i] : false) != ext) {
+            return acceptAll();
+        }
+    }
+
+    // Sorted, de-duplicated working copy
+    uint32_t id_mask = ext ? EXT_ID_MASK : STD_ID_MASK;
+    uint32_t sorted[MAX_FILTER_IDS];
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (n >= MAX_FILTER_IDS) {
+            return acceptAll();
+        }
+
+        uint32_t id = ids[i] & id_mask;
+        size_t pos = n;
+        while (pos > 0 && sorted[pos - 1] > id) {
+            pos--;
+        }
+        if (pos > 0 && sorted[pos - 1] == id) {
+            continue;
+        }
+        memmove(&sorted[pos + 1], &sorted[pos], (n - pos) * sizeof(uint32_t));
+        sorted[pos] = id;
+        n++;
+    }
+
+    IdCube single = coverIds(sorted, n, id_mask);
+
+    if (ext) {
+        return fromIdMask(single.code, ~single.dont_care, true);
+    }
+
+    CANFilter best = fromIdMask(single.code, ~single.dont_care, false);
+    if (n < 2) {
+        return best;
+    }
+
+    // Dual filter: try splitting on each ID bit and at each point of the
+    // sorted list, keep whichever pair of cubes passes the fewest IDs
+    uint32_t best_size = single.size();
+    IdCube best_a = single, best_b = single;
+    bool use_dual = false;
+
+    uint32_t part_a[MAX_FILTER_IDS];
+    uint32_t part_b[MAX_FILTER_IDS];
+
+    auto tryPartition = [&](size_t na, size_t nb) {
+        if (na == 0 || nb == 0) return;
+        IdCube a = coverIds(part_a, na, id_mask);
+        IdCube b = coverIds(part_b, nb, id_mask);
+        uint32_t size = unionSize(a, b);
+        if (size < best_size) {
+            best_size = size;
+            best_a = a;
+            best_b = b;
+            use_dual = true;
+        }
+    };
+
+    for (uint8_t bit = 0; bit < 11; bit++) {
+        size_t na = 0, nb = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (sorted[i] & (1UL << bit)) {
+                part_a[na++] = sorted[i];
+            } else {
+                part_b[nb++] = sorted[i];
+            }
+        }
+        tryPartition(na, nb);
+    }
+
+    for (size_t split = 1; split < n; split++) {
+        memcpy(part_a, sorted, split * sizeof(uint32_t));
+        memcpy(part_b, sorted + split, (n - split) * sizeof(uint32_t));
+        tryPartition(split, n - split);
+    }
+
+    if (use_dual) {
+        best.single_filter = false;
+        best.acceptance_code = (best_a.code << 21) | (best_b.code << 5);
+        best.acceptance_mask = (best_a.dont_care << 21) | (best_b.dont_care << 5) | STD_DUAL_UNUSED;
+        best.accepted_ids = best_size;
+    }
+
+    return best;
+}
@@ -0,0 +1,43 @@
+#ifndef CAN_FILTER_H
+#define CAN_FILTER_H
+
+#include <Arduino.h>
+
+// TWAI hardware acceptance filter settings
+//
+// Stored in the controller's native layout: acceptance_mask bits set to 1 are
+// "don't care". For standard frames in single-filter mode the 11-bit ID sits at
+// bits 31:21 and RTR at bit 20; in dual-filter mode filter 1 holds its ID at
+// bits 31:21 and filter 2 at bits 15:5. Extended frames use bits 31:3 (single
+// filter only - dual mode can only compare the upper 16 ID bits).
+struct CANFilter {
+    uint32_t acceptance_code;
+    uint32_t acceptance_mask;
+    bool single_filter;
+    bool extended;
+    uint32_t accepted_ids;      // Number of IDs the hardware lets through (0 = all)
+
+    CANFilter() : acceptance_code(0), acceptance_mask(0xFFFFFFFF), single_filter(true),
+                  extended(false), accepted_ids(0) {}
+
+    bool acceptsAll() const { return acceptance_mask == 0xFFFFFFFF; }
+
+    // Software model of the hardware comparison (for diagnostics/validation)
+    bool accepts(uint32_t id, bool is_extended, bool rtr = false) const;
+
+    // Printable summary, e.g. "dual 0x20000000/0x001F001F (16 IDs)"
+    void describe(char* buffer, size_t size) const;
+
+    // Factories
+    static CANFilter acceptAll();
+
+    // Single ID/mask pair; mask bits set to 1 must match (conventional sense)
+    static CANFilter fromIdMask(uint32_t id, uint32_t mask, bool extended);
+
+    // Tightest single or dual filter that passes every ID in the list.
+    // Mixed standard/extended lists, or an empty list, fall back to accept-all.
+    static CANFilter forIds(const uint32_t* ids, const bool* extended, size_t count);
+    static CANFilter forIds(const uint32_t* ids, size_t count);
+};
+
+#endif // CAN_FILTER_H
@@ -0,0 +1,228 @@
+#ifndef CAN_FRAME_BUS_H
+#define CAN_FRAME_BUS_H
+
+#include <Arduino.h>
+#include "can_message.h"
+#include "../utils/remote_log.h"
+
+// What to do with a new frame when a consumer's queue is full
+enum class FrameDropPolicy : uint8_t {
+    DROP_NEWEST,    // Keep the backlog, discard the incoming frame
+    DROP_OLDEST     // Discard the oldest queued frame to make room
+};
+
+// Per-consumer counters
+struct FrameConsumerStats {
+    uint32_t delivered;     // Frames accepted into the queue
+    uint32_t dropped;       // Frames lost to the drop policy
+    uint32_t processed;     // Frames handed to the handler
+    uint32_t high_water;    // Deepest queue backlog seen
+
+    FrameConsumerStats() : delivered(0), dropped(0), processed(0), high_water(0) {}
+};
+
+// Publish/subscribe fan-out of CAN frames (raw CANFrame or decoded records).
+//
+// The producer only calls publish(), which copies the item into every
+// consumer's bounded FreeRTOS queue without blocking. Each consumer drains its
+// queue in its own task, so a slow consumer (e.g. an MQTT write) only ever
+// drops its own items instead of stalling the producer.
+template<typename T>
+class FrameBus {
+public:
+    typedef void (*FrameHandler)(const T& item);
+
+    static constexpr size_t MAX_CONSUMERS = 6;
+
+    FrameBus() : consumer_count(0) {
+        for (size_t i = 0; i < MAX_CONSUMERS; i++) {
+            consumers[i].name = nullptr;
+            consumers[i].handler = nullptr;
+            consumers[i].queue = nullptr;
+            consumers[i].task = nullptr;
+            consumers[i].depth = 0;
+            consumers[i].policy = FrameDropPolicy::DROP_NEWEST;
+            consumers[i].enabled = false;
+        }
+    }
+
+    // Register a consumer and start its task (priority/core/stack apply to
+    // that task). Subscribe during setup; consumers cannot be removed.
+    // Returns the consumer index, or -1 on failure.
+    int subscribe(const char* name, FrameHandler handler, size_t queue_depth,
+                  FrameDropPolicy policy = FrameDropPolicy::DROP_NEWEST,
+                  UBaseType_t priority = 1, BaseType_t core = 1,
+                  uint32_t stack_size = 4096) {
+        if (handler == nullptr || queue_depth == 0) {
+            LOG_ERROR("FrameBus: Invalid consumer '%s'", name ? name : "?");
+            return -1;
+        }
+
+        if (consumer_count >= MAX_CONSUMERS) {
+            LOG_ERROR("FrameBus: Too many consumers, '%s' not registered", name);
+            return -1;
+        }
+
+        size_t index = consumer_count;
+        Consumer& c = consumers[index];
+        c.name = name;
+        c.handler = handler;
+        c.depth = queue_depth;
+        c.policy = policy;
+        c.enabled = true;
+        c.stats = FrameConsumerStats();
+
+        c.queue = xQueueCreate(queue_depth, sizeof(T));
+        if (c.queue == nullptr) {
+            LOG_ERROR("FrameBus: Failed to allocate %u-item queue for '%s'",
+                      (unsigned)queue_depth, name);
+            return -1;
+        }
+
+        char task_name[16];
+        snprintf(task_name, sizeof(task_name), "CAN %s", name);
+        if (xTaskCreatePinnedToCore(consumerTaskFunc, task_name, stack_size, &c,
+                                    priority, &c.task, core) != pdPASS) {
+            LOG_ERROR("FrameBus: Failed to start task for '%s'", name);
+            vQueueDelete(c.queue);
+            c.queue = nullptr;
+            return -1;
+        }
+
+        // Publish the slot only once it is complete
+        consumer_count = index + 1;
+
+        LOG_INFO("FrameBus: Consumer '%s' registered (queue %u, %s, prio %u)",
+                 name, (unsigned)queue_depth,
+                 policy == FrameDropPolicy::DROP_OLDEST ? "drop-oldest" : "drop-newest",
+                 (unsigned)priority);
+        return static_cast<int>(index);
+    }
+
+    // Pause/resume delivery to a consumer without tearing down its task
+    void setEnabled(int index, bool enabled) {
+        if (index < 0 || static_cast<size_t>(index) >= consumer_count) {
+            return;
+        }
+        consumers[index].enabled = enabled;
+    }
+
+    // Producer side: never blocks
+    void publish(const T& item) {
+        size_t count = consumer_count;
+
+        for (size_t i = 0; i < count; i++) {
+            Consumer& c = consumers[i];
+            if (!c.enabled) {
+                continue;
+            }
+
+            if (xQueueSend(c.queue, &item, 0) != pdTRUE) {
+                c.stats.dropped++;
+
+                if (c.policy == FrameDropPolicy::DROP_NEWEST) {
+                    continue;
+                }
+
+                // Make room by discarding the oldest item, then retry once
+                T discarded;
+                xQueueReceive(c.queue, &discarded, 0);
+                if (xQueueSend(c.queue, &item, 0) != pdTRUE) {
+                    continue;
+                }
+            }
+
+            c.stats.delivered++;
+
+            uint32_t waiting = uxQueueMessagesWaiting(c.queue);
+            if (waiting > c.stats.high_water) {
+                c.stats.high_water = waiting;
+            }
+        }
+    }
+
+    // Statistics
+    size_t getConsumerCount() const { return consumer_count; }
+
+    const char* getConsumerName(size_t index) const {
+        return index < consumer_count ? consumers[index].name : nullptr;
+    }
+
+    FrameConsumerStats getConsumerStats(size_t index) const {
+        return index < consumer_count ? consumers[index].stats : FrameConsumerStats();
+    }
+
+    size_t getConsumerCapacity(size_t index) const {
+        return index < consumer_count ? consumers[index].depth : 0;
+    }
+
+    // Items currently queued for a consumer
+    uint32_t getConsumerLag(size_t index) const {
+        if (index >= consumer_count || consumers[index].queue == nullptr) {
+            return 0;
+        }
+        return uxQueueMessagesWaiting(consumers[index].queue);
+    }
+
+    void resetStats() {
+        for (size_t i = 0; i < consumer_count; i++) {
+            consumers[i].stats = FrameConsumerStats();
+        }
+    }
+
+    // Append one line per consumer; returns characters written
+    size_t getDiagnostics(char* buffer, size_t size) const {
+        if (!buffer || size == 0) return 0;
+
+        size_t len = 0;
+        buffer[0] = '\0';
+
+        for (size_t i = 0; i < consumer_count && len < size; i++) {
+            const Consumer& c = consumers[i];
+            int n = snprintf(buffer + len, size - len,
+                "  %-8s lag %u/%u  peak %u  delivered %u  dropped %u%s\n",
+                c.name,
+                (unsigned)getConsumerLag(i), (unsigned)c.depth,
+                c.stats.high_water, c.stats.delivered, c.stats.dropped,
+                c.enabled ? "" : "  (paused)");
+            if (n < 0) break;
+            len += static_cast<size_t>(n);
+        }
+
+        return len < size ? len : size - 1;
+    }
+
+private:
+    struct Consumer {
+        const char* name;
+        FrameHandler handler;
+        QueueHandle_t queue;
+        TaskHandle_t task;
+        size_t depth;
+        FrameDropPolicy policy;
+        volatile bool enabled;
+        FrameConsumerStats stats;
+    };
+
+    Consumer consumers[MAX_CONSUMERS];
+    volatile size_t consumer_count;   // Bumped only once a slot is fully set up
+
+    static void consumerTaskFunc(void* parameter) {
+        Consumer* c = static_cast<Consumer*>(parameter);
+        T item;
+
+        LOG_INFO("FrameBus: '%s' task started", c->name);
+
+        while (true) {
+            if (xQueueReceive(c->queue, &item, portMAX_DELAY) == pdTRUE) {
+                c->handler(item);
+                c->stats.processed++;
+            }
+        }
+    }
+};
+
+// Raw frames, published by the CAN RX task
+using CANFrameBus = FrameBus<CANFrame>;
+
+#endif // CAN_FRAME_BUS_H
@@ -0,0 +1,453 @@
+#include "can_load_test.h"
+#include "../utils/remote_log.h"
+
+static constexpr uint16_t DEFAULT_WEIGHT = 1;       // Messages without a period
+static constexpr uint32_t MAX_STEP_MS = 60000;      // Keeps micros() deltas far from wrapping
+
+// Write a field's raw value the way Field::extractValue() reads it back
+static void encodeField(const Protocol::Field& field, float value, uint8_t* data) {
+    if (field.byte_offset + field.length > 8) {
+        return;
+    }
+
+    uint8_t* p = data + field.byte_offset;
+    if (field.data_type == Protocol::DataType::FLOAT_LE ||
+        field.data_type == Protocol::DataType::FLOAT_BE) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        for (uint8_t i = 0; i < 4; i++) {
+            uint8_t byte = static_cast<uint8_t>(bits >> (8 * i));
+            p[field.data_type == Protocol::DataType::FLOAT_LE ? i : 3 - i] = byte;
+        }
+        return;
+    }
+
+    float scaled = field.scale != 0 ? (value - field.offset) / field.scale : 0;
+    uint32_t raw = static_cast<uint32_t>(static_cast<int32_t>(lroundf(scaled)));
+    bool big_endian = false;
+    uint8_t length = 0;
+    switch (field.data_type) {
+        case Protocol::DataType::UINT8:
+        case Protocol::DataType::INT8:
+            length = 1;
+            break;
+        case Protocol::DataType::UINT16_LE:
+        case Protocol::DataType::INT16_LE:
+            length = 2;
+            break;
+        case Protocol::DataType::UINT16_BE:
+        case Protocol::DataType::INT16_BE:
+            length = 2;
+            big_endian = true;
+            break;
+        case Protocol::DataType::UINT32_LE:
+        case Protocol::DataType::INT32_LE:
+            length = 4;
+            break;
+        case Protocol::DataType::UINT32_BE:
+        case Protocol::DataType::INT32_BE:
+            length = 4;
+            big_endian = true;
+            break;
+        default:
+            return;
+    }
+    for (uint8_t i = 0; i < length; i++) {
+        p[big_endian ? length - 1 - i : i] = static_cast<uint8_t>(raw >> (8 * i));
+    }
+}
+
+// Least significant byte of a field, the one a changing value moves first
+static uint8_t lowByte(const Protocol::Field& field) {
+    switch (field.data_type) {
+        case Protocol::DataType::UINT16_BE:
+        case Protocol::DataType::INT16_BE:
+        case Protocol::DataType::UINT32_BE:
+        case Protocol::DataType::INT32_BE:
+        case Protocol::DataType::FLOAT_BE:
+            return field.byte_offset + field.length - 1;
+        default:
+            return field.byte_offset;
+    }
+}
+
+CANLoadTest::CANLoadTest()
+    : stage_count_(0),
+      stop_pending_(false),
+      total_weight_(0),
+      rng_(1),
+      sequence_(0),
+      phase_(Phase::IDLE),
+      loopback_(false),
+      aborted_(false),
+      armed_(false),
+      step_(0),
+      phase_start_ms_(0),
+      step_start_us_(0),
+      step_ms_(0),
+      generated_(0),
+      lagged_(0),
+      parsed_start_(0),
+      steps_done_(0),
+      mux_(portMUX_INITIALIZER_UNLOCKED) {
+    memset(stages_, 0, sizeof(stages_));
+    memset(drops_start_, 0, sizeof(drops_start_));
+    memset(latency_start_, 0, sizeof(latency_start_));
+    memset(results_, 0, sizeof(results_));
+}
+
+bool CANLoadTest::addStage(const char* name, StageCounter counter) {
+    if (stage_count_ >= MAX_STAGES || counter == nullptr) {
+        return false;
+    }
+    stages_[stage_count_].name = name;
+    stages_[stage_count_].counter = counter;
+    stage_count_++;
+    return true;
+}
+
+size_t CANLoadTest::addTemplates(const Protocol::Definition& protocol, int32_t id_offset,
+                                 Template* out, size_t count, size_t max) {
+    for (uint8_t m = 0; m < protocol.message_count && count < max; m++) {
+        const Protocol::Message& message = protocol.messages[m];
+        uint32_t bus_id = message.can_id + id_offset;
+
+        // An ID shared by two routes belongs to the first, as in the router
+        bool taken = false;
+        for (size_t i = 0; i < count; i++) {
+            if (out[i].id == bus_id) {
+                taken = true;
+                break;
+            }
+        }
+        if (taken) {
+            continue;
+        }
+
+        Template& t = out[count];
+        memset(&t, 0, sizeof(t));
+        t.id = bus_id;
+        t.extended = bus_id > 0x7FF;
+        t.weight = DEFAULT_WEIGHT;
+        if (message.period_ms > 0 && message.period_ms < 10000) {
+            t.weight = 10000 / message.period_ms;       // Frames per 10 s
+        }
+
+        // Mid-range values keep the decoded pack plausible (no alarms)
+        uint8_t dlc = message.field_count > 0 ? 1 : 8;
+        for (uint8_t f = 0; f < message.field_count; f++) {
+            const Protocol::Field& field = message.fields[f];
+            float value = field.offset;
+            if (field.has_min && field.has_max) {
+                value = (field.min_value + field.max_value) / 2;
+            } else if (field.has_min) {
+                value = field.min_value;
+            } else if (field.has_max) {
+                value = field.max_value;
+            }
+            encodeField(field, value, t.data);
+
+            uint8_t end = field.byte_offset + field.length;
+            if (end > dlc) {
+                dlc = end > 8 ? 8 : end;
+            }
+        }
+        t.dlc = dlc;
+        if (message.field_count > 0) {
+            t.vary_byte = lowByte(message.fields[0]);
+        }
+        if (t.vary_byte >= dlc) {
+            t.vary_byte = 0;
+        }
+        count++;
+    }
+    return count;
+}
+
+bool CANLoadTest::start(const Config& config) {
+    if (config.step_count == 0 || config.step_count > MAX_STEPS ||
+        config.template_count > MAX_TEMPLATES || config.foreign_pct > 100 ||
+        config.step_ms == 0 || config.step_ms > MAX_STEP_MS) {
+        return false;
+    }
+    if (config.template_count == 0 && config.foreign_pct < 100) {
+        return false;
+    }
+    if (config.loopback && config.template_count > 0) {
+        return false;   // Would put BMS-looking frames on the real bus
+    }
+    for (uint8_t i = 0; i < config.step_count; i++) {
+        if (config.rates[i] == 0 || config.rates[i] > CAN_LOADTEST_MAX_RATE) {
+            return false;
+        }
+    }
+
+    bool ok = false;
+    portENTER_CRITICAL(&mux_);
+    if (phase_ == Phase::IDLE) {
+        config_ = config;
+        steps_done_ = 0;
+        aborted_ = false;
+        stop_pending_ = false;
+        phase_ = Phase::ARMING;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&mux_);
+
+    if (ok) {
+        LOG_INFO("[LoadTest] Starting %u step(s) of %u ms, %u template(s), %u%% foreign%s",
+                 config.step_count, config.step_ms, config.template_count, config.foreign_pct,
+                 config.loopback ? ", loopback" : "");
+    }
+    return ok;
+}
+
+void CANLoadTest::stop() {
+    portENTER_CRITICAL(&mux_);
+    if (phase_ != Phase::IDLE) {
+        stop_pending_ = true;
+    }
+    portEXIT_CRITICAL(&mux_);
+}
+
+bool CANLoadTest::isActive() const {
+    portENTER_CRITICAL(&mux_);
+    bool active = phase_ != Phase::IDLE;
+    portEXIT_CRITICAL(&mux_);
+    return active;
+}
+
+void CANLoadTest::getStatus(Status& out) const {
+    portENTER_CRITICAL(&mux_);
+    out.phase = phase_;
+    out.loopback = config_.loopback;
+    out.aborted = aborted_;
+    out.step = step_;
+    out.step_count = config_.step_count;
+    out.steps_done = steps_done_;
+    out.step_ms = config_.step_ms;
+    out.template_count = config_.template_count;
+    out.foreign_pct = config_.foreign_pct;
+    portEXIT_CRITICAL(&mux_);
+}
+
+bool CANLoadTest::getResult(uint8_t step, StepResult& out) const {
+    portENTER_CRITICAL(&mux_);
+    bool ok = step < steps_done_;
+    if (ok) {
+        out = results_[step];
+    }
+    portEXIT_CRITICAL(&mux_);
+    return ok;
+}
+
+bool CANLoadTest::poll(uint32_t now_ms) {
+    portENTER_CRITICAL(&mux_);
+    Phase phase = phase_;
+    bool stop = stop_pending_;
+    stop_pending_ = false;
+    portEXIT_CRITICAL(&mux_);
+
+    if (phase == Phase::IDLE) {
+        return false;
+    }
+    if (stop) {
+        endRun(true);
+        return false;
+    }
+
+    switch (phase) {
+        case Phase::ARMING:
+            // One pass for the driver to switch modes before the clock starts
+            if (!armed_) {
+                beginRun();
+                return false;
+            }
+            beginStep(now_ms);
+            return true;
+
+        case Phase::GENERATING:
+            if (now_ms - phase_start_ms_ < config_.step_ms) {
+                return true;
+            }
+            step_ms_ = now_ms - phase_start_ms_;
+            portENTER_CRITICAL(&mux_);
+            phase_ = Phase::SETTLING;
+            portEXIT_CRITICAL(&mux_);
+            phase_start_ms_ = now_ms;
+            return false;
+
+        case Phase::SETTLING:
+            if (now_ms - phase_start_ms_ < CAN_LOADTEST_SETTLE_MS) {
+                return false;
+            }
+            finishStep();
+            if (step_ + 1 < config_.step_count) {
+                portENTER_CRITICAL(&mux_);
+                step_++;
+                portEXIT_CRITICAL(&mux_);
+                beginStep(now_ms);
+                return true;
+            }
+            endRun(false);
+            return false;
+
+        default:
+            return false;
+    }
+}
+
+uint32_t CANLoadTest::due(uint32_t now_us) {
+    if (phase_ != Phase::GENERATING) {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(now_us - step_start_us_) * config_.rates[step_] / 1000000;
+    uint64_t done = static_cast<uint64_t>(generated_) + lagged_;
+    if (target <= done) {
+        return 0;
+    }
+
+    // Don't sprint to catch up after a stall; the shortfall is reported
+    uint64_t owed = target - done;
+    if (owed > CAN_LOADTEST_BURST) {
+        lagged_ += static_cast<uint32_t>(owed - CAN_LOADTEST_BURST);
+        owed = CAN_LOADTEST_BURST;
+    }
+    return static_cast<uint32_t>(owed);
+}
+
+void CANLoadTest::next(CANFrame& frame) {
+    uint32_t r = nextRandom();
+    uint32_t sequence = sequence_++;
+
+    if (config_.template_count == 0 || r % 100 < config_.foreign_pct) {
+        uint8_t payload[8];
+        for (uint8_t i = 0; i < 8; i++) {
+            payload[i] = static_cast<uint8_t>(sequence >> (8 * (i & 3)));
+        }
+        frame = CANFrame::make(CAN_LOADTEST_FOREIGN_ID + (sequence & (FOREIGN_IDS - 1)), false, false, 8,
+                               payload, CANFrame::now());
+        return;
+    }
+
+    uint32_t pick = (r >> 8) % total_weight_;
+    uint8_t i = 0;
+    while (i + 1 < config_.template_count && pick >= config_.templates[i].weight) {
+        pick -= config_.templates[i].weight;
+        i++;
+    }
+
+    // Every frame of an ID differs from the one before it
+    Template& t = config_.templates[i];
+    t.data[t.vary_byte] ^= 0x01;
+    frame = CANFrame::make(t.id, t.extended, false, t.dlc, t.data, CANFrame::now());
+}
+
+void CANLoadTest::sent(uint32_t count) {
+    generated_ += count;
+}
+
+void CANLoadTest::skip(uint32_t count) {
+    lagged_ += count;
+}
+
+void CANLoadTest::beginRun() {
+    total_weight_ = 0;
+    for (uint8_t i = 0; i < config_.template_count; i++) {
+        total_weight_ += config_.templates[i].weight;
+    }
+    if (total_weight_ == 0) {
+        total_weight_ = 1;
+    }
+    rng_ = micros() | 1;
+    sequence_ = 0;
+    loopback_ = config_.loopback;
+    armed_ = true;
+
+    portENTER_CRITICAL(&mux_);
+    step_ = 0;
+    portEXIT_CRITICAL(&mux_);
+}
+
+void CANLoadTest::beginStep(uint32_t now_ms) {
+    generated_ = 0;
+    lagged_ = 0;
+    for (uint8_t i = 0; i < stage_count_; i++) {
+        drops_start_[i] = stages_[i].counter();
+    }
+    parsed_start_ = perfMonitor.latency(PerfMonitor::Latency::PARSE).count();
+    for (size_t k = 0; k < LATENCY_KINDS; k++) {
+        perfMonitor.latency(static_cast<PerfMonitor::Latency>(k)).copyBuckets(latency_start_[k]);
+    }
+
+    phase_start_ms_ = now_ms;
+    step_start_us_ = micros();
+    portENTER_CRITICAL(&mux_);
+    phase_ = Phase::GENERATING;
+    portEXIT_CRITICAL(&mux_);
+}
+
+void CANLoadTest::finishStep() {
+    StepResult result;
+    memset(&result, 0, sizeof(result));
+    result.rate = config_.rates[step_];
+    result.duration_ms = step_ms_;
+    result.generated = generated_;
+    result.lagged = lagged_;
+    result.parsed = perfMonitor.latency(PerfMonitor::Latency::PARSE).count() - parsed_start_;
+    if (step_ms_ > 0) {
+        result.generated_fps = result.generated * 1000.0f / step_ms_;
+        result.parsed_fps = result.parsed * 1000.0f / step_ms_;
+    }
+
+    uint32_t dropped = 0;
+    for (uint8_t i = 0; i < stage_count_; i++) {
+        result.drops[i] = stages_[i].counter() - drops_start_[i];
+        dropped += result.drops[i];
+    }
+
+    // Only what was recorded during this step and its settle time
+    for (size_t k = 0; k < LATENCY_KINDS; k++) {
+        const PerfMonitor::Histogram& histogram = perfMonitor.latency(static_cast<PerfMonitor::Latency>(k));
+        uint32_t buckets[PerfMonitor::LATENCY_BUCKETS];
+        histogram.copyBuckets(buckets);
+        for (uint8_t b = 0; b < PerfMonitor::LATENCY_BUCKETS; b++) {
+            buckets[b] -= latency_start_[k][b];
+            result.latency_count[k] += buckets[b];
+        }
+        result.p50_us[k] = PerfMonitor::Histogram::percentileUs(buckets, 0.50f, histogram.maxUs());
+        result.p90_us[k] = PerfMonitor::Histogram::percentileUs(buckets, 0.90f, histogram.maxUs());
+        result.p99_us[k] = PerfMonitor::Histogram::percentileUs(buckets, 0.99f, histogram.maxUs());
+    }
+
+    portENTER_CRITICAL(&mux_);
+    results_[step_] = result;
+    steps_done_ = step_ + 1;
+    portEXIT_CRITICAL(&mux_);
+
+    LOG_INFO("[LoadTest] Step %u: %u fps requested, %.0f generated, %.0f parsed, %u lagged, %u dropped",
+             step_ + 1, result.rate, result.generated_fps, result.parsed_fps, result.lagged, dropped);
+}
+
+void CANLoadTest::endRun(bool aborted) {
+    loopback_ = false;
+    armed_ = false;
+
+    portENTER_CRITICAL(&mux_);
+    phase_ = Phase::IDLE;
+    aborted_ = aborted;
+    uint8_t done = steps_done_;
+    portEXIT_CRITICAL(&mux_);
+
+    LOG_INFO("[LoadTest] %s after %u of %u step(s)", aborted ? "Stopped" : "Finished",
+             done, config_.step_count);
+}
+
+// xorshift32: cheap and good enough to shuffle the ID mix
+uint32_t CANLoadTest::nextRandom() {
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 17;
+    rng_ ^= rng_ << 5;
+    return rng_;
+}
@@ -0,0 +1,190 @@
+#ifndef CAN_LOAD_TEST_H
+#define CAN_LOAD_TEST_H
+
+#include <Arduino.h>
+#include "can_message.h"
+#include "protocol.h"
+#include "../config/config.h"
+#include "../utils/perf_monitor.h"
+
+// Synthetic traffic for end-to-end load tests of the receive pipeline.
+//
+// A run is a list of rate steps. During each step the RX task generates
+// frames at the requested rate from a set of templates: one per protocol
+// message of every battery route (bus ID, DLC from the field layout,
+// mid-range field values), weighted by the message's period_ms so the mix
+// resembles a live bus, plus an optional share of unknown IDs. Each frame
+// flips one payload bit so the parser cache always misses.
+//
+//   - Injected (default): frames enter the driver right after twai_receive,
+//     so they take the real path through the RX ring, analyzer, frame bus,
+//     CAN task and every consumer. The bus is not touched.
+//   - Loopback: the driver is reinstalled in TWAI self-test (no ACK) mode
+//     with accept-all, and frames are transmitted with self reception, so
+//     the controller and driver queues are included too. The frames DO go
+//     out on the bus, so they only use the foreign IDs (never protocol
+//     templates, which would look like BMS traffic);
+//     CANRouter::prepareLoadTest() refuses the run if a route uses one. The
+//     TX scheduler is held until the run ends, and frames queued meanwhile
+//     expire as usual.
+//
+// After each step the generator pauses for CAN_LOADTEST_SETTLE_MS so queued
+// frames drain, then the step's figures are recorded: achieved and parsed
+// frames/s, the growth of every registered drop counter, and latency
+// percentiles from the PerfMonitor histograms over the step. A stage only
+// sees traffic while its output is active (WebSocket client, CAN logging,
+// MQTT CAN frames); millisecond frame timestamps make latencies coarse
+// unless CAN_FRAME_TIMESTAMP_US is set.
+//
+// While a run is active the CAN task still decodes every frame but applies
+// none to the packs (bus traffic included), so pack values, the statistics
+// checkpointed to NVS and the history keep their pre-test state. Analytics,
+// the CAN log and MQTT CAN frames do see the synthetic traffic.
+class CANLoadTest {
+public:
+    static constexpr size_t MAX_STEPS = CAN_LOADTEST_MAX_STEPS;
+    static constexpr size_t MAX_TEMPLATES = CAN_LOADTEST_MAX_TEMPLATES;
+    static constexpr size_t MAX_STAGES = CAN_LOADTEST_MAX_STAGES;
+    static constexpr size_t LATENCY_KINDS = static_cast<size_t>(PerfMonitor::Latency::COUNT);
+    static constexpr uint32_t FOREIGN_IDS = 16;     // From CAN_LOADTEST_FOREIGN_ID (power of two)
+
+    // Reads a monotonically growing drop count (any task's counter)
+    typedef uint32_t (*StageCounter)();
+
+    struct Template {
+        uint32_t id;
+        bool extended;
+        uint8_t dlc;
+        uint8_t vary_byte;          // Byte whose low bit changes per frame
+        uint16_t weight;            // Relative share of the mix
+        uint8_t data[8];
+    };
+
+    struct Config {
+        uint32_t rates[MAX_STEPS];  // Frames/s per step
+        uint8_t step_count;
+        uint32_t step_ms;
+        uint8_t foreign_pct;        // Share of frames with IDs outside the templates
+        bool loopback;              // TWAI self-test instead of injection
+        Template templates[MAX_TEMPLATES];
+        uint8_t template_count;
+
+        Config() : step_count(0), step_ms(CAN_LOADTEST_STEP_MS), foreign_pct(0),
+                   loopback(false), template_count(0) {
+            memset(rates, 0, sizeof(rates));
+        }
+    };
+
+    struct StepResult {
+        uint32_t rate;              // Requested frames/s
+        uint32_t duration_ms;       // Generation time
+        uint32_t generated;         // Frames injected / transmitted
+        uint32_t lagged;            // Frames the generator fell behind on
+        uint32_t parsed;            // Frames through the CAN task (includes bus traffic)
+        float generated_fps;
+        float parsed_fps;
+        uint32_t drops[MAX_STAGES];
+        uint32_t latency_count[LATENCY_KINDS];
+        uint32_t p50_us[LATENCY_KINDS];
+        uint32_t p90_us[LATENCY_KINDS];
+        uint32_t p99_us[LATENCY_KINDS];
+    };
+
+    enum class Phase : uint8_t {
+        IDLE,
+        ARMING,                     // Accepted, waiting for the RX task
+        GENERATING,
+        SETTLING
+    };
+
+    struct Status {
+        Phase phase;
+        bool loopback;
+        bool aborted;               // Last run stopped before its final step
+        uint8_t step;               // Current step (GENERATING/SETTLING)
+        uint8_t step_count;
+        uint8_t steps_done;         // Results available
+        uint32_t step_ms;
+        uint8_t template_count;
+        uint8_t foreign_pct;
+    };
+
+    CANLoadTest();
+
+    // Drop counters reported for each step, during setup (not thread-safe)
+    bool addStage(const char* name, StageCounter counter);
+    size_t getStageCount() const { return stage_count_; }
+    const char* getStageName(size_t index) const {
+        return index < stage_count_ ? stages_[index].name : nullptr;
+    }
+
+    // Append templates for one protocol whose lowest ID is moved by
+    // id_offset; returns the new template count
+    static size_t addTemplates(const Protocol::Definition& protocol, int32_t id_offset,
+                               Template* out, size_t count, size_t max);
+
+    // Any task. start() is refused while a run is active or if the config
+    // has no steps, a rate above CAN_LOADTEST_MAX_RATE, no templates with
+    // foreign_pct under 100, or templates in loopback mode
+    bool start(const Config& config);
+    void stop();
+    bool isActive() const;
+    void getStatus(Status& out) const;
+    bool getResult(uint8_t step, StepResult& out) const;
+
+    // RX task: advance the run; true while frames are being generated
+    bool poll(uint32_t now_ms);
+    bool loopbackWanted() const { return loopback_; }
+
+    // RX task, during GENERATING: frames owed now (at most
+    // CAN_LOADTEST_BURST; anything further behind counts as lagged)
+    uint32_t due(uint32_t now_us);
+    void next(CANFrame& frame);
+    void sent(uint32_t count);      // Frames from next() that went into the pipeline
+    void skip(uint32_t count);      // Owed frames that could not be sent
+
+private:
+    struct Stage {
+        const char* name;
+        StageCounter counter;
+    };
+
+    Stage stages_[MAX_STAGES];
+    uint8_t stage_count_;
+
+    // Written by start() while IDLE, then read by the RX task only
+    Config config_;
+    bool stop_pending_;
+
+    // RX task only while a run is active
+    uint32_t total_weight_;
+    uint32_t rng_;
+    uint32_t sequence_;
+
+    Phase phase_;
+    bool loopback_;
+    bool aborted_;
+    bool armed_;                    // beginRun() done, first step not started
+    uint8_t step_;
+    uint32_t phase_start_ms_;
+    uint32_t step_start_us_;
+    uint32_t step_ms_;              // Generation time of the current step
+    uint32_t generated_;
+    uint32_t lagged_;
+    uint32_t parsed_start_;
+    uint32_t drops_start_[MAX_STAGES];
+    uint32_t latency_start_[LATENCY_KINDS][PerfMonitor::LATENCY_BUCKETS];
+
+    StepResult results_[MAX_STEPS];
+    uint8_t steps_done_;
+
+    mutable portMUX_TYPE mux_;
+
+    void beginRun();
+    void beginStep(uint32_t now_ms);
+    void finishStep();
+    void endRun(bool aborted);
+    uint32_t nextRandom();
+};
+
+#endif // CAN_LOAD_TEST_H
@@ -0,0 +1,213 @@
+#include "can_log_codec.h"
+#include <string.h>
+
+namespace CANLogCodec {
+
+using CANLogFormat::Record;
+
+static constexpr uint8_t TAG_SAME = 0x20;
+static constexpr uint8_t TAG_ENTRY_MASK = 0x1F;
+static constexpr uint8_t TAG_NEW = 0x80;
+static constexpr uint8_t TAG_ANCHOR = 0x81;
+
+// Worst case for one record: tag + delta + id_flags + DLC + data
+static constexpr size_t MAX_RECORD_BYTES = 1 + 4 + 5 + 1 + 8;
+
+static_assert(DICTIONARY_SIZE <= TAG_ENTRY_MASK + 1, "Entry index must fit the tag");
+
+static size_t writeVarint(uint8_t* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+size_t encodeBlock(const Record* records, size_t count, uint8_t* out, size_t max_len) {
+    struct Entry {
+        uint32_t id_flags;
+        uint8_t dlc;
+        uint8_t data[8];
+    };
+    Entry dictionary[DICTIONARY_SIZE];
+    size_t dictionary_count = 0;
+    size_t len = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const Record& rec = records[i];
+        if (len + MAX_RECORD_BYTES > max_len) {
+            return 0;
+        }
+
+        if (CANLogFormat::isAnchor(rec)) {
+            // Anchors carry nothing but their data bytes
+            if (rec.id_flags != CANLogFormat::FLAG_ANCHOR || rec.dlc != 0 ||
+                CANLogFormat::recordDelta(rec) != 0) {
+                return 0;
+            }
+            out[len++] = TAG_ANCHOR;
+            memcpy(out + len, rec.data, 8);
+            len += 8;
+            continue;
+        }
+
+        size_t entry = 0;
+        while (entry < dictionary_count &&
+               (dictionary[entry].id_flags != rec.id_flags || dictionary[entry].dlc != rec.dlc)) {
+            entry++;
+        }
+
+        if (entry == dictionary_count) {
+            out[len++] = TAG_NEW;
+            len += writeVarint(out + len, CANLogFormat::recordDelta(rec));
+            len += writeVarint(out + len, rec.id_flags);
+            out[len++] = rec.dlc;
+            memcpy(out + len, rec.data, 8);
+            len += 8;
+
+            // A full dictionary just means later frames of this ID are sent in full
+            if (dictionary_count < DICTIONARY_SIZE) {
+                Entry& e = dictionary[dictionary_count++];
+                e.id_flags = rec.id_flags;
+                e.dlc = rec.dlc;
+                memcpy(e.data, rec.data, 8);
+            }
+            continue;
+        }
+
+        Entry& e = dictionary[entry];
+        uint8_t mask = 0;
+        uint8_t diff[8];
+        uint8_t diff_count = 0;
+        for (uint8_t b = 0; b < 8; b++) {
+            uint8_t x = rec.data[b] ^ e.data[b];
+            if (x != 0) {
+                mask |= 1 << b;
+                diff[diff_count++] = x;
+            }
+        }
+
+        out[len++] = static_cast<uint8_t>(entry) | (mask == 0 ? TAG_SAME : 0);
+        len += writeVarint(out + len, CANLogFormat::recordDelta(rec));
+        if (mask != 0) {
+            out[len++] = mask;
+            memcpy(out + len, diff, diff_count);
+            len += diff_count;
+            memcpy(e.data, rec.data, 8);
+        }
+    }
+
+    return len;
+}
+
+BlockDecoder::BlockDecoder(const uint8_t* block, size_t block_len, uint16_t records)
+    : data(block), len(block_len), pos(0),
+      remaining(records & ~CANLogFormat::BLOCK_STORED),
+      stored((records & CANLogFormat::BLOCK_STORED) != 0),
+      dictionary_count(0) {}
+
+bool BlockDecoder::readVarint(uint32_t& value) {
+    value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (pos >= len) {
+            return false;
+        }
+        uint8_t b = data[pos++];
+        value |= static_cast<uint32_t>(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BlockDecoder::next(Record& rec) {
+    if (remaining == 0) {
+        return false;
+    }
+
+    if (stored) {
+        if (pos + sizeof(Record) > len) {
+            return false;
+        }
+        memcpy(&rec, data + pos, sizeof(Record));
+        pos += sizeof(Record);
+        remaining--;
+        return true;
+    }
+
+    if (pos >= len) {
+        return false;
+    }
+    uint8_t tag = data[pos++];
+
+    if (tag == TAG_ANCHOR) {
+        if (pos + 8 > len) {
+            return false;
+        }
+        memset(&rec, 0, sizeof(rec));
+        rec.id_flags = CANLogFormat::FLAG_ANCHOR;
+        memcpy(rec.data, data + pos, 8);
+        pos += 8;
+        remaining--;
+        return true;
+    }
+
+    uint32_t delta;
+    if ((tag != TAG_NEW && tag >= 2 * TAG_SAME) || !readVarint(delta) || delta > CANLogFormat::MAX_DELTA_MS) {
+        return false;
+    }
+
+    if (tag == TAG_NEW) {
+        uint32_t id_flags;
+        if (!readVarint(id_flags) || pos + 9 > len) {
+            return false;
+        }
+        rec.id_flags = id_flags;
+        rec.dlc = data[pos++];
+        memcpy(rec.data, data + pos, 8);
+        pos += 8;
+
+        if (dictionary_count < DICTIONARY_SIZE) {
+            Entry& e = dictionary[dictionary_count++];
+            e.id_flags = rec.id_flags;
+            e.dlc = rec.dlc;
+            memcpy(e.data, rec.data, 8);
+        }
+    } else {
+        uint8_t entry = tag & TAG_ENTRY_MASK;
+        if (entry >= dictionary_count) {
+            return false;
+        }
+        Entry& e = dictionary[entry];
+
+        if ((tag & TAG_SAME) == 0) {
+            if (pos >= len) {
+                return false;
+            }
+            uint8_t mask = data[pos++];
+            for (uint8_t b = 0; b < 8; b++) {
+                if (mask & (1 << b)) {
+                    if (pos >= len) {
+                        return false;
+                    }
+                    e.data[b] ^= data[pos++];
+                }
+            }
+        }
+
+        rec.id_flags = e.id_flags;
+        rec.dlc = e.dlc;
+        memcpy(rec.data, e.data, 8);
+    }
+
+    rec.delta_ms[0] = static_cast<uint8_t>(delta);
+    rec.delta_ms[1] = static_cast<uint8_t>(delta >> 8);
+    rec.delta_ms[2] = static_cast<uint8_t>(delta >> 16);
+    remaining--;
+    return true;
+}
+
+} // namespace CANLogCodec
@@ -0,0 +1,59 @@
+#ifndef CAN_LOG_CODEC_H
+#define CAN_LOG_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "can_log_format.h"
+
+// Packed encoding of CAN log write blocks.
+//
+// BMS traffic is a handful of IDs at fixed periods with slowly changing
+// payloads, so each block is packed record by record against a small ID
+// dictionary that starts empty in every block (blocks decode on their own):
+//
+//   0x00-0x1F  Frame of dictionary entry n: varint delta, XOR mask, XOR bytes
+//   0x20-0x3F  Frame of entry n - 0x20, payload unchanged: varint delta
+//   0x80       New entry: varint delta, varint id_flags, DLC, 8 data bytes
+//   0x81       Anchor: the anchor's 8 data bytes
+//
+// The XOR mask has a bit per payload byte that differs from the previous
+// frame of that entry; only those bytes follow. Unpacking yields the exact
+// records that were packed.
+namespace CANLogCodec {
+
+constexpr size_t DICTIONARY_SIZE = 32;
+
+// Pack `count` records into `out`. Returns the packed length, or 0 if it
+// would exceed max_len (the block is then stored as plain records).
+size_t encodeBlock(const CANLogFormat::Record* records, size_t count, uint8_t* out, size_t max_len);
+
+// Unpacks one block (packed or stored) record by record
+class BlockDecoder {
+public:
+    // `records` is the BlockHeader field (count | BLOCK_STORED)
+    BlockDecoder(const uint8_t* data, size_t len, uint16_t records);
+
+    // Next record; false at the end of the block or on corrupt input
+    bool next(CANLogFormat::Record& rec);
+
+private:
+    struct Entry {
+        uint32_t id_flags;
+        uint8_t dlc;
+        uint8_t data[8];
+    };
+
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+    uint16_t remaining;
+    bool stored;
+    Entry dictionary[DICTIONARY_SIZE];
+    uint8_t dictionary_count;
+
+    bool readVarint(uint32_t& value);
+};
+
+} // namespace CANLogCodec
+
+#endif // CAN_LOG_CODEC_H
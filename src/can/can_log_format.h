@@ -0,0 +1,299 @@
+#ifndef CAN_LOG_FORMAT_H
+#define CAN_LOG_FORMAT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "can_message.h"
+
+// On-flash layout of binary CAN logs.
+//
+// The log is a ring of segment files. Each segment is one FileHeader followed
+// by fixed 16-byte records, or (ENCODING_PACKED) by one BlockHeader and the
+// packed records of each write block (see can_log_codec.h). Records store the time since the previous record
+// rather than an absolute stamp; an ANCHOR record carries the absolute
+// millis() value. The logger starts every write block with an anchor (so each
+// segment decodes on its own) and repeats it whenever the delta would overflow
+// 24 bits or time goes backwards. A small Manifest names the oldest and newest
+// segment, and a SegmentIndex per segment (time range, anchor checkpoints and
+// a CAN ID bitmap) lets queries skip segments and seek within them.
+// All multi-byte values are little-endian (native on ESP32).
+namespace CANLogFormat {
+
+constexpr uint32_t MAGIC = 0x474C4E43;         // "CNLG"
+constexpr uint16_t VERSION = 1;
+
+constexpr uint32_t ID_MASK = 0x1FFFFFFF;       // 29-bit CAN ID
+constexpr uint32_t FLAG_EXTENDED = 1UL << 29;
+constexpr uint32_t FLAG_RTR = 1UL << 30;
+constexpr uint32_t FLAG_ANCHOR = 1UL << 31;    // Timestamp record, not a frame
+
+constexpr uint32_t MAX_DELTA_MS = 0xFFFFFF;
+
+constexpr uint8_t ENCODING_RECORDS = 0;        // Plain 16-byte records
+constexpr uint8_t ENCODING_PACKED = 1;         // Packed write blocks
+constexpr uint16_t BLOCK_STORED = 0x8000;      // Packed segment block holding plain records
+
+constexpr uint32_t MANIFEST_MAGIC = 0x464D4C43;    // "CLMF"
+constexpr uint16_t MANIFEST_VERSION = 1;
+
+constexpr uint32_t INDEX_MAGIC = 0x58444C43;       // "CLDX"
+constexpr uint16_t INDEX_VERSION = 1;
+constexpr uint16_t INDEX_ID_BITS = 2048;
+constexpr uint8_t INDEX_CHECKPOINTS = 16;
+
+struct FileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t bitrate;           // Bus bitrate when the file was created (0 = unknown)
+    uint32_t boot_time;         // Unix time of that boot (0 = clock not set)
+    uint32_t created_ms;        // millis() when the file was created
+    uint32_t segment;           // Sequence number of this segment
+    uint8_t encoding;           // ENCODING_* (0 in files from older firmware)
+    uint8_t reserved[7];
+};
+
+// Start of each block in a packed segment
+struct BlockHeader {
+    uint16_t length;            // Bytes that follow
+    uint16_t records;           // Records in the block | BLOCK_STORED
+};
+
+struct Record {
+    uint32_t id_flags;          // ID | FLAG_*
+    uint8_t dlc;
+    uint8_t delta_ms[3];        // Milliseconds since the previous record
+    uint8_t data[8];            // Anchor: absolute millis(), then boot Unix time
+};
+
+struct Manifest {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t first_segment;     // Oldest segment still on flash
+    uint32_t last_segment;      // Segment being appended to
+    uint32_t check;             // Guards against a torn write
+};
+
+// Position of an anchor record, for seeking by time
+struct Checkpoint {
+    uint32_t offset;
+    uint32_t timestamp;
+};
+
+// Sparse index of one segment
+struct SegmentIndex {
+    uint32_t segment;
+    uint32_t records;           // Frame records (anchors excluded)
+    uint32_t min_ts;
+    uint32_t max_ts;
+    uint32_t clock;             // Running clock after the last indexed record
+    uint8_t monotonic;          // Time never goes backwards, so seeking is exact
+    uint8_t checkpoint_count;
+    uint16_t reserved;
+    Checkpoint checkpoints[INDEX_CHECKPOINTS];
+    uint32_t id_bits[INDEX_ID_BITS / 32];   // See idBit()
+};
+
+// Sidecar file of a closed segment: this header, then its SegmentIndex
+struct IndexFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t index_size;        // sizeof(SegmentIndex)
+    uint32_t check;
+};
+
+static_assert(sizeof(FileHeader) == 32, "CAN log header must stay 32 bytes");
+static_assert(sizeof(Record) == 16, "CAN log records must stay 16 bytes");
+static_assert(sizeof(BlockHeader) == 4, "CAN log block headers must stay 4 bytes");
+
+inline void initHeader(FileHeader& header, uint32_t segment, uint32_t bitrate,
+                       uint32_t boot_time, uint32_t now_ms, uint8_t encoding = ENCODING_RECORDS) {
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.record_size = sizeof(Record);
+    header.bitrate = bitrate;
+    header.boot_time = boot_time;
+    header.created_ms = now_ms;
+    header.segment = segment;
+    header.encoding = encoding;
+}
+
+inline bool isValidHeader(const FileHeader& header) {
+    return header.magic == MAGIC && header.version == VERSION &&
+           header.record_size == sizeof(Record) && header.encoding <= ENCODING_PACKED;
+}
+
+inline uint32_t manifestCheck(const Manifest& manifest) {
+    return ~(manifest.magic ^ manifest.first_segment ^ (manifest.last_segment * 0x9E3779B1u));
+}
+
+inline void initManifest(Manifest& manifest, uint32_t first_segment, uint32_t last_segment) {
+    memset(&manifest, 0, sizeof(manifest));
+    manifest.magic = MANIFEST_MAGIC;
+    manifest.version = MANIFEST_VERSION;
+    manifest.first_segment = first_segment;
+    manifest.last_segment = last_segment;
+    manifest.check = manifestCheck(manifest);
+}
+
+inline bool isValidManifest(const Manifest& manifest) {
+    return manifest.magic == MANIFEST_MAGIC && manifest.version == MANIFEST_VERSION &&
+           manifest.first_segment <= manifest.last_segment &&
+           manifest.check == manifestCheck(manifest);
+}
+
+inline void encodeAnchor(Record& rec, uint32_t timestamp, uint32_t boot_time) {
+    memset(&rec, 0, sizeof(rec));
+    rec.id_flags = FLAG_ANCHOR;
+    memcpy(&rec.data[0], &timestamp, 4);
+    memcpy(&rec.data[4], &boot_time, 4);
+}
+
+inline void encodeFrame(Record& rec, const CANMessage& msg, uint32_t delta_ms) {
+    rec.id_flags = (msg.id & ID_MASK) |
+                   (msg.extended ? FLAG_EXTENDED : 0) |
+                   (msg.rtr ? FLAG_RTR : 0);
+    rec.dlc = msg.dlc;
+    rec.delta_ms[0] = static_cast<uint8_t>(delta_ms);
+    rec.delta_ms[1] = static_cast<uint8_t>(delta_ms >> 8);
+    rec.delta_ms[2] = static_cast<uint8_t>(delta_ms >> 16);
+    memcpy(rec.data, msg.data, sizeof(rec.data));
+}
+
+inline bool isAnchor(const Record& rec) {
+    return (rec.id_flags & FLAG_ANCHOR) != 0;
+}
+
+inline uint32_t anchorTimestamp(const Record& rec) {
+    uint32_t timestamp;
+    memcpy(&timestamp, &rec.data[0], 4);
+    return timestamp;
+}
+
+inline uint32_t recordDelta(const Record& rec) {
+    return rec.delta_ms[0] |
+           (static_cast<uint32_t>(rec.delta_ms[1]) << 8) |
+           (static_cast<uint32_t>(rec.delta_ms[2]) << 16);
+}
+
+static_assert(CANFrame::FLAG_EXTENDED == FLAG_EXTENDED && CANFrame::FLAG_RTR == FLAG_RTR,
+              "CANFrame flags must match the record flags");
+
+// Same from a packed frame; bytes past the DLC are stored as zero
+inline void encodeFrame(Record& rec, const CANFrame& frame, uint32_t delta_ms) {
+    rec.id_flags = frame.id_flags & ~CANFrame::FLAG_SHORT;
+    rec.dlc = frame.dlc();
+    rec.delta_ms[0] = static_cast<uint8_t>(delta_ms);
+    rec.delta_ms[1] = static_cast<uint8_t>(delta_ms >> 8);
+    rec.delta_ms[2] = static_cast<uint8_t>(delta_ms >> 16);
+    memcpy(rec.data, frame.data, sizeof(rec.data));
+    if (rec.dlc < 8) {
+        rec.data[7] = 0;
+    }
+}
+
+// Rebuild a frame; timestamp is the running clock after applying the delta
+inline void decodeFrame(const Record& rec, uint32_t timestamp, CANMessage& msg) {
+    msg.id = rec.id_flags & ID_MASK;
+    msg.dlc = rec.dlc > 8 ? 8 : rec.dlc;
+    memcpy(msg.data, rec.data, sizeof(msg.data));
+    msg.timestamp = timestamp;
+    msg.extended = (rec.id_flags & FLAG_EXTENDED) != 0;
+    msg.rtr = (rec.id_flags & FLAG_RTR) != 0;
+}
+
+// CSV log line without the line ending: Timestamp,ID,DLC,Data,Extended,RTR,
+// data as space-separated hex bytes
+inline void formatCSV(const CANMessage& msg, char* buffer, size_t size) {
+    char data_str[25] = "";  // 8 bytes * 2 hex chars + spaces = 24 chars
+
+    for (uint8_t i = 0; i < msg.dlc && i < 8; i++) {
+        char byte_str[4];
+        snprintf(byte_str, sizeof(byte_str), "%02X", msg.data[i]);
+        strlcat(data_str, byte_str, sizeof(data_str));
+        if (i < msg.dlc - 1) {
+            strlcat(data_str, " ", sizeof(data_str));
+        }
+    }
+
+    snprintf(buffer, size, "%u,0x%03X,%d,%s,%d,%d",
+             msg.timestamp,
+             msg.id,
+             msg.dlc,
+             data_str,
+             msg.extended ? 1 : 0,
+             msg.rtr ? 1 : 0);
+}
+
+// Bitmap slot of an ID: standard IDs map 1:1, extended IDs are folded in
+// (a shared slot only costs a scan, never a missed frame)
+inline uint16_t idBit(uint32_t id) {
+    return id <= 0x7FF ? static_cast<uint16_t>(id)
+                       : static_cast<uint16_t>((id ^ (id >> 11) ^ (id >> 22)) & 0x7FF);
+}
+
+inline void initIndex(SegmentIndex& index, uint32_t segment) {
+    memset(&index, 0, sizeof(index));
+    index.segment = segment;
+    index.monotonic = 1;
+}
+
+inline uint32_t indexCheck(const SegmentIndex& index) {
+    return ~(INDEX_MAGIC ^ index.records ^ (index.segment * 0x9E3779B1u) ^ index.max_ts);
+}
+
+inline bool mayContainId(const SegmentIndex& index, uint32_t id) {
+    uint16_t bit = idBit(id);
+    return (index.id_bits[bit >> 5] & (1UL << (bit & 31))) != 0;
+}
+
+inline bool overlapsTime(const SegmentIndex& index, uint32_t from, uint32_t to) {
+    return index.records > 0 && index.max_ts >= from && index.min_ts <= to;
+}
+
+// Offset to start reading at for frames at or after `from` (0 = segment start)
+inline uint32_t seekOffset(const SegmentIndex& index, uint32_t from) {
+    if (!index.monotonic) {
+        return 0;
+    }
+    uint32_t offset = 0;
+    for (uint8_t i = 0; i < index.checkpoint_count && index.checkpoints[i].timestamp <= from; i++) {
+        offset = index.checkpoints[i].offset;
+    }
+    return offset;
+}
+
+// Add one record at `offset` (in packed segments, the offset of its block);
+// a checkpoint is kept for the first anchor after every `spacing` bytes
+inline void indexRecord(SegmentIndex& index, const Record& rec, uint32_t offset, uint32_t spacing) {
+    if (isAnchor(rec)) {
+        uint32_t timestamp = anchorTimestamp(rec);
+        if (index.records > 0 && timestamp < index.clock) {
+            index.monotonic = 0;
+        }
+        index.clock = timestamp;
+
+        uint8_t n = index.checkpoint_count;
+        if (n < INDEX_CHECKPOINTS && (n == 0 || offset >= index.checkpoints[n - 1].offset + spacing)) {
+            index.checkpoints[n].offset = offset;
+            index.checkpoints[n].timestamp = timestamp;
+            index.checkpoint_count = n + 1;
+        }
+        return;
+    }
+
+    index.clock += recordDelta(rec);
+    if (index.records == 0 || index.clock < index.min_ts) index.min_ts = index.clock;
+    if (index.records == 0 || index.clock > index.max_ts) index.max_ts = index.clock;
+    index.records++;
+
+    uint16_t bit = idBit(rec.id_flags & ID_MASK);
+    index.id_bits[bit >> 5] |= 1UL << (bit & 31);
+}
+
+} // namespace CANLogFormat
+
+#endif // CAN_LOG_FORMAT_H
@@ -1,21 +1,136 @@
 #include "can_logger.h"
+#include "can_log_codec.h"
 #include "../config/config.h"
+#include <time.h>
 
 // Global instance
 CANLogger canLogger;
 
+static const char* const CSV_HEADER = "Timestamp,ID,DLC,Data,Extended,RTR";
+
+static_assert(CAN_LOG_SEGMENT_SIZE % CAN_LOG_BLOCK_SIZE == 0, "Segments hold whole write blocks");
+static_assert(CAN_LOG_BLOCK_SIZE <= 0xFFFF, "Packed block lengths are 16-bit");
+static_assert(CAN_LOG_MAX_SEGMENTS >= 2 && CAN_LOG_MAX_SEGMENTS <= 1000, "Segment names are three digits");
+
+// Records converted per readCSV() call, bounds how long the mutex is held
+static constexpr size_t EXPORT_RECORDS_PER_CALL = 256;
+
+// Distance between the anchor checkpoints of a segment index
+static constexpr uint32_t INDEX_CHECKPOINT_SPACING = CAN_LOG_SEGMENT_SIZE / CANLogFormat::INDEX_CHECKPOINTS;
+
+// Copy an entry into the output; whatever does not fit is parked in the cursor
+static bool appendBytes(CANLogExportCursor& cursor, uint8_t* buffer, size_t& len,
+                        size_t max_len, const uint8_t* data, size_t data_len) {
+    size_t room = max_len - len;
+
+    if (data_len <= room) {
+        memcpy(buffer + len, data, data_len);
+        len += data_len;
+        return true;
+    }
+
+    size_t rest = data_len - room;
+    if (rest > sizeof(cursor.pending)) {
+        rest = sizeof(cursor.pending);
+    }
+    memcpy(buffer + len, data, room);
+    len = max_len;
+    memcpy(cursor.pending, data + room, rest);
+    cursor.pending_len = static_cast<uint8_t>(rest);
+    cursor.pending_pos = 0;
+    return false;
+}
+
+static bool appendLine(CANLogExportCursor& cursor, uint8_t* buffer, size_t& len,
+                       size_t max_len, const char* line) {
+    return appendBytes(cursor, buffer, len, max_len,
+                       reinterpret_cast<const uint8_t*>(line), strlen(line));
+}
+
+// Passes the header line and the lines of one CAN ID through to the output
+class CSVLineFilter : public Print {
+public:
+    CSVLineFilter(Print& out, uint32_t id) : output(out), filter_id(id), len(0), header(true) {}
+
+    size_t write(uint8_t c) override {
+        if (len < sizeof(line)) {
+            line[len++] = static_cast<char>(c);
+        }
+        if (c == '\n') {
+            // Format: timestamp,ID,...
+            const char* comma = static_cast<const char*>(memchr(line, ',', len));
+            if (header || (comma != nullptr && strtoul(comma + 1, nullptr, 16) == filter_id)) {
+                output.write(reinterpret_cast<const uint8_t*>(line), len);
+            }
+            header = false;
+            len = 0;
+        }
+        return 1;
+    }
+
+private:
+    Print& output;
+    uint32_t filter_id;
+    char line[96];
+    size_t len;
+    bool header;
+};
+
+// Drain a cursor into a stream, giving up if the log stays busy
+static bool streamCSV(CANLogger& logger, CANLogExportCursor& cursor, Print& output) {
+    uint8_t chunk[256];
+    uint8_t stalled = 0;
+
+    while (!cursor.done || cursor.pending_pos < cursor.pending_len) {
+        uint32_t position = cursor.position;
+        size_t n = logger.readCSV(cursor, chunk, sizeof(chunk));
+
+        if (n > 0) {
+            output.write(chunk, n);
+            stalled = 0;
+        } else if (cursor.position == position && ++stalled >= 10) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 CANLogger::CANLogger()
-    : is_initialized(false),
+    : fill_index(0),
+      write_index(0),
+      writer_task(nullptr),
+      writer_running(false),
+      flush_requested(false),
+      clear_requested(false),
+      anchor_requested(false),
+      memory_seq(0),
+      memory_floor(0),
+      is_initialized(false),
+      mode(CANLogMode::BINARY),
+      first_segment(0),
+      current_segment(0),
+      segment_bytes(0),
+      log_bytes(0),
       message_count(0),
       dropped_count(0),
       last_flush_time(0),
+      last_rotation_check(0),
+      bitrate(0),
+      last_record_time(0),
+      need_anchor(true),
+      rate_window_start(0),
+      rate_window_bytes(0),
       auto_flush(true),
       flush_interval_ms(CAN_LOG_FLUSH_INTERVAL_MS),
       mutex_(nullptr) {
+    memset(log_dir, 0, sizeof(log_dir));
     memset(log_filename, 0, sizeof(log_filename));
+    blocks[0].state.store(0);
+    blocks[1].state.store(BLOCK_FREE);
 }
 
-bool CANLogger::begin(const char* log_file) {
+bool CANLogger::begin(const char* dir, CANLogMode log_mode, uint32_t log_bitrate) {
     if (is_initialized) {
         Serial.println("CANLogger: Already initialized");
         return true;
@@ -36,42 +151,100 @@ bool CANLogger::begin(const char* log_file) {
         return false;
     }
 
-    // Store log filename
-    strlcpy(log_filename, log_file, sizeof(log_filename));
+    // Store log directory and format
+    strlcpy(log_dir, dir, sizeof(log_dir));
+    mode = log_mode;
+    bitrate = log_bitrate;
 
     // Check available space
     size_t total = SPIFFS.totalBytes();
     size_t used = SPIFFS.usedBytes();
     Serial.printf("CANLogger: SPIFFS - Total: %d bytes, Used: %d bytes\n", total, used);
 
-    // Check if log file exists and is empty
-    bool file_exists = SPIFFS.exists(log_filename);
-    bool write_header = false;
+    // Single-file logs from older firmware are superseded by the segment ring
+    static const char* const legacy_logs[] = { "/canlog.csv", "/canlog.bin" };
+    for (const char* legacy : legacy_logs) {
+        if (SPIFFS.exists(legacy)) {
+            Serial.printf("CANLogger: Removing legacy log %s\n", legacy);
+            SPIFFS.remove(legacy);
+        }
+    }
+
+    // The manifest names the newest segment; rebuild it if it is missing or torn
+    if (!loadManifest()) {
+        recoverSegments();
+    }
 
-    if (file_exists) {
-        File f = SPIFFS.open(log_filename, "r");
-        if (f && f.size() == 0) {
-            write_header = true;
+    // A newest segment cut off mid-block (e.g. by power loss) or written in the
+    // other binary encoding is kept as it is; logging continues after it
+    if (checkCurrentSegment() == SegmentState::CLOSED) {
+        Serial.printf("CANLogger: Segment %u cannot be appended to, continuing in the next one\n",
+                      current_segment);
+        current_segment++;
+        while (current_segment - first_segment >= CAN_LOG_MAX_SEGMENTS) {
+            dropOldestSegment();
         }
-        if (f) f.close();
-    } else {
-        write_header = true;
+        saveManifest();
     }
 
-    // Create/open log file and write header if needed
-    if (write_header) {
-        if (!openLogFile("w")) {
-            Serial.println("CANLogger: Failed to create log file");
-            return false;
+    // Closed segments keep their index in a sidecar; rescan any without one
+    for (CANLogFormat::SegmentIndex& index : seg_index) {
+        CANLogFormat::initIndex(index, UINT32_MAX);
+    }
+    if (isBinary()) {
+        for (uint32_t seg = first_segment; seg < current_segment; seg++) {
+            if (!loadIndex(seg)) {
+                rebuildIndex(seg);
+                saveIndex(seg);
+            }
         }
-        this->log_file.println("Timestamp,ID,DLC,Data,Extended,RTR");
+    }
+
+    // Size of the ring, for getLogSize() and rotation
+    log_bytes = 0;
+    for (uint32_t seg = first_segment; seg < current_segment; seg++) {
+        char path[32];
+        segmentPath(seg, path, sizeof(path));
+        File f = SPIFFS.open(path, "r");
+        if (f) {
+            log_bytes += f.size();
+            f.close();
+        }
+    }
+
+    // The writer appends through one handle for the logger's lifetime
+    if (!openCurrentSegment()) {
+        Serial.println("CANLogger: Failed to open log segment");
+        return false;
+    }
+    log_bytes += segment_bytes;
+
+    fill_index = 0;
+    write_index = 0;
+    blocks[0].state.store(0);
+    blocks[1].state.store(BLOCK_FREE);
+    need_anchor = true;  // New boot session
+    last_flush_time = millis();
+    last_rotation_check = last_flush_time;
+    rate_window_start = last_flush_time;
+    rate_window_bytes = 0;
+    stats = CANLoggerStats();
+
+    writer_running = true;
+    if (xTaskCreatePinnedToCore(writerTaskFunc, "CAN Log Writer", 4096, this,
+                                CAN_LOG_WRITER_PRIORITY, &writer_task, 0) != pdPASS) {
+        Serial.println("CANLogger: Failed to start writer task");
+        writer_running = false;
+        writer_task = nullptr;
         closeLogFile();
+        return false;
     }
 
     is_initialized = true;
-    last_flush_time = millis();
 
-    Serial.printf("CANLogger: Initialized, logging to %s\n", log_filename);
+    static const char* const mode_names[] = { "CSV", "binary", "compressed" };
+    Serial.printf("CANLogger: Initialized, logging to %s (%s, segments %u-%u)\n", log_filename,
+                  mode_names[static_cast<uint8_t>(mode)], first_segment, current_segment);
     return true;
 }
 
@@ -82,8 +255,16 @@ void CANLogger::end() {
 
     Serial.println("CANLogger: Shutting down...");
 
-    // Flush any remaining messages
-    flush();
+    // The writer commits what is buffered before it exits
+    writer_running = false;
+    if (writer_task != nullptr) {
+        xTaskNotifyGive(writer_task);
+    }
+    for (uint32_t waited = 0; writer_task != nullptr && waited < 2000; waited += 10) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    is_initialized = false;
 
     closeLogFile();
     SPIFFS.end();
@@ -94,221 +275,794 @@ void CANLogger::end() {
         mutex_ = nullptr;
     }
 
-    is_initialized = false;
-
     Serial.println("CANLogger: Shutdown complete");
 }
 
 bool CANLogger::logMessage(const CANMessage& msg) {
+    return logFrame(CANFrame::fromMessage(msg));
+}
+
+bool CANLogger::logFrame(const CANFrame& frame) {
     if (!is_initialized) {
         return false;
     }
 
-    // Add to in-memory buffer for web interface
-    if (!memory_buffer.push(msg)) {
-        // Memory buffer full, oldest message will be overwritten
+    // Add to in-memory ring for web interface
+    pushRecent(frame);
+
+    uint32_t timestamp = frame.timestampMs();
+
+    // Up to three tries: current block, then the other one after a handoff
+    for (uint8_t attempt = 0; attempt < 3; attempt++) {
+        if (anchor_requested.exchange(false, std::memory_order_acquire)) {
+            need_anchor = true;
+        }
+
+        bool anchor = isBinary() &&
+                      (need_anchor || timestamp < last_record_time ||
+                       timestamp - last_record_time > CANLogFormat::MAX_DELTA_MS);
+
+        uint8_t entry[96];
+        size_t len = encodeEntry(frame, timestamp, anchor, entry, sizeof(entry));
+
+        LogBlock& block = blocks[fill_index];
+        uint32_t state = block.state.load(std::memory_order_acquire);
+
+        if ((state & (BLOCK_SEALED | BLOCK_FREE)) == 0) {
+            if (state + len <= CAN_LOG_BLOCK_SIZE) {
+                // Copy first, then publish the new length; if the writer
+                // sealed the block meanwhile the entry is simply not counted
+                memcpy(block.data + state, entry, len);
+                if (block.state.compare_exchange_strong(state, state + len,
+                                                        std::memory_order_release,
+                                                        std::memory_order_relaxed)) {
+                    if (anchor) {
+                        need_anchor = false;
+                    }
+                    last_record_time = timestamp;
+                    message_count++;
+
+                    if (state + len == CAN_LOG_BLOCK_SIZE) {
+                        sealBlock(block, state + len);
+                    }
+                    return true;
+                }
+                continue;
+            }
+
+            // No room left: hand the block to the writer
+            sealBlock(block, state);
+            continue;
+        }
+
+        // Current block belongs to the writer; move on once it released the other
+        uint8_t next = fill_index ^ 1;
+        uint32_t expected = BLOCK_FREE;
+        if (!blocks[next].state.compare_exchange_strong(expected, 0, std::memory_order_acq_rel)) {
+            break;  // Writer still committing it
+        }
+        fill_index = next;
+        need_anchor = true;  // Every block starts with absolute time
     }
 
-    // Add to write buffer
-    if (!write_buffer.push(msg)) {
-        dropped_count++;
-        return false;
+    dropped_count++;
+    return false;
+}
+
+size_t CANLogger::encodeEntry(const CANFrame& frame, uint32_t timestamp, bool anchor,
+                              uint8_t* out, size_t size) {
+    if (mode == CANLogMode::CSV) {
+        CANMessage msg = frame.toMessage();
+        msg.timestamp = timestamp;
+        CANLogFormat::formatCSV(msg, reinterpret_cast<char*>(out), size - 2);
+        strlcat(reinterpret_cast<char*>(out), "\r\n", size);
+        return strlen(reinterpret_cast<char*>(out));
     }
 
-    message_count++;
+    CANLogFormat::Record* rec = reinterpret_cast<CANLogFormat::Record*>(out);
+    size_t len = 0;
+    uint32_t delta = timestamp - last_record_time;
 
-    // Check if we should auto-flush
-    if (auto_flush && (millis() - last_flush_time) >= flush_interval_ms) {
-        return flush();
+    if (anchor) {
+        CANLogFormat::encodeAnchor(rec[len++], timestamp, getBootTime());
+        delta = 0;
     }
+    CANLogFormat::encodeFrame(rec[len++], frame, delta);
+
+    return len * sizeof(CANLogFormat::Record);
+}
 
+bool CANLogger::sealBlock(LogBlock& block, uint32_t state) {
+    // Only an open block is sealed; a failed exchange means the writer got there first
+    if (!block.state.compare_exchange_strong(state, state | BLOCK_SEALED,
+                                             std::memory_order_acq_rel)) {
+        return false;
+    }
+    if (writer_task != nullptr) {
+        xTaskNotifyGive(writer_task);
+    }
     return true;
 }
 
 bool CANLogger::flush() {
-    if (!is_initialized || write_buffer.isEmpty()) {
+    if (!is_initialized) {
         return true;
     }
 
-    // Try to take mutex with timeout (don't block indefinitely)
-    if (xSemaphoreTake(mutex_, pdMS_TO_TICKS(100)) != pdTRUE) {
-        // Another task has the mutex, skip this flush
-        return true;
+    return requestWriter(flush_requested, 1000);
+}
+
+bool CANLogger::clear() {
+    if (!is_initialized) {
+        return false;
     }
 
-    // Open log file in append mode
-    if (!openLogFile("a")) {
-        Serial.println("CANLogger: Failed to open log file for flushing");
-        xSemaphoreGive(mutex_);
+    if (!requestWriter(clear_requested, 1000)) {
+        Serial.println("CANLogger: Writer did not clear the log in time");
         return false;
     }
 
-    // Write all buffered messages
-    CANMessage msg;
-    size_t written = 0;
+    Serial.println("CANLogger: Log cleared");
+    return true;
+}
 
-    while (write_buffer.pop(msg)) {
-        if (writeMessageToFile(msg)) {
-            written++;
+bool CANLogger::requestWriter(std::atomic<bool>& request, uint32_t timeout_ms) {
+    if (writer_task == nullptr) {
+        return false;
+    }
+
+    request.store(true, std::memory_order_release);
+    xTaskNotifyGive(writer_task);
+
+    for (uint32_t waited = 0; request.load(std::memory_order_acquire); waited += 5) {
+        if (waited >= timeout_ms) {
+            return false;
         }
+        vTaskDelay(pdMS_TO_TICKS(5));
     }
+    return true;
+}
 
-    closeLogFile();
-    last_flush_time = millis();
+void CANLogger::writerTaskFunc(void* parameter) {
+    CANLogger* logger = static_cast<CANLogger*>(parameter);
+    logger->writerLoop();
 
-    xSemaphoreGive(mutex_);
+    logger->writer_task = nullptr;
+    vTaskDelete(nullptr);
+}
+
+void CANLogger::writerLoop() {
+    while (writer_running) {
+        // Woken when a block is handed over or a request is posted
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(flush_interval_ms));
+
+        if (clear_requested.load(std::memory_order_acquire)) {
+            resetLogFile();
+            clear_requested.store(false, std::memory_order_release);
+            continue;
+        }
+
+        uint32_t now = millis();
+        bool flush_now = flush_requested.load(std::memory_order_acquire);
+        bool include_partial = flush_now ||
+                               (auto_flush && now - last_flush_time >= flush_interval_ms);
+
+        commitBlocks(include_partial);
+        if (include_partial) {
+            last_flush_time = now;
+        }
+        if (flush_now) {
+            flush_requested.store(false, std::memory_order_release);
+        }
 
-    // Check if rotation is needed (outside mutex to avoid deadlock)
-    checkAndRotate();
+        // Throughput over the last window
+        uint32_t elapsed = now - rate_window_start;
+        if (elapsed >= 1000) {
+            stats.bytes_per_sec = (uint32_t)(((uint64_t)(stats.bytes_written - rate_window_bytes) * 1000) / elapsed);
+            rate_window_start = now;
+            rate_window_bytes = stats.bytes_written;
+        }
 
-    if (written > 0) {
-        Serial.printf("CANLogger: Flushed %d messages\n", written);
+        // Querying SPIFFS usage is slow, so only check now and then
+        if (now - last_rotation_check >= CAN_LOG_ROTATION_CHECK_MS) {
+            last_rotation_check = now;
+            checkAndRotate();
+        }
     }
 
-    return true;
+    commitBlocks(true);
 }
 
-bool CANLogger::clear() {
-    if (!is_initialized) {
-        return false;
+void CANLogger::commitBlocks(bool include_partial) {
+    // Blocks are committed strictly in the order they were filled
+    for (uint8_t i = 0; i < 2; i++) {
+        LogBlock& block = blocks[write_index];
+        uint32_t state = block.state.load(std::memory_order_acquire);
+
+        if (state & BLOCK_FREE) {
+            return;
+        }
+        if (!(state & BLOCK_SEALED)) {
+            if (!include_partial || state == 0) {
+                return;
+            }
+            state = block.state.fetch_or(BLOCK_SEALED, std::memory_order_acq_rel);
+        }
+
+        writeBlock(block.data, state & BLOCK_LEN_MASK);
+
+        block.state.store(BLOCK_FREE, std::memory_order_release);
+        write_index ^= 1;
     }
+}
 
-    // Take mutex
+void CANLogger::writeBlock(const uint8_t* data, size_t len) {
     if (xSemaphoreTake(mutex_, pdMS_TO_TICKS(1000)) != pdTRUE) {
-        Serial.println("CANLogger: Failed to acquire mutex for clear");
-        return false;
+        Serial.println("CANLogger: Log busy, block discarded");
+        return;
     }
 
-    Serial.println("CANLogger: Clearing log file...");
+    bool packed = mode == CANLogMode::COMPRESSED;
+    CANLogFormat::BlockHeader block;
+    size_t frame_len = packed ? packBlock(data, len, block) : len;
 
-    // Remove the file
-    if (SPIFFS.exists(log_filename)) {
-        SPIFFS.remove(log_filename);
+    // Blocks never straddle segments, so each segment starts on an anchor
+    if (segment_bytes + frame_len > CAN_LOG_SEGMENT_SIZE && segment_bytes > sizeof(CANLogFormat::FileHeader)) {
+        startNextSegment();
+        if (packed) {
+            frame_len = packBlock(data, len, block);  // Opening the segment may reuse io_buffer
+        }
     }
 
-    // Recreate with header
-    if (!openLogFile("w")) {
+    if (!log_file && !openLogFile("a")) {
         xSemaphoreGive(mutex_);
+        return;
+    }
+
+    uint32_t start = micros();
+    size_t written;
+    if (packed) {
+        const uint8_t* payload = (block.records & CANLogFormat::BLOCK_STORED) ? data : io_buffer;
+        written = log_file.write(reinterpret_cast<const uint8_t*>(&block), sizeof(block));
+        written += log_file.write(payload, block.length);
+    } else {
+        written = log_file.write(data, len);
+    }
+    log_file.flush();
+    uint32_t duration = micros() - start;
+
+    if (isBinary()) {
+        // A short write leaves a partial packed block, which no reader gets past
+        size_t indexed = !packed ? written : (written == frame_len ? len : 0);
+        indexRecords(indexOf(current_segment), data, indexed, segment_bytes, packed);
+        stats.record_bytes += len;
+    }
+    segment_bytes += written;
+    log_bytes += written;
+
+    xSemaphoreGive(mutex_);
+
+    if (written != frame_len) {
+        Serial.printf("CANLogger: Short write (%u of %u bytes)\n", (unsigned)written, (unsigned)frame_len);
+    }
+
+    stats.blocks_written++;
+    stats.bytes_written += written;
+    stats.last_flush_us = duration;
+    if (duration > stats.max_flush_us) {
+        stats.max_flush_us = duration;
+    }
+}
+
+size_t CANLogger::packBlock(const uint8_t* data, size_t len, CANLogFormat::BlockHeader& block) {
+    // Kept only if it saves space; otherwise the records are stored as they are
+    size_t count = len / sizeof(CANLogFormat::Record);
+    size_t packed = CANLogCodec::encodeBlock(reinterpret_cast<const CANLogFormat::Record*>(data), count,
+                                             io_buffer, len > 0 ? len - 1 : 0);
+
+    block.length = static_cast<uint16_t>(packed > 0 ? packed : len);
+    block.records = static_cast<uint16_t>(count) | (packed > 0 ? 0 : CANLogFormat::BLOCK_STORED);
+    return sizeof(block) + block.length;
+}
+
+bool CANLogger::resetLogFile() {
+    Serial.println("CANLogger: Clearing log segments...");
+
+    // Drop buffered blocks in fill order, so the capture side moves on cleanly
+    anchor_requested.store(true, std::memory_order_release);
+    for (uint8_t i = 0; i < 2; i++) {
+        LogBlock& block = blocks[write_index];
+        if (block.state.load(std::memory_order_acquire) & BLOCK_FREE) {
+            break;
+        }
+        block.state.fetch_or(BLOCK_SEALED, std::memory_order_acq_rel);
+        block.state.store(BLOCK_FREE, std::memory_order_release);
+        write_index ^= 1;
+    }
+
+    if (xSemaphoreTake(mutex_, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        Serial.println("CANLogger: Failed to acquire mutex for clear");
         return false;
     }
 
-    log_file.println("Timestamp,ID,DLC,Data,Extended,RTR");
     closeLogFile();
 
-    // Clear in-memory buffers
-    memory_buffer.clear();
-    write_buffer.clear();
+    // Remove every segment and continue numbering after the last one
+    for (uint32_t seg = first_segment; seg <= current_segment; seg++) {
+        char path[32];
+        segmentPath(seg, path, sizeof(path));
+        if (SPIFFS.exists(path)) {
+            SPIFFS.remove(path);
+        }
+        indexPath(seg, path, sizeof(path));
+        if (SPIFFS.exists(path)) {
+            SPIFFS.remove(path);
+        }
+    }
+
+    current_segment++;
+    first_segment = current_segment;
+    log_bytes = 0;
+
+    bool ok = openCurrentSegment() && saveManifest();
+    log_bytes = segment_bytes;
+
+    // Hide the frames in RAM; sequence numbers keep counting
+    memory_floor.store(memory_seq.load(std::memory_order_acquire), std::memory_order_relaxed);
 
     message_count = 0;
     dropped_count = 0;
 
     xSemaphoreGive(mutex_);
+    return ok;
+}
 
-    Serial.println("CANLogger: Log cleared");
-    return true;
+bool CANLogger::exportCSV(Stream& output) {
+    if (!is_initialized) {
+        return false;
+    }
+
+    flush();  // Flush pending messages first
+
+    CANLogExportCursor cursor;
+    return streamCSV(*this, cursor, output);
 }
 
-size_t CANLogger::getLogSize() {
+bool CANLogger::exportFiltered(Stream& output, uint32_t filter_id) {
     if (!is_initialized) {
+        return false;
+    }
+
+    flush();  // Flush pending messages first
+
+    if (isBinary()) {
+        CANLogExportCursor cursor;
+        cursor.filtered = true;
+        cursor.filter_id = filter_id;
+        return streamCSV(*this, cursor, output);
+    }
+
+    // Text log: filter the stored lines as they stream past
+    CSVLineFilter filter(output, filter_id);
+    CANLogExportCursor cursor;
+    return streamCSV(*this, cursor, filter);
+}
+
+size_t CANLogger::readCSV(CANLogExportCursor& cursor, uint8_t* buffer, size_t max_len) {
+    cursor.raw = false;
+    return readExport(cursor, buffer, max_len);
+}
+
+size_t CANLogger::readRaw(CANLogExportCursor& cursor, uint8_t* buffer, size_t max_len) {
+    if (!isBinary()) {
+        cursor.done = true;
         return 0;
     }
+    cursor.raw = true;
+    return readExport(cursor, buffer, max_len);
+}
 
-    // Take mutex with short timeout
-    if (xSemaphoreTake(mutex_, pdMS_TO_TICKS(100)) != pdTRUE) {
+size_t CANLogger::readExport(CANLogExportCursor& cursor, uint8_t* buffer, size_t max_len) {
+    if (!is_initialized || buffer == nullptr || max_len == 0) {
+        cursor.done = true;
         return 0;
     }
 
-    size_t size = 0;
-    if (SPIFFS.exists(log_filename)) {
-        File f = SPIFFS.open(log_filename, "r");
-        if (f) {
-            size = f.size();
-            f.close();
-        }
+    size_t len = 0;
+
+    // Finish the entry split off at the end of the previous chunk
+    while (cursor.pending_pos < cursor.pending_len && len < max_len) {
+        buffer[len++] = static_cast<uint8_t>(cursor.pending[cursor.pending_pos++]);
+    }
+    if (cursor.pending_pos < cursor.pending_len || cursor.done || len == max_len) {
+        return len;
+    }
+    cursor.pending_len = 0;
+    cursor.pending_pos = 0;
+
+    if (xSemaphoreTake(mutex_, pdMS_TO_TICKS(100)) != pdTRUE) {
+        return len;  // Busy flushing, caller retries
+    }
+
+    if (!cursor.started) {
+        cursor.started = true;
+        cursor.segment = first_segment;
+        cursor.position = 0;
+    }
+
+    // Segments dropped by rotation since the last chunk are skipped
+    if (cursor.segment < first_segment) {
+        cursor.segment = first_segment;
+        cursor.position = 0;
+    }
+
+    if (isBinary()) {
+        len += readBinarySegments(cursor, buffer + len, max_len - len);
+    } else {
+        len += readTextSegments(cursor, buffer + len, max_len - len);
     }
 
     xSemaphoreGive(mutex_);
-    return size;
+    return len;
 }
 
-bool CANLogger::exportCSV(Stream& output) {
-    if (!is_initialized) {
+bool CANLogger::openExportSegment(CANLogExportCursor& cursor, File& file) {
+    char path[32];
+    segmentPath(cursor.segment, path, sizeof(path));
+    file = SPIFFS.open(path, "r");
+    return static_cast<bool>(file);
+}
+
+bool CANLogger::segmentMayMatch(const CANLogExportCursor& cursor) const {
+    const CANLogFormat::SegmentIndex* index = findIndex(cursor.segment);
+    if (index == nullptr || cursor.raw) {
+        return true;  // Not indexed, has to be read
+    }
+    if (cursor.filtered && !CANLogFormat::mayContainId(*index, cursor.filter_id)) {
+        return false;
+    }
+    if (cursor.time_filtered && !CANLogFormat::overlapsTime(*index, cursor.from_ms, cursor.to_ms)) {
         return false;
     }
+    return true;
+}
 
-    flush();  // Flush pending messages first
+void CANLogger::nextExportSegment(CANLogExportCursor& cursor) {
+    if (cursor.segment >= current_segment) {
+        cursor.done = true;
+    } else {
+        cursor.segment++;
+        cursor.position = 0;
+    }
+}
 
-    // Take mutex
-    if (xSemaphoreTake(mutex_, pdMS_TO_TICKS(1000)) != pdTRUE) {
+size_t CANLogger::readBinarySegments(CANLogExportCursor& cursor, uint8_t* buffer, size_t max_len) {
+    size_t len = 0;
+    bool full = false;
+
+    if (!cursor.header_sent && !cursor.raw) {
+        cursor.header_sent = true;
+        char line[40];
+        snprintf(line, sizeof(line), "%s\n", CSV_HEADER);
+        full = !appendLine(cursor, buffer, len, max_len, line);
+    }
+
+    CANLogFormat::Record block[16];
+    size_t budget = EXPORT_RECORDS_PER_CALL;
+
+    while (!full && budget > 0 && !cursor.done) {
+        // The index rules out most segments of a query without opening them
+        if (cursor.position == 0 && !segmentMayMatch(cursor)) {
+            nextExportSegment(cursor);
+            continue;
+        }
+
+        File f;
+        if (!openExportSegment(cursor, f)) {
+            nextExportSegment(cursor);
+            continue;
+        }
+
+        size_t file_size = f.size();
+        const CANLogFormat::SegmentIndex* index = findIndex(cursor.segment);
+        bool in_order = index != nullptr && index->monotonic;
+
+        if (cursor.position == 0) {
+            CANLogFormat::FileHeader header;
+            if (f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) ||
+                !CANLogFormat::isValidHeader(header)) {
+                f.close();
+                nextExportSegment(cursor);
+                continue;
+            }
+            cursor.position = sizeof(header);
+            cursor.encoding = header.encoding;
+            cursor.block_record = 0;
+
+            // Start at the last checkpoint before the range
+            if (cursor.time_filtered && !cursor.raw && index != nullptr) {
+                uint32_t offset = CANLogFormat::seekOffset(*index, cursor.from_ms);
+                if (offset > cursor.position) {
+                    cursor.position = offset;
+                }
+            }
+
+            // Raw export: the first segment's header stands for the whole log,
+            // whose records are sent unpacked
+            if (cursor.raw && !cursor.header_sent) {
+                cursor.header_sent = true;
+                header.encoding = CANLogFormat::ENCODING_RECORDS;
+                full = !appendBytes(cursor, buffer, len, max_len,
+                                    reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+            }
+        }
+
+        bool past_range = false;
+        size_t tail;
+
+        if (cursor.encoding == CANLogFormat::ENCODING_PACKED) {
+            tail = sizeof(CANLogFormat::BlockHeader);
+
+            CANLogFormat::BlockHeader header;
+            while (!full && budget > 0 && !past_range && readPackedBlock(f, cursor, file_size, header)) {
+                CANLogCodec::BlockDecoder decoder(io_buffer, header.length, header.records);
+                CANLogFormat::Record rec;
+                uint16_t skip = cursor.block_record;
+                bool block_done = true;
+
+                while (decoder.next(rec)) {
+                    if (skip > 0) {
+                        skip--;  // Sent by an earlier call
+                        continue;
+                    }
+                    if (full || budget == 0) {
+                        block_done = false;
+                        break;
+                    }
+                    cursor.block_record++;
+                    budget--;
+
+                    RecordResult result = exportRecord(cursor, rec, in_order, buffer, len, max_len);
+                    if (result == RecordResult::FULL) {
+                        full = true;
+                    } else if (result == RecordResult::PAST_RANGE) {
+                        past_range = true;
+                        break;
+                    }
+                }
+
+                if (block_done) {
+                    cursor.position += sizeof(header) + header.length;
+                    cursor.block_record = 0;
+                }
+            }
+        } else {
+            tail = sizeof(CANLogFormat::Record);
+            f.seek(cursor.position);
+
+            while (!full && budget > 0 && !past_range && cursor.position + sizeof(CANLogFormat::Record) <= file_size) {
+                size_t want = (file_size - cursor.position) / sizeof(CANLogFormat::Record);
+                if (want > 16) want = 16;
+                if (want > budget) want = budget;
+
+                size_t got = f.read(reinterpret_cast<uint8_t*>(block), want * sizeof(CANLogFormat::Record)) /
+                             sizeof(CANLogFormat::Record);
+                if (got == 0) {
+                    break;
+                }
+
+                for (size_t i = 0; i < got; i++) {
+                    cursor.position += sizeof(CANLogFormat::Record);
+                    budget--;
+
+                    RecordResult result = exportRecord(cursor, block[i], in_order, buffer, len, max_len);
+                    if (result == RecordResult::FULL) {
+                        full = true;
+                        break;
+                    }
+                    if (result == RecordResult::PAST_RANGE) {
+                        past_range = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (past_range) {
+            cursor.position = file_size;  // Nothing later in this segment matches
+        }
+        bool segment_done = cursor.position + tail > file_size;
+        f.close();
+
+        if (segment_done) {
+            nextExportSegment(cursor);
+        } else if (!full && budget > 0) {
+            break;  // Short read
+        }
+    }
+
+    return len;
+}
+
+CANLogger::RecordResult CANLogger::exportRecord(CANLogExportCursor& cursor, const CANLogFormat::Record& rec,
+                                                bool in_order, uint8_t* buffer, size_t& len, size_t max_len) {
+    if (cursor.raw) {
+        return appendBytes(cursor, buffer, len, max_len, reinterpret_cast<const uint8_t*>(&rec), sizeof(rec))
+            ? RecordResult::NEXT : RecordResult::FULL;
+    }
+
+    if (CANLogFormat::isAnchor(rec)) {
+        cursor.timestamp = CANLogFormat::anchorTimestamp(rec);
+        return RecordResult::NEXT;
+    }
+
+    cursor.timestamp += CANLogFormat::recordDelta(rec);
+
+    if (cursor.time_filtered) {
+        if (cursor.timestamp > cursor.to_ms && in_order) {
+            return RecordResult::PAST_RANGE;
+        }
+        if (cursor.timestamp < cursor.from_ms || cursor.timestamp > cursor.to_ms) {
+            return RecordResult::NEXT;
+        }
+    }
+
+    if (cursor.filtered && (rec.id_flags & CANLogFormat::ID_MASK) != cursor.filter_id) {
+        return RecordResult::NEXT;
+    }
+
+    CANMessage msg;
+    CANLogFormat::decodeFrame(rec, cursor.timestamp, msg);
+
+    char line[72];
+    CANLogFormat::formatCSV(msg, line, sizeof(line) - 1);
+    strlcat(line, "\n", sizeof(line));
+
+    return appendLine(cursor, buffer, len, max_len, line) ? RecordResult::NEXT : RecordResult::FULL;
+}
+
+bool CANLogger::readPackedBlock(File& file, CANLogExportCursor& cursor, size_t file_size,
+                                CANLogFormat::BlockHeader& block) {
+    if (cursor.position + sizeof(block) > file_size) {
         return false;
     }
 
-    if (!openLogFile("r")) {
-        xSemaphoreGive(mutex_);
+    file.seek(cursor.position);
+    if (file.read(reinterpret_cast<uint8_t*>(&block), sizeof(block)) != sizeof(block) ||
+        block.length > sizeof(io_buffer) || cursor.position + sizeof(block) + block.length > file_size ||
+        file.read(io_buffer, block.length) != block.length) {
+        cursor.position = file_size;  // Torn or corrupt, the rest of the segment is unreadable
         return false;
     }
+    return true;
+}
+
+size_t CANLogger::readTextSegments(CANLogExportCursor& cursor, uint8_t* buffer, size_t max_len) {
+    // Already CSV: copy the segments through (filtering is done by exportFiltered)
+    size_t len = 0;
 
-    // Copy file to output stream
-    while (log_file.available()) {
-        output.write(log_file.read());
+    if (!cursor.header_sent) {
+        cursor.header_sent = true;
+        char line[40];
+        snprintf(line, sizeof(line), "%s\r\n", CSV_HEADER);
+        if (!appendLine(cursor, buffer, len, max_len, line)) {
+            return len;
+        }
     }
 
-    closeLogFile();
-    xSemaphoreGive(mutex_);
-    return true;
+    while (len < max_len && !cursor.done) {
+        File f;
+        if (!openExportSegment(cursor, f)) {
+            nextExportSegment(cursor);
+            continue;
+        }
+
+        f.seek(cursor.position);
+        size_t n = f.read(buffer + len, max_len - len);
+        cursor.position += n;
+        len += n;
+
+        bool segment_done = cursor.position >= f.size();
+        f.close();
+
+        if (segment_done) {
+            nextExportSegment(cursor);
+        } else if (n == 0) {
+            break;
+        }
+    }
+
+    return len;
 }
 
-bool CANLogger::exportFiltered(Stream& output, uint32_t filter_id) {
-    if (!is_initialized) {
-        return false;
+void CANLogger::pushRecent(const CANFrame& frame) {
+    static_assert((MEMORY_BUFFER_SIZE & (MEMORY_BUFFER_SIZE - 1)) == 0,
+                  "MEMORY_BUFFER_SIZE must be a power of two");
+
+    // The previous store of memory_seq retired the frame in this slot; the
+    // fence keeps readers from seeing the new bytes before that
+    uint32_t seq = memory_seq.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memory_ring[seq & (MEMORY_BUFFER_SIZE - 1)] = frame;
+    memory_seq.store(seq + 1, std::memory_order_release);
+
+    // Keep the floor within one ring of the head so distances never wrap;
+    // a failed exchange means clear() just moved it forward
+    uint32_t floor = memory_floor.load(std::memory_order_relaxed);
+    if (seq + 1 - floor > MEMORY_BUFFER_SIZE) {
+        memory_floor.compare_exchange_strong(floor, seq + 1 - MEMORY_BUFFER_SIZE,
+                                             std::memory_order_relaxed);
     }
+}
 
-    flush();  // Flush pending messages first
+uint32_t CANLogger::getOldestSequence() const {
+    uint32_t next = memory_seq.load(std::memory_order_acquire);
+    uint32_t available = next - memory_floor.load(std::memory_order_relaxed);
+    if (available > MEMORY_BUFFER_SIZE - 1) {
+        available = MEMORY_BUFFER_SIZE - 1;
+    }
+    return next - available;
+}
 
-    // Take mutex
-    if (xSemaphoreTake(mutex_, pdMS_TO_TICKS(1000)) != pdTRUE) {
-        return false;
+uint8_t CANLogger::getPendingBlocks() const {
+    uint8_t pending = 0;
+    for (const LogBlock& block : blocks) {
+        uint32_t state = block.state.load(std::memory_order_acquire);
+        if ((state & BLOCK_SEALED) && !(state & BLOCK_FREE)) {
+            pending++;
+        }
     }
+    return pending;
+}
 
-    if (!openLogFile("r")) {
-        xSemaphoreGive(mutex_);
+bool CANLogger::readFrame(uint32_t seq, CANFrame& frame) const {
+    uint32_t next = memory_seq.load(std::memory_order_acquire);
+    uint32_t floor = memory_floor.load(std::memory_order_relaxed);
+    if (seq - floor >= next - floor || next - seq >= MEMORY_BUFFER_SIZE) {
         return false;
     }
 
-    // Write CSV header
-    output.println("Timestamp,ID,DLC,Data,Extended,RTR");
+    frame = memory_ring[seq & (MEMORY_BUFFER_SIZE - 1)];
 
-    // Read and filter
-    String line;
-    bool first_line = true;
+    // Valid only if the writer did not reach this slot while it was copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    next = memory_seq.load(std::memory_order_relaxed);
+    return next - seq < MEMORY_BUFFER_SIZE;
+}
 
-    while (log_file.available()) {
-        line = log_file.readStringUntil('\n');
+bool CANLogger::getRecentFrames(CANFrame* buffer, size_t& count, size_t max_count) {
+    count = 0;
 
-        // Skip header
-        if (first_line) {
-            first_line = false;
-            continue;
+    if (!is_initialized || buffer == nullptr) {
+        return false;
+    }
+
+    // Copy from the memory ring, oldest first
+    uint32_t next = getNextSequence();
+    for (uint32_t seq = getOldestSequence(); seq != next && count < max_count; seq++) {
+        if (readFrame(seq, buffer[count])) {
+            count++;
         }
+    }
 
-        // Parse ID from CSV (format: timestamp,ID,...)
-        int comma_pos = line.indexOf(',');
-        if (comma_pos < 0) continue;
+    return true;
+}
 
-        int second_comma = line.indexOf(',', comma_pos + 1);
-        if (second_comma < 0) continue;
+bool CANLogger::getFilteredFrames(CANFrame* buffer, size_t& count, size_t max_count, uint32_t filter_id) {
+    count = 0;
 
-        String id_str = line.substring(comma_pos + 1, second_comma);
-        uint32_t msg_id = strtoul(id_str.c_str(), nullptr, 16);
+    if (!is_initialized || buffer == nullptr) {
+        return false;
+    }
 
-        // Filter by ID
-        if (msg_id == filter_id) {
-            output.println(line);
+    // Copy filtered frames from the memory ring
+    uint32_t next = getNextSequence();
+    for (uint32_t seq = getOldestSequence(); seq != next && count < max_count; seq++) {
+        if (readFrame(seq, buffer[count]) && buffer[count].id() == filter_id) {
+            count++;
         }
     }
 
-    closeLogFile();
-    xSemaphoreGive(mutex_);
     return true;
 }
 
@@ -319,12 +1073,13 @@ bool CANLogger::getRecentMessages(CANMessage* buffer, size_t& count, size_t max_
         return false;
     }
 
-    // Copy from memory buffer
-    memory_buffer.forEach([&](const CANMessage& msg) {
-        if (count < max_count) {
-            buffer[count++] = msg;
+    uint32_t next = getNextSequence();
+    CANFrame frame;
+    for (uint32_t seq = getOldestSequence(); seq != next && count < max_count; seq++) {
+        if (readFrame(seq, frame)) {
+            buffer[count++] = frame.toMessage();
         }
-    });
+    }
 
     return true;
 }
@@ -336,12 +1091,13 @@ bool CANLogger::getFilteredMessages(CANMessage* buffer, size_t& count, size_t ma
         return false;
     }
 
-    // Copy filtered messages from memory buffer
-    memory_buffer.forEach([&](const CANMessage& msg) {
-        if (count < max_count && msg.id == filter_id) {
-            buffer[count++] = msg;
+    uint32_t next = getNextSequence();
+    CANFrame frame;
+    for (uint32_t seq = getOldestSequence(); seq != next && count < max_count; seq++) {
+        if (readFrame(seq, frame) && frame.id() == filter_id) {
+            buffer[count++] = frame.toMessage();
         }
-    });
+    }
 
     return true;
 }
@@ -364,59 +1120,395 @@ void CANLogger::closeLogFile() {
     }
 }
 
-bool CANLogger::writeMessageToFile(const CANMessage& msg) {
-    if (!log_file) {
+void CANLogger::segmentPath(uint32_t segment, char* path, size_t size) const {
+    snprintf(path, size, "%s/%03u.%s", log_dir, (unsigned)(segment % 1000),
+             isBinary() ? "bin" : "csv");
+}
+
+void CANLogger::indexPath(uint32_t segment, char* path, size_t size) const {
+    snprintf(path, size, "%s/%03u.idx", log_dir, (unsigned)(segment % 1000));
+}
+
+const CANLogFormat::SegmentIndex* CANLogger::findIndex(uint32_t segment) const {
+    if (!isBinary() || segment < first_segment || segment > current_segment) {
+        return nullptr;
+    }
+    const CANLogFormat::SegmentIndex& index = seg_index[segment % CAN_LOG_MAX_SEGMENTS];
+    return index.segment == segment ? &index : nullptr;
+}
+
+void CANLogger::indexRecords(CANLogFormat::SegmentIndex& index, const uint8_t* data,
+                             size_t len, uint32_t offset, bool packed) {
+    // Packed records can only be found from the start of their block
+    for (size_t pos = 0; pos + sizeof(CANLogFormat::Record) <= len; pos += sizeof(CANLogFormat::Record)) {
+        CANLogFormat::Record rec;
+        memcpy(&rec, data + pos, sizeof(rec));
+        CANLogFormat::indexRecord(index, rec, packed ? offset : offset + pos, INDEX_CHECKPOINT_SPACING);
+    }
+}
+
+bool CANLogger::loadIndex(uint32_t segment) {
+    char path[32];
+    indexPath(segment, path, sizeof(path));
+
+    File f = SPIFFS.open(path, "r");
+    if (!f) {
+        return false;
+    }
+
+    CANLogFormat::IndexFileHeader header;
+    CANLogFormat::SegmentIndex& index = indexOf(segment);
+    bool ok = f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header) &&
+              header.magic == CANLogFormat::INDEX_MAGIC &&
+              header.version == CANLogFormat::INDEX_VERSION &&
+              header.index_size == sizeof(index) &&
+              f.read(reinterpret_cast<uint8_t*>(&index), sizeof(index)) == sizeof(index) &&
+              index.segment == segment && header.check == CANLogFormat::indexCheck(index);
+    f.close();
+
+    if (!ok) {
+        CANLogFormat::initIndex(index, UINT32_MAX);
+    }
+    return ok;
+}
+
+bool CANLogger::saveIndex(uint32_t segment) {
+    char path[32];
+    indexPath(segment, path, sizeof(path));
+
+    const CANLogFormat::SegmentIndex& index = indexOf(segment);
+    CANLogFormat::IndexFileHeader header;
+    header.magic = CANLogFormat::INDEX_MAGIC;
+    header.version = CANLogFormat::INDEX_VERSION;
+    header.index_size = sizeof(index);
+    header.check = CANLogFormat::indexCheck(index);
+
+    File f = SPIFFS.open(path, "w");
+    if (!f) {
+        Serial.printf("CANLogger: Failed to write %s\n", path);
         return false;
     }
+    bool ok = f.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header) &&
+              f.write(reinterpret_cast<const uint8_t*>(&index), sizeof(index)) == sizeof(index);
+    f.close();
+    return ok;
+}
+
+void CANLogger::rebuildIndex(uint32_t segment) {
+    CANLogFormat::SegmentIndex& index = indexOf(segment);
+    CANLogFormat::initIndex(index, segment);
 
-    char buffer[128];
-    formatMessageCSV(msg, buffer, sizeof(buffer));
+    char path[32];
+    segmentPath(segment, path, sizeof(path));
+    File f = SPIFFS.open(path, "r");
+    if (!f) {
+        return;
+    }
 
-    log_file.println(buffer);
+    CANLogFormat::FileHeader header;
+    if (f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) ||
+        !CANLogFormat::isValidHeader(header)) {
+        f.close();
+        return;
+    }
+
+    uint32_t offset = sizeof(header);
+
+    if (header.encoding == CANLogFormat::ENCODING_PACKED) {
+        size_t size = f.size();
+        CANLogFormat::BlockHeader block;
+        while (offset + sizeof(block) <= size &&
+               f.read(reinterpret_cast<uint8_t*>(&block), sizeof(block)) == sizeof(block) &&
+               block.length <= sizeof(io_buffer) &&
+               f.read(io_buffer, block.length) == block.length) {
+            CANLogCodec::BlockDecoder decoder(io_buffer, block.length, block.records);
+            CANLogFormat::Record rec;
+            while (decoder.next(rec)) {
+                CANLogFormat::indexRecord(index, rec, offset, INDEX_CHECKPOINT_SPACING);
+            }
+            offset += sizeof(block) + block.length;
+        }
+    } else {
+        uint8_t chunk[16 * sizeof(CANLogFormat::Record)];
+        size_t n;
+        while ((n = f.read(chunk, sizeof(chunk))) > 0) {
+            indexRecords(index, chunk, n, offset, false);
+            offset += n;
+        }
+    }
+    f.close();
+}
+
+bool CANLogger::loadManifest() {
+    char path[32];
+    snprintf(path, sizeof(path), "%s/manifest", log_dir);
+
+    File f = SPIFFS.open(path, "r");
+    if (!f) {
+        return false;
+    }
+
+    CANLogFormat::Manifest manifest;
+    bool ok = f.read(reinterpret_cast<uint8_t*>(&manifest), sizeof(manifest)) == sizeof(manifest) &&
+              CANLogFormat::isValidManifest(manifest) &&
+              manifest.last_segment - manifest.first_segment < CAN_LOG_MAX_SEGMENTS;
+    f.close();
+
+    if (!ok) {
+        Serial.println("CANLogger: Log manifest invalid, scanning segments");
+        return false;
+    }
+
+    first_segment = manifest.first_segment;
+    current_segment = manifest.last_segment;
     return true;
 }
 
+bool CANLogger::saveManifest() {
+    char path[32];
+    snprintf(path, sizeof(path), "%s/manifest", log_dir);
+
+    CANLogFormat::Manifest manifest;
+    CANLogFormat::initManifest(manifest, first_segment, current_segment);
+
+    File f = SPIFFS.open(path, "w");
+    if (!f) {
+        Serial.printf("CANLogger: Failed to write %s\n", path);
+        return false;
+    }
+    bool ok = f.write(reinterpret_cast<const uint8_t*>(&manifest), sizeof(manifest)) == sizeof(manifest);
+    f.close();
+    return ok;
+}
+
+void CANLogger::recoverSegments() {
+    bool found = false;
+    uint32_t lowest = 0;
+    uint32_t highest = 0;
+
+    File root = SPIFFS.open(log_dir);
+    if (root && root.isDirectory()) {
+        File file = root.openNextFile();
+        while (file) {
+            const char* name = file.name();
+            bool segment_file = !file.isDirectory() && strstr(name, ".bin") != nullptr;
+
+            if (segment_file && isBinary()) {
+                CANLogFormat::FileHeader header;
+                if (file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header) &&
+                    CANLogFormat::isValidHeader(header)) {
+                    if (!found || header.segment < lowest) lowest = header.segment;
+                    if (!found || header.segment > highest) highest = header.segment;
+                    found = true;
+                }
+            }
+            file = root.openNextFile();
+        }
+    }
+    if (root) {
+        root.close();
+    }
+
+    if (found && highest - lowest < CAN_LOG_MAX_SEGMENTS) {
+        first_segment = lowest;
+        current_segment = highest;
+        Serial.printf("CANLogger: Recovered segments %u-%u\n", first_segment, current_segment);
+    } else {
+        // Nothing usable (or CSV segments, which carry no sequence number):
+        // empty the directory, restarting the listing after each removal
+        while (true) {
+            File dir = SPIFFS.open(log_dir);
+            File file = dir ? dir.openNextFile() : File();
+            if (!file) {
+                break;
+            }
+            char path[48];
+            strlcpy(path, file.path(), sizeof(path));
+            file.close();
+            dir.close();
+            if (!SPIFFS.remove(path)) {
+                break;
+            }
+        }
+        first_segment = 0;
+        current_segment = 0;
+    }
+
+    saveManifest();
+}
+
+CANLogger::SegmentState CANLogger::checkCurrentSegment() {
+    char path[32];
+    segmentPath(current_segment, path, sizeof(path));
+
+    File f = SPIFFS.open(path, "r");
+    if (!f) {
+        return SegmentState::MISSING;
+    }
+    if (mode == CANLogMode::CSV) {
+        f.close();
+        return SegmentState::APPENDABLE;
+    }
+
+    // Appending needs a matching header, the same encoding and no torn tail
+    uint8_t encoding = mode == CANLogMode::COMPRESSED ? CANLogFormat::ENCODING_PACKED
+                                                       : CANLogFormat::ENCODING_RECORDS;
+    CANLogFormat::FileHeader header;
+    SegmentState state;
+    if (f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) ||
+        !CANLogFormat::isValidHeader(header) || header.segment != current_segment) {
+        state = SegmentState::INVALID;
+    } else if (header.encoding != encoding || !segmentIntact(f, header)) {
+        state = SegmentState::CLOSED;
+    } else {
+        state = SegmentState::APPENDABLE;
+    }
+    f.close();
+    return state;
+}
+
+bool CANLogger::segmentIntact(File& file, const CANLogFormat::FileHeader& header) {
+    size_t size = file.size();
+    if (header.encoding == CANLogFormat::ENCODING_RECORDS) {
+        return (size - sizeof(header)) % sizeof(CANLogFormat::Record) == 0;
+    }
+
+    // Walk the block headers; the last block must end at the end of the file
+    size_t offset = sizeof(header);
+    CANLogFormat::BlockHeader block;
+    while (offset + sizeof(block) <= size) {
+        file.seek(offset);
+        if (file.read(reinterpret_cast<uint8_t*>(&block), sizeof(block)) != sizeof(block)) {
+            return false;
+        }
+        offset += sizeof(block) + block.length;
+    }
+    return offset == size;
+}
+
+bool CANLogger::openCurrentSegment() {
+    segmentPath(current_segment, log_filename, sizeof(log_filename));
+
+    SegmentState state = checkCurrentSegment();
+    if (state == SegmentState::INVALID || state == SegmentState::CLOSED) {
+        Serial.printf("CANLogger: %s is not a valid log segment, starting it over\n", log_filename);
+    }
+    if (state != SegmentState::APPENDABLE && !writeFileHeader()) {
+        return false;
+    }
+    if (isBinary()) {
+        rebuildIndex(current_segment);
+    }
+
+    if (!openLogFile("a")) {
+        return false;
+    }
+    segment_bytes = log_file.size();
+    return true;
+}
+
+bool CANLogger::startNextSegment() {
+    closeLogFile();
+    if (isBinary()) {
+        saveIndex(current_segment);  // Closed segments are indexed once, here
+    }
+
+    current_segment++;
+    while (current_segment - first_segment >= CAN_LOG_MAX_SEGMENTS) {
+        dropOldestSegment();
+    }
+
+    if (!openCurrentSegment()) {
+        return false;
+    }
+    log_bytes += segment_bytes;
+    return saveManifest();
+}
+
+bool CANLogger::dropOldestSegment() {
+    if (first_segment >= current_segment) {
+        return false;  // Never drop the segment being written
+    }
+
+    char path[32];
+    segmentPath(first_segment, path, sizeof(path));
+
+    File f = SPIFFS.open(path, "r");
+    if (f) {
+        size_t size = f.size();
+        f.close();
+        log_bytes = size < log_bytes ? log_bytes - size : 0;
+    }
+    SPIFFS.remove(path);
+    char index_path[32];
+    indexPath(first_segment, index_path, sizeof(index_path));
+    if (SPIFFS.exists(index_path)) {
+        SPIFFS.remove(index_path);
+    }
+
+    first_segment++;
+    Serial.printf("CANLogger: Dropped oldest segment %s\n", path);
+    return true;
+}
+
+bool CANLogger::writeFileHeader() {
+    if (!openLogFile("w")) {
+        return false;
+    }
+
+    if (isBinary()) {
+        CANLogFormat::FileHeader header;
+        CANLogFormat::initHeader(header, current_segment, bitrate, getBootTime(), millis(),
+                                 mode == CANLogMode::COMPRESSED ? CANLogFormat::ENCODING_PACKED
+                                                                : CANLogFormat::ENCODING_RECORDS);
+        log_file.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+    }
+
+    closeLogFile();
+    return true;
+}
+
+uint32_t CANLogger::getBootTime() {
+    // Only known once the wall clock has been set (e.g. by SNTP)
+    time_t now = time(nullptr);
+    if (now < 1600000000) {
+        return 0;
+    }
+    return static_cast<uint32_t>(now) - millis() / 1000;
+}
+
 bool CANLogger::checkAndRotate() {
     // Check SPIFFS usage
     size_t total = SPIFFS.totalBytes();
     size_t used = SPIFFS.usedBytes();
     uint8_t usage_percent = (used * 100) / total;
 
-    if (usage_percent >= SPIFFS_ROTATION_PERCENT) {
-        Serial.printf("CANLogger: SPIFFS usage at %d%%, rotating log...\n", usage_percent);
-
-        // Simple rotation: delete oldest half of the log
-        // A more sophisticated approach would keep recent messages
+    if (usage_percent < SPIFFS_ROTATION_PERCENT) {
+        return false;
+    }
 
-        // For now, just clear the log when it gets too big
-        // In a production system, you'd want to archive or rotate properly
-        clear();
+    Serial.printf("CANLogger: SPIFFS usage at %d%%, dropping old segments...\n", usage_percent);
 
-        Serial.println("CANLogger: Log rotated (cleared)");
-        return true;
+    if (xSemaphoreTake(mutex_, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        return false;
     }
 
-    return false;
-}
+    // Drop the oldest segments until usage is back under the threshold;
+    // the history in the remaining ones is kept
+    bool dropped = false;
+    while (usage_percent >= SPIFFS_ROTATION_PERCENT && dropOldestSegment()) {
+        dropped = true;
+        used = SPIFFS.usedBytes();
+        usage_percent = (used * 100) / total;
+    }
+    if (dropped) {
+        saveManifest();
+    }
 
-void CANLogger::formatMessageCSV(const CANMessage& msg, char* buffer, size_t size) {
-    // Format: Timestamp,ID,DLC,Data,Extended,RTR
-    char data_str[25] = "";  // 8 bytes * 2 hex chars + spaces = 24 chars
+    xSemaphoreGive(mutex_);
 
-    for (uint8_t i = 0; i < msg.dlc && i < 8; i++) {
-        char byte_str[4];
-        snprintf(byte_str, sizeof(byte_str), "%02X", msg.data[i]);
-        strlcat(data_str, byte_str, sizeof(data_str));
-        if (i < msg.dlc - 1) {
-            strlcat(data_str, " ", sizeof(data_str));
-        }
+    if (!dropped) {
+        Serial.println("CANLogger: Only the current segment is left, cannot free more space");
     }
-
-    snprintf(buffer, size, "%u,0x%03X,%d,%s,%d,%d",
-             msg.timestamp,
-             msg.id,
-             msg.dlc,
-             data_str,
-             msg.extended ? 1 : 0,
-             msg.rtr ? 1 : 0);
+    return dropped;
 }
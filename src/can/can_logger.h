@@ -5,35 +5,136 @@
 #include <SPIFFS.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <atomic>
 #include "can_message.h"
-#include "../utils/ring_buffer.h"
+#include "can_log_format.h"
+#include "../config/config.h"
 
-// CAN logger for SPIFFS storage
+// On-flash log format
+enum class CANLogMode : uint8_t {
+    CSV,        // One text line per frame
+    BINARY,     // Fixed 16-byte records (see can_log_format.h), CSV on export
+    COMPRESSED  // Binary records packed per write block (see can_log_codec.h)
+};
+
+// Resumable CSV export state for chunked responses (see readCSV)
+struct CANLogExportCursor {
+    uint32_t segment;           // Segment being read
+    uint32_t position;          // Offset of the next unread byte in that segment
+    uint32_t timestamp;         // Running clock of binary records
+    uint8_t encoding;           // CANLogFormat::ENCODING_* of that segment
+    uint16_t block_record;      // Records of the packed block at position already read
+    bool filtered;              // Only emit frames with filter_id
+    uint32_t filter_id;
+    bool time_filtered;         // Only emit frames stamped from_ms..to_ms
+    uint32_t from_ms;
+    uint32_t to_ms;
+    bool raw;                   // Emit binary records instead of CSV (readRaw)
+    bool started;
+    bool header_sent;
+    bool done;                  // Whole log has been converted
+    char pending[72];           // Output that did not fit the previous chunk
+    uint8_t pending_len;
+    uint8_t pending_pos;
+
+    CANLogExportCursor() : segment(0), position(0), timestamp(0), encoding(0), block_record(0),
+                           filtered(false), filter_id(0),
+                           time_filtered(false), from_ms(0), to_ms(0), raw(false), started(false), header_sent(false), done(false),
+                           pending_len(0), pending_pos(0) {
+        pending[0] = '\0';
+    }
+};
+
+// Writer statistics
+struct CANLoggerStats {
+    uint32_t blocks_written;
+    uint32_t bytes_written;
+    uint32_t last_flush_us;     // Duration of the last block write
+    uint32_t max_flush_us;      // Slowest block write since begin()
+    uint32_t bytes_per_sec;     // Write throughput over the last interval
+    uint32_t record_bytes;      // Binary records committed, before packing
+
+    CANLoggerStats() : blocks_written(0), bytes_written(0), last_flush_us(0),
+                       max_flush_us(0), bytes_per_sec(0), record_bytes(0) {}
+};
+
+// CAN logger for SPIFFS storage.
+//
+// Capture and storage are decoupled by two preallocated blocks. logFrame()
+// encodes each frame straight into the block being filled, claiming space
+// with an atomic length word (no lock), and hands the block over once it is
+// full. A low-priority writer task commits handed-over blocks, or the partial
+// block after the flush interval, with one write to a file handle that stays
+// open. logFrame() must only be called from one task.
+//
+// Recent frames are also kept in a RAM ring of packed CANFrames for the web
+// interface. Every frame gets a sequence number (one more than the previous
+// frame's, wrapping at 2^32), so a reader can resume after the last frame it
+// saw. Reads take no lock: a frame that is overwritten while it is copied is
+// reported as gone instead.
+//
+// On flash the log is a ring of segment files (<dir>/000.bin, 001.bin, ...)
+// of up to CAN_LOG_SEGMENT_SIZE bytes. When space runs low only the oldest
+// segment is deleted, and a manifest lets begin() reopen the newest segment
+// without scanning. Exports read all segments in order as one log.
+//
+// Binary segments are indexed as blocks are written: time range, an anchor
+// checkpoint per block-sized stretch and a bitmap of the CAN IDs present.
+// Closed segments keep their index in a sidecar (<dir>/000.idx). Exports
+// filtered by ID or time skip segments the index rules out and seek to the
+// checkpoint before the start time.
+//
+// In COMPRESSED mode the writer packs each block before writing it (ID
+// dictionary, varint time deltas, XOR of the previous payload of the same
+// ID), typically to a fifth of its size. Exports unpack on the fly.
 class CANLogger {
 public:
     CANLogger();
 
-    // Initialization
-    bool begin(const char* log_file = "/canlog.csv");
+    // Initialization (bitrate is recorded in the binary segment headers)
+    bool begin(const char* log_dir = "/canlog", CANLogMode mode = CANLogMode::BINARY,
+               uint32_t bitrate = 0);
     void end();
 
     // Logging operations
-    bool logMessage(const CANMessage& msg);
-    bool flush();  // Write buffered messages to file
+    bool logFrame(const CANFrame& frame);
+    bool logMessage(const CANMessage& msg);  // Converts and calls logFrame()
+    bool flush();  // Commit buffered messages and wait for the writer
 
     // Log management
-    bool clear();  // Clear the log file
-    size_t getLogSize();  // Get log file size in bytes
+    bool clear();  // Delete all segments and start a new one
+    size_t getLogSize() const { return log_bytes; }  // Bytes in all segments
     bool exportCSV(Stream& output);  // Export log as CSV
     bool exportFiltered(Stream& output, uint32_t filter_id);  // Export filtered by ID
 
+    // Convert the next part of the log to CSV. Returns bytes written; 0 with
+    // cursor.done false means the log is busy and the call should be retried.
+    size_t readCSV(CANLogExportCursor& cursor, uint8_t* buffer, size_t max_len);
+
+    // Same for the binary log as one file: the first segment's header
+    // followed by the records of every segment (binary mode only, filters
+    // are ignored)
+    size_t readRaw(CANLogExportCursor& cursor, uint8_t* buffer, size_t max_len);
+
+    bool isBinary() const { return mode != CANLogMode::CSV; }
+    uint32_t getSegmentCount() const { return current_segment - first_segment + 1; }
+
     // Memory-only logging (for web interface)
+    uint32_t getNextSequence() const { return memory_seq.load(std::memory_order_acquire); }
+    uint32_t getOldestSequence() const;     // Oldest frame still readable
+    size_t getMemoryCapacity() const { return MEMORY_BUFFER_SIZE - 1; }
+    bool readFrame(uint32_t seq, CANFrame& frame) const;  // False if not (or no longer) in RAM
+    bool getRecentFrames(CANFrame* buffer, size_t& count, size_t max_count);
+    bool getFilteredFrames(CANFrame* buffer, size_t& count, size_t max_count, uint32_t filter_id);
     bool getRecentMessages(CANMessage* buffer, size_t& count, size_t max_count);
     bool getFilteredMessages(CANMessage* buffer, size_t& count, size_t max_count, uint32_t filter_id);
 
     // Statistics
     uint32_t getMessageCount() const { return message_count; }
     uint32_t getDroppedCount() const { return dropped_count; }
+    CANLoggerStats getStats() const { return stats; }
+    uint8_t getPendingBlocks() const;   // Blocks handed to the writer, not yet on flash (0-2)
 
     // Configuration
     void setAutoFlush(bool enable) { auto_flush = enable; }
@@ -43,34 +144,127 @@ private:
     // File operations
     bool openLogFile(const char* mode);
     void closeLogFile();
-    bool writeMessageToFile(const CANMessage& msg);
-    bool checkAndRotate();  // Check if rotation is needed
+    bool writeFileHeader();  // Start the current segment (binary header, CSV empty)
+    bool resetLogFile();  // Discard buffered blocks and all segments (writer task)
+    bool checkAndRotate();  // Drop old segments if space is low (writer task)
+
+    // Segment ring (writer task or begin(); callers hold the mutex)
+    void segmentPath(uint32_t segment, char* path, size_t size) const;
+    bool loadManifest();
+    bool saveManifest();
+    void recoverSegments();  // Rebuild the manifest from segment headers
+    enum class SegmentState : uint8_t {
+        MISSING,
+        INVALID,        // Unknown header: started over
+        APPENDABLE,
+        CLOSED          // Torn last block or other encoding: kept, logging moves on
+    };
+    SegmentState checkCurrentSegment();
+    bool segmentIntact(File& file, const CANLogFormat::FileHeader& header);
+    bool openCurrentSegment();  // Validate/create the newest segment and open it
+    bool startNextSegment();
+    bool dropOldestSegment();
+
+    // Per-segment index (binary mode; same locking as the segment ring)
+    CANLogFormat::SegmentIndex seg_index[CAN_LOG_MAX_SEGMENTS];
+    CANLogFormat::SegmentIndex& indexOf(uint32_t segment) { return seg_index[segment % CAN_LOG_MAX_SEGMENTS]; }
+    const CANLogFormat::SegmentIndex* findIndex(uint32_t segment) const;  // nullptr if not indexed
+    void indexPath(uint32_t segment, char* path, size_t size) const;
+    void indexRecords(CANLogFormat::SegmentIndex& index, const uint8_t* data, size_t len,
+                      uint32_t offset, bool packed);
+    bool loadIndex(uint32_t segment);
+    bool saveIndex(uint32_t segment);
+    void rebuildIndex(uint32_t segment);  // Scan the segment file
+
+    // Block handoff between logFrame() and the writer task
+    static constexpr uint32_t BLOCK_SEALED = 1UL << 31;  // Owned by the writer
+    static constexpr uint32_t BLOCK_FREE = 1UL << 30;    // Written, may be claimed again
+    static constexpr uint32_t BLOCK_LEN_MASK = BLOCK_FREE - 1;
+
+    struct LogBlock {
+        alignas(4) uint8_t data[CAN_LOG_BLOCK_SIZE];
+        std::atomic<uint32_t> state;    // Bytes used | BLOCK_SEALED | BLOCK_FREE
+    };
 
-    // In-memory buffer for recent messages
-    static constexpr size_t MEMORY_BUFFER_SIZE = 2000;
-    RingBuffer<CANMessage, MEMORY_BUFFER_SIZE> memory_buffer;
+    LogBlock blocks[2];
+    uint8_t fill_index;     // Block logFrame() appends to (capture side only)
+    uint8_t write_index;    // Next block to commit (writer side only)
 
-    // Write buffer for batching - increased to prevent dropped messages
-    static constexpr size_t WRITE_BUFFER_SIZE = 500;
-    RingBuffer<CANMessage, WRITE_BUFFER_SIZE> write_buffer;
+    // Packed blocks on their way to flash, and on their way back for exports
+    // and index rebuilds (used under the mutex)
+    alignas(4) uint8_t io_buffer[CAN_LOG_BLOCK_SIZE];
+
+    size_t encodeEntry(const CANFrame& frame, uint32_t timestamp, bool anchor, uint8_t* out, size_t size);
+    bool sealBlock(LogBlock& block, uint32_t state);
+    void commitBlocks(bool include_partial);
+    void writeBlock(const uint8_t* data, size_t len);
+    size_t packBlock(const uint8_t* data, size_t len, CANLogFormat::BlockHeader& block);  // Into io_buffer
+
+    // Writer task
+    static void writerTaskFunc(void* parameter);
+    void writerLoop();
+    bool requestWriter(std::atomic<bool>& request, uint32_t timeout_ms);
+    TaskHandle_t writer_task;
+    std::atomic<bool> writer_running;
+    std::atomic<bool> flush_requested;
+    std::atomic<bool> clear_requested;
+    std::atomic<bool> anchor_requested;     // A new file needs an anchor record first
+
+    // In-memory ring of recent frames (32 KB). Frame `seq` lives in slot
+    // seq % MEMORY_BUFFER_SIZE, a power of two so that holds across the
+    // sequence wrap. The slot about to be reused is not readable, so
+    // MEMORY_BUFFER_SIZE - 1 frames are available.
+    static constexpr size_t MEMORY_BUFFER_SIZE = 2048;
+    CANFrame memory_ring[MEMORY_BUFFER_SIZE];
+    std::atomic<uint32_t> memory_seq;       // Sequence of the next frame
+    std::atomic<uint32_t> memory_floor;     // Frames before this one are dropped (clear())
+    void pushRecent(const CANFrame& frame);
 
     // State
     bool is_initialized;
-    char log_filename[32];
-    File log_file;
+    CANLogMode mode;
+    char log_dir[24];
+    char log_filename[32];  // Path of the current segment
+    File log_file;          // Current segment, kept open for appending
+    uint32_t first_segment; // Oldest segment on flash
+    uint32_t current_segment;
+    size_t segment_bytes;   // Size of the current segment
+    size_t log_bytes;       // Size of all segments
     uint32_t message_count;
     uint32_t dropped_count;
     uint32_t last_flush_time;
+    uint32_t last_rotation_check;
+
+    // Binary record clock (capture side only)
+    uint32_t bitrate;
+    uint32_t last_record_time;  // Timestamp the next delta is relative to
+    bool need_anchor;           // Next record must re-establish absolute time
+
+    // Writer statistics
+    CANLoggerStats stats;
+    uint32_t rate_window_start;
+    uint32_t rate_window_bytes;
 
     // Configuration
     bool auto_flush;
     uint32_t flush_interval_ms;
 
-    // Thread safety
+    // Thread safety (file access)
     SemaphoreHandle_t mutex_;
 
     // Helper functions
-    void formatMessageCSV(const CANMessage& msg, char* buffer, size_t size);
+    size_t readExport(CANLogExportCursor& cursor, uint8_t* buffer, size_t max_len);
+    size_t readBinarySegments(CANLogExportCursor& cursor, uint8_t* buffer, size_t max_len);
+    enum class RecordResult : uint8_t { NEXT, FULL, PAST_RANGE };
+    RecordResult exportRecord(CANLogExportCursor& cursor, const CANLogFormat::Record& rec, bool in_order,
+                              uint8_t* buffer, size_t& len, size_t max_len);
+    bool readPackedBlock(File& file, CANLogExportCursor& cursor, size_t file_size,
+                         CANLogFormat::BlockHeader& block);
+    size_t readTextSegments(CANLogExportCursor& cursor, uint8_t* buffer, size_t max_len);
+    bool openExportSegment(CANLogExportCursor& cursor, File& file);
+    bool segmentMayMatch(const CANLogExportCursor& cursor) const;
+    void nextExportSegment(CANLogExportCursor& cursor);
+    static uint32_t getBootTime();
 };
 
 // Global logger instance
@@ -2,6 +2,10 @@
 #define CAN_MESSAGE_H
 
 #include <Arduino.h>
+#include "../config/config.h"
+#if CAN_FRAME_TIMESTAMP_US
+#include <esp_timer.h>
+#endif
 
 // CAN frame structure
 struct CANMessage {
@@ -17,6 +21,91 @@ struct CANMessage {
     }
 };
 
+// Packed frame for queues and in-memory history (16 bytes, no padding).
+//
+// Flags live in the top bits of the ID word. A frame shorter than 8 bytes
+// keeps its DLC in data[7], which is never a payload byte then. The
+// timestamp is millis(), or the low 32 bits of esp_timer with
+// CAN_FRAME_TIMESTAMP_US. The driver, frame bus, logger history and web
+// batch carry CANFrame; it is converted to CANMessage only where frames
+// leave that path (parsers, callbacks, API output).
+struct CANFrame {
+    static constexpr uint32_t ID_MASK = 0x1FFFFFFF;
+    static constexpr uint32_t FLAG_EXTENDED = 1UL << 29;
+    static constexpr uint32_t FLAG_RTR = 1UL << 30;
+    static constexpr uint32_t FLAG_SHORT = 1UL << 31;   // DLC < 8, stored in data[7]
+
+    uint32_t id_flags;
+    uint32_t timestamp;
+    uint8_t data[8];
+
+    uint32_t id() const { return id_flags & ID_MASK; }
+    bool extended() const { return (id_flags & FLAG_EXTENDED) != 0; }
+    bool rtr() const { return (id_flags & FLAG_RTR) != 0; }
+    uint8_t dlc() const { return (id_flags & FLAG_SHORT) ? data[7] : 8; }
+
+    // Timestamp for a frame received now
+    static uint32_t now() {
+#if CAN_FRAME_TIMESTAMP_US
+        return static_cast<uint32_t>(esp_timer_get_time());
+#else
+        return millis();
+#endif
+    }
+
+    // Receive time in millis() (microsecond stamps resolve for ~71 minutes)
+    uint32_t timestampMs() const {
+#if CAN_FRAME_TIMESTAMP_US
+        return millis() - (static_cast<uint32_t>(esp_timer_get_time()) - timestamp) / 1000;
+#else
+        return timestamp;
+#endif
+    }
+
+    // Time since the frame was received, in microseconds (ms resolution
+    // unless CAN_FRAME_TIMESTAMP_US)
+    uint32_t ageUs() const {
+#if CAN_FRAME_TIMESTAMP_US
+        return static_cast<uint32_t>(esp_timer_get_time()) - timestamp;
+#else
+        return (millis() - timestamp) * 1000;
+#endif
+    }
+
+    static CANFrame make(uint32_t id, bool extended, bool rtr, uint8_t dlc,
+                         const uint8_t* payload, uint32_t timestamp) {
+        CANFrame frame;
+        if (dlc > 8) dlc = 8;
+        frame.id_flags = (id & ID_MASK) | (extended ? FLAG_EXTENDED : 0) |
+                         (rtr ? FLAG_RTR : 0) | (dlc < 8 ? FLAG_SHORT : 0);
+        frame.timestamp = timestamp;
+        memset(frame.data, 0, sizeof(frame.data));
+        memcpy(frame.data, payload, dlc);
+        if (dlc < 8) {
+            frame.data[7] = dlc;
+        }
+        return frame;
+    }
+
+    // msg.timestamp is in ms and is stored as is
+    static CANFrame fromMessage(const CANMessage& msg) {
+        return make(msg.id, msg.extended, msg.rtr, msg.dlc, msg.data, msg.timestamp);
+    }
+
+    CANMessage toMessage() const {
+        CANMessage msg;
+        msg.id = id();
+        msg.dlc = dlc();
+        memcpy(msg.data, data, msg.dlc);
+        msg.timestamp = timestampMs();
+        msg.extended = extended();
+        msg.rtr = rtr();
+        return msg;
+    }
+};
+
+static_assert(sizeof(CANFrame) == 16, "CANFrame must stay 16 bytes");
+
 // Parsed battery data from CAN
 struct CANBatteryData {
     uint8_t battery_id;
@@ -27,13 +116,28 @@ struct CANBatteryData {
     float temp2;                // Temperature sensor 2 (°C)
     uint8_t status_flags;       // Status bits
     uint32_t pack_identifier;   // Manufacturing date/serial (YYDDMMSSSS format)
+    uint8_t present;            // CANBatteryFields this frame carried
     bool valid;                 // Data is valid
 
     CANBatteryData() : battery_id(0), pack_voltage(0), pack_current(0),
                        soc(0), temp1(0), temp2(0), status_flags(0),
-                       pack_identifier(0), valid(false) {}
+                       pack_identifier(0), present(0), valid(false) {}
 };
 
+// CANBatteryData::present bits. A frame usually carries only some of the
+// values (D-power sends voltage and state in separate messages); the rest
+// are left at 0 and must not overwrite what the pack reported before.
+namespace CANBatteryFields {
+    constexpr uint8_t VOLTAGE        = 0x01;
+    constexpr uint8_t CURRENT        = 0x02;
+    constexpr uint8_t SOC            = 0x04;
+    constexpr uint8_t TEMP1          = 0x08;
+    constexpr uint8_t TEMP2          = 0x10;
+    constexpr uint8_t STATUS_FLAGS   = 0x20;
+    constexpr uint8_t IDENTIFIER     = 0x40;
+    constexpr uint8_t ALL            = 0x7F;
+}
+
 // Status flag definitions
 namespace CANStatusFlags {
     constexpr uint8_t CHARGING       = 0x01;
@@ -1,16 +1,47 @@
 #include "can_parser.h"
 #include <cmath>
 
-CANParser::CANParser() : protocol(nullptr), handler_count(0) {
+float DecodedFrame::getValue(const char* field_name) const {
+    if (message == nullptr || field_name == nullptr) {
+        return NAN;
+    }
+
+    for (uint8_t i = 0; i < value_count; i++) {
+        if (strcmp(message->fields[i].name, field_name) == 0) {
+            return values[i];
+        }
+    }
+    return NAN;
+}
+
+CANParser::CANParser()
+    : protocol(nullptr), compiled(nullptr), compiled_fields(nullptr), compiled_count(0),
+      handler_count(0), id_index_count(0),
+      cache_mux(portMUX_INITIALIZER_UNLOCKED), cache_hits(0), cache_misses(0) {
     // Initialize handler registry
     for (size_t i = 0; i < MAX_HANDLERS; i++) {
         handlers[i].can_id = 0;
         handlers[i].handler = nullptr;
     }
+
+    for (size_t i = 0; i < CACHE_SIZE; i++) {
+        cache[i].used = false;
+        cache[i].repeats = 0;
+    }
+
+    rebuildIndex();
+}
+
+CANParser::~CANParser() {
+    delete[] compiled;
+    delete[] compiled_fields;
 }
 
 void CANParser::setProtocol(const Protocol::Definition* proto) {
     protocol = proto;
+    compileProtocol();
+    rebuildIndex();
+    clearCache();
     if (protocol) {
         Serial.printf("CANParser: Protocol set to '%s'\n", protocol->name);
     } else {
@@ -18,83 +49,313 @@ void CANParser::setProtocol(const Protocol::Definition* proto) {
     }
 }
 
-bool CANParser::parseMessage(const CANMessage& msg, CANBatteryData& data) {
-    // Clear previous data
-    data = CANBatteryData();
+bool CANParser::decode(const CANMessage& msg, DecodedFrame& out,
+                       int32_t id_offset, int16_t battery_id) {
+    // Unknown IDs (most of a shared bus) are rejected with one bit test
+    uint32_t protocol_id = msg.id - id_offset;
+    if (!isKnownId(protocol_id, msg.extended)) {
+        out = DecodedFrame();
+        out.frame = msg;
+        return false;
+    }
 
-    // Check for registered custom handlers first (legacy support)
-    for (size_t i = 0; i < handler_count; i++) {
-        if (handlers[i].can_id == msg.id && handlers[i].handler != nullptr) {
-            return handlers[i].handler(msg, data);
+    // Same payload as last time for this ID: reuse the previous decode
+    portENTER_CRITICAL(&cache_mux);
+    int slot = findCacheSlot(msg.id, msg.extended);
+    if (slot >= 0 && cache[slot].used) {
+        const DecodedFrame& last = cache[slot].record;
+        if (last.frame.dlc == msg.dlc && last.frame.rtr == msg.rtr &&
+            memcmp(last.frame.data, msg.data, msg.dlc) == 0) {
+            out = last;
+            cache[slot].repeats++;
+            cache_hits++;
+            portEXIT_CRITICAL(&cache_mux);
+
+            out.frame = msg;    // Keep this frame's timestamp
+            out.from_cache = true;
+            return out.decoded;
         }
     }
+    portEXIT_CRITICAL(&cache_mux);
 
-    // Use protocol-based parsing if protocol is configured
-    if (protocol != nullptr) {
-        return parseWithProtocol(msg, data);
+    cache_misses++;
+    bool ok = decodeUncached(msg, protocol_id, out);
+    if (ok && battery_id >= 0) {
+        out.battery.battery_id = static_cast<uint8_t>(battery_id);
+    }
+
+    // Only frames a parser understood are worth remembering
+    if (ok && slot >= 0) {
+        portENTER_CRITICAL(&cache_mux);
+        cache[slot].used = true;
+        cache[slot].repeats = 0;
+        cache[slot].record = out;
+        portEXIT_CRITICAL(&cache_mux);
+    }
+
+    return ok;
+}
+
+bool CANParser::decodeUncached(const CANMessage& msg, uint32_t protocol_id, DecodedFrame& out) {
+    // Clear previous data
+    out = DecodedFrame();
+    out.frame = msg;
+
+    // Registered handlers shadow protocol messages (resolved in the index)
+    const IndexEntry* entry = findIndex(protocol_id);
+    if (entry != nullptr) {
+        if (entry->kind == IndexKind::HANDLER) {
+            out.decoded = handlers[entry->slot].handler(msg, out.battery);
+        } else {
+            out.decoded = parseWithProtocol(msg, compiled[entry->slot], out);
+        }
+        return out.decoded;
     }
 
     // Fall back to legacy parsers if no protocol configured
-    if (msg.id == 0x100 || (msg.id >= 0x100 && msg.id <= 0x104)) {
-        return parseBatteryStatus(msg, data);
-    } else if (msg.id >= 0x200 && msg.id <= 0x204) {
-        return parseCellVoltages(msg, data);
+    if (protocol == nullptr) {
+        if (protocol_id >= 0x100 && protocol_id <= 0x104) {
+            out.decoded = parseBatteryStatus(msg, out.battery);
+        } else if (protocol_id >= 0x200 && protocol_id <= 0x204) {
+            out.decoded = parseCellVoltages(msg, out.battery);
+        }
     }
 
     // Unknown message
-    return false;
+    return out.decoded;
 }
 
-bool CANParser::parseWithProtocol(const CANMessage& msg, CANBatteryData& data) {
-    // Find the message definition for this CAN ID
-    const Protocol::Message* msg_def = protocol->findMessage(msg.id);
-    if (!msg_def) {
-        return false;  // Message ID not in protocol
+bool CANParser::parseMessage(const CANMessage& msg, CANBatteryData& data) {
+    DecodedFrame decoded;
+    bool ok = decode(msg, decoded);
+    data = decoded.battery;
+    return ok;
+}
+
+void CANParser::compileProtocol() {
+    delete[] compiled;
+    delete[] compiled_fields;
+    compiled = nullptr;
+    compiled_fields = nullptr;
+    compiled_count = 0;
+    if (protocol == nullptr) {
+        return;
     }
 
-    // Extract well-known fields into CANBatteryData structure
-    // Try to map protocol fields to standard data structure
-    data.valid = true;
+    uint8_t message_count = protocol->message_count < MAX_MESSAGES_PER_PROTOCOL ?
+                            protocol->message_count : MAX_MESSAGES_PER_PROTOCOL;
+    size_t total_fields = 0;
+    for (uint8_t m = 0; m < message_count; m++) {
+        uint8_t n = protocol->messages[m].field_count;
+        total_fields += n < MAX_FIELDS_PER_MESSAGE ? n : MAX_FIELDS_PER_MESSAGE;
+    }
+
+    compiled = new CompiledMessage[message_count];
+    compiled_fields = new CompiledField[total_fields > 0 ? total_fields : 1];
+    if (compiled == nullptr || compiled_fields == nullptr) {
+        Serial.println("CANParser: Out of memory compiling protocol!");
+        delete[] compiled;
+        delete[] compiled_fields;
+        compiled = nullptr;
+        compiled_fields = nullptr;
+        return;
+    }
+
+    CompiledField* next_field = compiled_fields;
+    for (uint8_t m = 0; m < message_count; m++) {
+        const Protocol::Message& msg_def = protocol->messages[m];
+        CompiledMessage& cm = compiled[compiled_count];
+        cm.can_id = msg_def.can_id;
+        cm.message = &msg_def;
+        cm.field_count = 0;
+        cm.fields = next_field;
+
+        for (uint8_t i = 0; i < msg_def.field_count && i < MAX_FIELDS_PER_MESSAGE; i++) {
+            const Protocol::Field& field = msg_def.fields[i];
+            CompiledField& cf = *next_field++;
+
+            // Unknown data types compile to an always-invalid field so
+            // values[] stays aligned with the message's field order
+            cf.extract = Protocol::getRawExtractor(field.data_type);
+            cf.byte_offset = field.byte_offset;
+            cf.scale = field.scale;
+            cf.offset = field.offset;
+            cf.min_value = field.has_min ? field.min_value : -INFINITY;
+            cf.max_value = field.has_max ? field.max_value : INFINITY;
+
+            float unit_factor = 1.0f;
+            cf.slot = resolveSlot(field, unit_factor);
+            cf.slot_scale = field.scale * unit_factor;
+            cf.slot_offset = field.offset * unit_factor;
+
+            cm.field_count++;
+        }
+
+        compiled_count++;
+    }
+
+    Serial.printf("CANParser: Compiled %u message(s)\n", compiled_count);
+}
 
-    for (uint8_t i = 0; i < msg_def->field_count; i++) {
-        const Protocol::Field& field = msg_def->fields[i];
-        float value = field.extractValue(msg.data);
+CANParser::BatterySlot CANParser::resolveSlot(const Protocol::Field& field, float& unit_factor) {
+    unit_factor = 1.0f;
 
-        if (isnan(value)) continue;
-        if (!field.isValueValid(value)) continue;
+    // Map common field names to CANBatteryData fields
+    if (strcmp(field.name, "pack_voltage") == 0 ||
+        strcmp(field.name, "total_voltage_mv") == 0) {
+        // Convert to volts if in millivolts
+        if (strcmp(field.unit, "mV") == 0) unit_factor = 0.001f;
+        return BatterySlot::PACK_VOLTAGE;
+    }
+    if (strcmp(field.name, "pack_current") == 0) {
+        // Convert to amps if in milliamps
+        if (strcmp(field.unit, "mA") == 0) unit_factor = 0.001f;
+        return BatterySlot::PACK_CURRENT;
+    }
+    if (strcmp(field.name, "soc") == 0) {
+        return BatterySlot::SOC;
+    }
+    if (strcmp(field.name, "temperature") == 0 || strcmp(field.name, "temp1") == 0) {
+        return BatterySlot::TEMP1;
+    }
+    if (strcmp(field.name, "temp2") == 0) {
+        return BatterySlot::TEMP2;
+    }
+    if (strcmp(field.name, "state") == 0 || strcmp(field.name, "status_flags") == 0) {
+        return BatterySlot::STATUS_FLAGS;
+    }
+    if (strcmp(field.name, "pack_identifier") == 0) {
+        return BatterySlot::PACK_IDENTIFIER;
+    }
+    return BatterySlot::NONE;
+}
+
+bool CANParser::isLegacyId(uint32_t can_id) {
+    return (can_id >= 0x100 && can_id <= 0x104) || (can_id >= 0x200 && can_id <= 0x204);
+}
 
-        // Map common field names to CANBatteryData fields
-        if (strcmp(field.name, "pack_voltage") == 0 ||
-            strcmp(field.name, "total_voltage_mv") == 0) {
-            // Convert to volts if in millivolts
-            if (strcmp(field.unit, "mV") == 0) {
-                data.pack_voltage = value / 1000.0f;
-            } else {
-                data.pack_voltage = value;
-            }
+void CANParser::markStdId(uint32_t can_id) {
+    if (can_id <= 0x7FF) {
+        std_id_bitmap[can_id >> 5] |= (1UL << (can_id & 31));
+    }
+}
+
+void CANParser::rebuildIndex() {
+    memset(std_id_bitmap, 0, sizeof(std_id_bitmap));
+    id_index_count = 0;
+
+    auto insert = [&](uint32_t can_id, IndexKind kind, uint8_t slot) {
+        // Keep sorted; an existing entry for the ID wins (handlers go first)
+        size_t pos = id_index_count;
+        while (pos > 0 && id_index[pos - 1].can_id > can_id) {
+            pos--;
         }
-        else if (strcmp(field.name, "pack_current") == 0) {
-            // Convert to amps if in milliamps
-            if (strcmp(field.unit, "mA") == 0) {
-                data.pack_current = value / 1000.0f;
-            } else {
-                data.pack_current = value;
-            }
+        if (pos > 0 && id_index[pos - 1].can_id == can_id) {
+            return;
         }
-        else if (strcmp(field.name, "soc") == 0) {
-            data.soc = static_cast<uint8_t>(value);
+        if (id_index_count >= MAX_INDEX_ENTRIES) {
+            return;
         }
-        else if (strcmp(field.name, "temperature") == 0 || strcmp(field.name, "temp1") == 0) {
-            data.temp1 = value;
+        memmove(&id_index[pos + 1], &id_index[pos], (id_index_count - pos) * sizeof(IndexEntry));
+        id_index[pos].can_id = can_id;
+        id_index[pos].kind = kind;
+        id_index[pos].slot = slot;
+        id_index_count++;
+        markStdId(can_id);
+    };
+
+    for (size_t i = 0; i < handler_count; i++) {
+        if (handlers[i].handler != nullptr) {
+            insert(handlers[i].can_id, IndexKind::HANDLER, i);
         }
-        else if (strcmp(field.name, "temp2") == 0) {
-            data.temp2 = value;
+    }
+
+    for (uint8_t i = 0; i < compiled_count; i++) {
+        insert(compiled[i].can_id, IndexKind::MESSAGE, i);
+    }
+
+    if (protocol == nullptr) {
+        for (uint32_t id = 0x100; id <= 0x104; id++) markStdId(id);
+        for (uint32_t id = 0x200; id <= 0x204; id++) markStdId(id);
+    }
+}
+
+bool CANParser::isKnownId(uint32_t can_id, bool extended) const {
+    if (!extended && can_id <= 0x7FF) {
+        return (std_id_bitmap[can_id >> 5] >> (can_id & 31)) & 1;
+    }
+    // Extended IDs aren't in the bitmap; only indexed entries can match
+    return findIndex(can_id) != nullptr || (protocol == nullptr && isLegacyId(can_id));
+}
+
+const CANParser::IndexEntry* CANParser::findIndex(uint32_t can_id) const {
+    size_t lo = 0, hi = id_index_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (id_index[mid].can_id < can_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
-        else if (strcmp(field.name, "state") == 0 || strcmp(field.name, "status_flags") == 0) {
-            data.status_flags = static_cast<uint8_t>(value);
+    }
+    return (lo < id_index_count && id_index[lo].can_id == can_id) ? &id_index[lo] : nullptr;
+}
+
+bool CANParser::parseWithProtocol(const CANMessage& msg, const CompiledMessage& cm,
+                                  DecodedFrame& out) {
+    out.message = cm.message;
+    out.value_count = cm.field_count;
+
+    CANBatteryData& data = out.battery;
+    data.valid = true;
+
+    for (uint8_t i = 0; i < cm.field_count; i++) {
+        const CompiledField& cf = cm.fields[i];
+        if (cf.extract == nullptr) {
+            out.values[i] = NAN;
+            continue;
         }
-        else if (strcmp(field.name, "pack_identifier") == 0) {
-            data.pack_identifier = static_cast<uint32_t>(value);
+
+        float raw = cf.extract(msg.data, cf.byte_offset);
+        float value = raw * cf.scale + cf.offset;
+        out.values[i] = value;
+
+        // NAN fails both comparisons
+        if (!(value >= cf.min_value && value <= cf.max_value)) continue;
+        out.valid_mask |= (1U << i);
+
+        float slot_value = raw * cf.slot_scale + cf.slot_offset;
+        switch (cf.slot) {
+            case BatterySlot::PACK_VOLTAGE:
+                data.pack_voltage = slot_value;
+                data.present |= CANBatteryFields::VOLTAGE;
+                break;
+            case BatterySlot::PACK_CURRENT:
+                data.pack_current = slot_value;
+                data.present |= CANBatteryFields::CURRENT;
+                break;
+            case BatterySlot::SOC:
+                data.soc = static_cast<uint8_t>(slot_value);
+                data.present |= CANBatteryFields::SOC;
+                break;
+            case BatterySlot::TEMP1:
+                data.temp1 = slot_value;
+                data.present |= CANBatteryFields::TEMP1;
+                break;
+            case BatterySlot::TEMP2:
+                data.temp2 = slot_value;
+                data.present |= CANBatteryFields::TEMP2;
+                break;
+            case BatterySlot::STATUS_FLAGS:
+                data.status_flags = static_cast<uint8_t>(slot_value);
+                data.present |= CANBatteryFields::STATUS_FLAGS;
+                break;
+            case BatterySlot::PACK_IDENTIFIER:
+                data.pack_identifier = static_cast<uint32_t>(slot_value);
+                data.present |= CANBatteryFields::IDENTIFIER;
+                break;
+            case BatterySlot::NONE:
+                break;
         }
     }
 
@@ -106,20 +367,88 @@ float CANParser::extractField(const CANMessage& msg, const char* field_name) {
         return NAN;
     }
 
-    // Find message definition
-    const Protocol::Message* msg_def = protocol->findMessage(msg.id);
-    if (!msg_def) {
-        return NAN;
+    // Served from the last-value cache when the payload hasn't changed
+    DecodedFrame decoded;
+    decode(msg, decoded);
+    return decoded.getValue(field_name);
+}
+
+int CANParser::findCacheSlot(uint32_t can_id, bool extended) const {
+    size_t index = (can_id ^ (can_id >> 5) ^ (can_id >> 10)) & (CACHE_SIZE - 1);
+
+    for (size_t probe = 0; probe < CACHE_SIZE; probe++) {
+        const CacheEntry& entry = cache[index];
+        if (!entry.used) {
+            return static_cast<int>(index);
+        }
+        if (entry.record.frame.id == can_id && entry.record.frame.extended == extended) {
+            return static_cast<int>(index);
+        }
+        index = (index + 1) & (CACHE_SIZE - 1);
     }
+    return -1;
+}
 
-    // Find field in message
-    const Protocol::Field* field = msg_def->findField(field_name);
-    if (!field) {
-        return NAN;
+bool CANParser::getLastDecoded(uint32_t can_id, DecodedFrame& out) const {
+    bool found = false;
+
+    portENTER_CRITICAL(&cache_mux);
+    int slot = findCacheSlot(can_id, can_id > 0x7FF);
+    if (slot >= 0 && cache[slot].used) {
+        out = cache[slot].record;
+        found = true;
+    }
+    portEXIT_CRITICAL(&cache_mux);
+
+    return found;
+}
+
+size_t CANParser::getAllLastDecoded(DecodedFrame* out, size_t max_count) const {
+    size_t count = 0;
+
+    portENTER_CRITICAL(&cache_mux);
+    for (size_t i = 0; i < CACHE_SIZE && count < max_count; i++) {
+        if (cache[i].used) {
+            out[count++] = cache[i].record;
+        }
+    }
+    portEXIT_CRITICAL(&cache_mux);
+
+    return count;
+}
+
+void CANParser::clearCache() {
+    portENTER_CRITICAL(&cache_mux);
+    for (size_t i = 0; i < CACHE_SIZE; i++) {
+        cache[i].used = false;
+        cache[i].repeats = 0;
     }
+    portEXIT_CRITICAL(&cache_mux);
+}
 
-    // Extract and return value
-    return field->extractValue(msg.data);
+size_t CANParser::getAcceptedIds(uint32_t* ids, size_t max_ids) const {
+    size_t count = 0;
+    auto add = [&](uint32_t id) {
+        if (count < max_ids) {
+            ids[count++] = id;
+        }
+    };
+
+    for (uint8_t i = 0; i < id_index_count; i++) {
+        add(id_index[i].can_id);
+    }
+
+    if (protocol == nullptr) {
+        // Legacy parser ranges (see decodeUncached)
+        for (uint32_t id = 0x100; id <= 0x104; id++) {
+            if (!findIndex(id)) add(id);
+        }
+        for (uint32_t id = 0x200; id <= 0x204; id++) {
+            if (!findIndex(id)) add(id);
+        }
+    }
+
+    return count;
 }
 
 void CANParser::registerHandler(uint32_t can_id, MessageHandler handler) {
@@ -133,6 +462,8 @@ void CANParser::registerHandler(uint32_t can_id, MessageHandler handler) {
         if (handlers[i].can_id == can_id) {
             Serial.printf("CANParser: Updating handler for ID 0x%03X\n", can_id);
             handlers[i].handler = handler;
+            rebuildIndex();
+            clearCache();
             return;
         }
     }
@@ -141,6 +472,8 @@ void CANParser::registerHandler(uint32_t can_id, MessageHandler handler) {
     handlers[handler_count].can_id = can_id;
     handlers[handler_count].handler = handler;
     handler_count++;
+    rebuildIndex();
+    clearCache();
 
     Serial.printf("CANParser: Registered handler for ID 0x%03X\n", can_id);
 }
@@ -168,12 +501,17 @@ bool CANParser::parseBatteryStatus(const CANMessage& msg, CANBatteryData& data)
     // Parse SOC (byte 4, 0-100%)
     data.soc = msg.data[4];
 
+    data.present = CANBatteryFields::VOLTAGE | CANBatteryFields::CURRENT |
+                   CANBatteryFields::SOC | CANBatteryFields::STATUS_FLAGS;
+
     // Parse temperatures (bytes 5-6, offset by 40)
     if (msg.data[5] != 0xFF) {  // 0xFF = invalid/not present
         data.temp1 = msg.data[5] - 40.0f;
+        data.present |= CANBatteryFields::TEMP1;
     }
     if (msg.data[6] != 0xFF) {
         data.temp2 = msg.data[6] - 40.0f;
+        data.present |= CANBatteryFields::TEMP2;
     }
 
     // Parse status flags (byte 7)
@@ -3,15 +3,48 @@
 
 #include "can_message.h"
 #include "protocol.h"
+#include "can_frame_bus.h"
+
+// A received frame decoded once and shared with every consumer
+struct DecodedFrame {
+    CANMessage frame;                       // Raw frame as received
+    const Protocol::Message* message;       // Matching protocol message (nullptr if none)
+    uint8_t value_count;                    // Entries used in values[]
+    uint16_t valid_mask;                    // Bit i set = values[i] passed its range check
+    float values[MAX_FIELDS_PER_MESSAGE];   // Extracted values, in message field order
+    CANBatteryData battery;                 // Standard fields mapped for BatteryModule
+    bool decoded;                           // A parser (protocol, handler or legacy) accepted it
+    bool from_cache;                        // Payload identical to the last frame with this ID
+
+    DecodedFrame() : message(nullptr), value_count(0), valid_mask(0),
+                     decoded(false), from_cache(false) {}
+
+    // Extracted value of a protocol field (NAN if not present)
+    float getValue(const char* field_name) const;
+};
+
+// Decoded frames, published once per frame after parsing
+using DecodedFrameBus = FrameBus<DecodedFrame>;
 
 // CAN protocol parser class
 class CANParser {
 public:
     CANParser();
+    ~CANParser();
 
-    // Set the protocol to use for parsing
+    // Set the protocol to use for parsing. The definition is compiled into a
+    // per-message dispatch table here; call again if it is modified.
     void setProtocol(const Protocol::Definition* protocol);
 
+    // Decode a frame once: raw frame, matched message, field values and
+    // battery data. Repeated identical payloads are served from the
+    // last-value cache without re-decoding.
+    // id_offset maps a bus ID onto the protocol (protocol ID = msg.id - id_offset)
+    // and battery_id, if >= 0, overrides the decoded battery_id; both are used
+    // by CANRouter so several packs can share one parser.
+    bool decode(const CANMessage& msg, DecodedFrame& out,
+                int32_t id_offset = 0, int16_t battery_id = -1);
+
     // Parse a CAN message and extract battery data using the configured protocol
     bool parseMessage(const CANMessage& msg, CANBatteryData& data);
 
@@ -22,17 +55,79 @@ public:
     // Get the current protocol
     const Protocol::Definition* getProtocol() const { return protocol; }
 
+    // List the CAN IDs this parser can decode (handlers + protocol/legacy IDs)
+    // Returns the number of IDs written, at most max_ids
+    size_t getAcceptedIds(uint32_t* ids, size_t max_ids) const;
+
     // Register custom message handlers (legacy support)
+    // Handlers must be pure functions of the frame: results are cached.
+    // Set CANBatteryData::present for every value filled in
     typedef bool (*MessageHandler)(const CANMessage&, CANBatteryData&);
     void registerHandler(uint32_t can_id, MessageHandler handler);
 
+    // Last-value cache (safe to read from other tasks)
+    bool getLastDecoded(uint32_t can_id, DecodedFrame& out) const;
+    size_t getAllLastDecoded(DecodedFrame* out, size_t max_count) const;
+    void clearCache();
+    uint32_t getCacheHits() const { return cache_hits; }
+    uint32_t getCacheMisses() const { return cache_misses; }
+
+    // Consumers of decoded frames; the parsing task publishes each record once
+    DecodedFrameBus& getDecodedBus() { return decoded_bus; }
+    const DecodedFrameBus& getDecodedBus() const { return decoded_bus; }
+
 private:
     const Protocol::Definition* protocol;
 
-    // Parse message using protocol definition
-    bool parseWithProtocol(const CANMessage& msg, CANBatteryData& data);
+    // Full decode, bypassing the cache (protocol_id = ID to look up)
+    bool decodeUncached(const CANMessage& msg, uint32_t protocol_id, DecodedFrame& out);
+
+    // CANBatteryData member a protocol field feeds
+    enum class BatterySlot : uint8_t {
+        NONE,
+        PACK_VOLTAGE,
+        PACK_CURRENT,
+        SOC,
+        TEMP1,
+        TEMP2,
+        STATUS_FLAGS,
+        PACK_IDENTIFIER
+    };
+
+    // Protocol field resolved at setProtocol() time: no string compares or
+    // DataType switch left for the per-frame path
+    struct CompiledField {
+        Protocol::RawExtractor extract;
+        uint8_t byte_offset;
+        BatterySlot slot;
+        float scale;            // Field value = raw * scale + offset
+        float offset;
+        float slot_scale;       // Slot value = raw * slot_scale + slot_offset
+        float slot_offset;      //   (scale/offset with mV->V, mA->A folded in)
+        float min_value;        // -INFINITY / INFINITY when unbounded
+        float max_value;
+    };
+
+    struct CompiledMessage {
+        uint32_t can_id;
+        const Protocol::Message* message;
+        uint8_t field_count;
+        const CompiledField* fields;    // Into compiled_fields
+    };
+
+    // Sized to the protocol at compile time
+    CompiledMessage* compiled;
+    CompiledField* compiled_fields;
+    uint8_t compiled_count;
+
+    void compileProtocol();
+    static BatterySlot resolveSlot(const Protocol::Field& field, float& unit_factor);
+
+    // Parse message using its compiled protocol definition
+    bool parseWithProtocol(const CANMessage& msg, const CompiledMessage& cm, DecodedFrame& out);
 
     // Legacy parsers for backwards compatibility (deprecated)
+    static bool isLegacyId(uint32_t can_id);
     bool parseBatteryStatus(const CANMessage& msg, CANBatteryData& data);
     bool parseCellVoltages(const CANMessage& msg, CANBatteryData& data);
 
@@ -44,6 +139,46 @@ private:
     };
     HandlerEntry handlers[MAX_HANDLERS];
     size_t handler_count;
+
+    // CAN ID index, rebuilt whenever the protocol or handlers change.
+    // Sorted for binary search; handlers shadow protocol messages.
+    enum class IndexKind : uint8_t { HANDLER, MESSAGE };
+    struct IndexEntry {
+        uint32_t can_id;
+        IndexKind kind;
+        uint8_t slot;           // Into handlers[] or compiled[]
+    };
+    static constexpr size_t MAX_INDEX_ENTRIES = MAX_HANDLERS + MAX_MESSAGES_PER_PROTOCOL;
+    IndexEntry id_index[MAX_INDEX_ENTRIES];
+    uint8_t id_index_count;
+
+    // One bit per 11-bit ID that some parser path handles
+    uint32_t std_id_bitmap[2048 / 32];
+
+    void rebuildIndex();
+    void markStdId(uint32_t can_id);
+    bool isKnownId(uint32_t can_id, bool extended) const;
+    const IndexEntry* findIndex(uint32_t can_id) const;
+
+    // Last decoded record per CAN ID (open addressing, linear probing)
+    static constexpr size_t CACHE_SIZE = 64;    // Power of two
+    struct CacheEntry {
+        bool used;
+        uint32_t repeats;       // Identical payloads served since last change
+        DecodedFrame record;
+    };
+    CacheEntry cache[CACHE_SIZE];
+    mutable portMUX_TYPE cache_mux;
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+
+    DecodedFrameBus decoded_bus;
+
+    // Slot holding can_id, or the free slot it would go in (-1 if table full)
+    int findCacheSlot(uint32_t can_id, bool extended) const;
 };
 
+// Global parser instance (defined in main.cpp)
+extern CANParser canParser;
+
 #endif // CAN_PARSER_H
@@ -0,0 +1,353 @@
+#include "can_router.h"
+#include "builtin_protocols.h"
+#include "protocol_loader.h"
+#include "../utils/remote_log.h"
+
+CANRouter::CANRouter()
+    : fallback(nullptr), parser_count(0), channel_count(0),
+      ext_route_count(0), unrouted_count(0) {
+    memset(std_route, NO_ROUTE, sizeof(std_route));
+}
+
+CANRouter::~CANRouter() {
+    reset();
+}
+
+void CANRouter::reset() {
+    for (size_t i = 0; i < parser_count; i++) {
+        delete parsers[i].parser;
+        delete parsers[i].owned;
+        parsers[i].parser = nullptr;
+        parsers[i].owned = nullptr;
+    }
+    parser_count = 0;
+    channel_count = 0;
+    ext_route_count = 0;
+    unrouted_count = 0;
+    memset(std_route, NO_ROUTE, sizeof(std_route));
+}
+
+bool CANRouter::begin(const Settings& settings, CANParser* fallbackParser, Protocol::Loader* loader) {
+    reset();
+    fallback = fallbackParser;
+
+    for (uint8_t b = 0; b < settings.num_batteries && b < MAX_BATTERY_MODULES; b++) {
+        const BatteryConfig& cfg = settings.batteries[b];
+        if (!cfg.enabled) {
+            continue;
+        }
+
+        CANParser* parser = getParser(cfg, loader);
+        if (parser == nullptr) {
+            LOG_WARN("CANRouter: Battery %u has no usable protocol, using fallback parser", b);
+            continue;
+        }
+
+        uint32_t proto_ids[MAX_MESSAGES_PER_PROTOCOL];
+        size_t proto_count = parser->getAcceptedIds(proto_ids, MAX_MESSAGES_PER_PROTOCOL);
+        if (proto_count == 0) {
+            continue;
+        }
+
+        uint32_t min_id = proto_ids[0];
+        for (size_t i = 1; i < proto_count; i++) {
+            if (proto_ids[i] < min_id) min_id = proto_ids[i];
+        }
+
+        uint8_t index = static_cast<uint8_t>(channel_count);
+        Channel& ch = channels[index];
+        ch.battery_id = b;
+        ch.id_offset = cfg.can_base_id == 0 ? 0 : static_cast<int32_t>(cfg.can_base_id - min_id);
+        ch.parser = parser;
+        ch.id_count = 0;
+
+        for (size_t i = 0; i < proto_count; i++) {
+            uint32_t bus_id = proto_ids[i] + ch.id_offset;
+            if (addRoute(bus_id, bus_id > 0x7FF, index)) {
+                ch.id_count++;
+            } else {
+                LOG_WARN("CANRouter: ID 0x%03X of battery %u already routed, set a distinct can_base_id",
+                         bus_id, b);
+            }
+        }
+
+        if (ch.id_count > 0) {
+            channel_count++;
+            LOG_INFO("CANRouter: Battery %u -> '%s' at 0x%03X (%u IDs)",
+                     b, parser->getProtocol()->name, min_id + ch.id_offset, ch.id_count);
+        }
+    }
+
+    LOG_INFO("CANRouter: %u channel(s), %u parser(s)",
+             (unsigned)channel_count, (unsigned)parser_count);
+    return channel_count > 0;
+}
+
+CANParser* CANRouter::getParser(const BatteryConfig& config, Protocol::Loader* loader) {
+    bool custom = config.protocol_source == ProtocolSource::CUSTOM_PROTOCOL;
+
+    // Batteries on the same protocol share its parser and compiled table
+    for (size_t i = 0; i < parser_count; i++) {
+        if (parsers[i].source == config.protocol_source &&
+            (!custom || strcmp(parsers[i].path, config.protocol_path) == 0)) {
+            return parsers[i].parser;
+        }
+    }
+
+    if (parser_count >= MAX_PARSERS) {
+        return nullptr;
+    }
+
+    const Protocol::Definition* definition = nullptr;
+    Protocol::OwnedDefinition* owned = nullptr;
+
+    if (custom) {
+        if (loader == nullptr || config.protocol_path[0] == '\0') {
+            return nullptr;
+        }
+        owned = new Protocol::OwnedDefinition();
+        if (owned == nullptr) {
+            return nullptr;
+        }
+        if (!loader->loadFromFile(config.protocol_path, *owned)) {
+            LOG_WARN("CANRouter: Failed to load %s: %s", config.protocol_path, loader->getLastError());
+            delete owned;
+            return nullptr;
+        }
+        definition = owned->get();
+    } else {
+        definition = Protocol::getBuiltinProtocol(
+            static_cast<Protocol::BuiltinId>(config.protocol_source));
+        if (definition == nullptr) {
+            return nullptr;
+        }
+    }
+
+    CANParser* parser = new CANParser();
+    if (parser == nullptr) {
+        delete owned;
+        return nullptr;
+    }
+    parser->setProtocol(definition);
+
+    ParserSlot& slot = parsers[parser_count++];
+    slot.source = config.protocol_source;
+    strlcpy(slot.path, custom ? config.protocol_path : "", sizeof(slot.path));
+    slot.parser = parser;
+    slot.owned = owned;
+    return parser;
+}
+
+bool CANRouter::addRoute(uint32_t can_id, bool extended, uint8_t channel) {
+    if (!extended) {
+        if (std_route[can_id] != NO_ROUTE) {
+            return false;
+        }
+        std_route[can_id] = channel;
+        return true;
+    }
+
+    if (ext_route_count >= MAX_EXT_ROUTES) {
+        return false;
+    }
+
+    size_t pos = ext_route_count;
+    while (pos > 0 && ext_routes[pos - 1].can_id > can_id) {
+        pos--;
+    }
+    if (pos > 0 && ext_routes[pos - 1].can_id == can_id) {
+        return false;
+    }
+    memmove(&ext_routes[pos + 1], &ext_routes[pos], (ext_route_count - pos) * sizeof(ExtRoute));
+    ext_routes[pos].can_id = can_id;
+    ext_routes[pos].channel = channel;
+    ext_route_count++;
+    return true;
+}
+
+uint8_t CANRouter::findRoute(uint32_t can_id, bool extended) const {
+    if (!extended) {
+        return can_id <= 0x7FF ? std_route[can_id] : NO_ROUTE;
+    }
+
+    size_t lo = 0, hi = ext_route_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (ext_routes[mid].can_id < can_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < ext_route_count && ext_routes[lo].can_id == can_id) ? ext_routes[lo].channel : NO_ROUTE;
+}
+
+bool CANRouter::decode(const CANMessage& msg, DecodedFrame& out) {
+    uint8_t route = findRoute(msg.id, msg.extended);
+    if (route != NO_ROUTE) {
+        const Channel& ch = channels[route];
+        return ch.parser->decode(msg, out, ch.id_offset, ch.battery_id);
+    }
+
+    unrouted_count++;
+    if (fallback != nullptr) {
+        return fallback->decode(msg, out);
+    }
+
+    out = DecodedFrame();
+    out.frame = msg;
+    return false;
+}
+
+int CANRouter::getBatteryForId(uint32_t can_id, bool extended) const {
+    uint8_t route = findRoute(can_id, extended);
+    return route != NO_ROUTE ? channels[route].battery_id : -1;
+}
+
+size_t CANRouter::getAcceptedIds(uint32_t* ids, size_t max_ids) const {
+    size_t count = 0;
+
+    for (uint32_t id = 0; id <= 0x7FF && count < max_ids; id++) {
+        if (std_route[id] != NO_ROUTE) {
+            ids[count++] = id;
+        }
+    }
+    for (size_t i = 0; i < ext_route_count && count < max_ids; i++) {
+        ids[count++] = ext_routes[i].can_id;
+    }
+
+    if (fallback != nullptr && count < max_ids) {
+        uint32_t extra[CAN_FILTER_MAX_IDS];
+        size_t extra_count = fallback->getAcceptedIds(extra, CAN_FILTER_MAX_IDS);
+        for (size_t i = 0; i < extra_count && count < max_ids; i++) {
+            // Routed IDs never reach the fallback parser
+            if (findRoute(extra[i], extra[i] > 0x7FF) == NO_ROUTE) {
+                ids[count++] = extra[i];
+            }
+        }
+    }
+
+    return count;
+}
+
+size_t CANRouter::getExpectedPeriods(uint32_t* ids, uint16_t* periods, size_t max_ids) const {
+    size_t count = 0;
+
+    for (size_t c = 0; c < channel_count; c++) {
+        const Channel& ch = channels[c];
+        const Protocol::Definition* protocol = ch.parser->getProtocol();
+        if (protocol == nullptr) {
+            continue;
+        }
+
+        for (uint8_t i = 0; i < protocol->message_count && count < max_ids; i++) {
+            const Protocol::Message& message = protocol->messages[i];
+            uint32_t bus_id = message.can_id + ch.id_offset;
+            // Skip periodless messages and IDs another channel claimed first
+            if (message.period_ms == 0 || findRoute(bus_id, bus_id > 0x7FF) != c) {
+                continue;
+            }
+            ids[count] = bus_id;
+            periods[count] = message.period_ms;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+bool CANRouter::prepareLoadTest(CANLoadTest::Config& config) const {
+    if (!config.loopback) {
+        config.template_count = getLoadTemplates(config.templates, CANLoadTest::MAX_TEMPLATES);
+        return true;
+    }
+
+    // Nothing a BMS or one of our parsers could take for pack data
+    config.template_count = 0;
+    config.foreign_pct = 100;
+
+    uint32_t first = CAN_LOADTEST_FOREIGN_ID;
+    for (uint32_t id = first; id < first + CANLoadTest::FOREIGN_IDS; id++) {
+        if (std_route[id] != NO_ROUTE) {
+            return false;
+        }
+    }
+    if (fallback != nullptr) {
+        uint32_t ids[CAN_FILTER_MAX_IDS];
+        size_t count = fallback->getAcceptedIds(ids, CAN_FILTER_MAX_IDS);
+        for (size_t i = 0; i < count; i++) {
+            if (ids[i] - first < CANLoadTest::FOREIGN_IDS) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+size_t CANRouter::getLoadTemplates(CANLoadTest::Template* out, size_t max) const {
+    size_t count = 0;
+
+    for (size_t c = 0; c < channel_count; c++) {
+        const Protocol::Definition* protocol = channels[c].parser->getProtocol();
+        if (protocol != nullptr) {
+            count = CANLoadTest::addTemplates(*protocol, channels[c].id_offset, out, count, max);
+        }
+    }
+
+    if (channel_count == 0 && fallback != nullptr && fallback->getProtocol() != nullptr) {
+        count = CANLoadTest::addTemplates(*fallback->getProtocol(), 0, out, count, max);
+    }
+
+    return count;
+}
+
+size_t CANRouter::getAllLastDecoded(DecodedFrame* out, size_t max_count) const {
+    size_t count = 0;
+    for (size_t i = 0; i < parser_count && count < max_count; i++) {
+        count += parsers[i].parser->getAllLastDecoded(out + count, max_count - count);
+    }
+    if (fallback != nullptr && count < max_count) {
+        count += fallback->getAllLastDecoded(out + count, max_count - count);
+    }
+    return count;
+}
+
+uint32_t CANRouter::getCacheHits() const {
+    uint32_t hits = fallback != nullptr ? fallback->getCacheHits() : 0;
+    for (size_t i = 0; i < parser_count; i++) {
+        hits += parsers[i].parser->getCacheHits();
+    }
+    return hits;
+}
+
+uint32_t CANRouter::getCacheMisses() const {
+    uint32_t misses = fallback != nullptr ? fallback->getCacheMisses() : 0;
+    for (size_t i = 0; i < parser_count; i++) {
+        misses += parsers[i].parser->getCacheMisses();
+    }
+    return misses;
+}
+
+size_t CANRouter::getDiagnostics(char* buffer, size_t size) const {
+    if (!buffer || size == 0) return 0;
+
+    size_t len = 0;
+    buffer[0] = '\0';
+
+    for (size_t i = 0; i < channel_count && len < size; i++) {
+        const Channel& ch = channels[i];
+        int n = snprintf(buffer + len, size - len,
+            "  Battery %u: %-16s offset %+d  %u IDs\n",
+            ch.battery_id, ch.parser->getProtocol()->name,
+            (int)ch.id_offset, ch.id_count);
+        if (n < 0) break;
+        len += static_cast<size_t>(n);
+    }
+
+    if (len < size) {
+        int n = snprintf(buffer + len, size - len, "  Unrouted frames: %u\n", unrouted_count);
+        if (n > 0) len += static_cast<size_t>(n);
+    }
+
+    return len < size ? len : size - 1;
+}
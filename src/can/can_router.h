@@ -0,0 +1,112 @@
+#ifndef CAN_ROUTER_H
+#define CAN_ROUTER_H
+
+#include "can_parser.h"
+#include "can_load_test.h"
+#include "../config/config.h"
+#include "../config/settings.h"
+
+namespace Protocol {
+    class Loader;
+}
+
+// Demultiplexes a shared bus onto per-battery decoders.
+//
+// Each enabled battery gets a channel: its protocol's parser plus the ID
+// offset of its can_base_id (the lowest protocol ID lands on can_base_id).
+// Batteries using the same protocol share one parser, and so one compiled
+// dispatch table. Routes are resolved once in begin() into a 2048-entry table
+// for standard IDs and a sorted list for extended IDs, so per-frame cost is a
+// single lookup regardless of the number of packs. Frames without a route go
+// to the fallback parser (custom handlers and the legacy 0x100/0x200 layout).
+class CANRouter {
+public:
+    CANRouter();
+    ~CANRouter();
+
+    // Build parsers, channels and route tables from the battery settings.
+    // Custom protocols are loaded through the loader (skipped if nullptr).
+    // Call during setup, before frames are decoded.
+    bool begin(const Settings& settings, CANParser* fallback, Protocol::Loader* loader = nullptr);
+
+    // Decode a frame with the parser of the battery that owns its ID
+    bool decode(const CANMessage& msg, DecodedFrame& out);
+
+    // Battery that owns a bus ID (-1 if unrouted)
+    int getBatteryForId(uint32_t can_id, bool extended) const;
+
+    // All IDs to accept: routed IDs plus the fallback parser's IDs
+    size_t getAcceptedIds(uint32_t* ids, size_t max_ids) const;
+
+    // Routed IDs whose protocol message has a period_ms, with that period
+    size_t getExpectedPeriods(uint32_t* ids, uint16_t* periods, size_t max_ids) const;
+
+    // Load test templates for every channel's protocol at its bus IDs (the
+    // fallback parser's protocol when no battery is routed)
+    size_t getLoadTemplates(CANLoadTest::Template* out, size_t max) const;
+
+    // Fill in a load test's frames. Injected runs get getLoadTemplates();
+    // loopback runs put their frames on the real bus, so they get foreign
+    // IDs only, and false if any of those is routed or parsed here
+    bool prepareLoadTest(CANLoadTest::Config& config) const;
+
+    // Last-value caches of every parser
+    size_t getAllLastDecoded(DecodedFrame* out, size_t max_count) const;
+    uint32_t getCacheHits() const;
+    uint32_t getCacheMisses() const;
+
+    // Channel summary for diagnostics; returns characters written
+    size_t getDiagnostics(char* buffer, size_t size) const;
+
+    size_t getChannelCount() const { return channel_count; }
+    uint32_t getUnroutedCount() const { return unrouted_count; }
+
+private:
+    static constexpr uint8_t NO_ROUTE = 0xFF;
+    static constexpr size_t MAX_PARSERS = MAX_BATTERY_MODULES;
+    static constexpr size_t MAX_EXT_ROUTES = MAX_BATTERY_MODULES * MAX_MESSAGES_PER_PROTOCOL;
+
+    // One parser per distinct protocol
+    struct ParserSlot {
+        ProtocolSource source;
+        char path[48];
+        CANParser* parser;
+        Protocol::OwnedDefinition* owned;   // Loaded custom protocol (nullptr for built-ins)
+    };
+
+    struct Channel {
+        uint8_t battery_id;
+        int32_t id_offset;      // Bus ID - protocol ID
+        CANParser* parser;
+        uint8_t id_count;       // Routes claimed by this channel
+    };
+
+    struct ExtRoute {
+        uint32_t can_id;
+        uint8_t channel;
+    };
+
+    CANParser* fallback;
+
+    ParserSlot parsers[MAX_PARSERS];
+    size_t parser_count;
+
+    Channel channels[MAX_BATTERY_MODULES];
+    size_t channel_count;
+
+    uint8_t std_route[2048];            // Standard ID -> channel index (NO_ROUTE if none)
+    ExtRoute ext_routes[MAX_EXT_ROUTES];  // Sorted by can_id
+    size_t ext_route_count;
+
+    uint32_t unrouted_count;
+
+    void reset();
+    CANParser* getParser(const BatteryConfig& config, Protocol::Loader* loader);
+    bool addRoute(uint32_t can_id, bool extended, uint8_t channel);
+    uint8_t findRoute(uint32_t can_id, bool extended) const;
+};
+
+// Global instance
+extern CANRouter canRouter;
+
+#endif // CAN_ROUTER_H
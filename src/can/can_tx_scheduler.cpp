@@ -0,0 +1,553 @@
+#include "can_tx_scheduler.h"
+#include "can_driver.h"
+#include "can_analyzer.h"
+#include "../utils/remote_log.h"
+#include "driver/twai.h"
+
+// Longest the task sleeps with nothing due (expiry checks keep running)
+static constexpr uint32_t IDLE_WAIT_MS = 1000;
+// Retry delay when the controller would not take a frame
+static constexpr uint32_t RETRY_WAIT_MS = 5;
+
+static uint32_t frameKey(const CANMessage& msg) {
+    return (msg.id & CANFrame::ID_MASK) | (msg.extended ? CANFrame::FLAG_EXTENDED : 0);
+}
+
+CANTxScheduler::CANTxScheduler()
+    : pending_count_(0),
+      in_flight_(false),
+      flight_start_(0),
+      tokens_(0),
+      token_time_(0),
+      refill_bits_per_ms_(0),
+      bucket_bits_(0),
+      mux_(portMUX_INITIALIZER_UNLOCKED),
+      alerts_(0),
+      holds_(0),
+      parked_(nullptr),
+      driver_stats_(nullptr),
+      task_handle_(nullptr) {
+    for (size_t i = 0; i < MAX_PERIODIC; i++) {
+        periodic_[i] = Periodic();
+    }
+    memset(limits_, 0, sizeof(limits_));
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+bool CANTxScheduler::begin(uint32_t bitrate, CANStats* stats) {
+    if (task_handle_ != nullptr) {
+        return true;
+    }
+
+    driver_stats_ = stats;
+    refill_bits_per_ms_ = bitrate * (CAN_TX_MAX_LOAD_PCT / 100.0f) / 1000.0f;
+    bucket_bits_ = CAN_TX_BURST_FRAMES * static_cast<float>(CANAnalyzer::frameBits(true, false, 8));
+    tokens_ = bucket_bits_;
+    token_time_ = millis();
+
+    if (parked_ == nullptr) {
+        parked_ = xSemaphoreCreateBinary();
+        if (parked_ == nullptr) {
+            LOG_ERROR("CANTxScheduler: Failed to create hold semaphore");
+            return false;
+        }
+    }
+
+    if (xTaskCreatePinnedToCore(taskFunc, "CAN TX", 3072, this, 2, &task_handle_, 0) != pdPASS) {
+        task_handle_ = nullptr;
+        LOG_ERROR("CANTxScheduler: Failed to create TX task");
+        return false;
+    }
+    return true;
+}
+
+void CANTxScheduler::end() {
+    if (task_handle_ != nullptr) {
+        vTaskDelete(task_handle_);
+        task_handle_ = nullptr;
+    }
+    in_flight_ = false;
+}
+
+bool CANTxScheduler::submit(const CANMessage& msg, TxPriority priority, TxCallback callback) {
+    Request request;
+    request.msg = msg;
+    request.queued_us = micros();
+    request.callback = callback;
+    request.priority = priority;
+    request.periodic = -1;
+    request.rate_limited = false;
+    request.budget_waited = false;
+
+    bool ok = submit_queue_.push(request);
+
+    portENTER_CRITICAL(&mux_);
+    if (ok) {
+        stats_.submitted++;
+    } else {
+        stats_.rejected++;
+    }
+    portEXIT_CRITICAL(&mux_);
+
+    if (ok && task_handle_ != nullptr) {
+        xTaskNotifyGive(task_handle_);
+    }
+    return ok;
+}
+
+int CANTxScheduler::addPeriodic(const CANMessage& msg, uint32_t period_ms, TxPriority priority,
+                                TxPrepare prepare, TxCallback callback) {
+    if (period_ms == 0) {
+        return -1;
+    }
+
+    int handle = -1;
+    portENTER_CRITICAL(&mux_);
+    for (size_t i = 0; i < MAX_PERIODIC; i++) {
+        Periodic& slot = periodic_[i];
+        if (slot.active) {
+            continue;
+        }
+        slot.active = true;
+        slot.queued = false;
+        slot.msg = msg;
+        slot.period_ms = period_ms;
+        slot.next_due = millis();       // First frame right away
+        slot.sequence = 0;
+        slot.priority = priority;
+        slot.prepare = prepare;
+        slot.callback = callback;
+        handle = static_cast<int>(i);
+        break;
+    }
+    portEXIT_CRITICAL(&mux_);
+
+    if (handle >= 0 && task_handle_ != nullptr) {
+        xTaskNotifyGive(task_handle_);
+    }
+    return handle;
+}
+
+bool CANTxScheduler::updatePeriodic(int handle, const uint8_t* data, uint8_t dlc) {
+    if (handle < 0 || handle >= static_cast<int>(MAX_PERIODIC) || data == nullptr || dlc > 8) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&mux_);
+    Periodic& slot = periodic_[handle];
+    bool ok = slot.active;
+    if (ok) {
+        memcpy(slot.msg.data, data, dlc);
+        slot.msg.dlc = dlc;
+    }
+    portEXIT_CRITICAL(&mux_);
+    return ok;
+}
+
+bool CANTxScheduler::removePeriodic(int handle) {
+    if (handle < 0 || handle >= static_cast<int>(MAX_PERIODIC)) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&mux_);
+    bool ok = periodic_[handle].active;
+    periodic_[handle].active = false;
+    portEXIT_CRITICAL(&mux_);
+    return ok;
+}
+
+bool CANTxScheduler::setRateLimit(uint32_t id, bool extended, uint32_t min_interval_ms) {
+    uint32_t key = (id & CANFrame::ID_MASK) | (extended ? CANFrame::FLAG_EXTENDED : 0);
+
+    portENTER_CRITICAL(&mux_);
+    RateLimit* slot = nullptr;
+    RateLimit* free_slot = nullptr;
+    for (size_t i = 0; i < CAN_TX_MAX_RATE_LIMITS; i++) {
+        if (limits_[i].used && limits_[i].key == key) {
+            slot = &limits_[i];
+            break;
+        }
+        if (!limits_[i].used && free_slot == nullptr) {
+            free_slot = &limits_[i];
+        }
+    }
+
+    bool ok = true;
+    if (min_interval_ms == 0) {
+        if (slot != nullptr) {
+            slot->used = false;
+        }
+    } else if (slot != nullptr) {
+        slot->min_interval_ms = min_interval_ms;
+    } else if (free_slot != nullptr) {
+        free_slot->used = true;
+        free_slot->key = key;
+        free_slot->min_interval_ms = min_interval_ms;
+        free_slot->sent_once = false;
+    } else {
+        ok = false;
+    }
+    portEXIT_CRITICAL(&mux_);
+    return ok;
+}
+
+void CANTxScheduler::onAlerts(uint32_t alerts) {
+    uint32_t bits = alerts & (TWAI_ALERT_TX_SUCCESS | TWAI_ALERT_TX_FAILED | TWAI_ALERT_BUS_OFF);
+    if (bits == 0) {
+        return;
+    }
+    alerts_.fetch_or(bits);
+    if (task_handle_ != nullptr) {
+        xTaskNotifyGive(task_handle_);
+    }
+}
+
+bool CANTxScheduler::hold() {
+    holds_.fetch_add(1);
+    if (task_handle_ == nullptr) {
+        return true;    // No task, nothing to park
+    }
+
+    // Only an acknowledgement from a pass that already saw the hold counts
+    xSemaphoreTake(parked_, 0);
+    xTaskNotifyGive(task_handle_);
+    if (xSemaphoreTake(parked_, pdMS_TO_TICKS(CAN_TX_HOLD_TIMEOUT_MS)) == pdTRUE) {
+        return true;
+    }
+
+    LOG_WARN("CANTxScheduler: TX task did not pause within %u ms", (unsigned)CAN_TX_HOLD_TIMEOUT_MS);
+    release();
+    return false;
+}
+
+void CANTxScheduler::release() {
+    if (holds_.fetch_sub(1) == 1 && task_handle_ != nullptr) {
+        xTaskNotifyGive(task_handle_);
+    }
+}
+
+void CANTxScheduler::getStats(Stats& out) const {
+    portENTER_CRITICAL(&mux_);
+    out = stats_;
+    out.pending = pending_count_ + (in_flight_ ? 1 : 0);
+    out.periodic = 0;
+    for (size_t i = 0; i < MAX_PERIODIC; i++) {
+        if (periodic_[i].active) out.periodic++;
+    }
+    portEXIT_CRITICAL(&mux_);
+}
+
+void CANTxScheduler::taskFunc(void* parameter) {
+    CANTxScheduler* scheduler = static_cast<CANTxScheduler*>(parameter);
+
+    while (true) {
+        uint32_t wait_ms = scheduler->service();
+        // Woken early by submissions, new periodic frames and TX alerts
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+    }
+}
+
+uint32_t CANTxScheduler::service() {
+    uint32_t now = millis();
+    uint32_t alerts = alerts_.exchange(0);
+
+    // Read once: when set, this pass makes no TWAI call after acknowledging
+    bool held = holds_.load() > 0;
+
+    if (in_flight_) {
+        if (alerts & TWAI_ALERT_TX_SUCCESS) {
+            completeFlight(true);
+        } else if (alerts & (TWAI_ALERT_TX_FAILED | TWAI_ALERT_BUS_OFF)) {
+            completeFlight(false);
+        } else if (held) {
+            // The reinstall drops it from the controller; send it again later
+            requeueFlight();
+        } else if (now - flight_start_ >= CAN_TX_TIMEOUT_MS) {
+            // Nobody acknowledged it; stop the controller retrying
+            twai_clear_transmit_queue();
+            completeFlight(false);
+        }
+    }
+
+    if (held) {
+        xSemaphoreGive(parked_);
+    }
+
+    // Periodic frames first so one-shot bursts can't crowd them out
+    uint32_t wait_ms = collectPeriodic(now);
+    collectSubmitted();
+    expireWaiting(now);
+
+    if (in_flight_) {
+        uint32_t left = CAN_TX_TIMEOUT_MS - (now - flight_start_);
+        return left < wait_ms ? left : wait_ms;
+    }
+
+    if (held) {
+        return wait_ms;
+    }
+
+    uint32_t pick_wait = IDLE_WAIT_MS;
+    int next = pickNext(now, pick_wait);
+    if (next < 0) {
+        return pick_wait < wait_ms ? pick_wait : wait_ms;
+    }
+
+    if (!transmit(pending_[next], now)) {
+        return RETRY_WAIT_MS;   // Controller busy, stopped or between reinstalls
+    }
+    removePending(next);
+    return wait_ms < CAN_TX_TIMEOUT_MS ? wait_ms : CAN_TX_TIMEOUT_MS;
+}
+
+void CANTxScheduler::collectSubmitted() {
+    Request request;
+    while (pending_count_ < CAN_TX_PENDING && submit_queue_.pop(request)) {
+        pending_[pending_count_++] = request;
+    }
+}
+
+uint32_t CANTxScheduler::collectPeriodic(uint32_t now) {
+    Request due[MAX_PERIODIC];
+    TxPrepare prepare[MAX_PERIODIC];
+    uint32_t sequence[MAX_PERIODIC];
+    size_t due_count = 0;
+    size_t room = CAN_TX_PENDING - pending_count_;
+    uint32_t wait_ms = IDLE_WAIT_MS;
+
+    portENTER_CRITICAL(&mux_);
+    for (size_t i = 0; i < MAX_PERIODIC; i++) {
+        Periodic& slot = periodic_[i];
+        if (!slot.active) {
+            continue;
+        }
+
+        if (static_cast<int32_t>(now - slot.next_due) >= 0) {
+            if (slot.queued || due_count >= room) {
+                stats_.periodic_skipped++;
+            } else {
+                Request& request = due[due_count];
+                request.msg = slot.msg;
+                request.queued_us = micros();
+                request.callback = slot.callback;
+                request.priority = slot.priority;
+                request.periodic = static_cast<int8_t>(i);
+                request.rate_limited = false;
+                request.budget_waited = false;
+                prepare[due_count] = slot.prepare;
+                sequence[due_count] = slot.sequence++;
+                slot.queued = true;
+                due_count++;
+            }
+
+            // Keep the cadence, but don't try to catch up after a stall
+            slot.next_due += slot.period_ms;
+            if (static_cast<int32_t>(now - slot.next_due) >= 0) {
+                slot.next_due = now + slot.period_ms;
+            }
+        }
+
+        uint32_t until = slot.next_due - now;
+        if (until < wait_ms) {
+            wait_ms = until;
+        }
+    }
+    portEXIT_CRITICAL(&mux_);
+
+    // Payload callbacks run outside the lock
+    for (size_t i = 0; i < due_count; i++) {
+        if (prepare[i] != nullptr) {
+            prepare[i](due[i].msg, sequence[i]);
+        }
+        pending_[pending_count_++] = due[i];
+    }
+    return wait_ms;
+}
+
+void CANTxScheduler::expireWaiting(uint32_t now) {
+    uint32_t now_us = micros();
+    for (int i = static_cast<int>(pending_count_) - 1; i >= 0; i--) {
+        Request& request = pending_[i];
+        if (now_us - request.queued_us < CAN_TX_MAX_WAIT_MS * 1000UL) {
+            continue;
+        }
+
+        Request expired = request;
+        removePending(i);
+
+        portENTER_CRITICAL(&mux_);
+        stats_.expired++;
+        if (expired.periodic >= 0) {
+            periodic_[expired.periodic].queued = false;
+        }
+        portEXIT_CRITICAL(&mux_);
+
+        if (expired.callback != nullptr) {
+            expired.callback(expired.msg, false);
+        }
+    }
+}
+
+int CANTxScheduler::pickNext(uint32_t now, uint32_t& wait_ms) {
+    refillTokens(now);
+
+    int best = -1;
+    for (uint8_t i = 0; i < pending_count_; i++) {
+        Request& request = pending_[i];
+
+        uint32_t limit_wait = rateLimitWait(frameKey(request.msg), now);
+        if (limit_wait > 0) {
+            if (!request.rate_limited) {
+                request.rate_limited = true;
+                portENTER_CRITICAL(&mux_);
+                stats_.rate_limited++;
+                portEXIT_CRITICAL(&mux_);
+            }
+            if (limit_wait < wait_ms) wait_ms = limit_wait;
+            continue;
+        }
+
+        if (best < 0 ||
+            request.priority < pending_[best].priority ||
+            (request.priority == pending_[best].priority &&
+             static_cast<int32_t>(request.queued_us - pending_[best].queued_us) < 0)) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        return -1;
+    }
+
+    // Our share of the bus: wait for the bucket to refill rather than
+    // letting a lower priority frame go first
+    Request& request = pending_[best];
+    float bits = CANAnalyzer::frameBits(request.msg.extended, request.msg.rtr, request.msg.dlc);
+    if (tokens_ < bits) {
+        if (!request.budget_waited) {
+            request.budget_waited = true;
+            portENTER_CRITICAL(&mux_);
+            stats_.budget_waits++;
+            portEXIT_CRITICAL(&mux_);
+        }
+        uint32_t refill_ms = refill_bits_per_ms_ > 0
+                           ? static_cast<uint32_t>((bits - tokens_) / refill_bits_per_ms_) + 1 : RETRY_WAIT_MS;
+        if (refill_ms < wait_ms) wait_ms = refill_ms;
+        return -1;
+    }
+    return best;
+}
+
+bool CANTxScheduler::transmit(const Request& request, uint32_t now) {
+    // One frame at a time: a frame cleared after a timeout may still be
+    // on its way out, and its alert must not complete the next one
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) != ESP_OK ||
+        status.state != TWAI_STATE_RUNNING || status.msgs_to_tx > 0) {
+        return false;
+    }
+
+    twai_message_t twai_msg;
+    twai_msg.flags = 0;
+    twai_msg.identifier = request.msg.id;
+    twai_msg.data_length_code = request.msg.dlc;
+    twai_msg.rtr = request.msg.rtr ? 1 : 0;
+    twai_msg.extd = request.msg.extended ? 1 : 0;
+    memcpy(twai_msg.data, request.msg.data, request.msg.dlc);
+
+    alerts_.store(0);
+    if (twai_transmit(&twai_msg, 0) != ESP_OK) {
+        return false;
+    }
+
+    in_flight_ = true;
+    flight_ = request;
+    flight_start_ = now;
+    tokens_ -= CANAnalyzer::frameBits(request.msg.extended, request.msg.rtr, request.msg.dlc);
+    noteSent(frameKey(request.msg), now);
+    return true;
+}
+
+void CANTxScheduler::completeFlight(bool success) {
+    in_flight_ = false;
+    uint32_t latency_us = micros() - flight_.queued_us;
+
+    portENTER_CRITICAL(&mux_);
+    if (success) {
+        stats_.sent++;
+    } else {
+        stats_.failed++;
+    }
+    if (latency_us > stats_.max_latency_us) {
+        stats_.max_latency_us = latency_us;
+    }
+    if (flight_.periodic >= 0) {
+        periodic_[flight_.periodic].queued = false;
+    }
+    portEXIT_CRITICAL(&mux_);
+
+    if (driver_stats_ != nullptr) {
+        if (success) {
+            driver_stats_->tx_count++;
+        } else {
+            driver_stats_->tx_failed++;
+        }
+    }
+
+    if (flight_.callback != nullptr) {
+        flight_.callback(flight_.msg, success);
+    }
+}
+
+void CANTxScheduler::requeueFlight() {
+    in_flight_ = false;
+    if (pending_count_ >= CAN_TX_PENDING) {
+        completeFlight(false);
+        return;
+    }
+    // Keeps its queued_us, so it is still first in line and expires as before
+    pending_[pending_count_++] = flight_;
+}
+
+void CANTxScheduler::removePending(int index) {
+    // Order is kept by priority and queued_us, not by position
+    pending_[index] = pending_[--pending_count_];
+}
+
+uint32_t CANTxScheduler::rateLimitWait(uint32_t key, uint32_t now) const {
+    uint32_t wait_ms = 0;
+    portENTER_CRITICAL(&mux_);
+    for (size_t i = 0; i < CAN_TX_MAX_RATE_LIMITS; i++) {
+        const RateLimit& limit = limits_[i];
+        if (!limit.used || limit.key != key) {
+            continue;
+        }
+        uint32_t since = now - limit.last_sent;
+        if (limit.sent_once && since < limit.min_interval_ms) {
+            wait_ms = limit.min_interval_ms - since;
+        }
+        break;
+    }
+    portEXIT_CRITICAL(&mux_);
+    return wait_ms;
+}
+
+void CANTxScheduler::noteSent(uint32_t key, uint32_t now) {
+    portENTER_CRITICAL(&mux_);
+    for (size_t i = 0; i < CAN_TX_MAX_RATE_LIMITS; i++) {
+        RateLimit& limit = limits_[i];
+        if (limit.used && limit.key == key) {
+            limit.last_sent = now;
+            limit.sent_once = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&mux_);
+}
+
+void CANTxScheduler::refillTokens(uint32_t now) {
+    tokens_ += (now - token_time_) * refill_bits_per_ms_;
+    if (tokens_ > bucket_bits_) {
+        tokens_ = bucket_bits_;
+    }
+    token_time_ = now;
+}
@@ -0,0 +1,174 @@
+#ifndef CAN_TX_SCHEDULER_H
+#define CAN_TX_SCHEDULER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <atomic>
+#include "can_message.h"
+#include "../config/config.h"
+#include "../utils/mpsc_queue.h"
+
+struct CANStats;
+
+enum class TxPriority : uint8_t {
+    URGENT = 0,     // Wake-up and control requests
+    NORMAL,         // sendMessage() default
+    BACKGROUND      // Ping, background polls
+};
+
+// Transmit side of the CAN driver, run by its own "CAN TX" task.
+//
+// Callers never touch the TWAI driver: submit() puts a one-shot frame on a
+// lock-free queue and returns, and periodic frames are sent on the
+// scheduler's own clock. The task keeps up to CAN_TX_PENDING frames and
+// sends the best eligible one next:
+//
+//   - highest priority first, oldest first within a priority
+//   - an ID with a rate limit waits until its minimum interval has passed
+//     (frames of other IDs go ahead meanwhile)
+//   - all our frames together stay within CAN_TX_MAX_LOAD_PCT of the bus,
+//     with bursts of up to CAN_TX_BURST_FRAMES (token bucket in bits)
+//
+// Only one frame is handed to the controller at a time, so priorities hold
+// and every TWAI_ALERT_TX_SUCCESS/TX_FAILED (forwarded by the RX task)
+// completes exactly that frame. A frame with no completion within
+// CAN_TX_TIMEOUT_MS (no ACK, bus-off) is cleared and counted as failed;
+// frames still waiting after CAN_TX_MAX_WAIT_MS are dropped as expired.
+//
+// The task calls into the TWAI driver on its own, so whoever reinstalls the
+// driver first parks it with hold(): the call returns once the task has
+// acknowledged that it is between TWAI calls, and until release() it makes
+// none. A frame still in flight then is sent again afterwards (the
+// reinstall drops it), so it may reach the bus twice.
+class CANTxScheduler {
+public:
+    static constexpr size_t MAX_PERIODIC = CAN_TX_MAX_PERIODIC;
+
+    // Completion of a frame, in the TX task; keep it short
+    typedef void (*TxCallback)(const CANMessage& msg, bool success);
+    // Fills in a periodic frame just before it is queued (e.g. a counter)
+    typedef void (*TxPrepare)(CANMessage& msg, uint32_t sequence);
+
+    struct Stats {
+        uint32_t submitted;         // One-shot frames accepted
+        uint32_t rejected;          // submit() with the queue full
+        uint32_t sent;              // Acknowledged on the bus
+        uint32_t failed;            // TX_FAILED alerts or timeouts
+        uint32_t expired;           // Dropped after CAN_TX_MAX_WAIT_MS unsent
+        uint32_t periodic_skipped;  // Periods whose previous frame was still waiting
+        uint32_t rate_limited;      // Times a frame had to wait for its ID's interval
+        uint32_t budget_waits;      // Times the load budget held the next frame back
+        uint32_t max_latency_us;    // Submission to completion
+        uint8_t pending;            // Frames waiting in the scheduler
+        uint8_t periodic;           // Registered periodic frames
+    };
+
+    CANTxScheduler();
+
+    // Start the TX task; stats gets tx_count/tx_failed updates
+    bool begin(uint32_t bitrate, CANStats* stats);
+    void end();
+
+    // Any task, never blocks; false if the submit queue is full
+    bool submit(const CANMessage& msg, TxPriority priority = TxPriority::NORMAL,
+                TxCallback callback = nullptr);
+
+    // Periodic frames (any task); addPeriodic() returns a handle or -1
+    int addPeriodic(const CANMessage& msg, uint32_t period_ms,
+                    TxPriority priority = TxPriority::BACKGROUND, TxPrepare prepare = nullptr,
+                    TxCallback callback = nullptr);
+    bool updatePeriodic(int handle, const uint8_t* data, uint8_t dlc);
+    bool removePeriodic(int handle);
+
+    // Minimum interval between frames of one ID (0 removes the limit)
+    bool setRateLimit(uint32_t id, bool extended, uint32_t min_interval_ms);
+
+    // From the RX task: TX_SUCCESS / TX_FAILED / BUS_OFF alert bits
+    void onAlerts(uint32_t alerts);
+
+    // Park the TX task before the driver goes away (RX task). Waits up to
+    // CAN_TX_HOLD_TIMEOUT_MS for the task to acknowledge; false (and not
+    // held) if it didn't. Holds nest, each needs its release(). While held
+    // frames keep queueing and expire as usual
+    bool hold();
+    void release();
+    bool isHeld() const { return holds_.load() > 0; }
+
+    void getStats(Stats& out) const;
+    size_t getQueueDepth() const { return submit_queue_.size(); }
+    size_t getQueueCapacity() const { return submit_queue_.capacity(); }
+    TaskHandle_t getTaskHandle() const { return task_handle_; }
+
+private:
+    struct Request {
+        CANMessage msg;
+        uint32_t queued_us;         // micros() at submission / due time
+        TxCallback callback;
+        TxPriority priority;
+        int8_t periodic;            // Source slot, -1 for one-shots
+        bool rate_limited;          // Already counted in the stats
+        bool budget_waited;
+    };
+
+    struct Periodic {
+        bool active;
+        bool queued;                // Instance waiting in pending_ (TX task)
+        CANMessage msg;
+        uint32_t period_ms;
+        uint32_t next_due;          // millis()
+        uint32_t sequence;
+        TxPriority priority;
+        TxPrepare prepare;
+        TxCallback callback;
+    };
+
+    struct RateLimit {
+        bool used;
+        uint32_t key;               // id | CANFrame::FLAG_EXTENDED
+        uint32_t min_interval_ms;
+        uint32_t last_sent;         // millis()
+        bool sent_once;
+    };
+
+    MpscQueue<Request, CAN_TX_SUBMIT_QUEUE> submit_queue_;
+
+    // TX task only
+    Request pending_[CAN_TX_PENDING];
+    uint8_t pending_count_;
+    bool in_flight_;
+    Request flight_;
+    uint32_t flight_start_;         // millis()
+    float tokens_;                  // Bits we may still send now
+    uint32_t token_time_;           // millis() of the last refill
+    float refill_bits_per_ms_;
+    float bucket_bits_;
+
+    // Shared with other tasks, under mux_
+    Periodic periodic_[MAX_PERIODIC];
+    RateLimit limits_[CAN_TX_MAX_RATE_LIMITS];
+    Stats stats_;
+    mutable portMUX_TYPE mux_;
+
+    std::atomic<uint32_t> alerts_;  // Collected by onAlerts(), taken by the task
+    std::atomic<uint8_t> holds_;
+    SemaphoreHandle_t parked_;      // Given by the task on every pass while held
+    CANStats* driver_stats_;
+    TaskHandle_t task_handle_;
+
+    static void taskFunc(void* parameter);
+    uint32_t service();             // Returns ms until the next event
+    void collectSubmitted();
+    uint32_t collectPeriodic(uint32_t now);
+    void completeFlight(bool success);
+    void requeueFlight();
+    void expireWaiting(uint32_t now);
+    int pickNext(uint32_t now, uint32_t& wait_ms);
+    bool transmit(const Request& request, uint32_t now);
+    void removePending(int index);
+    uint32_t rateLimitWait(uint32_t key, uint32_t now) const;
+    void noteSent(uint32_t key, uint32_t now);
+    void refillTokens(uint32_t now);
+};
+
+#endif // CAN_TX_SCHEDULER_H
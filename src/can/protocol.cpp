@@ -8,65 +8,10 @@ namespace Protocol {
 float Field::extractValue(const uint8_t* data) const {
     if (data == nullptr) return NAN;
 
-    uint32_t raw_value = 0;
-    int32_t signed_value = 0;
-    float float_value = 0.0f;
+    RawExtractor extract = getRawExtractor(data_type);
+    if (extract == nullptr) return NAN;
 
-    switch (data_type) {
-        case DataType::UINT8:
-            raw_value = data[byte_offset];
-            break;
-
-        case DataType::INT8:
-            signed_value = (int8_t)data[byte_offset];
-            return (signed_value * scale) + offset;
-
-        case DataType::UINT16_LE:
-            raw_value = extractUint16LE(data, byte_offset);
-            break;
-
-        case DataType::UINT16_BE:
-            raw_value = extractUint16BE(data, byte_offset);
-            break;
-
-        case DataType::INT16_LE:
-            signed_value = extractInt16LE(data, byte_offset);
-            return (signed_value * scale) + offset;
-
-        case DataType::INT16_BE:
-            signed_value = extractInt16BE(data, byte_offset);
-            return (signed_value * scale) + offset;
-
-        case DataType::UINT32_LE:
-            raw_value = extractUint32LE(data, byte_offset);
-            break;
-
-        case DataType::UINT32_BE:
-            raw_value = extractUint32BE(data, byte_offset);
-            break;
-
-        case DataType::INT32_LE:
-            signed_value = extractInt32LE(data, byte_offset);
-            return (signed_value * scale) + offset;
-
-        case DataType::INT32_BE:
-            signed_value = extractInt32BE(data, byte_offset);
-            return (signed_value * scale) + offset;
-
-        case DataType::FLOAT_LE:
-            float_value = extractFloatLE(data, byte_offset);
-            return (float_value * scale) + offset;
-
-        case DataType::FLOAT_BE:
-            float_value = extractFloatBE(data, byte_offset);
-            return (float_value * scale) + offset;
-
-        default:
-            return NAN;
-    }
-
-    // For unsigned types, apply scale and offset
-    return (raw_value * scale) + offset;
+    return (extract(data, byte_offset) * scale) + offset;
 }
 
 bool Field::isValueValid(float value) const {
@@ -107,7 +52,7 @@ const Message* Definition::findMessage(uint32_t can_id) const {
 
 bool Definition::isValid() const {
     // Check basic fields
-    if (strlen(name) == 0) return false;
+    if (name == nullptr || name[0] == '\0') return false;
     if (message_count == 0) return false;
     if (message_count > MAX_MESSAGES_PER_PROTOCOL) return false;
 
@@ -138,6 +83,41 @@ bool Definition::isValid() const {
     return true;
 }
 
+// OwnedDefinition implementation
+OwnedDefinition::OwnedDefinition(OwnedDefinition&& other)
+    : block(other.block), block_size(other.block_size), cold_offset(other.cold_offset) {
+    other.block = nullptr;
+    other.block_size = 0;
+    other.cold_offset = 0;
+}
+
+OwnedDefinition& OwnedDefinition::operator=(OwnedDefinition&& other) {
+    if (this != &other) {
+        reset();
+        block = other.block;
+        block_size = other.block_size;
+        cold_offset = other.cold_offset;
+        other.block = nullptr;
+        other.block_size = 0;
+        other.cold_offset = 0;
+    }
+    return *this;
+}
+
+void OwnedDefinition::reset() {
+    delete[] block;
+    block = nullptr;
+    block_size = 0;
+    cold_offset = 0;
+}
+
+void OwnedDefinition::adopt(uint8_t* data, size_t size, size_t cold_start) {
+    reset();
+    block = data;
+    block_size = size;
+    cold_offset = cold_start;
+}
+
 // Data type helpers
 const char* dataTypeToString(DataType type) {
     switch (type) {
@@ -198,6 +178,62 @@ uint8_t getDataTypeSize(DataType type) {
     }
 }
 
+// Raw extractors (specialized per data type so callers can hold a direct pointer)
+template<> float extractRaw<DataType::UINT8>(const uint8_t* data, uint8_t offset) {
+    return data[offset];
+}
+template<> float extractRaw<DataType::INT8>(const uint8_t* data, uint8_t offset) {
+    return (int8_t)data[offset];
+}
+template<> float extractRaw<DataType::UINT16_LE>(const uint8_t* data, uint8_t offset) {
+    return extractUint16LE(data, offset);
+}
+template<> float extractRaw<DataType::UINT16_BE>(const uint8_t* data, uint8_t offset) {
+    return extractUint16BE(data, offset);
+}
+template<> float extractRaw<DataType::INT16_LE>(const uint8_t* data, uint8_t offset) {
+    return extractInt16LE(data, offset);
+}
+template<> float extractRaw<DataType::INT16_BE>(const uint8_t* data, uint8_t offset) {
+    return extractInt16BE(data, offset);
+}
+template<> float extractRaw<DataType::UINT32_LE>(const uint8_t* data, uint8_t offset) {
+    return extractUint32LE(data, offset);
+}
+template<> float extractRaw<DataType::UINT32_BE>(const uint8_t* data, uint8_t offset) {
+    return extractUint32BE(data, offset);
+}
+template<> float extractRaw<DataType::INT32_LE>(const uint8_t* data, uint8_t offset) {
+    return extractInt32LE(data, offset);
+}
+template<> float extractRaw<DataType::INT32_BE>(const uint8_t* data, uint8_t offset) {
+    return extractInt32BE(data, offset);
+}
+template<> float extractRaw<DataType::FLOAT_LE>(const uint8_t* data, uint8_t offset) {
+    return extractFloatLE(data, offset);
+}
+template<> float extractRaw<DataType::FLOAT_BE>(const uint8_t* data, uint8_t offset) {
+    return extractFloatBE(data, offset);
+}
+
+RawExtractor getRawExtractor(DataType type) {
+    switch (type) {
+        case DataType::UINT8: return extractRaw<DataType::UINT8>;
+        case DataType::INT8: return extractRaw<DataType::INT8>;
+        case DataType::UINT16_LE: return extractRaw<DataType::UINT16_LE>;
+        case DataType::UINT16_BE: return extractRaw<DataType::UINT16_BE>;
+        case DataType::INT16_LE: return extractRaw<DataType::INT16_LE>;
+        case DataType::INT16_BE: return extractRaw<DataType::INT16_BE>;
+        case DataType::UINT32_LE: return extractRaw<DataType::UINT32_LE>;
+        case DataType::UINT32_BE: return extractRaw<DataType::UINT32_BE>;
+        case DataType::INT32_LE: return extractRaw<DataType::INT32_LE>;
+        case DataType::INT32_BE: return extractRaw<DataType::INT32_BE>;
+        case DataType::FLOAT_LE: return extractRaw<DataType::FLOAT_LE>;
+        case DataType::FLOAT_BE: return extractRaw<DataType::FLOAT_BE>;
+        default: return nullptr;
+    }
+}
+
 // Value extraction implementations
 uint16_t extractUint16LE(const uint8_t* data, uint8_t offset) {
     return (uint16_t)data[offset] | ((uint16_t)data[offset + 1] << 8);
@@ -4,15 +4,14 @@
 #include <Arduino.h>
 #include <cstdint>
 
-// Maximum limits for static allocation
-// Reduced to minimize DRAM usage
-#define MAX_PROTOCOL_NAME_LEN 32
+// Parsing limits. Definitions are sized to their actual contents (built-ins
+// are constant tables, loaded protocols live in one arena), so these only
+// bound what a protocol may declare.
+#define MAX_PROTOCOL_NAME_LEN 32        // Listing buffers (Loader::ProtocolInfo)
 #define MAX_FIELD_NAME_LEN 24
-#define MAX_UNIT_LEN 8
-#define MAX_FORMULA_LEN 24
-#define MAX_ENUM_VALUES 8
-#define MAX_FIELDS_PER_MESSAGE 8
-#define MAX_MESSAGES_PER_PROTOCOL 8
+#define MAX_ENUM_VALUES 32
+#define MAX_FIELDS_PER_MESSAGE 16
+#define MAX_MESSAGES_PER_PROTOCOL 32
 
 namespace Protocol {
 
@@ -36,28 +35,30 @@ enum class DataType : uint8_t {
 // Enumeration value mapping (for state machines, etc.)
 struct EnumValue {
     uint32_t raw_value;
-    char name[MAX_FIELD_NAME_LEN];
+    const char* name;
 };
 
-// Field definition within a CAN message
+// Field definition within a CAN message.
+// Strings are never null ("" when absent). Members used to compile and decode
+// come first; description, formula and enum_values are descriptive only.
 struct Field {
-    char name[MAX_FIELD_NAME_LEN];
-    char description[32];  // Reduced from 64 to save DRAM
+    const char* name;
+    const char* unit;           // e.g., "mV", "mA", "°C"
     uint8_t byte_offset;        // 0-7
     uint8_t length;             // 1, 2, or 4 bytes
     DataType data_type;
-    char unit[MAX_UNIT_LEN];    // e.g., "mV", "mA", "°C"
+    bool has_min;               // Whether min_value is valid
+    bool has_max;               // Whether max_value is valid
+    uint8_t enum_count;
     float scale;                // Multiplication factor
     float offset;               // Additive offset
-    char formula[MAX_FORMULA_LEN]; // Optional formula description
     float min_value;
     float max_value;
-    bool has_min;               // Whether min_value is valid
-    bool has_max;               // Whether max_value is valid
 
-    // Enumeration support
-    uint8_t enum_count;
-    EnumValue enum_values[MAX_ENUM_VALUES];
+    // Cold metadata
+    const char* description;
+    const char* formula;        // Optional formula description
+    const EnumValue* enum_values;
 
     // Extract value from raw CAN data
     float extractValue(const uint8_t* data) const;
@@ -72,12 +73,12 @@ struct Field {
 // CAN message definition
 struct Message {
     uint32_t can_id;            // CAN message ID
-    char name[MAX_FIELD_NAME_LEN];
-    char description[32];  // Reduced from 64 to save DRAM
+    const char* name;
     uint16_t period_ms;         // Expected message period
-
     uint8_t field_count;
-    Field fields[MAX_FIELDS_PER_MESSAGE];
+    const Field* fields;
+
+    const char* description;    // Cold
 
     // Find field by name
     const Field* findField(const char* name) const;
@@ -85,17 +86,18 @@ struct Message {
 
 // Complete protocol definition
 struct Definition {
-    char name[MAX_PROTOCOL_NAME_LEN];
-    char manufacturer[MAX_FIELD_NAME_LEN];
-    char version[16];
-    char description[48];  // Reduced from 128 to save DRAM
+    const char* name;
     uint8_t cell_count;
     float nominal_voltage;
     float capacity_ah;
-    char chemistry[16];
-
     uint8_t message_count;
-    Message messages[MAX_MESSAGES_PER_PROTOCOL];
+    const Message* messages;
+
+    // Cold metadata
+    const char* manufacturer;
+    const char* version;
+    const char* description;
+    const char* chemistry;
 
     // Find message by CAN ID
     const Message* findMessage(uint32_t can_id) const;
@@ -104,11 +106,54 @@ struct Definition {
     bool isValid() const;
 };
 
+// A loaded protocol laid out in a single heap block sized to its contents:
+// the Definition, messages and fields, with their names/units, followed by a
+// cold section (descriptions, formulas, enum tables) that decoding never reads.
+// Owns the block; movable, not copyable.
+class OwnedDefinition {
+public:
+    OwnedDefinition() : block(nullptr), block_size(0), cold_offset(0) {}
+    ~OwnedDefinition() { reset(); }
+
+    OwnedDefinition(OwnedDefinition&& other);
+    OwnedDefinition& operator=(OwnedDefinition&& other);
+    OwnedDefinition(const OwnedDefinition&) = delete;
+    OwnedDefinition& operator=(const OwnedDefinition&) = delete;
+
+    // nullptr until a protocol has been loaded
+    const Definition* get() const { return reinterpret_cast<const Definition*>(block); }
+    const Definition* operator->() const { return get(); }
+    explicit operator bool() const { return block != nullptr; }
+
+    // Total block size and the size of its cold section, in bytes
+    size_t size() const { return block_size; }
+    size_t coldSize() const { return block_size - cold_offset; }
+
+    // Raw block (for the loader's binary cache)
+    const uint8_t* data() const { return block; }
+    size_t coldOffset() const { return cold_offset; }
+
+    void reset();
+
+    // Take ownership of a block built by the loader (allocated with new[])
+    void adopt(uint8_t* data, size_t size, size_t cold_start);
+
+private:
+    uint8_t* block;
+    size_t block_size;
+    size_t cold_offset;
+};
+
 // Helper functions for data type handling
 const char* dataTypeToString(DataType type);
 DataType stringToDataType(const char* str);
 uint8_t getDataTypeSize(DataType type);
 
+// Raw (unscaled) field readers, one per DataType
+typedef float (*RawExtractor)(const uint8_t* data, uint8_t offset);
+template<DataType TYPE> float extractRaw(const uint8_t* data, uint8_t offset);
+RawExtractor getRawExtractor(DataType type);    // nullptr for UNKNOWN
+
 // Value extraction helpers
 uint16_t extractUint16LE(const uint8_t* data, uint8_t offset);
 uint16_t extractUint16BE(const uint8_t* data, uint8_t offset);
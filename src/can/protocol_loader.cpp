@@ -1,10 +1,11 @@
 #include "protocol_loader.h"
 #include <ArduinoJson.h>
 #include <HTTPClient.h>
+#include <new>
 
 namespace Protocol {
 
-Loader::Loader() {
+Loader::Loader() : last_from_cache(false) {
     last_error[0] = '\0';
 }
 
@@ -22,7 +23,21 @@ bool Loader::begin() {
     return true;
 }
 
-bool Loader::loadFromFile(const char* filepath, Definition& protocol) {
+bool Loader::loadFromFile(const char* filepath, OwnedDefinition& protocol) {
+    last_from_cache = false;
+
+    // Hashing streams the file in small chunks; only a stale or missing
+    // cache pays for the JSON buffer and document below
+    uint32_t source_hash = 0;
+    size_t source_size = 0;
+    char cache_path[48];
+    bool cacheable = getCachePath(filepath, cache_path, sizeof(cache_path)) &&
+                     hashFile(filepath, source_hash, source_size);
+    if (cacheable && loadCache(cache_path, source_hash, protocol)) {
+        last_from_cache = true;
+        return true;
+    }
+
     File file = SPIFFS.open(filepath, "r");
     if (!file) {
         setError("Failed to open protocol file");
@@ -37,7 +52,7 @@ bool Loader::loadFromFile(const char* filepath, Definition& protocol) {
     }
 
     // Read file into buffer
-    char* buffer = new char[size + 1];
+    char* buffer = new (std::nothrow) char[size + 1];
     if (!buffer) {
         file.close();
         setError("Memory allocation failed");
@@ -51,10 +66,14 @@ bool Loader::loadFromFile(const char* filepath, Definition& protocol) {
     bool result = loadFromString(buffer, protocol);
     delete[] buffer;
 
+    if (result && cacheable) {
+        writeCache(cache_path, protocol, source_hash);
+    }
+
     return result;
 }
 
-bool Loader::loadFromString(const char* json_str, Definition& protocol) {
+bool Loader::loadFromString(const char* json_str, OwnedDefinition& protocol) {
     return parseProtocol(json_str, protocol);
 }
 
@@ -97,7 +116,7 @@ bool Loader::saveToFile(const char* filepath, const Definition& protocol) {
             json_field["scale"] = field.scale;
             json_field["offset"] = field.offset;
 
-            if (strlen(field.formula) > 0) {
+            if (field.formula[0] != '\0') {
                 json_field["formula"] = field.formula;
             }
 
@@ -157,7 +176,7 @@ bool Loader::fetchFromUrl(const char* url, const char* filepath) {
     }
 
     // Parse to validate
-    Definition temp_protocol;
+    OwnedDefinition temp_protocol;
     if (!loadFromString(payload.c_str(), temp_protocol)) {
         return false;  // Error already set
     }
@@ -187,11 +206,11 @@ uint8_t Loader::listCustomProtocols(ProtocolInfo* protocols, uint8_t max_count)
     while (file && count < max_count) {
         if (!file.isDirectory() && strstr(file.name(), ".json")) {
             // Try to parse protocol name
-            Definition temp;
+            OwnedDefinition temp;
             if (loadFromFile(file.path(), temp)) {
                 strncpy(protocols[count].filename, file.name(), sizeof(protocols[count].filename) - 1);
-                strncpy(protocols[count].name, temp.name, sizeof(protocols[count].name) - 1);
-                strncpy(protocols[count].manufacturer, temp.manufacturer, sizeof(protocols[count].manufacturer) - 1);
+                strncpy(protocols[count].name, temp->name, sizeof(protocols[count].name) - 1);
+                strncpy(protocols[count].manufacturer, temp->manufacturer, sizeof(protocols[count].manufacturer) - 1);
                 protocols[count].file_size = file.size();
                 count++;
             }
@@ -213,6 +232,11 @@ bool Loader::deleteProtocol(const char* filepath) {
         return false;
     }
 
+    char cache_path[48];
+    if (getCachePath(filepath, cache_path, sizeof(cache_path)) && SPIFFS.exists(cache_path)) {
+        SPIFFS.remove(cache_path);
+    }
+
     return true;
 }
 
@@ -220,7 +244,191 @@ bool Loader::validate(const Definition& protocol) {
     return protocol.isValid();
 }
 
-bool Loader::parseProtocol(const char* json_str, Definition& protocol) {
+namespace {
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+size_t stringCost(const char* str) {
+    return (str != nullptr && str[0] != '\0') ? strlen(str) + 1 : 0;
+}
+
+// Sizes gathered in a first pass over the JSON document
+struct LayoutSize {
+    size_t messages;
+    size_t fields;
+    size_t enums;
+    size_t hot_chars;       // Protocol/message/field names and units
+    size_t cold_chars;      // Descriptions, formulas, enum names, metadata
+
+    // hot_chars starts at 1: the shared "" every absent string points at
+    LayoutSize() : messages(0), fields(0), enums(0), hot_chars(1), cold_chars(0) {}
+};
+
+// Block offsets: [Definition][Message[]][Field[]][hot strings] | [EnumValue[]][cold strings]
+struct LayoutOffsets {
+    size_t messages;
+    size_t fields;
+    size_t hot_strings;
+    size_t cold_start;
+    size_t enums;
+    size_t cold_strings;
+    size_t total;
+
+    explicit LayoutOffsets(const LayoutSize& sz) {
+        messages = alignUp(sizeof(Definition), alignof(Message));
+        fields = alignUp(messages + sz.messages * sizeof(Message), alignof(Field));
+        hot_strings = fields + sz.fields * sizeof(Field);
+        cold_start = alignUp(hot_strings + sz.hot_chars, alignof(EnumValue));
+        enums = cold_start;
+        cold_strings = enums + sz.enums * sizeof(EnumValue);
+        total = cold_strings + sz.cold_chars;
+    }
+};
+
+// Hands out the pieces of a block laid out by LayoutOffsets
+class LayoutWriter {
+public:
+    LayoutWriter(uint8_t* block, const LayoutOffsets& off)
+        : base(block), next_message(off.messages), next_field(off.fields),
+          empty(reinterpret_cast<const char*>(block + off.hot_strings)),
+          next_hot(off.hot_strings + 1), hot_end(off.cold_start),
+          next_enum(off.enums), next_cold(off.cold_strings), cold_end(off.total) {}
+
+    Message* messages(size_t count) { return take<Message>(next_message, count); }
+    Field* fields(size_t count) { return take<Field>(next_field, count); }
+    EnumValue* enums(size_t count) { return take<EnumValue>(next_enum, count); }
+
+    const char* hotString(const char* str) { return copy(str, next_hot, hot_end); }
+    const char* coldString(const char* str) { return copy(str, next_cold, cold_end); }
+
+private:
+    uint8_t* base;
+    size_t next_message, next_field;
+    const char* empty;          // Block is zeroed, so its first string byte is ""
+    size_t next_hot, hot_end;
+    size_t next_enum, next_cold, cold_end;
+
+    template<typename T>
+    T* take(size_t& pos, size_t count) {
+        T* items = reinterpret_cast<T*>(base + pos);
+        pos += count * sizeof(T);
+        return items;
+    }
+
+    const char* copy(const char* str, size_t& pos, size_t end) {
+        size_t cost = stringCost(str);
+        if (cost == 0 || pos + cost > end) {
+            return empty;
+        }
+        char* dest = reinterpret_cast<char*>(base + pos);
+        memcpy(dest, str, cost);
+        pos += cost;
+        return dest;
+    }
+};
+
+// First pass: check limits and add up what the block must hold.
+// Returns nullptr on success or an error message.
+const char* measureProtocol(JsonDocument& doc, LayoutSize& sz) {
+    JsonArray messages = doc["messages"];
+    if (!messages) {
+        return "No messages array found";
+    }
+
+    sz.hot_chars += stringCost(doc["name"] | "");
+    sz.cold_chars += stringCost(doc["manufacturer"] | "");
+    sz.cold_chars += stringCost(doc["version"] | "1.0");
+    sz.cold_chars += stringCost(doc["description"] | "");
+    sz.cold_chars += stringCost(doc["chemistry"] | "Li-ion");
+
+    for (JsonObject json_msg : messages) {
+        if (++sz.messages > MAX_MESSAGES_PER_PROTOCOL) {
+            return "Too many messages";
+        }
+        sz.hot_chars += stringCost(json_msg["name"] | "");
+        sz.cold_chars += stringCost(json_msg["description"] | "");
+
+        JsonArray fields = json_msg["fields"];
+        if (!fields) {
+            return "No fields array in message";
+        }
+        if (fields.size() > MAX_FIELDS_PER_MESSAGE) {
+            return "Too many fields";
+        }
+
+        for (JsonObject json_field : fields) {
+            sz.fields++;
+            sz.hot_chars += stringCost(json_field["name"] | "");
+            sz.hot_chars += stringCost(json_field["unit"] | "");
+            sz.cold_chars += stringCost(json_field["description"] | "");
+            sz.cold_chars += stringCost(json_field["formula"] | "");
+
+            JsonObject json_enum = json_field["enum_values"];
+            if (json_enum) {
+                if (json_enum.size() > MAX_ENUM_VALUES) {
+                    return "Too many enum values";
+                }
+                for (JsonPair kv : json_enum) {
+                    sz.enums++;
+                    sz.cold_chars += stringCost(kv.value().as<const char*>());
+                }
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+// Second pass: fill the block. Returns nullptr on success or an error message.
+const char* buildField(JsonObject json_field, Field& field, LayoutWriter& out,
+                       char* error, size_t error_size) {
+    field.name = out.hotString(json_field["name"] | "");
+    field.unit = out.hotString(json_field["unit"] | "");
+    field.description = out.coldString(json_field["description"] | "");
+    field.formula = out.coldString(json_field["formula"] | "");
+
+    field.byte_offset = json_field["byte_offset"];
+    field.length = json_field["length"];
+    field.scale = json_field["scale"] | 1.0f;
+    field.offset = json_field["offset"] | 0.0f;
+
+    // Parse data type
+    const char* type_str = json_field["data_type"] | "";
+    field.data_type = stringToDataType(type_str);
+
+    if (field.data_type == DataType::UNKNOWN) {
+        snprintf(error, error_size, "Unknown data type: %s", type_str);
+        return error;
+    }
+
+    // Parse min/max
+    field.has_min = json_field.containsKey("min_value");
+    field.has_max = json_field.containsKey("max_value");
+    field.min_value = field.has_min ? json_field["min_value"].as<float>() : 0.0f;
+    field.max_value = field.has_max ? json_field["max_value"].as<float>() : 0.0f;
+
+    // Parse enum values
+    field.enum_count = 0;
+    field.enum_values = nullptr;
+    JsonObject json_enum = json_field["enum_values"];
+    if (json_enum && json_enum.size() > 0) {
+        EnumValue* values = out.enums(json_enum.size());
+        for (JsonPair kv : json_enum) {
+            EnumValue& ev = values[field.enum_count++];
+            ev.raw_value = atoi(kv.key().c_str());
+            ev.name = out.coldString(kv.value().as<const char*>());
+        }
+        field.enum_values = values;
+    }
+
+    return nullptr;
+}
+
+} // namespace
+
+bool Loader::parseProtocol(const char* json_str, OwnedDefinition& protocol) {
     JsonDocument doc;
     DeserializationError error = deserializeJson(doc, json_str);
 
@@ -229,137 +437,367 @@ bool Loader::parseProtocol(const char* json_str, Definition& protocol) {
         return false;
     }
 
-    // Parse top-level fields
-    strncpy(protocol.name, doc["name"] | "", sizeof(protocol.name) - 1);
-    strncpy(protocol.manufacturer, doc["manufacturer"] | "", sizeof(protocol.manufacturer) - 1);
-    strncpy(protocol.version, doc["version"] | "1.0", sizeof(protocol.version) - 1);
-    strncpy(protocol.description, doc["description"] | "", sizeof(protocol.description) - 1);
-    strncpy(protocol.chemistry, doc["chemistry"] | "Li-ion", sizeof(protocol.chemistry) - 1);
-
-    protocol.cell_count = doc["cell_count"] | 0;
-    protocol.nominal_voltage = doc["nominal_voltage"] | 0.0f;
-    protocol.capacity_ah = doc["capacity_ah"] | 0.0f;
+    LayoutSize sz;
+    const char* err = measureProtocol(doc, sz);
+    if (err != nullptr) {
+        setError(err);
+        return false;
+    }
 
-    // Parse messages
-    JsonArray messages = doc["messages"];
-    if (!messages) {
-        setError("No messages array found");
+    LayoutOffsets off(sz);
+    uint8_t* block = new (std::nothrow) uint8_t[off.total];
+    if (!block) {
+        setError("Memory allocation failed");
         return false;
     }
+    memset(block, 0, off.total);
+    LayoutWriter out(block, off);
 
-    protocol.message_count = 0;
-    for (JsonObject json_msg : messages) {
-        if (protocol.message_count >= MAX_MESSAGES_PER_PROTOCOL) {
-            setError("Too many messages");
-            return false;
-        }
+    // Parse top-level fields
+    Definition& def = *reinterpret_cast<Definition*>(block);
+    def.name = out.hotString(doc["name"] | "");
+    def.manufacturer = out.coldString(doc["manufacturer"] | "");
+    def.version = out.coldString(doc["version"] | "1.0");
+    def.description = out.coldString(doc["description"] | "");
+    def.chemistry = out.coldString(doc["chemistry"] | "Li-ion");
 
-        if (!parseMessage(&json_msg, protocol.messages[protocol.message_count])) {
-            return false;
-        }
+    def.cell_count = doc["cell_count"] | 0;
+    def.nominal_voltage = doc["nominal_voltage"] | 0.0f;
+    def.capacity_ah = doc["capacity_ah"] | 0.0f;
 
-        protocol.message_count++;
+    // Parse messages
+    Message* messages = out.messages(sz.messages);
+    def.messages = messages;
+    def.message_count = 0;
+
+    for (JsonObject json_msg : doc["messages"].as<JsonArray>()) {
+        Message& message = messages[def.message_count++];
+        message.can_id = json_msg["can_id"];
+        message.name = out.hotString(json_msg["name"] | "");
+        message.description = out.coldString(json_msg["description"] | "");
+        message.period_ms = json_msg["period_ms"] | 100;
+
+        JsonArray json_fields = json_msg["fields"];
+        Field* fields = out.fields(json_fields.size());
+        message.fields = fields;
+        message.field_count = 0;
+
+        for (JsonObject json_field : json_fields) {
+            err = buildField(json_field, fields[message.field_count++], out,
+                             last_error, sizeof(last_error));
+            if (err != nullptr) {
+                delete[] block;
+                return false;
+            }
+        }
     }
 
     // Validate
-    if (!validate(protocol)) {
+    if (!def.isValid()) {
+        delete[] block;
         setError("Protocol validation failed");
         return false;
     }
 
+    protocol.adopt(block, off.total, off.cold_start);
     return true;
 }
 
-bool Loader::parseMessage(void* json_msg_ptr, Message& message) {
-    JsonObject json_msg = *static_cast<JsonObject*>(json_msg_ptr);
+// ============================================================================
+// Binary protocol cache
+// ============================================================================
+//
+// A cache file is a CacheHeader followed by the definition's block, with every
+// pointer stored as an offset from the start of the block. Loading is one read
+// plus a pointer fix-up pass; no JSON is involved.
+
+namespace {
+
+constexpr uint32_t CACHE_MAGIC = 0x42435250;     // "PRCB"
+constexpr uint32_t CACHE_VERSION = 1;            // Bump when the layout changes
+constexpr uintptr_t NULL_OFFSET = ~static_cast<uintptr_t>(0);
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t layout;            // Structure sizes of the build that wrote it
+    uint32_t source_hash;       // FNV-1a of the JSON source
+    uint32_t block_size;
+    uint32_t cold_offset;
+    uint32_t block_hash;        // FNV-1a of the stored (offset) block
+};
+
+constexpr uint32_t FNV_OFFSET_BASIS = 2166136261u;
+
+uint32_t fnv1a(const uint8_t* data, size_t len, uint32_t hash = FNV_OFFSET_BASIS) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-    message.can_id = json_msg["can_id"];
-    strncpy(message.name, json_msg["name"] | "", sizeof(message.name) - 1);
-    strncpy(message.description, json_msg["description"] | "", sizeof(message.description) - 1);
-    message.period_ms = json_msg["period_ms"] | 100;
+uint32_t layoutSignature() {
+    return static_cast<uint32_t>(sizeof(Definition)) |
+           (static_cast<uint32_t>(sizeof(Message)) << 8) |
+           (static_cast<uint32_t>(sizeof(Field)) << 16) |
+           (static_cast<uint32_t>(sizeof(EnumValue)) << 24);
+}
 
-    // Parse fields
-    JsonArray fields = json_msg["fields"];
-    if (!fields) {
-        setError("No fields array in message");
-        return false;
+// Absolute pointers -> block offsets. 'image' is a copy of the block at 'base'.
+class ToOffsets {
+public:
+    ToOffsets(const uint8_t* base, uint8_t* image) : base(base), image(image) {}
+
+    void run() {
+        const Definition& src = *reinterpret_cast<const Definition*>(base);
+        Definition& dst = *reinterpret_cast<Definition*>(image);
+
+        store(dst.name, src.name);
+        store(dst.manufacturer, src.manufacturer);
+        store(dst.version, src.version);
+        store(dst.description, src.description);
+        store(dst.chemistry, src.chemistry);
+        store(dst.messages, src.messages);
+
+        for (uint8_t m = 0; m < src.message_count; m++) {
+            const Message& sm = src.messages[m];
+            Message& dm = *at(&sm);
+            store(dm.name, sm.name);
+            store(dm.description, sm.description);
+            store(dm.fields, sm.fields);
+
+            for (uint8_t f = 0; f < sm.field_count; f++) {
+                const Field& sf = sm.fields[f];
+                Field& df = *at(&sf);
+                store(df.name, sf.name);
+                store(df.unit, sf.unit);
+                store(df.description, sf.description);
+                store(df.formula, sf.formula);
+                store(df.enum_values, sf.enum_values);
+
+                for (uint8_t e = 0; e < sf.enum_count; e++) {
+                    store(at(&sf.enum_values[e])->name, sf.enum_values[e].name);
+                }
+            }
+        }
+    }
+
+private:
+    const uint8_t* base;
+    uint8_t* image;
+
+    // Same object within the image
+    template<typename T>
+    T* at(const T* ptr) {
+        return reinterpret_cast<T*>(image + (reinterpret_cast<const uint8_t*>(ptr) - base));
     }
 
-    message.field_count = 0;
-    for (JsonObject json_field : fields) {
-        if (message.field_count >= MAX_FIELDS_PER_MESSAGE) {
-            setError("Too many fields");
+    template<typename T>
+    void store(const T*& slot, const T* ptr) {
+        uintptr_t offset = ptr ? static_cast<uintptr_t>(reinterpret_cast<const uint8_t*>(ptr) - base)
+                               : NULL_OFFSET;
+        slot = reinterpret_cast<const T*>(offset);
+    }
+};
+
+// Block offsets -> absolute pointers, rejecting anything outside the block
+class FromOffsets {
+public:
+    FromOffsets(uint8_t* block, size_t size) : block(block), size(size) {}
+
+    bool run() {
+        Definition& def = *reinterpret_cast<Definition*>(block);
+        if (!string(def.name) || !string(def.manufacturer) || !string(def.version) ||
+            !string(def.description) || !string(def.chemistry) ||
+            !array(def.messages, def.message_count)) {
             return false;
         }
 
-        if (!parseField(&json_field, message.fields[message.field_count])) {
+        for (uint8_t m = 0; m < def.message_count; m++) {
+            Message& msg = const_cast<Message&>(def.messages[m]);
+            if (!string(msg.name) || !string(msg.description) ||
+                !array(msg.fields, msg.field_count)) {
+                return false;
+            }
+
+            for (uint8_t f = 0; f < msg.field_count; f++) {
+                Field& field = const_cast<Field&>(msg.fields[f]);
+                if (!string(field.name) || !string(field.unit) ||
+                    !string(field.description) || !string(field.formula)) {
+                    return false;
+                }
+                if (field.enum_count == 0) {
+                    field.enum_values = nullptr;
+                    continue;
+                }
+                if (!array(field.enum_values, field.enum_count)) {
+                    return false;
+                }
+                for (uint8_t e = 0; e < field.enum_count; e++) {
+                    if (!string(const_cast<EnumValue&>(field.enum_values[e]).name)) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    uint8_t* block;
+    size_t size;
+
+    template<typename T>
+    bool array(const T*& slot, size_t count) {
+        uintptr_t offset = reinterpret_cast<uintptr_t>(slot);
+        if (offset == NULL_OFFSET || offset % alignof(T) != 0 ||
+            offset > size || count * sizeof(T) > size - offset) {
             return false;
         }
+        slot = reinterpret_cast<const T*>(block + offset);
+        return true;
+    }
 
-        message.field_count++;
+    bool string(const char*& slot) {
+        uintptr_t offset = reinterpret_cast<uintptr_t>(slot);
+        if (offset >= size || memchr(block + offset, '\0', size - offset) == nullptr) {
+            return false;
+        }
+        slot = reinterpret_cast<const char*>(block + offset);
+        return true;
     }
+};
+
+} // namespace
 
+bool Loader::getCachePath(const char* filepath, char* cache_path, size_t size) {
+    size_t len = strlen(filepath);
+    if (len < 5 || strcmp(filepath + len - 5, ".json") != 0 || len >= size) {
+        return false;
+    }
+    memcpy(cache_path, filepath, len - 5);
+    strcpy(cache_path + len - 5, ".bin");
     return true;
 }
 
-bool Loader::parseField(void* json_field_ptr, Field& field) {
-    JsonObject json_field = *static_cast<JsonObject*>(json_field_ptr);
+bool Loader::hashFile(const char* filepath, uint32_t& hash, size_t& size) {
+    File file = SPIFFS.open(filepath, "r");
+    if (!file) {
+        return false;
+    }
 
-    strncpy(field.name, json_field["name"] | "", sizeof(field.name) - 1);
-    strncpy(field.description, json_field["description"] | "", sizeof(field.description) - 1);
-    strncpy(field.unit, json_field["unit"] | "", sizeof(field.unit) - 1);
-    strncpy(field.formula, json_field["formula"] | "", sizeof(field.formula) - 1);
+    uint8_t chunk[256];
+    hash = FNV_OFFSET_BASIS;
+    size = 0;
+    size_t n;
+    while ((n = file.read(chunk, sizeof(chunk))) > 0) {
+        hash = fnv1a(chunk, n, hash);
+        size += n;
+    }
+    file.close();
+    return true;
+}
 
-    field.byte_offset = json_field["byte_offset"];
-    field.length = json_field["length"];
-    field.scale = json_field["scale"] | 1.0f;
-    field.offset = json_field["offset"] | 0.0f;
+bool Loader::loadCache(const char* cache_path, uint32_t source_hash, OwnedDefinition& protocol) {
+    if (!SPIFFS.exists(cache_path)) {
+        return false;
+    }
 
-    // Parse data type
-    const char* type_str = json_field["data_type"];
-    field.data_type = stringToDataType(type_str);
+    File file = SPIFFS.open(cache_path, "r");
+    if (!file) {
+        return false;
+    }
 
-    if (field.data_type == DataType::UNKNOWN) {
-        snprintf(last_error, sizeof(last_error), "Unknown data type: %s", type_str);
+    CacheHeader header;
+    if (file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) ||
+        header.magic != CACHE_MAGIC || header.version != CACHE_VERSION ||
+        header.layout != layoutSignature() || header.source_hash != source_hash ||
+        header.block_size < sizeof(Definition) || header.block_size > 16384 ||
+        header.cold_offset > header.block_size ||
+        file.size() != sizeof(header) + header.block_size) {
+        file.close();
         return false;
     }
 
-    // Parse min/max
-    field.has_min = json_field.containsKey("min_value");
-    field.has_max = json_field.containsKey("max_value");
-    if (field.has_min) field.min_value = json_field["min_value"];
-    if (field.has_max) field.max_value = json_field["max_value"];
+    // No room for the image: the caller parses the JSON instead
+    uint8_t* block = new (std::nothrow) uint8_t[header.block_size];
+    if (!block) {
+        file.close();
+        return false;
+    }
 
-    // Parse enum values
-    field.enum_count = 0;
-    if (json_field.containsKey("enum_values")) {
-        JsonObject enum_obj = json_field["enum_values"];
-        if (!parseEnumValues(&enum_obj, field)) {
-            return false;
-        }
+    size_t got = file.read(block, header.block_size);
+    file.close();
+
+    if (got != header.block_size || fnv1a(block, got) != header.block_hash) {
+        delete[] block;
+        return false;
     }
 
+    FromOffsets relocate(block, header.block_size);
+    if (!relocate.run() || !reinterpret_cast<Definition*>(block)->isValid()) {
+        delete[] block;
+        return false;
+    }
+
+    protocol.adopt(block, header.block_size, header.cold_offset);
     return true;
 }
 
-bool Loader::parseEnumValues(void* json_enum_ptr, Field& field) {
-    JsonObject json_enum = *static_cast<JsonObject*>(json_enum_ptr);
+bool Loader::writeCache(const char* cache_path, const OwnedDefinition& protocol, uint32_t source_hash) {
+    if (!protocol) {
+        return false;
+    }
 
-    field.enum_count = 0;
-    for (JsonPair kv : json_enum) {
-        if (field.enum_count >= MAX_ENUM_VALUES) {
-            setError("Too many enum values");
-            return false;
-        }
+    // Without the image the protocol simply stays uncached
+    uint8_t* image = new (std::nothrow) uint8_t[protocol.size()];
+    if (!image) {
+        return false;
+    }
+    memcpy(image, protocol.data(), protocol.size());
+    ToOffsets(protocol.data(), image).run();
+
+    CacheHeader header;
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.layout = layoutSignature();
+    header.source_hash = source_hash;
+    header.block_size = protocol.size();
+    header.cold_offset = protocol.coldOffset();
+    header.block_hash = fnv1a(image, protocol.size());
+
+    File file = SPIFFS.open(cache_path, "w");
+    if (!file) {
+        delete[] image;
+        return false;
+    }
 
-        field.enum_values[field.enum_count].raw_value = atoi(kv.key().c_str());
-        strncpy(field.enum_values[field.enum_count].name,
-                kv.value().as<const char*>(),
-                sizeof(field.enum_values[field.enum_count].name) - 1);
+    bool ok = file.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header) &&
+              file.write(image, protocol.size()) == protocol.size();
+    file.close();
+    delete[] image;
 
-        field.enum_count++;
+    if (!ok) {
+        SPIFFS.remove(cache_path);
     }
+    return ok;
+}
 
+bool Loader::updateCache(const char* filepath, const OwnedDefinition& protocol) {
+    char cache_path[48];
+    uint32_t source_hash;
+    size_t source_size;
+    if (!getCachePath(filepath, cache_path, sizeof(cache_path)) ||
+        !hashFile(filepath, source_hash, source_size)) {
+        setError("Cannot cache protocol file");
+        return false;
+    }
+
+    if (!writeCache(cache_path, protocol, source_hash)) {
+        setError("Failed to write protocol cache");
+        return false;
+    }
     return true;
 }
 
@@ -16,15 +16,23 @@ public:
     // Initialize loader (mounts SPIFFS if needed)
     bool begin();
 
-    // Load protocol from JSON file in SPIFFS
-    bool loadFromFile(const char* filepath, Definition& protocol);
+    // Load protocol from JSON file in SPIFFS. Uses the binary cache next to
+    // it (custom_0.json -> custom_0.bin) when it matches the JSON's hash, and
+    // rebuilds the cache after parsing otherwise.
+    bool loadFromFile(const char* filepath, OwnedDefinition& protocol);
 
-    // Load protocol from JSON string
-    bool loadFromString(const char* json_str, Definition& protocol);
+    // Load protocol from JSON string into a single block sized to its contents
+    bool loadFromString(const char* json_str, OwnedDefinition& protocol);
 
     // Save protocol to SPIFFS
     bool saveToFile(const char* filepath, const Definition& protocol);
 
+    // Write the binary cache for a protocol loaded from the JSON at filepath
+    bool updateCache(const char* filepath, const OwnedDefinition& protocol);
+
+    // Whether the last loadFromFile() was served from the binary cache
+    bool lastLoadFromCache() const { return last_from_cache; }
+
     // Fetch protocol from URL and save to SPIFFS
     // Returns true if successful, saves to filepath
     bool fetchFromUrl(const char* url, const char* filepath);
@@ -38,7 +46,7 @@ public:
     };
     uint8_t listCustomProtocols(ProtocolInfo* protocols, uint8_t max_count);
 
-    // Delete a custom protocol file
+    // Delete a custom protocol file (and its binary cache)
     bool deleteProtocol(const char* filepath);
 
     // Validate protocol structure
@@ -49,12 +57,16 @@ public:
 
 private:
     char last_error[128];
+    bool last_from_cache;
+
+    // JSON parsing helpers (layout in protocol_loader.cpp)
+    bool parseProtocol(const char* json_str, OwnedDefinition& protocol);
 
-    // JSON parsing helpers
-    bool parseProtocol(const char* json_str, Definition& protocol);
-    bool parseMessage(void* json_msg, Message& message);
-    bool parseField(void* json_field, Field& field);
-    bool parseEnumValues(void* json_enum, Field& field);
+    // Binary cache helpers
+    static bool getCachePath(const char* filepath, char* cache_path, size_t size);
+    bool hashFile(const char* filepath, uint32_t& hash, size_t& size);
+    bool loadCache(const char* cache_path, uint32_t source_hash, OwnedDefinition& protocol);
+    bool writeCache(const char* cache_path, const OwnedDefinition& protocol, uint32_t source_hash);
 
     void setError(const char* error);
 };
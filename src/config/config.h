@@ -31,12 +31,52 @@
 #define CAN_PING_ENABLED    false   // Disabled by default - enable after fixing bus termination
 #define CAN_PING_INTERVAL   1000    // Ping interval in milliseconds
 #define CAN_PING_ID         0x404   // Ping message ID
+#define CAN_STATUS_POLL_INTERVAL_MS 250 // Bus status/ping housekeeping in the RX task
+#define CAN_HW_FILTER_ENABLED true  // Accept only protocol/battery IDs in hardware (false = accept all)
+#define CAN_FILTER_MAX_IDS  64      // Upper bound on IDs fed into the filter computation
+#define CAN_FRAME_TIMESTAMP_US false // Stamp frames with esp_timer microseconds (wrap after ~71 min)
+
+// CAN frame bus consumer queues (frames buffered per consumer task)
+#define CAN_BUS_WEB_QUEUE_DEPTH     64
+#define CAN_BUS_LOG_QUEUE_DEPTH     128
+#define CAN_BUS_MQTT_QUEUE_DEPTH    32
+
+// CAN transmit scheduler (own task; ping and request frames)
+#define CAN_TX_SUBMIT_QUEUE         32      // One-shot frames handed to the TX task (power of two)
+#define CAN_TX_PENDING              16      // Frames the scheduler picks from by priority
+#define CAN_TX_MAX_PERIODIC         8       // Periodic frames (ping, BMS polls)
+#define CAN_TX_MAX_RATE_LIMITS      16      // IDs with a minimum send interval
+#define CAN_TX_MAX_LOAD_PCT         10      // Bus share our own frames may use
+#define CAN_TX_BURST_FRAMES         4       // Back-to-back frames allowed within that share
+#define CAN_TX_TIMEOUT_MS           100     // No completion alert by then = failed (no ACK, bus-off)
+#define CAN_TX_MAX_WAIT_MS          1000    // One-shot frames still waiting after this are dropped
+#define CAN_TX_HOLD_TIMEOUT_MS      100     // Longest a driver reinstall waits for the TX task to pause
+
+// CAN bus analytics (per-ID timing and bus load, updated in the RX task)
+#define CAN_ANALYZER_TABLE_SIZE     128     // ID slots, power of two (3/4 usable)
+#define CAN_ANALYZER_WINDOW_MS      1000    // Bus load / frame rate window
+
+// CAN load test (synthetic frames generated in the RX task)
+#define CAN_LOADTEST_MAX_STEPS      8       // Rate steps per run
+#define CAN_LOADTEST_MAX_TEMPLATES  32      // Frame templates from the active protocols
+#define CAN_LOADTEST_MAX_STAGES     10      // Drop counters reported per step
+#define CAN_LOADTEST_MAX_RATE       20000   // Frames/s per step
+#define CAN_LOADTEST_STEP_MS        5000    // Default step length
+#define CAN_LOADTEST_SETTLE_MS      1000    // Quiet time after a step before its drops are read
+#define CAN_LOADTEST_BURST          64      // Most frames generated per RX task pass (~1 ms)
+#define CAN_LOADTEST_FOREIGN_ID     0x7F0   // First of 16 IDs used for frames outside the protocols
 
 // Timing Configuration (milliseconds)
 #define DEFAULT_SAMPLE_INTERVAL_MS      100
 #define DEFAULT_PUBLISH_INTERVAL_MS     1000
+#define DEFAULT_DEADBAND_VOLTAGE        0.2f    // Pack telemetry goes out when voltage moves this much (V)
+#define DEFAULT_DEADBAND_CURRENT        0.5f    // ... current (A)
+#define DEFAULT_DEADBAND_SOC            1       // ... SOC (%)
+#define DEFAULT_DEADBAND_TEMP           1.0f    // ... either temperature (°C)
+#define DEFAULT_TELEMETRY_HEARTBEAT_S   60      // Longest a pack stays silent on MQTT
 #define DEFAULT_WEB_REFRESH_MS          500
 #define CAN_LOG_FLUSH_INTERVAL_MS       5000
+#define CAN_LOG_ROTATION_CHECK_MS       30000   // How often the log writer checks SPIFFS usage
 
 // WiFi Configuration
 #define WIFI_AP_SSID_PREFIX     "eBikeMonitor-"
@@ -51,20 +91,50 @@
 #define MQTT_WEBSOCKET_PORT     8884  // TLS WebSocket port
 #define MQTT_RECONNECT_DELAY    5000
 #define MQTT_TOPIC_PREFIX       "ebike"
+#define DEFAULT_MQTT_CAN_BATCH_MS       1000    // Longest a CAN frame waits for its MQTT batch
+#define DEFAULT_MQTT_CAN_BATCH_BYTES    1024    // Largest binary CAN batch (two are allocated)
+#define MQTT_QUEUE_DIR          "/mqttq"    // Offline queue segments on SPIFFS
+#define MQTT_QUEUE_RAM_BYTES    8192        // Offline messages held in RAM before spilling to SPIFFS
+#define MQTT_CAN_BATCH_MAX_BYTES (MQTT_QUEUE_RAM_BYTES - 128)  // Largest batch setting (queue entry header and topic fit the rest)
+#define MQTT_QUEUE_SEGMENT_SIZE (32 * 1024) // Offline queue segment file size
+#define MQTT_QUEUE_MAX_SEGMENTS 4           // Segments kept before the oldest is dropped (max 1000)
+#define MQTT_QUEUE_DRAIN_RATE   20          // Backlog messages replayed per second once reconnected
+#define MQTT_QUEUE_DRAIN_BURST  4           // Most backlog messages replayed per update()
+#define MQTT_TASK_INTERVAL_MS   50          // MQTT task pass interval (sooner when something is queued)
+#define MQTT_TASK_PRIORITY      1
+#define MQTT_TASK_STACK         8192        // TLS handshakes need the room
+#define MQTT_OUTBOUND_QUEUE_DEPTH 16        // Messages waiting for the MQTT task, per producer (power of two)
+#define MQTT_OUTBOUND_POOL_SLOTS  4         // Reused outbound payload blocks
+#define MQTT_OUTBOUND_MAX_SIZE    1024      // Largest pooled outbound block (bigger ones are one-off)
 // Note: TLS support requires WiFiClientSecure and proper certificate handling
 
 // Web Server
 #define WEB_SERVER_PORT         80
+#define WS_CAN_RING_SIZE        512     // Frames queued for the live CAN view between flushes (power of two)
+#define WS_CAN_BATCH_BYTES      2048    // Largest full-rate CAN batch per 100 ms flush
+#define WS_CAN_DECIMATE_IDS     64      // IDs in the live view's latest-per-ID table
+#define JSON_POOL_BUFFERS       3       // Reusable buffers for JSON responses
+#define JSON_POOL_MAX_SIZE      8192    // Larger responses get a one-off buffer
 
 // Memory Management
 #define HEAP_WARNING_THRESHOLD  20000   // Warn if free heap below 20KB
 #define CAN_LOG_MAX_ENTRIES     1000    // Ring buffer size for CAN log
 #define SPIFFS_ROTATION_PERCENT 80      // Rotate log at 80% full
+#define CAN_LOG_BINARY          true    // 16-byte binary records, CSV only on export (false = CSV file)
+#define CAN_LOG_COMPRESSED      true    // Pack binary log blocks, ~5x more history (needs CAN_LOG_BINARY)
+#define CAN_LOG_BLOCK_SIZE      4096    // Log write block (two are preallocated)
+#define CAN_LOG_SEGMENT_SIZE    (64 * 1024)  // Log segment file size (whole blocks)
+#define CAN_LOG_MAX_SEGMENTS    16      // Segments kept before the oldest is dropped (max 1000)
+#define CAN_LOG_WRITER_PRIORITY 1       // Background log writer task priority
 
 // ADC Configuration
 #define ADC_SAMPLES_FOR_AVERAGE 10
 #define ADC_VREF                3.3f
 #define ADC_RESOLUTION          4095    // 12-bit ADC
+#define ADC_SAMPLING_ENABLED    true    // Continuous DMA sampling of the analog inputs
+#define ADC_DMA_SAMPLE_RATE_HZ  20000   // Total conversions/s shared by all inputs (ESP32 minimum)
+#define ADC_DMA_FRAME_BYTES     1024    // Bytes handed over per DMA frame (512 two-byte results)
+#define ADC_DMA_BUFFER_BYTES    4096    // Driver ring buffer
 
 // ACS712 Calibration Defaults
 #define ACS712_ZERO_CURRENT_MV  2500.0f // Center voltage at 0A
@@ -77,5 +147,22 @@
 
 // NVS Configuration
 #define NVS_NAMESPACE           "ebike_config"
+#define BATTERY_STATS_NAMESPACE "batt_stats"  // Pack statistics checkpoints (one blob per pack)
+#define BATTERY_STATS_CHECKPOINT_MS 300000  // How often changed statistics are written to NVS
+#define BATTERY_STATS_MAX_GAP_MS 5000   // Longer gaps between pack readings aren't integrated
+
+// Performance monitoring (/api/diagnostics/perf, "perf" WebSocket stream)
+#define PERF_SAMPLE_INTERVAL_MS 1000    // Task, queue and heap sampling period
+#define PERF_MAX_TASKS          12      // Tracked tasks (idle tasks included)
+#define PERF_MAX_QUEUES         12      // Tracked queues
+#define PERF_MAX_SYSTEM_TASKS   32      // uxTaskGetSystemState() snapshot size (run-time stats builds)
+
+// Battery history for charts (points per pack; 30 bytes each). At these
+// counts a pack takes ~19 KB of heap, ~95 KB with MAX_BATTERY_MODULES packs;
+// allocated at boot per pack, and packs that don't fit go without history
+#define HISTORY_1S_POINTS       300     // 5 minutes at 1 s
+#define HISTORY_1M_POINTS       240     // 4 hours at 1 min
+#define HISTORY_15M_POINTS      96      // 24 hours at 15 min
+#define HISTORY_HEAP_BUDGET     (96 * 1024) // Ceiling for all packs' rings (checked at compile time)
 
 #endif // CONFIG_H
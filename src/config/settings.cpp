@@ -61,9 +61,18 @@ bool SettingsManager::load() {
     settings.can_bitrate = preferences.getUInt("can_bitrate", CAN_BITRATE);
     settings.can_log_enabled = preferences.getBool("can_log_en", true);
     settings.mqtt_canmsg_enabled = preferences.getBool("mqtt_canmsg", false);
+    settings.mqtt_can_format = static_cast<MQTTCANFormat>(
+        preferences.getUChar("mqtt_can_fmt", static_cast<uint8_t>(MQTTCANFormat::BATCH_BINARY)));
+    settings.mqtt_can_batch_ms = preferences.getUShort("mqtt_can_ms", DEFAULT_MQTT_CAN_BATCH_MS);
+    settings.mqtt_can_batch_bytes = preferences.getUShort("mqtt_can_bytes", DEFAULT_MQTT_CAN_BATCH_BYTES);
 
     // Load timing configuration
     settings.publish_interval_ms = preferences.getUShort("pub_interval", DEFAULT_PUBLISH_INTERVAL_MS);
+    settings.mqtt_deadband.voltage = preferences.getFloat("db_volt", DEFAULT_DEADBAND_VOLTAGE);
+    settings.mqtt_deadband.current = preferences.getFloat("db_curr", DEFAULT_DEADBAND_CURRENT);
+    settings.mqtt_deadband.soc = preferences.getUChar("db_soc", DEFAULT_DEADBAND_SOC);
+    settings.mqtt_deadband.temp = preferences.getFloat("db_temp", DEFAULT_DEADBAND_TEMP);
+    settings.mqtt_deadband.heartbeat_s = preferences.getUShort("db_heartbeat", DEFAULT_TELEMETRY_HEARTBEAT_S);
     settings.sample_interval_ms = preferences.getUShort("sample_interval", DEFAULT_SAMPLE_INTERVAL_MS);
     settings.web_refresh_ms = preferences.getUShort("web_refresh", DEFAULT_WEB_REFRESH_MS);
 
@@ -141,9 +150,17 @@ bool SettingsManager::save() {
     preferences.putUInt("can_bitrate", settings.can_bitrate);
     preferences.putBool("can_log_en", settings.can_log_enabled);
     preferences.putBool("mqtt_canmsg", settings.mqtt_canmsg_enabled);
+    preferences.putUChar("mqtt_can_fmt", static_cast<uint8_t>(settings.mqtt_can_format));
+    preferences.putUShort("mqtt_can_ms", settings.mqtt_can_batch_ms);
+    preferences.putUShort("mqtt_can_bytes", settings.mqtt_can_batch_bytes);
 
     // Save timing configuration
     preferences.putUShort("pub_interval", settings.publish_interval_ms);
+    preferences.putFloat("db_volt", settings.mqtt_deadband.voltage);
+    preferences.putFloat("db_curr", settings.mqtt_deadband.current);
+    preferences.putUChar("db_soc", settings.mqtt_deadband.soc);
+    preferences.putFloat("db_temp", settings.mqtt_deadband.temp);
+    preferences.putUShort("db_heartbeat", settings.mqtt_deadband.heartbeat_s);
     preferences.putUShort("sample_interval", settings.sample_interval_ms);
     preferences.putUShort("web_refresh", settings.web_refresh_ms);
 
@@ -208,9 +225,17 @@ void SettingsManager::setDefaults() {
     settings.can_bitrate = CAN_BITRATE;
     settings.can_log_enabled = true;        // Local logging enabled by default
     settings.mqtt_canmsg_enabled = true;    // MQTT CAN messages enabled by default
+    settings.mqtt_can_format = MQTTCANFormat::BATCH_BINARY;
+    settings.mqtt_can_batch_ms = DEFAULT_MQTT_CAN_BATCH_MS;
+    settings.mqtt_can_batch_bytes = DEFAULT_MQTT_CAN_BATCH_BYTES;
 
     // Timing defaults
     settings.publish_interval_ms = DEFAULT_PUBLISH_INTERVAL_MS;
+    settings.mqtt_deadband.voltage = DEFAULT_DEADBAND_VOLTAGE;
+    settings.mqtt_deadband.current = DEFAULT_DEADBAND_CURRENT;
+    settings.mqtt_deadband.soc = DEFAULT_DEADBAND_SOC;
+    settings.mqtt_deadband.temp = DEFAULT_DEADBAND_TEMP;
+    settings.mqtt_deadband.heartbeat_s = DEFAULT_TELEMETRY_HEARTBEAT_S;
     settings.sample_interval_ms = DEFAULT_SAMPLE_INTERVAL_MS;
     settings.web_refresh_ms = DEFAULT_WEB_REFRESH_MS;
 
@@ -257,11 +282,42 @@ bool SettingsManager::validateSettings() {
         settings.publish_interval_ms = DEFAULT_PUBLISH_INTERVAL_MS;
     }
 
+    TelemetryDeadband& deadband = settings.mqtt_deadband;
+    if (!(deadband.voltage >= 0.0f && deadband.voltage <= 10.0f) ||
+        !(deadband.current >= 0.0f && deadband.current <= 50.0f) ||
+        !(deadband.temp >= 0.0f && deadband.temp <= 20.0f) || deadband.soc > 50) {
+        Serial.println("SettingsManager: Invalid telemetry deadbands, using defaults");
+        deadband.voltage = DEFAULT_DEADBAND_VOLTAGE;
+        deadband.current = DEFAULT_DEADBAND_CURRENT;
+        deadband.soc = DEFAULT_DEADBAND_SOC;
+        deadband.temp = DEFAULT_DEADBAND_TEMP;
+    }
+
+    if (deadband.heartbeat_s < 5 || deadband.heartbeat_s > 3600) {
+        Serial.printf("SettingsManager: Invalid telemetry heartbeat: %d\n", deadband.heartbeat_s);
+        deadband.heartbeat_s = DEFAULT_TELEMETRY_HEARTBEAT_S;
+    }
+
     if (settings.web_refresh_ms < 100 || settings.web_refresh_ms > 10000) {
         Serial.printf("SettingsManager: Invalid web refresh: %d\n", settings.web_refresh_ms);
         settings.web_refresh_ms = DEFAULT_WEB_REFRESH_MS;
     }
 
+    if (static_cast<uint8_t>(settings.mqtt_can_format) > static_cast<uint8_t>(MQTTCANFormat::BATCH_JSON)) {
+        Serial.printf("SettingsManager: Invalid MQTT CAN format: %d\n", static_cast<int>(settings.mqtt_can_format));
+        settings.mqtt_can_format = MQTTCANFormat::BATCH_BINARY;
+    }
+
+    if (settings.mqtt_can_batch_ms < 50 || settings.mqtt_can_batch_ms > 10000) {
+        Serial.printf("SettingsManager: Invalid MQTT CAN batch interval: %d\n", settings.mqtt_can_batch_ms);
+        settings.mqtt_can_batch_ms = DEFAULT_MQTT_CAN_BATCH_MS;
+    }
+
+    if (settings.mqtt_can_batch_bytes < 128 || settings.mqtt_can_batch_bytes > MQTT_CAN_BATCH_MAX_BYTES) {
+        Serial.printf("SettingsManager: Invalid MQTT CAN batch size: %d\n", settings.mqtt_can_batch_bytes);
+        settings.mqtt_can_batch_bytes = DEFAULT_MQTT_CAN_BATCH_BYTES;
+    }
+
     // Validate number of batteries
     if (settings.num_batteries < 1 || settings.num_batteries > MAX_BATTERY_MODULES) {
         Serial.printf("SettingsManager: Invalid battery count: %d\n", settings.num_batteries);
@@ -11,6 +11,25 @@ enum class ProtocolSource : uint8_t {
     CUSTOM_PROTOCOL = 100           // Custom protocol from SPIFFS
 };
 
+// How CAN frames go to MQTT
+enum class MQTTCANFormat : uint8_t {
+    FRAME_JSON = 0,                 // One JSON message per frame on <prefix>/canmsg
+    BATCH_BINARY = 1,               // Compact batches on <prefix>/canbatch
+    BATCH_JSON = 2                  // Same batches as JSON on <prefix>/canbatch/json
+};
+
+// Report-by-exception thresholds for per-pack MQTT telemetry. A pack is
+// published when a value moves at least this far from the last published
+// one (0 = any change), its status flags, error or freshness change, or
+// heartbeat_s passes without a publish.
+struct TelemetryDeadband {
+    float voltage;                  // V (default: 0.2)
+    float current;                  // A (default: 0.5)
+    uint8_t soc;                    // % (default: 1)
+    float temp;                     // °C, either sensor (default: 1.0)
+    uint16_t heartbeat_s;           // Max silence (default: 60)
+};
+
 // Battery-specific configuration
 struct BatteryConfig {
     bool enabled;
@@ -42,9 +61,13 @@ struct Settings {
     uint32_t can_bitrate;           // Fixed at 500000
     bool can_log_enabled;           // Enable local SPIFFS CAN logging (default: true)
     bool mqtt_canmsg_enabled;       // Enable MQTT CAN message publishing (default: false)
+    MQTTCANFormat mqtt_can_format;  // Per-frame JSON or batches (default: binary batches)
+    uint16_t mqtt_can_batch_ms;     // Longest a frame waits in a batch (default: 1000)
+    uint16_t mqtt_can_batch_bytes;  // Largest binary batch, applied at boot (default: 1024)
 
     // Timing Configuration
     uint16_t publish_interval_ms;   // MQTT publish rate (default: 1000)
+    TelemetryDeadband mqtt_deadband; // When pack telemetry is published
     uint16_t sample_interval_ms;    // ADC sample rate (default: 100)
     uint16_t web_refresh_ms;        // WebSocket push rate (default: 500)
 
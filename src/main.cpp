@@ -4,27 +4,38 @@
 #include "battery/battery_manager.h"
 #include "can/can_driver.h"
 #include "can/can_parser.h"
+#include "can/can_router.h"
+#include "can/protocol_loader.h"
 #include "can/can_logger.h"
 #include "network/wifi_manager.h"
 #include "network/web_server.h"
 #include "network/mqtt_client.h"
+#include "sensors/adc_manager.h"
 #include "utils/remote_log.h"
+#include "utils/perf_monitor.h"
 
 // Global objects
 SettingsManager settingsManager;
 BatteryManager batteryManager;
 CANParser canParser;
+CANRouter canRouter;
+Protocol::Loader protocolLoader;
+ADCManager adcManager;
 
 // Task handles
 TaskHandle_t canTaskHandle = NULL;
 TaskHandle_t sensorTaskHandle = NULL;
 TaskHandle_t networkTaskHandle = NULL;
+TaskHandle_t mainTaskHandle = NULL;     // setup()/loop()
 
 // Forward declarations
 void setupPins();
 void setupSerial();
 void setupCANBus();
+void applyCANFilter();
 void setupSensors();
+void setupPerfMonitor();
+void handleLoadTestCommand(String args);
 void setupNetwork();
 void setupWebServer();
 void canTask(void* parameter);
@@ -55,6 +66,7 @@ void setup() {
 
     // Print current settings
     settingsManager.printSettings();
+    perfMonitor.markBoot(PerfMonitor::BootPhase::SETTINGS);
 
     // Initialize battery manager
     const Settings& settings = settingsManager.getSettings();
@@ -70,13 +82,11 @@ void setup() {
         }
     }
 
-    // Initialize subsystems
+    // CAN capture first: BMS wake-up, precharge and fault frames arrive in
+    // the first moments after power-on, and the RX ring only holds them
+    // until the CAN task drains it
     setupCANBus();
-    setupSensors();
-    setupNetwork();
-    setupWebServer();
 
-    // Create FreeRTOS tasks
     LOG_INFO("Starting tasks...");
 
     xTaskCreatePinnedToCore(
@@ -88,6 +98,11 @@ void setup() {
         &canTaskHandle,     // Task handle
         0                   // Core (0 or 1)
     );
+    if (canDriver.getStatus() == CANStatus::RUNNING) {
+        perfMonitor.markBoot(PerfMonitor::BootPhase::CAN_CAPTURE);
+    }
+
+    setupSensors();
 
     xTaskCreatePinnedToCore(
         sensorTask,
@@ -98,7 +113,14 @@ void setup() {
         &sensorTaskHandle,
         0
     );
+    perfMonitor.markBoot(PerfMonitor::BootPhase::SENSORS);
 
+    // Runtime logging is queued from here on
+    remoteLog.startAsync();
+
+    // WiFi, web server and MQTT come up in the network task, so a slow STA
+    // connection never holds back the CAN pipeline
+    mainTaskHandle = xTaskGetCurrentTaskHandle();
     xTaskCreatePinnedToCore(
         networkTask,
         "Network Task",
@@ -109,7 +131,8 @@ void setup() {
         1                   // Run on core 1 (WiFi core)
     );
 
-    LOG_INFO("System initialized successfully!");
+    perfMonitor.markBoot(PerfMonitor::BootPhase::SETUP_DONE);
+    LOG_INFO("CAN capture running %u ms after boot, network starting in background", millis());
     LOG_INFO("Type 'help' for available commands");
 }
 
@@ -134,9 +157,14 @@ void loop() {
                     Serial.println("WiFi settings cleared. Rebooting in 2 seconds...");
                     delay(2000);
                     ESP.restart();
+                } else if (serialCommand == "loadtest" || serialCommand.startsWith("loadtest ")) {
+                    handleLoadTestCommand(serialCommand.substring(8));
                 } else if (serialCommand == "help") {
                     Serial.println("\n=== Available Commands ===");
                     Serial.println("  reset_wifi / clear_wifi - Clear WiFi credentials and reboot");
+                    Serial.println("  loadtest <fps>[,<fps>...] [step_ms] [foreign_pct] [loopback]");
+                    Serial.println("           - Synthetic CAN RX traffic, one step per rate");
+                    Serial.println("  loadtest [status] / loadtest stop - Progress and results / abort");
                     Serial.println("  help - Show this help message");
                     Serial.println("==========================\n");
                 } else {
@@ -162,15 +190,17 @@ void loop() {
             LOG_WARN("%d battery error(s) detected", errorCount);
 
             // Print detailed status
-            for (uint8_t i = 0; i < batteryManager.getActiveBatteryCount(); i++) {
-                const BatteryModule* battery = batteryManager.getBattery(i);
-                if (battery != nullptr && battery->isEnabled()) {
-                    if (battery->hasError() || !battery->isDataFresh(10000)) {
-                        if (!battery->isDataFresh(10000)) {
-                            LOG_WARN("Battery %d (%s): STALE DATA", i, battery->getName());
-                        } else if (battery->hasError()) {
-                            LOG_ERROR("Battery %d (%s): ERROR FLAG SET", i, battery->getName());
-                        }
+            BatterySnapshot packs[MAX_BATTERY_MODULES];
+            uint8_t active = batteryManager.snapshotAll(packs);
+            uint32_t now = millis();
+            for (uint8_t i = 0; i < active; i++) {
+                const BatterySnapshot& battery = packs[i];
+                if (battery.enabled) {
+                    const char* name = batteryManager.getBattery(i)->getName();
+                    if (!battery.isFresh(10000, now)) {
+                        LOG_WARN("Battery %d (%s): STALE DATA", i, name);
+                    } else if (battery.error) {
+                        LOG_ERROR("Battery %d (%s): ERROR FLAG SET", i, name);
                     }
                 }
             }
@@ -192,25 +222,28 @@ void loop() {
     static uint32_t lastSummary = 0;
     if (millis() - lastSummary > 60000) {  // Every 60 seconds
         Serial.println("\n========== Battery Summary ==========");
-        for (uint8_t i = 0; i < batteryManager.getActiveBatteryCount(); i++) {
-            const BatteryModule* battery = batteryManager.getBattery(i);
-            if (battery != nullptr && battery->isEnabled()) {
-                Serial.printf("Battery %d (%s):\n", i, battery->getName());
-                Serial.printf("  Voltage: %.2f V\n", battery->getVoltage());
-                Serial.printf("  Current: %.2f A\n", battery->getCurrent());
-                Serial.printf("  Power: %.2f W\n", battery->getPower());
-                Serial.printf("  SOC: %d%%\n", battery->getSOC());
+        BatterySnapshot packs[MAX_BATTERY_MODULES];
+        BatteryManager::Totals totals;
+        uint8_t active = batteryManager.snapshotAll(packs, &totals);
+        for (uint8_t i = 0; i < active; i++) {
+            const BatterySnapshot& battery = packs[i];
+            if (battery.enabled) {
+                Serial.printf("Battery %d (%s):\n", i, batteryManager.getBattery(i)->getName());
+                Serial.printf("  Voltage: %.2f V\n", battery.voltage);
+                Serial.printf("  Current: %.2f A\n", battery.current);
+                Serial.printf("  Power: %.2f W\n", battery.power());
+                Serial.printf("  SOC: %d%%\n", battery.soc);
                 Serial.printf("  Temp1: %.1f°C, Temp2: %.1f°C\n",
-                             battery->getTemp1(), battery->getTemp2());
+                             battery.temp1, battery.temp2);
                 Serial.printf("  Data age: %lu ms\n",
-                             millis() - battery->getLastUpdate());
+                             millis() - battery.last_update);
                 Serial.printf("  Has CAN data: %s\n",
-                             battery->hasCANData() ? "Yes" : "No");
+                             battery.has_can_data ? "Yes" : "No");
             }
         }
-        Serial.printf("Total Power: %.2f W\n", batteryManager.getTotalPower());
-        Serial.printf("Total Current: %.2f A\n", batteryManager.getTotalCurrent());
-        Serial.printf("Average Voltage: %.2f V\n", batteryManager.getAverageVoltage());
+        Serial.printf("Total Power: %.2f W\n", totals.power);
+        Serial.printf("Total Current: %.2f A\n", totals.current);
+        Serial.printf("Average Voltage: %.2f V\n", totals.average_voltage);
         Serial.println("=====================================\n");
         lastSummary = millis();
     }
@@ -220,8 +253,8 @@ void loop() {
 
 // Setup functions
 void setupSerial() {
+    // No wait for a monitor to attach: CAN capture must start right away
     Serial.begin(115200);
-    delay(1000);  // Wait for serial to be ready
 }
 
 void setupPins() {
@@ -236,10 +269,36 @@ void setupCANBus() {
     LOG_INFO("Initializing CAN bus...");
 
     // Initialize CAN logger
-    if (!canLogger.begin("/canlog.csv")) {
+#if CAN_LOG_BINARY
+    bool logger_ok = canLogger.begin("/canlog",
+                                     CAN_LOG_COMPRESSED ? CANLogMode::COMPRESSED : CANLogMode::BINARY,
+                                     settingsManager.getSettings().can_bitrate);
+#else
+    bool logger_ok = canLogger.begin("/canlog", CANLogMode::CSV);
+#endif
+    if (!logger_ok) {
         LOG_WARN("CAN logger initialization failed");
     }
 
+    // Per-battery protocol parsers and ID routes (custom protocols live in SPIFFS)
+    if (!protocolLoader.begin()) {
+        LOG_WARN("Protocol loader initialization failed, custom protocols unavailable");
+    }
+    if (!canRouter.begin(settingsManager.getSettings(), &canParser, &protocolLoader)) {
+        LOG_WARN("No battery protocol routes, using legacy parser only");
+    }
+
+    // Compute the acceptance filter first so begin() installs it directly
+    applyCANFilter();
+
+    // Protocol periods let the analyzer flag late and missing messages
+    uint32_t period_ids[CAN_FILTER_MAX_IDS];
+    uint16_t periods[CAN_FILTER_MAX_IDS];
+    size_t period_count = canRouter.getExpectedPeriods(period_ids, periods, CAN_FILTER_MAX_IDS);
+    for (size_t i = 0; i < period_count; i++) {
+        canDriver.getAnalyzer().setExpectedPeriod(period_ids[i], period_ids[i] > 0x7FF, periods[i]);
+    }
+
     // Initialize CAN driver
     uint32_t bitrate = settingsManager.getSettings().can_bitrate;
     if (!canDriver.begin(bitrate)) {
@@ -247,29 +306,42 @@ void setupCANBus() {
         return;
     }
 
-    // Set up message callback for logging and MQTT publishing
-    canDriver.setMessageCallback([](const CANMessage& msg) {
-        const Settings& settings = settingsManager.getSettings();
-
-        // Broadcast to WebSocket clients for real-time viewing
-        webServer.broadcastCANMessage(msg.id, msg.dlc, msg.data);
+    // Fan received frames out to consumers that each run in their own task,
+    // so the RX task only enqueues. Battery parsing is fed by the driver's
+    // own RX queue (see canTask), which republishes each frame once decoded.
+    CANFrameBus& frameBus = canDriver.getFrameBus();
 
-        // Log to local storage if enabled
-        if (settings.can_log_enabled) {
-            canLogger.logMessage(msg);
-        }
+    // Broadcast to WebSocket clients for real-time viewing (latest frames matter most)
+    frameBus.subscribe("web", [](const CANFrame& frame) {
+        webServer.broadcastCANFrame(frame);
+    }, CAN_BUS_WEB_QUEUE_DEPTH, FrameDropPolicy::DROP_OLDEST, 1, 1);
 
-        // Publish to MQTT if enabled
-        if (settings.mqtt_canmsg_enabled) {
-            mqttClient.publishCANMessage(msg);
+    // Log to local storage if enabled
+    frameBus.subscribe("logger", [](const CANFrame& frame) {
+        if (settingsManager.getSettings().can_log_enabled) {
+            canLogger.logFrame(frame);
         }
+    }, CAN_BUS_LOG_QUEUE_DEPTH, FrameDropPolicy::DROP_NEWEST, 1, 0);
 
-        // Parse battery data
-        CANBatteryData battData;
-        if (canParser.parseMessage(msg, battData)) {
-            // Successfully parsed - will be handled in CAN task
+    // Publish to MQTT if enabled (raw bytes plus the already-decoded fields)
+    canParser.getDecodedBus().subscribe("mqtt", [](const DecodedFrame& decoded) {
+        if (settingsManager.getSettings().mqtt_canmsg_enabled) {
+            mqttClient.publishCANMessage(decoded);
+            perfMonitor.latency(PerfMonitor::Latency::MQTT).record((millis() - decoded.frame.timestamp) * 1000);
         }
-    });
+    }, CAN_BUS_MQTT_QUEUE_DEPTH, FrameDropPolicy::DROP_OLDEST, 1, 1);
+
+    // Drop counters the load test reports for each rate step, in
+    // pipeline order (bus_* are the consumer queues in front of each stage)
+    CANLoadTest& loadTest = canDriver.getLoadTest();
+    loadTest.addStage("rx_ring", []() { return canDriver.getStats().rx_dropped; });
+    loadTest.addStage("rx_missed", []() { return canDriver.getStats().rx_missed; });
+    loadTest.addStage("bus_web", []() { return canDriver.getFrameBus().getConsumerStats(0).dropped; });
+    loadTest.addStage("ws_batch", []() { return webServer.getCANDropped(); });
+    loadTest.addStage("bus_logger", []() { return canDriver.getFrameBus().getConsumerStats(1).dropped; });
+    loadTest.addStage("logger", []() { return canLogger.getDroppedCount(); });
+    loadTest.addStage("bus_mqtt", []() { return canParser.getDecodedBus().getConsumerStats(0).dropped; });
+    loadTest.addStage("mqtt_batch", []() { return mqttClient.getCANBatchDropped(); });
 
     // Enable periodic ping to test transceiver
 #if CAN_PING_ENABLED
@@ -280,10 +352,225 @@ void setupCANBus() {
     LOG_INFO("CAN bus initialized at %u kbps", bitrate / 1000);
 }
 
+void applyCANFilter() {
+#if CAN_HW_FILTER_ENABLED
+    // Routed battery IDs (already shifted to each can_base_id) plus legacy/handler IDs
+    // One spare slot tells a full list apart from a truncated one
+    uint32_t ids[CAN_FILTER_MAX_IDS + 1];
+    size_t count = canRouter.getAcceptedIds(ids, CAN_FILTER_MAX_IDS + 1);
+    if (count == 0 || count > CAN_FILTER_MAX_IDS) {
+        if (count > 0) {
+            LOG_WARN("CAN filter: more than %d IDs, accepting all", CAN_FILTER_MAX_IDS);
+        }
+        canDriver.clearFilters();
+        return;
+    }
+
+    // IDs beyond the 11-bit range can only come from extended frames
+    bool extended[CAN_FILTER_MAX_IDS];
+    for (size_t i = 0; i < count; i++) {
+        extended[i] = ids[i] > 0x7FF;
+    }
+
+    CANFilter filter = CANFilter::forIds(ids, extended, count);
+    char desc[64];
+    filter.describe(desc, sizeof(desc));
+    LOG_INFO("CAN filter: %u ID(s) -> %s", (unsigned)count, desc);
+
+    canDriver.setFilter(filter);
+#else
+    canDriver.clearFilters();
+#endif
+}
+
 void setupSensors() {
     LOG_INFO("Initializing sensors...");
-    // TODO: Initialize ADC and sensors
-    LOG_INFO("Sensors initialized (placeholder)");
+#if ADC_SAMPLING_ENABLED
+    if (adcManager.begin(&settingsManager, &batteryManager)) {
+        LOG_INFO("Sensors initialized (%u ADC inputs)", adcManager.getChannelCount());
+    } else {
+        LOG_WARN("ADC sampling not started");
+    }
+#else
+    LOG_INFO("ADC sampling disabled");
+#endif
+}
+
+// Frame bus consumer queue as a perf gauge
+template<typename Bus>
+static void fillBusQueue(const Bus& bus, size_t index, PerfMonitor::QueueInfo& info) {
+    FrameConsumerStats stats = bus.getConsumerStats(index);
+    info.depth = bus.getConsumerLag(index);
+    info.capacity = bus.getConsumerCapacity(index);
+    info.high_water = stats.high_water;
+}
+
+void setupPerfMonitor() {
+    perfMonitor.begin();
+
+    perfMonitor.addTask("CAN RX", canDriver.getTaskHandle());
+    perfMonitor.addTask("CAN TX", canDriver.getTxScheduler().getTaskHandle());
+    perfMonitor.addTask("CAN", canTaskHandle);
+    perfMonitor.addTask("Sensor", sensorTaskHandle);
+    perfMonitor.addTask("Network", networkTaskHandle);
+    perfMonitor.addTask("loop", mainTaskHandle);
+    if (mqttClient.getTaskHandle() != nullptr) {
+        perfMonitor.addTask("MQTT", mqttClient.getTaskHandle());
+    }
+    if (remoteLog.getTaskHandle() != nullptr) {
+        perfMonitor.addTask("Log", remoteLog.getTaskHandle());
+    }
+
+    perfMonitor.addQueue("rx_queue", [](PerfMonitor::QueueInfo& info) {
+        info.depth = canDriver.available();
+        info.capacity = canDriver.getRxQueueCapacity();
+        info.high_water = canDriver.getRxQueueHighWater();
+    });
+    perfMonitor.addQueue("can_tx", [](PerfMonitor::QueueInfo& info) {
+        CANTxScheduler::Stats stats;
+        canDriver.getTxScheduler().getStats(stats);
+        info.depth = canDriver.getTxScheduler().getQueueDepth() + stats.pending;
+        info.capacity = canDriver.getTxScheduler().getQueueCapacity() + CAN_TX_PENDING;
+    });
+    perfMonitor.addQueue("bus_web", [](PerfMonitor::QueueInfo& info) {
+        fillBusQueue(canDriver.getFrameBus(), 0, info);
+    });
+    perfMonitor.addQueue("bus_logger", [](PerfMonitor::QueueInfo& info) {
+        fillBusQueue(canDriver.getFrameBus(), 1, info);
+    });
+    perfMonitor.addQueue("bus_mqtt", [](PerfMonitor::QueueInfo& info) {
+        fillBusQueue(canParser.getDecodedBus(), 0, info);
+    });
+    perfMonitor.addQueue("ws_can_batch", [](PerfMonitor::QueueInfo& info) {
+        info.depth = webServer.getCANRingDepth();
+        info.capacity = WS_CAN_RING_SIZE;
+        info.high_water = webServer.getCANRingHighWater();
+    });
+    perfMonitor.addQueue("canlog_blocks", [](PerfMonitor::QueueInfo& info) {
+        info.depth = canLogger.getPendingBlocks();
+        info.capacity = 2;
+    });
+    perfMonitor.addQueue("mqtt_outbound", [](PerfMonitor::QueueInfo& info) {
+        info.depth = mqttClient.getOutboundDepth(false);
+        info.capacity = MQTT_OUTBOUND_QUEUE_DEPTH;
+        info.high_water = mqttClient.getOutboundHighWater(false);
+    });
+    perfMonitor.addQueue("mqtt_outbound_can", [](PerfMonitor::QueueInfo& info) {
+        info.depth = mqttClient.getOutboundDepth(true);
+        info.capacity = MQTT_OUTBOUND_QUEUE_DEPTH;
+        info.high_water = mqttClient.getOutboundHighWater(true);
+    });
+    perfMonitor.addQueue("mqtt_offline", [](PerfMonitor::QueueInfo& info) {
+        MQTTOfflineQueue::Stats stats;
+        mqttClient.getQueueStats(stats);
+        info.depth = stats.depth;       // RAM then flash, no fixed capacity
+    });
+    perfMonitor.addQueue("log_queue", [](PerfMonitor::QueueInfo& info) {
+        info.depth = remoteLog.getQueueDepth();
+        info.capacity = remoteLog.getQueueCapacity();
+        info.high_water = remoteLog.getQueueHighWater();
+    });
+
+    perfMonitor.sample();
+}
+
+// Serial console: "loadtest <fps>[,<fps>...] [step_ms] [foreign_pct] [loopback]",
+// "loadtest stop", or "loadtest [status]" for progress and the per-step table
+void handleLoadTestCommand(String args) {
+    static const char* const PHASES[] = {"idle", "arming", "generating", "settling"};
+    CANLoadTest& test = canDriver.getLoadTest();
+    args.trim();
+
+    if (args == "stop") {
+        test.stop();
+        Serial.println("Load test stopping");
+        return;
+    }
+
+    if (args.length() > 0 && args != "status") {
+        CANLoadTest::Config* config = new (std::nothrow) CANLoadTest::Config();
+        if (config == nullptr) {
+            Serial.println("Load test: out of memory");
+            return;
+        }
+
+        // Rates first, then the optional numbers in order, "loopback" anywhere after
+        int space = args.indexOf(' ');
+        String rates = space < 0 ? args : args.substring(0, space);
+        String rest = space < 0 ? String("") : args.substring(space + 1);
+        int start = 0;
+        while (start < (int)rates.length() && config->step_count < CANLoadTest::MAX_STEPS) {
+            int comma = rates.indexOf(',', start);
+            if (comma < 0) comma = rates.length();
+            config->rates[config->step_count++] = rates.substring(start, comma).toInt();
+            start = comma + 1;
+        }
+        uint8_t numbers = 0;
+        rest.trim();
+        while (rest.length() > 0) {
+            space = rest.indexOf(' ');
+            String word = space < 0 ? rest : rest.substring(0, space);
+            rest = space < 0 ? String("") : rest.substring(space + 1);
+            rest.trim();
+            if (word == "loopback") {
+                config->loopback = true;
+            } else if (numbers == 0) {
+                config->step_ms = word.toInt();
+                numbers++;
+            } else {
+                long pct = word.toInt();
+                config->foreign_pct = pct < 0 || pct > 100 ? UINT8_MAX : pct;
+                numbers++;
+            }
+        }
+        if (test.isActive()) {
+            Serial.println("Load test already running (loadtest stop)");
+        } else if (!canRouter.prepareLoadTest(*config)) {
+            Serial.printf("Load test not started: loopback IDs 0x%03X-0x%03X are used by a configured protocol\n",
+                          (unsigned)CAN_LOADTEST_FOREIGN_ID,
+                          (unsigned)(CAN_LOADTEST_FOREIGN_ID + CANLoadTest::FOREIGN_IDS - 1));
+        } else if (test.start(*config)) {
+            Serial.printf("Load test started: %u step(s) of %u ms, %u template(s)%s\n",
+                          config->step_count, config->step_ms, config->template_count,
+                          config->loopback ? ", loopback (foreign IDs only, sent on the bus)" : "");
+        } else if (test.isActive()) {
+            Serial.println("Load test already running (loadtest stop)");
+        } else {
+            Serial.printf("Load test not started: rates 1-%u fps, step_ms 1-60000, foreign_pct 0-100 "
+                          "(100 when no protocol is configured)\n", CAN_LOADTEST_MAX_RATE);
+        }
+        delete config;
+        return;
+    }
+
+    CANLoadTest::Status status;
+    test.getStatus(status);
+    Serial.printf("\n=== CAN Load Test: %s%s ===\n", PHASES[static_cast<uint8_t>(status.phase)],
+                  status.aborted ? " (stopped)" : "");
+    if (status.phase != CANLoadTest::Phase::IDLE) {
+        Serial.printf("Step %u of %u (%u ms each)%s\n", status.step + 1, status.step_count,
+                      status.step_ms, status.loopback ? ", loopback" : "");
+    }
+
+    CANLoadTest::StepResult result;
+    for (uint8_t i = 0; i < status.steps_done && test.getResult(i, result); i++) {
+        Serial.printf("Step %u: %u fps requested, %.0f generated, %.0f parsed, %u lagged\n",
+                      i + 1, result.rate, result.generated_fps, result.parsed_fps, result.lagged);
+        Serial.print("  drops:");
+        for (size_t s = 0; s < test.getStageCount(); s++) {
+            Serial.printf(" %s=%u", test.getStageName(s), result.drops[s]);
+        }
+        Serial.println();
+        for (uint8_t k = 0; k < CANLoadTest::LATENCY_KINDS; k++) {
+            if (result.latency_count[k] == 0) {
+                continue;
+            }
+            Serial.printf("  %s latency: p50 %u us, p90 %u us, p99 %u us (%u frames)\n",
+                          PerfMonitor::latencyName(static_cast<PerfMonitor::Latency>(k)),
+                          result.p50_us[k], result.p90_us[k], result.p99_us[k], result.latency_count[k]);
+        }
+    }
+    Serial.println();
 }
 
 void setupNetwork() {
@@ -299,6 +586,7 @@ void setupNetwork() {
     wifiManager.setStateCallback([](WiFiState state) {
         switch (state) {
             case WiFiState::CONNECTED:
+                perfMonitor.markBoot(PerfMonitor::BootPhase::WIFI_CONNECTED);
                 digitalWrite(PIN_STATUS_LED, HIGH);
                 LOG_INFO("WiFi connected: %s", wifiManager.getLocalIP().toString().c_str());
                 break;
@@ -335,21 +623,8 @@ void setupNetwork() {
             ap_ssid.c_str(),
             WIFI_AP_PASSWORD
         );
-
-        // Wait for STA connection or timeout
-        Serial.print("[WiFi] Waiting for connection");
-        uint32_t start = millis();
-        while (!wifiManager.isConnected() && (millis() - start) < WIFI_CONNECTION_TIMEOUT) {
-            delay(100);
-            if ((millis() - start) % 1000 < 100) Serial.print(".");
-        }
-        Serial.println();
-
-        if (wifiManager.isConnected()) {
-            LOG_INFO("Connected to %s, IP: %s", settings.wifi_ssid, wifiManager.getLocalIP().toString().c_str());
-        } else {
-            LOG_WARN("STA connection failed, AP mode available for configuration");
-        }
+        // The connection completes in the background; networkTask reports
+        // a timeout, the state callback the connection
     } else {
         // No credentials configured, start AP only
         LOG_INFO("No WiFi configured, starting AP mode...");
@@ -357,6 +632,8 @@ void setupNetwork() {
         LOG_INFO("Connect to '%s' to configure", ap_ssid.c_str());
     }
 
+    perfMonitor.markBoot(PerfMonitor::BootPhase::WIFI_STARTED);
+
     // Initialize MQTT client
     LOG_INFO("Initializing MQTT client...");
     if (!mqttClient.begin(&settingsManager, &batteryManager)) {
@@ -370,7 +647,7 @@ void setupWebServer() {
     LOG_INFO("Initializing web server...");
 
     // Initialize web server with dependencies
-    webServer.begin(&settingsManager, &batteryManager, &canLogger);
+    webServer.begin(&settingsManager, &batteryManager, &canLogger, &protocolLoader);
 
     // Set up WebSocket client callback
     webServer.setClientCallback([](uint32_t client_id, bool connected) {
@@ -382,6 +659,7 @@ void setupWebServer() {
         webServer.broadcastLog(entry);
     });
 
+    perfMonitor.markBoot(PerfMonitor::BootPhase::WEB_SERVER);
     LOG_INFO("Web server started on port %d", WEB_SERVER_PORT);
 }
 
@@ -389,44 +667,63 @@ void setupWebServer() {
 void canTask(void* parameter) {
     LOG_INFO("CAN task started");
 
+    CANFrame frame;
     CANMessage msg;
-    CANBatteryData battData;
+    DecodedFrame decoded;
     uint32_t last_stats_print = 0;
+    PerfMonitor::Histogram& parseLatency = perfMonitor.latency(PerfMonitor::Latency::PARSE);
 
     while (true) {
+        // Block until the RX task hands over frames (10ms max so the
+        // periodic work below keeps running on a quiet bus)
+        bool have_msg = canDriver.receiveFrame(frame, 10);
+
+        // Load test frames are decoded like any other, but must not reach
+        // the packs: their statistics are checkpointed to NVS
+        bool load_test = have_msg && canDriver.getLoadTest().isActive();
+
         // Process received CAN messages
-        while (canDriver.receiveMessage(msg, 0)) {
-            // Parse the message
-            if (canParser.parseMessage(msg, battData)) {
+        while (have_msg) {
+            msg = frame.toMessage();
+
+            // Decode once with the owning battery's parser (repeated
+            // payloads come from the last-value cache)
+            if (canRouter.decode(msg, decoded)) {
                 // Update battery module with parsed data
-                if (battData.valid && battData.battery_id < MAX_BATTERY_MODULES) {
+                const CANBatteryData& battData = decoded.battery;
+                if (battData.valid && battData.battery_id < MAX_BATTERY_MODULES && !load_test) {
                     BatteryModule* battery = batteryManager.getBattery(battData.battery_id);
                     if (battery != nullptr) {
-                        battery->updateFromCAN(battData);
+                        battery->updateFromCAN(battData, msg.timestamp);
+                        batteryManager.getHistory().record(battData.battery_id, *battery, battData.present,
+                                                           msg.timestamp);
                     }
                 }
             }
-        }
 
-        // Periodic flush of CAN log
-        static uint32_t last_flush = 0;
-        if (millis() - last_flush > 5000) {  // Every 5 seconds
-            canLogger.flush();
-            last_flush = millis();
+            parseLatency.record(frame.ageUs());
+            perfMonitor.markBoot(PerfMonitor::BootPhase::FIRST_FRAME);
+
+            // Hand the same record to decoded-frame consumers
+            canParser.getDecodedBus().publish(decoded);
+            have_msg = canDriver.receiveFrame(frame, 0);
         }
 
         // Print CAN statistics every 30 seconds
         if (millis() - last_stats_print > 30000) {
             const CANStats& stats = canDriver.getStats();
-            LOG_DEBUG("CAN Stats - RX: %u, TX: %u, Dropped: %u, Errors: %u",
-                      stats.rx_count, stats.tx_count, stats.rx_dropped, stats.error_count);
-            LOG_DEBUG("CAN Logger - Messages: %u, Dropped: %u, Size: %d bytes",
+            LOG_DEBUG("CAN Stats - RX: %u, TX: %u, Dropped: %u, Missed: %u, Errors: %u",
+                      stats.rx_count, stats.tx_count, stats.rx_dropped, stats.rx_missed,
+                      stats.error_count);
+            LOG_DEBUG("CAN Parser - Cache hits: %u, misses: %u",
+                      canRouter.getCacheHits(), canRouter.getCacheMisses());
+            CANLoggerStats log_stats = canLogger.getStats();
+            LOG_DEBUG("CAN Logger - Messages: %u, Dropped: %u, Size: %d bytes, Flush: %u us (max %u), %u B/s",
                       canLogger.getMessageCount(), canLogger.getDroppedCount(),
-                      canLogger.getLogSize());
+                      canLogger.getLogSize(), log_stats.last_flush_us, log_stats.max_flush_us,
+                      log_stats.bytes_per_sec);
             last_stats_print = millis();
         }
-
-        vTaskDelay(pdMS_TO_TICKS(10));  // 10ms cycle
     }
 }
 
@@ -437,45 +734,74 @@ void sensorTask(void* parameter) {
     TickType_t sampleInterval = pdMS_TO_TICKS(settings.sample_interval_ms);
 
     while (true) {
-        // TODO: Read all ADC sensors
-        // - Current sensors (ACS712)
-        // - Voltage sensors
-        // - Update battery modules
-
         // LED status is controlled by WiFi state callback (see setupNetwork)
         // No unnecessary blinking to save power
 
-        vTaskDelay(sampleInterval);
+        if (adcManager.isRunning()) {
+            // Blocks until the next DMA frame; publishes every sample_interval_ms
+            adcManager.process(settings.sample_interval_ms);
+        } else {
+            vTaskDelay(sampleInterval);
+        }
     }
 }
 
 void networkTask(void* parameter) {
     LOG_INFO("Network task started");
 
+    // Bring-up moved out of setup(); CAN capture is already running
+    setupNetwork();
+    setupWebServer();
+    setupPerfMonitor();
+    perfMonitor.markBoot(PerfMonitor::BootPhase::NETWORK_READY);
+    LOG_INFO("Boot: CAN capture at %u ms, network ready at %u ms",
+             perfMonitor.getBootTime(PerfMonitor::BootPhase::CAN_CAPTURE),
+             perfMonitor.getBootTime(PerfMonitor::BootPhase::NETWORK_READY));
+
     const Settings& settings = settingsManager.getSettings();
+    uint32_t sta_started = millis();
+    bool sta_pending = strlen(settings.wifi_ssid) > 0;
     TickType_t webRefreshInterval = pdMS_TO_TICKS(settings.web_refresh_ms);
 
     uint32_t last_battery_broadcast = 0;
     uint32_t last_system_broadcast = 0;
     uint32_t last_wifi_check = 0;
-    uint32_t last_mqtt_update = 0;
     uint32_t last_mqtt_publish = 0;
+    uint32_t last_perf_sample = 0;
 
     while (true) {
         uint32_t now = millis();
 
+        // Performance sample, streamed to "perf" subscribers
+        if (now - last_perf_sample >= PERF_SAMPLE_INTERVAL_MS) {
+            perfMonitor.sample();
+            if (wifiManager.isConnected() || wifiManager.isAPActive()) {
+                webServer.broadcastPerf();
+            }
+            last_perf_sample = now;
+        }
+
         // Update WiFi manager (handles auto-reconnect)
         if (now - last_wifi_check > 1000) {  // Check every second
             wifiManager.update();
             last_wifi_check = now;
         }
 
-        // Update MQTT client (handles reconnection and keep-alive)
-        if (now - last_mqtt_update > 100) {  // Update MQTT every 100ms
-            mqttClient.update();
-            last_mqtt_update = now;
+        // First STA attempt: report once whether it made it in time
+        if (sta_pending) {
+            if (wifiManager.isConnected()) {
+                LOG_INFO("Connected to %s in %u ms, IP: %s", settings.wifi_ssid, now - sta_started,
+                         wifiManager.getLocalIP().toString().c_str());
+                sta_pending = false;
+            } else if (now - sta_started >= WIFI_CONNECTION_TIMEOUT) {
+                LOG_WARN("STA connection failed, AP mode available for configuration");
+                sta_pending = false;
+            }
         }
 
+        // MQTT connection and sending run in the MQTT task (see MQTTClient),
+        // so a slow or unreachable broker never stalls this loop
+
         // Only broadcast if WiFi is connected
         if (wifiManager.isConnected() || wifiManager.isAPActive()) {
             // Broadcast battery updates via WebSocket
@@ -491,12 +817,11 @@ void networkTask(void* parameter) {
             }
         }
 
-        // MQTT publishing (if connected)
-        if (mqttClient.isConnected() && now - last_mqtt_publish > settings.publish_interval_ms) {
-            // Battery status publishing disabled - use canmsg topic instead
-            // for (uint8_t i = 0; i < batteryManager.getActiveBatteryCount(); i++) {
-            //     mqttClient.publishBatteryStatus(i);
-            // }
+        // MQTT publishing (queued for later while offline)
+        if (mqttClient.isEnabled() && now - last_mqtt_publish > settings.publish_interval_ms) {
+            // Per-pack status only when it moved past the deadbands (or the
+            // heartbeat is due); the interval caps how often that can be
+            mqttClient.publishChangedBatteries();
             // mqttClient.publishAllBatteries();
 
             // Publish system status (every 5 publishes = every 5 seconds by default)
@@ -0,0 +1,174 @@
+#include "mqtt_can_batch.h"
+#include <string.h>
+
+namespace MQTTCANBatch {
+
+static void putU16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static uint16_t getU16(const uint8_t* in) {
+    return in[0] | (static_cast<uint16_t>(in[1]) << 8);
+}
+
+static uint32_t getU32(const uint8_t* in) {
+    return in[0] | (static_cast<uint32_t>(in[1]) << 8) |
+           (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+Encoder::Encoder()
+    : buffer_(nullptr), capacity_(0), len_(0), records_(0), frames_(0),
+      base_ms_(0), entry_count_(0) {}
+
+void Encoder::begin(uint8_t* buffer, size_t capacity) {
+    buffer_ = buffer;
+    capacity_ = capacity;
+    len_ = HEADER_SIZE;
+    records_ = 0;
+    frames_ = 0;
+    base_ms_ = 0;
+    entry_count_ = 0;
+    if (buffer_ != nullptr && capacity_ >= HEADER_SIZE) {
+        memset(buffer_, 0, HEADER_SIZE);
+        buffer_[0] = VERSION;
+    }
+}
+
+size_t Encoder::putId(size_t offset, uint32_t id, bool extended) {
+    buffer_[offset++] = static_cast<uint8_t>(id);
+    buffer_[offset++] = static_cast<uint8_t>(id >> 8);
+    if (extended) {
+        buffer_[offset++] = static_cast<uint8_t>(id >> 16);
+        buffer_[offset++] = static_cast<uint8_t>(id >> 24);
+    }
+    return offset;
+}
+
+bool Encoder::add(const CANMessage& msg) {
+    if (buffer_ == nullptr || capacity_ < HEADER_SIZE + MAX_FRAME_RECORD) {
+        return false;
+    }
+
+    uint8_t dlc = msg.dlc > 8 ? 8 : msg.dlc;
+    uint32_t id = msg.id & CANFrame::ID_MASK;
+    bool extended = msg.extended || id > 0x7FF;
+    uint32_t id_flags = id | (extended ? CANFrame::FLAG_EXTENDED : 0) | (msg.rtr ? CANFrame::FLAG_RTR : 0);
+    size_t id_len = extended ? 4 : 2;
+
+    Entry* entry = nullptr;
+    for (uint8_t i = 0; i < entry_count_; i++) {
+        if (entries_[i].id_flags == id_flags) {
+            entry = &entries_[i];
+            break;
+        }
+    }
+
+    // Same as the last frame of this ID: count it
+    if (entry != nullptr && entry->dlc == dlc && memcmp(entry->data, msg.data, dlc) == 0) {
+        if (entry->repeat_at != 0) {
+            uint16_t count = getU16(buffer_ + entry->repeat_at);
+            if (count < UINT16_MAX) {
+                putU16(buffer_ + entry->repeat_at, count + 1);
+                frames_++;
+                return true;
+            }
+        }
+        size_t size = 1 + id_len + 2;
+        if (len_ + size > capacity_) {
+            return false;
+        }
+        buffer_[len_] = TAG_REPEAT | (extended ? TAG_EXTENDED : 0);
+        size_t at = putId(len_ + 1, id, extended);
+        putU16(buffer_ + at, 1);
+        entry->repeat_at = static_cast<uint16_t>(at);
+        len_ = at + 2;
+        records_++;
+        frames_++;
+        putU16(buffer_ + 2, records_);
+        return true;
+    }
+
+    size_t size = 1 + id_len + 2 + dlc;
+    if (len_ + size > capacity_) {
+        return false;
+    }
+
+    if (frames_ == 0) {
+        base_ms_ = msg.timestamp;
+        buffer_[4] = static_cast<uint8_t>(base_ms_);
+        buffer_[5] = static_cast<uint8_t>(base_ms_ >> 8);
+        buffer_[6] = static_cast<uint8_t>(base_ms_ >> 16);
+        buffer_[7] = static_cast<uint8_t>(base_ms_ >> 24);
+    }
+    int32_t dt = static_cast<int32_t>(msg.timestamp - base_ms_);
+    if (dt < 0) dt = 0;
+    if (dt > UINT16_MAX) dt = UINT16_MAX;
+
+    buffer_[len_] = dlc | (extended ? TAG_EXTENDED : 0) | (msg.rtr ? TAG_RTR : 0);
+    size_t at = putId(len_ + 1, id, extended);
+    putU16(buffer_ + at, static_cast<uint16_t>(dt));
+    memcpy(buffer_ + at + 2, msg.data, dlc);
+    len_ = at + 2 + dlc;
+    records_++;
+    frames_++;
+    putU16(buffer_ + 2, records_);
+
+    // Remember the payload so repeats of it can be counted; a full table
+    // only means later frames of new IDs are sent in full
+    if (entry == nullptr && entry_count_ < MAX_IDS) {
+        entry = &entries_[entry_count_++];
+        entry->id_flags = id_flags;
+    }
+    if (entry != nullptr) {
+        entry->dlc = dlc;
+        memcpy(entry->data, msg.data, dlc);
+        entry->repeat_at = 0;
+    }
+    return true;
+}
+
+Reader::Reader(const uint8_t* data, size_t len)
+    : data_(data), len_(len), pos_(HEADER_SIZE), valid_(false),
+      records_(0), remaining_(0), base_ms_(0) {
+    if (data_ != nullptr && len_ >= HEADER_SIZE && data_[0] == VERSION) {
+        valid_ = true;
+        records_ = getU16(data_ + 2);
+        remaining_ = records_;
+        base_ms_ = getU32(data_ + 4);
+    }
+}
+
+bool Reader::next(Record& rec) {
+    if (!valid_ || remaining_ == 0 || pos_ >= len_) {
+        return false;
+    }
+
+    uint8_t tag = data_[pos_];
+    size_t id_len = (tag & TAG_EXTENDED) ? 4 : 2;
+    size_t dlc = (tag & TAG_REPEAT) ? 0 : (tag & TAG_DLC_MASK);
+    if (dlc > 8 || pos_ + 1 + id_len + 2 + dlc > len_) {
+        return false;
+    }
+
+    const uint8_t* p = data_ + pos_ + 1;
+    memset(&rec, 0, sizeof(rec));
+    rec.repeat = (tag & TAG_REPEAT) != 0;
+    rec.extended = (tag & TAG_EXTENDED) != 0;
+    rec.rtr = (tag & TAG_RTR) != 0;
+    rec.id = id_len == 4 ? getU32(p) : getU16(p);
+    p += id_len;
+    if (rec.repeat) {
+        rec.count = getU16(p);
+    } else {
+        rec.dlc = static_cast<uint8_t>(dlc);
+        rec.timestamp = base_ms_ + getU16(p);
+        memcpy(rec.data, p + 2, dlc);
+    }
+
+    pos_ += 1 + id_len + 2 + dlc;
+    remaining_--;
+    return true;
+}
+
+} // namespace MQTTCANBatch
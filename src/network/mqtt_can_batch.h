@@ -0,0 +1,104 @@
+#ifndef MQTT_CAN_BATCH_H
+#define MQTT_CAN_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../can/can_message.h"
+
+// Compact batches of CAN frames for MQTT (<prefix>/canbatch).
+//
+// A batch is a header followed by records. All values are little-endian:
+//
+//   version, reserved, record count u16, base_ms u32 (first frame's timestamp)
+//   Frame:  tag (DLC | TAG_EXTENDED | TAG_RTR), id (u16, or u32 with
+//           TAG_EXTENDED), dt u16 (ms since base_ms), DLC data bytes
+//   Repeat: tag (TAG_REPEAT | TAG_EXTENDED), id, count u16
+//
+// A repeat record stands for `count` more frames of that ID identical to its
+// most recent frame record; it comes after that record and before the next
+// one of the same ID. Every batch decodes on its own.
+namespace MQTTCANBatch {
+
+constexpr uint8_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 8;
+
+constexpr uint8_t TAG_DLC_MASK = 0x0F;
+constexpr uint8_t TAG_EXTENDED = 0x10;
+constexpr uint8_t TAG_RTR = 0x20;
+constexpr uint8_t TAG_REPEAT = 0x80;
+
+constexpr size_t MAX_FRAME_RECORD = 1 + 4 + 2 + 8;
+constexpr size_t MAX_IDS = 32;          // IDs tracked for repeat records per batch
+
+class Encoder {
+public:
+    Encoder();
+
+    // Start an empty batch in `buffer`
+    void begin(uint8_t* buffer, size_t capacity);
+
+    // False if the batch is full (the frame is not added)
+    bool add(const CANMessage& msg);
+
+    bool empty() const { return frames_ == 0; }
+    const uint8_t* data() const { return buffer_; }
+    size_t length() const { return len_; }
+    uint16_t records() const { return records_; }
+    uint32_t frames() const { return frames_; }
+
+private:
+    struct Entry {
+        uint32_t id_flags;
+        uint8_t dlc;
+        uint8_t data[8];
+        uint16_t repeat_at;     // Offset of the open repeat count (0 = none)
+    };
+
+    uint8_t* buffer_;
+    size_t capacity_;
+    size_t len_;
+    uint16_t records_;
+    uint32_t frames_;
+    uint32_t base_ms_;
+    Entry entries_[MAX_IDS];
+    uint8_t entry_count_;
+
+    size_t putId(size_t offset, uint32_t id, bool extended);
+};
+
+// Walks the records of a batch; see the layout above
+class Reader {
+public:
+    struct Record {
+        bool repeat;
+        bool extended;
+        bool rtr;
+        uint32_t id;
+        uint8_t dlc;
+        uint8_t data[8];
+        uint32_t timestamp;     // base_ms + dt (frame records)
+        uint16_t count;         // Repeat records
+    };
+
+    Reader(const uint8_t* data, size_t len);
+
+    bool valid() const { return valid_; }
+    uint32_t baseMs() const { return base_ms_; }
+    uint16_t records() const { return records_; }
+
+    // Next record; false at the end or on corrupt input
+    bool next(Record& rec);
+
+private:
+    const uint8_t* data_;
+    size_t len_;
+    size_t pos_;
+    bool valid_;
+    uint16_t records_;
+    uint16_t remaining_;
+    uint32_t base_ms_;
+};
+
+} // namespace MQTTCANBatch
+
+#endif // MQTT_CAN_BATCH_H
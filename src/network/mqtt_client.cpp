@@ -1,10 +1,13 @@
 #include "mqtt_client.h"
 #include "../config/settings.h"
 #include "../battery/battery_manager.h"
-#include "../can/can_message.h"
+#include "../can/can_parser.h"
 #include "../utils/remote_log.h"
 #include <ArduinoJson.h>
 
+// A full CAN batch must fit one offline queue entry under its topic[64]
+static_assert(MQTT_CAN_BATCH_MAX_BYTES <= MQTTOfflineQueue::maxPayload(64), "CAN batch cap exceeds the offline queue");
+
 #ifndef MQTT_DISABLE_TLS
 // HiveMQ Cloud root CA certificate
 // This is the ISRG Root X1 certificate used by HiveMQ Cloud (Let's Encrypt)
@@ -52,16 +55,34 @@ MQTTClient::MQTTClient()
       batteries_(nullptr),
       state_(MQTTState::DISCONNECTED),
       enabled_(true),
+      task_(nullptr),
       last_connect_attempt_(0),
       reconnect_delay_(MQTT_RECONNECT_DELAY),
       reconnect_count_(0),
       publish_count_(0),
-      failed_publish_count_(0) {
+      failed_publish_count_(0),
+      can_batch_buffers_{nullptr, nullptr},
+      can_batch_capacity_(0),
+      can_batch_open_(0),
+      can_batch_ready_(false),
+      can_batch_opened_ms_(0),
+      can_batch_count_(0),
+      can_batch_dropped_(0),
+      can_batch_mux_(portMUX_INITIALIZER_UNLOCKED),
+      drain_credit_(0),
+      last_drain_ms_(0),
+      replay_window_start_(0),
+      replay_window_count_(0),
+      replay_rate_(0),
+      outbound_pool_(MQTT_OUTBOUND_POOL_SLOTS, MQTT_OUTBOUND_MAX_SIZE),
+      outbound_dropped_(0) {
     last_error_[0] = '\0';
 }
 
 MQTTClient::~MQTTClient() {
     disconnect();
+    delete[] can_batch_buffers_[0];
+    delete[] can_batch_buffers_[1];
 }
 
 bool MQTTClient::begin(SettingsManager* settings, BatteryManager* batteries) {
@@ -102,10 +123,50 @@ bool MQTTClient::begin(SettingsManager* settings, BatteryManager* batteries) {
     mqtt_client_.setBufferSize(512);  // Increase buffer for larger payloads
     mqtt_client_.setKeepAlive(60);    // 60 second keep-alive
 
+    // CAN batch buffers (batches are streamed, so they may exceed the buffer above)
+    if (config.mqtt_can_format != MQTTCANFormat::FRAME_JSON) {
+        can_batch_capacity_ = config.mqtt_can_batch_bytes;
+        for (uint8_t i = 0; i < 2; i++) {
+            can_batch_buffers_[i] = new (std::nothrow) uint8_t[can_batch_capacity_];
+            if (can_batch_buffers_[i] == nullptr) {
+                LOG_ERROR("[MQTT] No memory for CAN batches, publishing frames one by one");
+                delete[] can_batch_buffers_[0];
+                can_batch_buffers_[0] = nullptr;
+                can_batch_capacity_ = 0;
+                break;
+            }
+            can_batches_[i].begin(can_batch_buffers_[i], can_batch_capacity_);
+        }
+    }
+
+    // Offline queue (picks up what an earlier boot spilled to SPIFFS)
+    if (!offline_queue_.begin()) {
+        LOG_WARN("[MQTT] Offline queue unavailable, data published while offline is lost");
+    }
+
+    if (xTaskCreatePinnedToCore(taskFunc, "MQTT Task", MQTT_TASK_STACK, this,
+                                MQTT_TASK_PRIORITY, &task_, 1) != pdPASS) {
+        setError("Failed to start MQTT task");
+        LOG_ERROR("[MQTT] Failed to start MQTT task");
+        enabled_ = false;
+        return false;
+    }
+
     LOG_INFO("[MQTT] MQTT client initialized");
     return true;
 }
 
+void MQTTClient::taskFunc(void* parameter) {
+    MQTTClient* client = static_cast<MQTTClient*>(parameter);
+    LOG_INFO("[MQTT] MQTT task started");
+
+    while (true) {
+        client->update();
+        // Publishers notify, so queued messages don't wait for the interval
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_TASK_INTERVAL_MS));
+    }
+}
+
 void MQTTClient::setupTLS() {
 #ifndef MQTT_DISABLE_TLS
     // Set root CA certificate for HiveMQ Cloud
@@ -122,7 +183,13 @@ void MQTTClient::setupTLS() {
 }
 
 void MQTTClient::update() {
-    if (!enabled_ || !settings_) {
+    if (!settings_) {
+        return;
+    }
+    if (!enabled_) {
+        if (mqtt_client_.connected()) {
+            disconnect();
+        }
         return;
     }
 
@@ -133,6 +200,12 @@ void MQTTClient::update() {
             state_ = MQTTState::DISCONNECTED;
         }
 
+        // Replayed messages not confirmed yet go again; everything queued
+        // meanwhile goes to the offline queue
+        offline_queue_.rewind();
+        sendOutbound();
+        flushCANBatch();
+
         // Attempt reconnect if enough time has passed
         uint32_t now = millis();
         if (now - last_connect_attempt_ > reconnect_delay_) {
@@ -149,6 +222,25 @@ void MQTTClient::update() {
         if (state_ != MQTTState::CONNECTED) {
             state_ = MQTTState::CONNECTED;
         }
+
+        // Backlog handed out by the previous update() survived a loop()
+        if (mqtt_client_.connected()) {
+            offline_queue_.ack();
+        } else {
+            offline_queue_.rewind();
+        }
+
+        // Live data first, then some backlog
+        sendOutbound();
+        flushCANBatch();
+        drainOfflineQueue();
+    }
+
+    uint32_t now = millis();
+    if (now - replay_window_start_ >= 1000) {
+        replay_rate_ = replay_window_count_ * 1000 / (now - replay_window_start_);
+        replay_window_count_ = 0;
+        replay_window_start_ = now;
     }
 }
 
@@ -201,8 +293,12 @@ bool MQTTClient::connect() {
 
         LOG_INFO("[MQTT] Connected successfully!");
 
-        // Publish initial config
-        publishConfig();
+        // Publish initial config (directly, this is the MQTT task)
+        String payload;
+        buildConfigPayload(payload);
+        char topic[64];
+        snprintf(topic, sizeof(topic), "%s/system/config", config.mqtt_topic_prefix);
+        sendNow(topic, reinterpret_cast<const uint8_t*>(payload.c_str()), payload.length(), true);
 
         return true;
     } else {
@@ -245,34 +341,47 @@ void MQTTClient::disconnect() {
     state_ = MQTTState::DISCONNECTED;
 }
 
-bool MQTTClient::isConnected() {
-    return mqtt_client_.connected() && state_ == MQTTState::CONNECTED;
-}
-
-bool MQTTClient::publishBatteryStatus(uint8_t battery_id) {
-    if (!isConnected() || !batteries_) {
+bool MQTTClient::publishBatteryStatus(uint8_t battery_id, uint8_t changed) {
+    if (!enabled_ || !settings_ || !batteries_) {
         return false;
     }
 
-    const BatteryModule* battery = batteries_->getBattery(battery_id);
+    BatteryModule* battery = batteries_->getBattery(battery_id);
     if (!battery || !battery->isEnabled()) {
         return false;
     }
 
+    uint32_t now = millis();
+    BatterySnapshot snap = battery->snapshot();
+    bool fresh = snap.isFresh(10000, now);
+
     // Build JSON payload
     JsonDocument doc;
     doc["id"] = battery_id;
     doc["name"] = battery->getName();
-    doc["voltage"] = battery->getVoltage();
-    doc["current"] = battery->getCurrent();
-    doc["power"] = battery->getPower();
-    doc["soc"] = battery->getSOC();
-    doc["temp1"] = battery->getTemp1();
-    doc["temp2"] = battery->getTemp2();
-    doc["enabled"] = battery->isEnabled();
-    doc["has_can_data"] = battery->hasCANData();
-    doc["data_fresh"] = battery->isDataFresh(10000);
-    doc["timestamp"] = millis() / 1000;
+    doc["voltage"] = snap.voltage;
+    doc["current"] = snap.current;
+    doc["power"] = snap.power();
+    doc["soc"] = snap.soc;
+    doc["temp1"] = snap.temp1;
+    doc["temp2"] = snap.temp2;
+    doc["status_flags"] = snap.status_flags;
+    doc["error"] = snap.error;
+    doc["enabled"] = snap.enabled;
+    doc["has_can_data"] = snap.has_can_data;
+    doc["data_fresh"] = fresh;
+    doc["timestamp"] = now / 1000;
+
+    // Why a report-by-exception publish went out
+    if (changed) {
+        JsonArray reasons = doc["changed"].to<JsonArray>();
+        if (changed & BatteryModule::CHANGED_VOLTAGE) reasons.add("voltage");
+        if (changed & BatteryModule::CHANGED_CURRENT) reasons.add("current");
+        if (changed & BatteryModule::CHANGED_SOC) reasons.add("soc");
+        if (changed & BatteryModule::CHANGED_TEMP) reasons.add("temp");
+        if (changed & BatteryModule::CHANGED_STATUS) reasons.add("status");
+        if (changed & BatteryModule::CHANGED_HEARTBEAT) reasons.add("heartbeat");
+    }
 
     String payload;
     serializeJson(doc, payload);
@@ -283,34 +392,68 @@ bool MQTTClient::publishBatteryStatus(uint8_t battery_id) {
     snprintf(topic, sizeof(topic), "%s/battery/%d/status",
              config.mqtt_topic_prefix, battery_id);
 
-    return publish(topic, payload.c_str(), false);
+    if (!publish(topic, payload.c_str(), false)) {
+        return false;
+    }
+
+    // Deadbands are measured from what subscribers last saw
+    battery->markPublished(snap, fresh, now);
+    return true;
+}
+
+uint8_t MQTTClient::publishChangedBatteries() {
+    if (!enabled_ || !settings_ || !batteries_) {
+        return 0;
+    }
+
+    const TelemetryDeadband& deadband = settings_->getSettings().mqtt_deadband;
+    uint32_t now = millis();
+    uint8_t sent = 0;
+
+    for (uint8_t i = 0; i < batteries_->getActiveBatteryCount(); i++) {
+        const BatteryModule* battery = batteries_->getBattery(i);
+        if (!battery || !battery->isEnabled()) {
+            continue;
+        }
+
+        BatterySnapshot snap = battery->snapshot();
+        uint8_t changed = battery->changedSincePublish(snap, deadband, snap.isFresh(10000, now), now);
+        if (changed && publishBatteryStatus(i, changed)) {
+            sent++;
+        }
+    }
+
+    return sent;
 }
 
 bool MQTTClient::publishAllBatteries() {
-    if (!isConnected() || !batteries_) {
+    if (!enabled_ || !settings_ || !batteries_) {
         return false;
     }
 
     // Build JSON payload with all batteries
+    BatterySnapshot packs[MAX_BATTERY_MODULES];
+    BatteryManager::Totals totals;
+    uint8_t active = batteries_->snapshotAll(packs, &totals);
+
     JsonDocument doc;
     JsonArray batteries = doc["batteries"].to<JsonArray>();
 
-    for (uint8_t i = 0; i < batteries_->getActiveBatteryCount(); i++) {
-        const BatteryModule* battery = batteries_->getBattery(i);
-        if (battery && battery->isEnabled()) {
+    for (uint8_t i = 0; i < active; i++) {
+        if (packs[i].enabled) {
             JsonObject bat = batteries.add<JsonObject>();
             bat["id"] = i;
-            bat["name"] = battery->getName();
-            bat["voltage"] = battery->getVoltage();
-            bat["current"] = battery->getCurrent();
-            bat["power"] = battery->getPower();
-            bat["soc"] = battery->getSOC();
+            bat["name"] = batteries_->getBattery(i)->getName();
+            bat["voltage"] = packs[i].voltage;
+            bat["current"] = packs[i].current;
+            bat["power"] = packs[i].power();
+            bat["soc"] = packs[i].soc;
         }
     }
 
-    doc["total_power"] = batteries_->getTotalPower();
-    doc["total_current"] = batteries_->getTotalCurrent();
-    doc["avg_voltage"] = batteries_->getAverageVoltage();
+    doc["total_power"] = totals.power;
+    doc["total_current"] = totals.current;
+    doc["avg_voltage"] = totals.average_voltage;
     doc["timestamp"] = millis() / 1000;
 
     String payload;
@@ -326,7 +469,7 @@ bool MQTTClient::publishAllBatteries() {
 }
 
 bool MQTTClient::publishSystemStatus() {
-    if (!isConnected()) {
+    if (!enabled_ || !settings_) {
         return false;
     }
 
@@ -338,6 +481,16 @@ bool MQTTClient::publishSystemStatus() {
     doc["ip_address"] = WiFi.localIP().toString();
     doc["mqtt_publishes"] = publish_count_;
     doc["mqtt_failures"] = failed_publish_count_;
+    doc["mqtt_can_batches"] = can_batch_count_;
+    doc["mqtt_can_dropped"] = can_batch_dropped_;
+
+    MQTTOfflineQueue::Stats queue;
+    offline_queue_.getStats(queue);
+    doc["mqtt_queue_depth"] = queue.depth;
+    doc["mqtt_queue_flash_bytes"] = queue.flash_bytes;
+    doc["mqtt_queue_dropped"] = queue.dropped;
+    doc["mqtt_replayed"] = queue.replayed;
+    doc["mqtt_replay_rate"] = replay_rate_;
     doc["timestamp"] = millis() / 1000;
 
     String payload;
@@ -382,7 +535,13 @@ bool MQTTClient::publishCANRaw(uint32_t can_id, uint8_t dlc, const uint8_t* data
 }
 
 bool MQTTClient::publishCANMessage(const CANMessage& msg) {
-    if (!isConnected()) {
+    DecodedFrame raw;
+    raw.frame = msg;
+    return publishCANMessage(raw);
+}
+
+bool MQTTClient::publishCANMessage(const DecodedFrame& decoded) {
+    if (!enabled_ || !settings_) {
         return false;
     }
 
@@ -392,6 +551,16 @@ bool MQTTClient::publishCANMessage(const CANMessage& msg) {
         return false;  // Silently skip if disabled
     }
 
+    const CANMessage& msg = decoded.frame;
+    if (config.mqtt_can_format != MQTTCANFormat::FRAME_JSON && can_batch_capacity_ > 0) {
+        return queueCANFrame(msg);  // Batches are queued while offline
+    }
+
+    // One message per frame is live only (it would flood the offline queue)
+    if (!isConnected()) {
+        return false;
+    }
+
     JsonDocument doc;
 
     // Format CAN ID as hex string
@@ -411,13 +580,199 @@ bool MQTTClient::publishCANMessage(const CANMessage& msg) {
         data_array.add(byte_str);
     }
 
+    // Decoded field values (already extracted by the parser, only valid ones)
+    if (decoded.message != nullptr) {
+        doc["name"] = decoded.message->name;
+        JsonObject fields = doc["fields"].to<JsonObject>();
+        for (uint8_t i = 0; i < decoded.value_count; i++) {
+            if (decoded.valid_mask & (1 << i)) {
+                fields[decoded.message->fields[i].name] = decoded.values[i];
+            }
+        }
+    }
+
     String payload;
     serializeJson(doc, payload);
 
-    // Build topic: <prefix>/canmsg
+    // Build topic: <prefix>/canmsg (this runs in the CAN bus consumer's task)
     char topic[64];
     snprintf(topic, sizeof(topic), "%s/canmsg", config.mqtt_topic_prefix);
-    return publish(topic, payload.c_str(), false);
+    return enqueue(outbound_can_, topic, payload.c_str(), payload.length(), FLAG_LIVE_ONLY);
+}
+
+bool MQTTClient::queueCANFrame(const CANMessage& msg) {
+    bool queued = true;
+
+    portENTER_CRITICAL(&can_batch_mux_);
+    MQTTCANBatch::Encoder* batch = &can_batches_[can_batch_open_];
+    bool was_empty = batch->empty();
+    if (!batch->add(msg)) {
+        if (can_batch_ready_) {
+            // Both full: the network can't keep up
+            can_batch_dropped_++;
+            queued = false;
+        } else {
+            can_batch_ready_ = true;
+            can_batch_open_ ^= 1;
+            batch = &can_batches_[can_batch_open_];
+            batch->begin(can_batch_buffers_[can_batch_open_], can_batch_capacity_);
+            batch->add(msg);
+            was_empty = true;
+        }
+    }
+    if (queued && was_empty) {
+        can_batch_opened_ms_ = millis();
+    }
+    portEXIT_CRITICAL(&can_batch_mux_);
+
+    return queued;
+}
+
+void MQTTClient::flushCANBatch() {
+    if (can_batch_capacity_ == 0) {
+        return;
+    }
+
+    const Settings& config = settings_->getSettings();
+
+    // Seal the open batch once its oldest frame has waited long enough
+    portENTER_CRITICAL(&can_batch_mux_);
+    const MQTTCANBatch::Encoder& open = can_batches_[can_batch_open_];
+    if (!can_batch_ready_ && !open.empty() &&
+        millis() - can_batch_opened_ms_ >= config.mqtt_can_batch_ms) {
+        can_batch_ready_ = true;
+        can_batch_open_ ^= 1;
+        can_batches_[can_batch_open_].begin(can_batch_buffers_[can_batch_open_], can_batch_capacity_);
+    }
+    bool ready = can_batch_ready_;
+    portEXIT_CRITICAL(&can_batch_mux_);
+
+    if (!ready) {
+        return;
+    }
+
+    // The sealed batch is only touched here until can_batch_ready_ is cleared;
+    // offline, or if the publish fails, it joins the backlog
+    const MQTTCANBatch::Encoder& sealed = can_batches_[can_batch_open_ ^ 1];
+    if (!linkUp() || !publishCANBatch(sealed.data(), sealed.length(), config.mqtt_can_format)) {
+        char topic[64];
+        snprintf(topic, sizeof(topic), "%s/canbatch", config.mqtt_topic_prefix);
+        queueOffline(topic, sealed.data(), sealed.length(), MQTTOfflineQueue::FLAG_CAN_BATCH);
+    }
+
+    portENTER_CRITICAL(&can_batch_mux_);
+    can_batch_ready_ = false;
+    portEXIT_CRITICAL(&can_batch_mux_);
+}
+
+// Collects short pieces of a message and writes them out in chunks; with
+// out == nullptr it only counts them
+class ChunkWriter {
+public:
+    explicit ChunkWriter(Print* out) : out_(out), used_(0), total_(0), ok_(true) {}
+
+    void add(const char* text, size_t len) {
+        if (used_ + len > sizeof(chunk_)) {
+            flush();
+        }
+        memcpy(chunk_ + used_, text, len);
+        used_ += len;
+        total_ += len;
+    }
+
+    // Total length, or 0 if a write fell short
+    size_t finish() {
+        flush();
+        return ok_ ? total_ : 0;
+    }
+
+private:
+    Print* out_;
+    char chunk_[256];
+    size_t used_;
+    size_t total_;
+    bool ok_;
+
+    void flush() {
+        if (out_ != nullptr && used_ > 0 &&
+            out_->write(reinterpret_cast<const uint8_t*>(chunk_), used_) != used_) {
+            ok_ = false;
+        }
+        used_ = 0;
+    }
+};
+
+// {"t":base_ms,"frames":[{"id":"0x351","dt":12,"data":"0102"},{"id":"0x351","repeat":3}]}
+// Built record by record, so a full batch never needs a JsonDocument or
+// String; returns the JSON length (0 = invalid batch or short write)
+static size_t writeCANBatchJSON(const uint8_t* data, size_t len, Print* out) {
+    MQTTCANBatch::Reader reader(data, len);
+    if (!reader.valid()) {
+        return 0;
+    }
+
+    ChunkWriter writer(out);
+    char piece[96];
+    int n = snprintf(piece, sizeof(piece), "{\"t\":%u,\"frames\":[", (unsigned)reader.baseMs());
+    writer.add(piece, n);
+
+    MQTTCANBatch::Reader::Record rec;
+    bool first = true;
+    while (reader.next(rec)) {
+        n = snprintf(piece, sizeof(piece), rec.extended ? "%s{\"id\":\"0x%08X\"" : "%s{\"id\":\"0x%03X\"",
+                     first ? "" : ",", (unsigned)rec.id);
+        first = false;
+        if (rec.repeat) {
+            n += snprintf(piece + n, sizeof(piece) - n, ",\"repeat\":%u}", (unsigned)rec.count);
+            writer.add(piece, n);
+            continue;
+        }
+        if (rec.extended) n += snprintf(piece + n, sizeof(piece) - n, ",\"ext\":true");
+        if (rec.rtr) n += snprintf(piece + n, sizeof(piece) - n, ",\"rtr\":true");
+        n += snprintf(piece + n, sizeof(piece) - n, ",\"dt\":%u,\"data\":\"",
+                      (unsigned)(rec.timestamp - reader.baseMs()));
+        for (uint8_t i = 0; i < rec.dlc; i++) {
+            n += snprintf(piece + n, sizeof(piece) - n, "%02X", rec.data[i]);
+        }
+        n += snprintf(piece + n, sizeof(piece) - n, "\"}");
+        writer.add(piece, n);
+    }
+
+    writer.add("]}", 2);
+    return writer.finish();
+}
+
+bool MQTTClient::publishCANBatch(const uint8_t* data, size_t len, MQTTCANFormat format) {
+    const Settings& config = settings_->getSettings();
+    MQTTCANBatch::Reader reader(data, len);
+    char topic[64];
+    bool success;
+
+    if (format == MQTTCANFormat::BATCH_JSON) {
+        // Measured first, then written: no document or String for the batch
+        snprintf(topic, sizeof(topic), "%s/canbatch/json", config.mqtt_topic_prefix);
+        size_t json_len = writeCANBatchJSON(data, len, nullptr);
+        success = json_len > 0 &&
+                  mqtt_client_.beginPublish(topic, json_len, false) &&
+                  writeCANBatchJSON(data, len, &mqtt_client_) == json_len &&
+                  mqtt_client_.endPublish() == 1;
+    } else {
+        snprintf(topic, sizeof(topic), "%s/canbatch", config.mqtt_topic_prefix);
+        success = mqtt_client_.beginPublish(topic, len, false) &&
+                  mqtt_client_.write(data, len) == len &&
+                  mqtt_client_.endPublish() == 1;
+    }
+
+    if (success) {
+        publish_count_++;
+        can_batch_count_++;
+        LOG_DEBUG("[MQTT] Published CAN batch: %u records, %u bytes",
+                  reader.records(), (unsigned)len);
+    } else {
+        failed_publish_count_++;
+        LOG_WARN("[MQTT] CAN batch publish failed to %s", topic);
+    }
+    return success;
 }
 
 bool MQTTClient::publishConfig() {
@@ -425,6 +780,18 @@ bool MQTTClient::publishConfig() {
         return false;
     }
 
+    String payload;
+    buildConfigPayload(payload);
+
+    char topic[64];
+    snprintf(topic, sizeof(topic), "%s/system/config",
+             settings_->getSettings().mqtt_topic_prefix);
+
+    // Publish with retained flag so new subscribers get the config
+    return publish(topic, payload.c_str(), true);
+}
+
+void MQTTClient::buildConfigPayload(String& payload) {
     const Settings& config = settings_->getSettings();
 
     JsonDocument doc;
@@ -441,28 +808,79 @@ bool MQTTClient::publishConfig() {
         bat["enabled"] = config.batteries[i].enabled;
     }
 
-    String payload;
     serializeJson(doc, payload);
+}
 
-    char topic[64];
-    snprintf(topic, sizeof(topic), "%s/system/config",
-             config.mqtt_topic_prefix);
+bool MQTTClient::publish(const char* topic, const char* payload, bool retained) {
+    if (!enabled_ || task_ == nullptr) {
+        return false;
+    }
 
-    // Publish with retained flag so new subscribers get the config
-    return publish(topic, payload.c_str(), true);
+    uint8_t flags = retained ? MQTTOfflineQueue::FLAG_RETAINED : 0;
+    if (!enqueue(outbound_, topic, payload, strlen(payload), flags)) {
+        return false;
+    }
+    xTaskNotifyGive(task_);
+    return true;
 }
 
-bool MQTTClient::publish(const char* topic, const char* payload, bool retained) {
-    if (!isConnected()) {
-        failed_publish_count_++;
+bool MQTTClient::enqueue(OutboundQueue& queue, const char* topic, const char* payload,
+                         size_t len, uint8_t flags) {
+    size_t topic_len = strlen(topic);
+    if (task_ == nullptr || topic_len > 0xFFFF || len > 0xFFFF) {
+        return false;
+    }
+
+    uint8_t* data = outbound_pool_.acquire(topic_len + 1 + len);
+    if (data == nullptr) {
+        outbound_dropped_++;
+        return false;
+    }
+    memcpy(data, topic, topic_len + 1);
+    memcpy(data + topic_len + 1, payload, len);
+
+    OutboundMessage msg = { data, static_cast<uint16_t>(topic_len), static_cast<uint16_t>(len), flags };
+    if (!queue.push(msg)) {
+        // The MQTT task is stuck (e.g. mid-handshake) and the queue is full
+        outbound_pool_.release(data);
+        outbound_dropped_++;
         return false;
     }
+    return true;
+}
+
+void MQTTClient::sendOutbound() {
+    bool live = linkUp();
+    OutboundMessage msg;
+    while (outbound_.pop(msg) || outbound_can_.pop(msg)) {
+        const char* topic = reinterpret_cast<const char*>(msg.data);
+        const uint8_t* payload = msg.data + msg.topic_len + 1;
+        bool retained = (msg.flags & MQTTOfflineQueue::FLAG_RETAINED) != 0;
+
+        if (live) {
+            live = sendNow(topic, payload, msg.length, retained);
+            if (!live && !(msg.flags & FLAG_LIVE_ONLY)) {
+                queueOffline(topic, payload, msg.length, msg.flags & MQTTOfflineQueue::FLAG_RETAINED);
+            }
+        } else {
+            failed_publish_count_++;
+            if (!(msg.flags & FLAG_LIVE_ONLY)) {
+                queueOffline(topic, payload, msg.length, msg.flags & MQTTOfflineQueue::FLAG_RETAINED);
+            }
+        }
+        outbound_pool_.release(msg.data);
+    }
+}
 
-    bool success = mqtt_client_.publish(topic, payload, retained);
+bool MQTTClient::sendNow(const char* topic, const uint8_t* payload, size_t len, bool retained) {
+    // Streamed, so payloads aren't limited by the client's packet buffer
+    bool success = mqtt_client_.beginPublish(topic, len, retained) &&
+                   mqtt_client_.write(payload, len) == len &&
+                   mqtt_client_.endPublish() == 1;
 
     if (success) {
         publish_count_++;
-        LOG_INFO("[MQTT] Published to %s (%d bytes)",topic, strlen(payload));
+        LOG_INFO("[MQTT] Published to %s (%d bytes)",topic, len);
     } else {
         failed_publish_count_++;
         LOG_WARN("[MQTT] Publish failed to %s", topic);
@@ -471,10 +889,52 @@ bool MQTTClient::publish(const char* topic, const char* payload, bool retained)
     return success;
 }
 
-void MQTTClient::setEnabled(bool enabled) {
-    enabled_ = enabled;
-    if (!enabled && mqtt_client_.connected()) {
-        disconnect();
+bool MQTTClient::queueOffline(const char* topic, const uint8_t* payload, size_t len, uint8_t flags) {
+    if (!enabled_) {
+        return false;
+    }
+    if (!offline_queue_.push(topic, payload, len, flags)) {
+        LOG_DEBUG("[MQTT] Offline queue dropped message to %s", topic);
+        return false;
+    }
+    return true;
+}
+
+void MQTTClient::drainOfflineQueue() {
+    uint32_t now = millis();
+    uint32_t elapsed = now - last_drain_ms_;
+    last_drain_ms_ = now;
+
+    // A sealed CAN batch still waiting means the link is busy with live data
+    portENTER_CRITICAL(&can_batch_mux_);
+    bool batch_waiting = can_batch_ready_;
+    portEXIT_CRITICAL(&can_batch_mux_);
+    if (offline_queue_.empty() || batch_waiting) {
+        drain_credit_ = 0;
+        return;
+    }
+
+    drain_credit_ = min(drain_credit_ + min(elapsed, (uint32_t)1000) * MQTT_QUEUE_DRAIN_RATE,
+                        (uint32_t)MQTT_QUEUE_DRAIN_BURST * 1000);
+
+    const Settings& config = settings_->getSettings();
+    MQTTOfflineQueue::Message msg;
+    while (drain_credit_ >= 1000 && offline_queue_.next(msg)) {
+        bool success;
+        if (msg.flags & MQTTOfflineQueue::FLAG_CAN_BATCH) {
+            success = publishCANBatch(msg.payload, msg.length, config.mqtt_can_format);
+        } else {
+            success = sendNow(msg.topic, msg.payload, msg.length,
+                              (msg.flags & MQTTOfflineQueue::FLAG_RETAINED) != 0);
+        }
+
+        if (!success) {
+            // Everything since the last ack goes again once the link recovers
+            offline_queue_.rewind();
+            break;
+        }
+        drain_credit_ -= 1000;
+        replay_window_count_++;
     }
 }
 
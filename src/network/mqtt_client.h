@@ -5,12 +5,19 @@
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <PubSubClient.h>
+#include <atomic>
 #include "../config/config.h"
+#include "../utils/buffer_pool.h"
+#include "../utils/spsc_queue.h"
+#include "mqtt_can_batch.h"
+#include "mqtt_offline_queue.h"
 
 // Forward declarations
 class SettingsManager;
 class BatteryManager;
 struct CANMessage;
+struct DecodedFrame;
+enum class MQTTCANFormat : uint8_t;
 
 // MQTT connection state
 enum class MQTTState {
@@ -20,42 +27,64 @@ enum class MQTTState {
     ERROR
 };
 
+// The broker connection lives in its own task ("MQTT Task"), so DNS, TCP
+// and TLS stalls while connecting never hold up the network task or the
+// web UI. Publishers only serialize their payload into a lock-free outbound
+// queue; the MQTT task sends it, or hands it to the offline queue.
+// Producers: the network task (status publishers, publish()) and the MQTT
+// CAN bus consumer (publishCANMessage()), each with its own queue.
 class MQTTClient {
 public:
     MQTTClient();
     ~MQTTClient();
 
-    // Initialize MQTT client with settings
+    // Initialize MQTT client with settings and start the MQTT task
     bool begin(SettingsManager* settings, BatteryManager* batteries);
 
-    // Update loop - handles reconnection and keep-alive
+    // One pass of the MQTT task: reconnection with backoff, keep-alive,
+    // outbound queue, CAN batches and offline backlog
     void update();
 
-    // Connection management
+    // Connection management (MQTT task only)
     bool connect();
     void disconnect();
-    bool isConnected();  // Cannot be const due to PubSubClient::connected()
+    bool isConnected() const { return state_ == MQTTState::CONNECTED; }
     MQTTState getState() const { return state_; }
 
     // Publishing methods
-    bool publishBatteryStatus(uint8_t battery_id);
+    bool publishBatteryStatus(uint8_t battery_id, uint8_t changed = 0);
+    // Status of each pack whose values moved past settings.mqtt_deadband since
+    // its last publish (or whose heartbeat is due); returns how many went out
+    uint8_t publishChangedBatteries();
     bool publishAllBatteries();
     bool publishSystemStatus();
     bool publishCANRaw(uint32_t can_id, uint8_t dlc, const uint8_t* data);
     bool publishCANMessage(const CANMessage& msg);  // New: Publish CAN message to canmsg topic
+    bool publishCANMessage(const DecodedFrame& decoded);  // Raw frame plus decoded field values
     bool publishConfig();
 
-    // Generic publish
+    // Generic publish, from the network task. Queued for the MQTT task, which
+    // keeps it for replay if offline or the publish fails; false if the
+    // outbound queue is full
     bool publish(const char* topic, const char* payload, bool retained = false);
 
     // Statistics
     uint32_t getPublishCount() const { return publish_count_; }
     uint32_t getFailedPublishCount() const { return failed_publish_count_; }
     uint32_t getReconnectCount() const { return reconnect_count_; }
+    uint32_t getCANBatchCount() const { return can_batch_count_; }
+    uint32_t getCANBatchDropped() const { return can_batch_dropped_; }
+    void getQueueStats(MQTTOfflineQueue::Stats& stats) const { offline_queue_.getStats(stats); }   // Any task
+    uint32_t getReplayRate() const { return replay_rate_; }  // Backlog messages per second
+    uint32_t getOutboundDropped() const { return outbound_dropped_.load(); }
+    // Outbound queues: network task (false) or CAN bus consumer (true)
+    size_t getOutboundDepth(bool can) const { return can ? outbound_can_.size() : outbound_.size(); }
+    size_t getOutboundHighWater(bool can) const { return can ? outbound_can_.highWater() : outbound_.highWater(); }
+    TaskHandle_t getTaskHandle() const { return task_; }
     const char* getLastError() const { return last_error_; }
 
-    // Enable/disable MQTT
-    void setEnabled(bool enabled);
+    // Enable/disable MQTT (the MQTT task disconnects when disabled)
+    void setEnabled(bool enabled) { enabled_ = enabled; }
     bool isEnabled() const { return enabled_; }
 
 private:
@@ -65,8 +94,9 @@ private:
     SettingsManager* settings_;
     BatteryManager* batteries_;
 
-    MQTTState state_;
-    bool enabled_;
+    std::atomic<MQTTState> state_;
+    std::atomic<bool> enabled_;
+    TaskHandle_t task_;
 
     uint32_t last_connect_attempt_;
     uint32_t reconnect_delay_;
@@ -77,6 +107,62 @@ private:
 
     char last_error_[128];
 
+    // Batched CAN publishing: frames from the MQTT bus task go into the open
+    // batch, update() seals it by latency and publishes it. Two buffers, so
+    // frames keep arriving while a full batch waits for the network.
+    MQTTCANBatch::Encoder can_batches_[2];
+    uint8_t* can_batch_buffers_[2];
+    size_t can_batch_capacity_;
+    uint8_t can_batch_open_;            // Index of the batch taking frames
+    bool can_batch_ready_;              // The other batch is sealed, waiting to publish
+    uint32_t can_batch_opened_ms_;      // When the open batch got its first frame
+    uint32_t can_batch_count_;          // Batches published
+    uint32_t can_batch_dropped_;        // Frames lost because both batches were full
+    portMUX_TYPE can_batch_mux_;
+
+    bool queueCANFrame(const CANMessage& msg);
+    void flushCANBatch();
+    bool publishCANBatch(const uint8_t* data, size_t len, MQTTCANFormat format);
+
+    // Store-and-forward: messages published while offline (or whose publish
+    // failed) are queued and replayed after reconnecting, rate-limited and
+    // after live data. PubSubClient only publishes at QoS 0, so a replayed
+    // message counts as delivered once the connection survives the next
+    // loop(); if it drops, everything since the last ack is sent again.
+    MQTTOfflineQueue offline_queue_;
+    uint32_t drain_credit_;             // Replay allowance in 1/1000 messages
+    uint32_t last_drain_ms_;
+    uint32_t replay_window_start_;
+    uint32_t replay_window_count_;
+    uint32_t replay_rate_;
+
+    bool queueOffline(const char* topic, const uint8_t* payload, size_t len, uint8_t flags);
+    void drainOfflineQueue();
+
+    // Outbound messages: topic, terminator and payload in one pooled block
+    struct OutboundMessage {
+        uint8_t* data;
+        uint16_t topic_len;
+        uint16_t length;
+        uint8_t flags;          // MQTTOfflineQueue::FLAG_RETAINED | FLAG_LIVE_ONLY
+    };
+    typedef SpscQueue<OutboundMessage, MQTT_OUTBOUND_QUEUE_DEPTH> OutboundQueue;
+
+    static constexpr uint8_t FLAG_LIVE_ONLY = 0x80;     // Dropped rather than queued offline
+
+    BufferPool outbound_pool_;
+    OutboundQueue outbound_;            // Network task -> MQTT task
+    OutboundQueue outbound_can_;        // MQTT CAN bus consumer -> MQTT task
+    std::atomic<uint32_t> outbound_dropped_;
+
+    bool enqueue(OutboundQueue& queue, const char* topic, const char* payload, size_t len, uint8_t flags);
+    void sendOutbound();
+    bool sendNow(const char* topic, const uint8_t* payload, size_t len, bool retained);
+    bool linkUp() { return mqtt_client_.connected() && state_ == MQTTState::CONNECTED; }
+    void buildConfigPayload(String& payload);
+
+    static void taskFunc(void* parameter);
+
     // Topic building
     void buildTopic(char* buffer, size_t buflen, const char* subtopic);
 
@@ -0,0 +1,501 @@
+#include "mqtt_offline_queue.h"
+#include "../can/can_log_format.h"
+#include "../utils/remote_log.h"
+#include <SPIFFS.h>
+#include <new>
+
+static_assert(MQTT_QUEUE_MAX_SEGMENTS >= 2 && MQTT_QUEUE_MAX_SEGMENTS <= 1000, "Segment names are three digits");
+static_assert(MQTT_QUEUE_RAM_BYTES <= MQTT_QUEUE_SEGMENT_SIZE - 16, "A spill must fit in one segment");
+
+MQTTOfflineQueue::MQTTOfflineQueue()
+    : flash_ok_(false),
+      ram_(nullptr),
+      scratch_(nullptr),
+      ram_len_(0),
+      ram_commit_(0),
+      ram_read_(0),
+      ram_messages_(0),
+      ram_read_messages_(0),
+      has_segments_(false),
+      can_append_(false),
+      first_segment_(0),
+      last_segment_(0),
+      commit_{0, 0, 0},
+      read_{0, 0, 0},
+      depth_(0),
+      in_flight_(0),
+      queued_(0),
+      replayed_(0),
+      dropped_(0),
+      stats_mux_(portMUX_INITIALIZER_UNLOCKED) {
+    dir_[0] = '\0';
+    memset(&stats_, 0, sizeof(stats_));
+    memset(segment_bytes_, 0, sizeof(segment_bytes_));
+    memset(segment_messages_, 0, sizeof(segment_messages_));
+}
+
+MQTTOfflineQueue::~MQTTOfflineQueue() {
+    delete[] ram_;
+    delete[] scratch_;
+}
+
+bool MQTTOfflineQueue::begin(const char* dir) {
+    if (ram_ != nullptr) {
+        return true;
+    }
+
+    ram_ = new (std::nothrow) uint8_t[MQTT_QUEUE_RAM_BYTES];
+    scratch_ = new (std::nothrow) uint8_t[MQTT_QUEUE_RAM_BYTES];
+    if (ram_ == nullptr || scratch_ == nullptr) {
+        delete[] ram_;
+        delete[] scratch_;
+        ram_ = nullptr;
+        scratch_ = nullptr;
+        LOG_ERROR("[MQTT] No memory for the offline queue");
+        return false;
+    }
+
+    strlcpy(dir_, dir, sizeof(dir_));
+    flash_ok_ = SPIFFS.begin(true);
+    if (flash_ok_) {
+        loadSegments();
+    } else {
+        LOG_WARN("[MQTT] SPIFFS unavailable, offline queue is RAM only");
+    }
+
+    LOG_INFO("[MQTT] Offline queue: %u bytes RAM, %u messages pending from flash",
+             (unsigned)MQTT_QUEUE_RAM_BYTES, depth_);
+    publishStats();
+    return true;
+}
+
+bool MQTTOfflineQueue::push(const char* topic, const uint8_t* payload, size_t length, uint8_t flags) {
+    bool ok = append(topic, payload, length, flags);
+    publishStats();
+    return ok;
+}
+
+bool MQTTOfflineQueue::append(const char* topic, const uint8_t* payload, size_t length, uint8_t flags) {
+    size_t topic_len = strlen(topic) + 1;
+    size_t entry_len = sizeof(EntryHeader) + topic_len + length;
+    if (ram_ == nullptr || topic_len > 255 || length > 0xFFFF || entry_len > MQTT_QUEUE_RAM_BYTES) {
+        dropped_++;
+        return false;
+    }
+
+    if (ram_len_ + entry_len > MQTT_QUEUE_RAM_BYTES) {
+        compact();
+        if (ram_len_ + entry_len > MQTT_QUEUE_RAM_BYTES && !spill()) {
+            dropped_++;
+            return false;
+        }
+    }
+
+    EntryHeader header;
+    header.topic_len = static_cast<uint8_t>(topic_len);
+    header.flags = flags;
+    header.payload_len = static_cast<uint16_t>(length);
+    header.queued_ms = millis();
+
+    uint8_t* out = ram_ + ram_len_;
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + sizeof(header), topic, topic_len);
+    memcpy(out + sizeof(header) + topic_len, payload, length);
+    ram_len_ += entry_len;
+    ram_messages_++;
+    depth_++;
+    queued_++;
+    return true;
+}
+
+bool MQTTOfflineQueue::next(Message& msg) {
+    // Flash holds the oldest messages, RAM the ones queued since the last spill
+    while (readingFlash()) {
+        if (read_.offset < bytesOf(read_.segment)) {
+            if (readFlashEntry(msg)) {
+                return true;
+            }
+
+            // Unreadable: give up on the rest of that segment
+            uint32_t lost = messagesOf(read_.segment) - read_.messages;
+            LOG_WARN("[MQTT] Offline queue segment %u unreadable, %u messages lost", read_.segment, lost);
+            depth_ -= lost;
+            dropped_ += lost;
+            messagesOf(read_.segment) = read_.messages;
+            bytesOf(read_.segment) = read_.offset;
+            can_append_ = can_append_ && read_.segment != last_segment_;
+            publishStats();
+        } else {
+            read_ = { read_.segment + 1, sizeof(SegmentHeader), 0 };
+        }
+    }
+
+    if (ram_read_ >= ram_len_) {
+        return false;
+    }
+
+    EntryHeader header;
+    memcpy(&header, ram_ + ram_read_, sizeof(header));
+    msg.topic = reinterpret_cast<const char*>(ram_ + ram_read_ + sizeof(header));
+    msg.payload = ram_ + ram_read_ + sizeof(header) + header.topic_len;
+    msg.length = header.payload_len;
+    msg.flags = header.flags;
+    msg.queued_ms = header.queued_ms;
+
+    ram_read_ += sizeof(header) + header.topic_len + header.payload_len;
+    ram_read_messages_++;
+    in_flight_++;
+    return true;
+}
+
+void MQTTOfflineQueue::ack() {
+    if (in_flight_ == 0) {
+        return;
+    }
+    depth_ -= in_flight_;
+    replayed_ += in_flight_;
+    in_flight_ = 0;
+
+    if (readingFlash()) {
+        // Segments read to the end are done with
+        bool changed = false;
+        while (first_segment_ < read_.segment) {
+            char path[32];
+            segmentPath(first_segment_, path, sizeof(path));
+            SPIFFS.remove(path);
+            first_segment_++;
+            changed = true;
+        }
+        commit_ = read_;
+        if (changed) {
+            saveManifest();
+        }
+    } else {
+        // Everything on flash went out; the rest is in RAM
+        if (has_segments_) {
+            clearSegments();
+        }
+        ram_commit_ = ram_read_;
+        ram_messages_ -= ram_read_messages_;
+        ram_read_messages_ = 0;
+        if (ram_commit_ == ram_len_) {
+            ram_len_ = 0;
+            ram_commit_ = 0;
+            ram_read_ = 0;
+        }
+    }
+    publishStats();
+}
+
+void MQTTOfflineQueue::rewind() {
+    read_ = commit_;
+    ram_read_ = ram_commit_;
+    ram_read_messages_ = 0;
+    in_flight_ = 0;
+}
+
+void MQTTOfflineQueue::getStats(Stats& stats) const {
+    portENTER_CRITICAL(&stats_mux_);
+    stats = stats_;
+    portEXIT_CRITICAL(&stats_mux_);
+}
+
+void MQTTOfflineQueue::publishStats() {
+    Stats snapshot;
+    snapshot.depth = depth_;
+    snapshot.ram_bytes = ram_len_ - ram_commit_;
+    snapshot.flash_bytes = 0;
+    if (has_segments_) {
+        for (uint32_t seg = first_segment_; seg <= last_segment_; seg++) {
+            snapshot.flash_bytes += segment_bytes_[seg % MQTT_QUEUE_MAX_SEGMENTS];
+        }
+    }
+    snapshot.queued = queued_;
+    snapshot.replayed = replayed_;
+    snapshot.dropped = dropped_;
+
+    portENTER_CRITICAL(&stats_mux_);
+    stats_ = snapshot;
+    portEXIT_CRITICAL(&stats_mux_);
+}
+
+void MQTTOfflineQueue::compact() {
+    if (ram_commit_ == 0) {
+        return;
+    }
+    memmove(ram_, ram_ + ram_commit_, ram_len_ - ram_commit_);
+    ram_len_ -= ram_commit_;
+    ram_read_ -= ram_commit_;
+    ram_commit_ = 0;
+}
+
+bool MQTTOfflineQueue::readingFlash() const {
+    return has_segments_ &&
+           !(read_.segment == last_segment_ &&
+             read_.offset >= segment_bytes_[last_segment_ % MQTT_QUEUE_MAX_SEGMENTS]);
+}
+
+bool MQTTOfflineQueue::readFlashEntry(Message& msg) {
+    char path[32];
+    segmentPath(read_.segment, path, sizeof(path));
+    File f = SPIFFS.open(path, "r");
+    if (!f) {
+        return false;
+    }
+
+    EntryHeader header;
+    bool ok = f.seek(read_.offset) &&
+              f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header);
+    size_t body_len = ok ? header.topic_len + header.payload_len : 0;
+    ok = ok && header.topic_len > 0 && body_len <= MQTT_QUEUE_RAM_BYTES &&
+         f.read(scratch_, body_len) == body_len && scratch_[header.topic_len - 1] == '\0';
+    f.close();
+    if (!ok) {
+        return false;
+    }
+
+    msg.topic = reinterpret_cast<const char*>(scratch_);
+    msg.payload = scratch_ + header.topic_len;
+    msg.length = header.payload_len;
+    msg.flags = header.flags;
+    msg.queued_ms = header.queued_ms;
+
+    read_.offset += sizeof(header) + body_len;
+    read_.messages++;
+    in_flight_++;
+    return true;
+}
+
+bool MQTTOfflineQueue::spill() {
+    if (!flash_ok_) {
+        return false;
+    }
+    compact();
+    if (ram_len_ == 0) {
+        return true;
+    }
+
+    // Everything before the cursors is acked, so they only move if they were in RAM
+    bool was_empty = !has_segments_;
+    bool read_in_ram = was_empty || !readingFlash();
+    if (was_empty || !can_append_ || bytesOf(last_segment_) + ram_len_ > MQTT_QUEUE_SEGMENT_SIZE) {
+        uint32_t segment = was_empty ? last_segment_ : last_segment_ + 1;
+        while (!was_empty && segment - first_segment_ >= MQTT_QUEUE_MAX_SEGMENTS) {
+            dropOldestSegment();
+            read_in_ram = false;    // Rewound to the start of the new oldest segment
+        }
+        if (!startSegment(segment)) {
+            return false;
+        }
+        if (was_empty) {
+            first_segment_ = segment;
+        }
+        last_segment_ = segment;
+        has_segments_ = true;
+        can_append_ = true;
+        saveManifest();
+    }
+
+    char path[32];
+    segmentPath(last_segment_, path, sizeof(path));
+    File f = SPIFFS.open(path, "a");
+    size_t written = f ? f.write(ram_, ram_len_) : 0;
+    if (f) {
+        f.close();
+    }
+    if (written != ram_len_) {
+        // Whatever did get written is past this segment's known end and ignored
+        LOG_WARN("[MQTT] Offline queue spill failed (%u of %u bytes)", (unsigned)written, (unsigned)ram_len_);
+        can_append_ = false;
+        return false;
+    }
+
+    uint32_t offset = bytesOf(last_segment_);
+    uint32_t messages = messagesOf(last_segment_);
+    if (was_empty) {
+        commit_ = { last_segment_, offset, messages };
+    }
+    if (read_in_ram) {
+        read_ = { last_segment_, static_cast<uint32_t>(offset + ram_read_), messages + ram_read_messages_ };
+    }
+    bytesOf(last_segment_) += ram_len_;
+    messagesOf(last_segment_) += ram_messages_;
+
+    LOG_DEBUG("[MQTT] Offline queue spilled %u messages to segment %u", ram_messages_, last_segment_);
+    ram_len_ = 0;
+    ram_read_ = 0;
+    ram_messages_ = 0;
+    ram_read_messages_ = 0;
+    return true;
+}
+
+bool MQTTOfflineQueue::startSegment(uint32_t segment) {
+    char path[32];
+    segmentPath(segment, path, sizeof(path));
+
+    SegmentHeader header;
+    header.magic = SEGMENT_MAGIC;
+    header.version = SEGMENT_VERSION;
+    header.reserved = 0;
+    header.segment = segment;
+
+    File f = SPIFFS.open(path, "w");
+    if (!f) {
+        LOG_WARN("[MQTT] Failed to create %s", path);
+        return false;
+    }
+    bool ok = f.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header);
+    f.close();
+
+    bytesOf(segment) = ok ? sizeof(header) : 0;
+    messagesOf(segment) = 0;
+    return ok;
+}
+
+void MQTTOfflineQueue::dropOldestSegment() {
+    // Anything handed out from it can't be acked any more
+    rewind();
+
+    uint32_t lost = messagesOf(first_segment_) - commit_.messages;
+    depth_ -= lost;
+    dropped_ += lost;
+    LOG_WARN("[MQTT] Offline queue full, dropped %u oldest messages", lost);
+
+    char path[32];
+    segmentPath(first_segment_, path, sizeof(path));
+    SPIFFS.remove(path);
+    first_segment_++;
+    commit_ = { first_segment_, sizeof(SegmentHeader), 0 };
+    read_ = commit_;
+}
+
+void MQTTOfflineQueue::clearSegments() {
+    for (uint32_t seg = first_segment_; seg <= last_segment_; seg++) {
+        char path[32];
+        segmentPath(seg, path, sizeof(path));
+        SPIFFS.remove(path);
+    }
+
+    // The next spill starts the segment after the last one; the manifest
+    // names it before it exists, which reads back as an empty queue
+    last_segment_++;
+    first_segment_ = last_segment_;
+    has_segments_ = false;
+    can_append_ = false;
+    saveManifest();
+}
+
+void MQTTOfflineQueue::loadSegments() {
+    char path[32];
+    snprintf(path, sizeof(path), "%s/manifest", dir_);
+
+    CANLogFormat::Manifest manifest;
+    File f = SPIFFS.open(path, "r");
+    bool ok = f && f.read(reinterpret_cast<uint8_t*>(&manifest), sizeof(manifest)) == sizeof(manifest) &&
+              CANLogFormat::isValidManifest(manifest) &&
+              manifest.last_segment - manifest.first_segment < MQTT_QUEUE_MAX_SEGMENTS;
+    if (f) {
+        f.close();
+    }
+
+    if (!ok) {
+        // Nothing to trust: empty the directory, restarting the listing after each removal
+        while (true) {
+            File dir = SPIFFS.open(dir_);
+            File file = dir ? dir.openNextFile() : File();
+            if (!file) {
+                break;
+            }
+            char stale[48];
+            strlcpy(stale, file.path(), sizeof(stale));
+            file.close();
+            dir.close();
+            if (!SPIFFS.remove(stale)) {
+                break;
+            }
+        }
+        first_segment_ = 0;
+        last_segment_ = 0;
+        has_segments_ = false;
+        saveManifest();
+        return;
+    }
+
+    first_segment_ = manifest.first_segment;
+    last_segment_ = manifest.last_segment;
+
+    uint32_t total = 0;
+    for (uint32_t seg = first_segment_; seg <= last_segment_; seg++) {
+        uint32_t messages = 0;
+        bytesOf(seg) = scanSegment(seg, messages);
+        messagesOf(seg) = messages;
+        total += messages;
+    }
+
+    if (total == 0) {
+        clearSegments();
+        return;
+    }
+
+    // The last segment may end in a torn spill, so new spills start a fresh one
+    has_segments_ = true;
+    can_append_ = false;
+    commit_ = { first_segment_, sizeof(SegmentHeader), 0 };
+    read_ = commit_;
+    depth_ = total;
+}
+
+uint32_t MQTTOfflineQueue::scanSegment(uint32_t segment, uint32_t& messages) {
+    char path[32];
+    segmentPath(segment, path, sizeof(path));
+    File f = SPIFFS.open(path, "r");
+    if (!f) {
+        return 0;
+    }
+
+    SegmentHeader header;
+    if (f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) ||
+        header.magic != SEGMENT_MAGIC || header.version != SEGMENT_VERSION || header.segment != segment) {
+        f.close();
+        return 0;
+    }
+
+    // Walk the entry headers; a partial entry at the end is ignored
+    size_t size = f.size();
+    uint32_t offset = sizeof(header);
+    while (true) {
+        EntryHeader entry;
+        if (!f.seek(offset) || f.read(reinterpret_cast<uint8_t*>(&entry), sizeof(entry)) != sizeof(entry)) {
+            break;
+        }
+        uint32_t end = offset + sizeof(entry) + entry.topic_len + entry.payload_len;
+        if (entry.topic_len == 0 || end > size) {
+            break;
+        }
+        messages++;
+        offset = end;
+    }
+    f.close();
+    return offset;
+}
+
+bool MQTTOfflineQueue::saveManifest() {
+    char path[32];
+    snprintf(path, sizeof(path), "%s/manifest", dir_);
+
+    CANLogFormat::Manifest manifest;
+    CANLogFormat::initManifest(manifest, first_segment_, last_segment_);
+
+    File f = SPIFFS.open(path, "w");
+    if (!f) {
+        LOG_WARN("[MQTT] Failed to write %s", path);
+        return false;
+    }
+    bool ok = f.write(reinterpret_cast<const uint8_t*>(&manifest), sizeof(manifest)) == sizeof(manifest);
+    f.close();
+    return ok;
+}
+
+void MQTTOfflineQueue::segmentPath(uint32_t segment, char* path, size_t size) const {
+    snprintf(path, size, "%s/%03u.q", dir_, (unsigned)(segment % 1000));
+}
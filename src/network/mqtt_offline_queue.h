@@ -0,0 +1,145 @@
+#ifndef MQTT_OFFLINE_QUEUE_H
+#define MQTT_OFFLINE_QUEUE_H
+
+#include <Arduino.h>
+#include "../config/config.h"
+
+// Bounded store-and-forward queue for MQTT messages published while offline.
+//
+// Messages go into a RAM buffer first. When it fills they are appended, as
+// one write, to a ring of SPIFFS segment files laid out like the CAN log
+// (three-digit segment names, a CANLogFormat::Manifest naming the oldest and
+// newest segment); past MQTT_QUEUE_MAX_SEGMENTS the oldest segment is dropped.
+// RAM contents are lost on reset, spilled segments are not.
+//
+// Replay is at-least-once: next() hands out messages without removing them,
+// ack() removes everything handed out so far and rewind() makes it come
+// again. Spilled messages that were acked but whose segment wasn't finished
+// yet are sent again after a reboot.
+//
+// Driven by the MQTT task only; nothing but getStats() may be called from
+// another task. Every change publishes a Stats snapshot under a lock, and
+// getStats() copies that, so the network task (status messages) and the
+// web server can read it at any time.
+class MQTTOfflineQueue {
+public:
+    struct Message {
+        const char* topic;
+        const uint8_t* payload;
+        size_t length;
+        uint8_t flags;          // FLAG_*
+        uint32_t queued_ms;     // millis() when it was queued (this boot or an earlier one)
+    };
+
+    struct Stats {
+        uint32_t depth;         // Messages waiting (including handed out, not acked)
+        uint32_t ram_bytes;
+        uint32_t flash_bytes;
+        uint32_t queued;        // Totals since boot
+        uint32_t replayed;
+        uint32_t dropped;       // Lost to a full queue or an unusable filesystem
+    };
+
+    static constexpr uint8_t FLAG_RETAINED = 0x01;
+    static constexpr uint8_t FLAG_CAN_BATCH = 0x02;   // Binary CAN batch, published per mqtt_can_format
+
+    // Largest payload push() takes with a topic of topic_len bytes
+    // (terminator included)
+    static constexpr size_t maxPayload(size_t topic_len) {
+        return MQTT_QUEUE_RAM_BYTES - sizeof(EntryHeader) - topic_len;
+    }
+
+    MQTTOfflineQueue();
+    ~MQTTOfflineQueue();
+
+    // Allocate the RAM buffer and pick up segments left by an earlier boot
+    bool begin(const char* dir = MQTT_QUEUE_DIR);
+
+    // False if the message was dropped (too large, or the queue is full and
+    // SPIFFS can't take it)
+    bool push(const char* topic, const uint8_t* payload, size_t length, uint8_t flags = 0);
+
+    // Oldest message not handed out yet; valid until the next call on the queue
+    bool next(Message& msg);
+
+    void ack();
+    void rewind();
+
+    bool empty() const { return depth_ == 0; }
+    uint32_t inFlight() const { return in_flight_; }
+    void getStats(Stats& stats) const;     // Any task
+
+private:
+    // Stored entry: this header, the topic with its terminator, then the payload
+    struct EntryHeader {
+        uint8_t topic_len;      // Including the terminator
+        uint8_t flags;
+        uint16_t payload_len;
+        uint32_t queued_ms;
+    };
+
+    // First bytes of each segment file
+    struct SegmentHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t reserved;
+        uint32_t segment;
+    };
+
+    // Position in the segment ring
+    struct Cursor {
+        uint32_t segment;
+        uint32_t offset;
+        uint32_t messages;      // Messages of that segment before the offset
+    };
+
+    static constexpr uint32_t SEGMENT_MAGIC = 0x514F514D;   // "MQOQ"
+    static constexpr uint16_t SEGMENT_VERSION = 1;
+
+    char dir_[24];
+    bool flash_ok_;
+
+    uint8_t* ram_;              // [ram_commit_, ram_len_) holds unacked messages
+    uint8_t* scratch_;          // Message read back from flash
+    size_t ram_len_;
+    size_t ram_commit_;
+    size_t ram_read_;
+    uint32_t ram_messages_;     // Unacked messages in RAM
+    uint32_t ram_read_messages_;
+
+    bool has_segments_;
+    bool can_append_;           // Spills may extend last_segment_ (not one from an earlier boot)
+    uint32_t first_segment_;
+    uint32_t last_segment_;     // Appended to by spills
+    uint32_t segment_bytes_[MQTT_QUEUE_MAX_SEGMENTS];
+    uint32_t segment_messages_[MQTT_QUEUE_MAX_SEGMENTS];
+    Cursor commit_;             // Always in first_segment_
+    Cursor read_;
+
+    uint32_t depth_;
+    uint32_t in_flight_;
+    uint32_t queued_;
+    uint32_t replayed_;
+    uint32_t dropped_;
+
+    Stats stats_;               // Snapshot for getStats(), under stats_mux_
+    mutable portMUX_TYPE stats_mux_;
+
+    bool append(const char* topic, const uint8_t* payload, size_t length, uint8_t flags);
+    void publishStats();
+    void compact();
+    bool readingFlash() const;
+    bool readFlashEntry(Message& msg);
+    bool spill();
+    bool startSegment(uint32_t segment);
+    void dropOldestSegment();
+    void clearSegments();
+    void loadSegments();
+    uint32_t scanSegment(uint32_t segment, uint32_t& messages);
+    bool saveManifest();
+    void segmentPath(uint32_t segment, char* path, size_t size) const;
+    uint32_t& bytesOf(uint32_t segment) { return segment_bytes_[segment % MQTT_QUEUE_MAX_SEGMENTS]; }
+    uint32_t& messagesOf(uint32_t segment) { return segment_messages_[segment % MQTT_QUEUE_MAX_SEGMENTS]; }
+};
+
+#endif // MQTT_OFFLINE_QUEUE_H
@@ -175,7 +175,7 @@ void WebServer::handleUploadProtocol(AsyncWebServerRequest* request, uint8_t* da
     }
 
     // Validate the protocol
-    Protocol::Definition protocol;
+    Protocol::OwnedDefinition protocol;
     if (!protocol_loader_->loadFromString((const char*)data, protocol)) {
         char error_msg[256];
         snprintf(error_msg, sizeof(error_msg), "Protocol validation failed: %s",
@@ -203,16 +203,20 @@ void WebServer::handleUploadProtocol(AsyncWebServerRequest* request, uint8_t* da
     }
 
     // Save the protocol
-    if (!protocol_loader_->saveToFile(filename, protocol)) {
+    if (!protocol_loader_->saveToFile(filename, *protocol.get())) {
         sendError(request, 500, "Failed to save protocol");
         return;
     }
 
+    // Build the binary cache now so the next boot skips JSON parsing
+    bool cached = protocol_loader_->updateCache(filename, protocol);
+
     // Return success with the filename
     JsonDocument response;
     response["success"] = true;
     response["filename"] = filename;
-    response["name"] = protocol.name;
+    response["name"] = protocol->name;
+    response["cached"] = cached;
 
     sendJSON(request, response, 201);
 }
@@ -265,7 +269,7 @@ void WebServer::handleFetchProtocol(AsyncWebServerRequest* request, uint8_t* dat
     }
 
     // Load it to get the name
-    Protocol::Definition protocol;
+    Protocol::OwnedDefinition protocol;
     if (!protocol_loader_->loadFromFile(filename, protocol)) {
         sendError(request, 500, "Failed to load fetched protocol");
         return;
@@ -275,7 +279,7 @@ void WebServer::handleFetchProtocol(AsyncWebServerRequest* request, uint8_t* dat
     JsonDocument response;
     response["success"] = true;
     response["filename"] = filename;
-    response["name"] = protocol.name;
+    response["name"] = protocol->name;
     response["source_url"] = url;
 
     sendJSON(request, response, 201);
@@ -315,7 +319,7 @@ void WebServer::handleValidateProtocol(AsyncWebServerRequest* request, const Str
         filepath += ".json";
     }
 
-    Protocol::Definition protocol;
+    Protocol::OwnedDefinition protocol;
     if (!protocol_loader_->loadFromFile(filepath.c_str(), protocol)) {
         JsonDocument response;
         response["valid"] = false;
@@ -324,7 +328,7 @@ void WebServer::handleValidateProtocol(AsyncWebServerRequest* request, const Str
         return;
     }
 
-    if (!protocol_loader_->validate(protocol)) {
+    if (!protocol_loader_->validate(*protocol.get())) {
         JsonDocument response;
         response["valid"] = false;
         response["error"] = "Protocol validation failed";
@@ -334,8 +338,10 @@ void WebServer::handleValidateProtocol(AsyncWebServerRequest* request, const Str
 
     JsonDocument response;
     response["valid"] = true;
-    response["name"] = protocol.name;
-    response["message_count"] = protocol.message_count;
+    response["name"] = protocol->name;
+    response["message_count"] = protocol->message_count;
+    response["size"] = protocol.size();
+    response["cached"] = protocol_loader_->lastLoadFromCache();
 
     sendJSON(request, response);
 }
@@ -0,0 +1,97 @@
+#include "web_assets.h"
+#include "../utils/remote_log.h"
+#include <SPIFFS.h>
+#include <ctype.h>
+
+const WebAssetHandler::Asset WebAssetHandler::ASSETS[] = {
+    {"/",           "/web/index.html", "text/html"},
+    {"/index.html", "/web/index.html", "text/html"},
+    {"/app.js",     "/web/app.js",     "application/javascript"},
+    {"/style.css",  "/web/style.css",  "text/css"},
+};
+
+WebAssetHandler::WebAssetHandler() {
+    build_hash_[0] = '\0';
+    loadBuildHash();
+}
+
+void WebAssetHandler::loadBuildHash() {
+    File file = SPIFFS.open("/web/assets.etag", "r");
+    if (!file) {
+        LOG_WARN("[WebServer] No /web/assets.etag, web assets are sent without ETag");
+        return;
+    }
+
+    // Hex digits only; anything else ends the hash
+    size_t len = 0;
+    while (len < sizeof(build_hash_) - 1 && file.available()) {
+        int c = file.read();
+        if (!isxdigit(c)) break;
+        build_hash_[len++] = (char)c;
+    }
+    build_hash_[len] = '\0';
+    file.close();
+    LOG_INFO("[WebServer] Web assets build %s", build_hash_);
+}
+
+const WebAssetHandler::Asset* WebAssetHandler::find(const String& url) {
+    for (const Asset& asset : ASSETS) {
+        if (url == asset.url) return &asset;
+    }
+    return nullptr;
+}
+
+bool WebAssetHandler::canHandle(AsyncWebServerRequest* request) {
+    if (request->method() != HTTP_GET) return false;
+
+    const Asset* asset = find(request->url());
+    if (asset == nullptr) return false;
+    if (!SPIFFS.exists(asset->path) && !SPIFFS.exists(String(asset->path) + ".gz")) {
+        return false;   // Left to the fallback page
+    }
+
+    // Other request headers are dropped before handleRequest()
+    request->addInterestingHeader("Accept-Encoding");
+    request->addInterestingHeader("If-None-Match");
+    return true;
+}
+
+void WebAssetHandler::handleRequest(AsyncWebServerRequest* request) {
+    const Asset* asset = find(request->url());
+    if (asset == nullptr) {
+        request->send(404);
+        return;
+    }
+
+    String path = asset->path;
+    String gz_path = path + ".gz";
+    AsyncWebHeader* accept = request->getHeader("Accept-Encoding");
+    bool gzip = SPIFFS.exists(gz_path) &&
+                ((accept != nullptr && accept->value().indexOf("gzip") >= 0) || !SPIFFS.exists(path));
+
+    // The two encodings are different representations, so different tags
+    char etag[sizeof(build_hash_) + 6];
+    etag[0] = '\0';
+    if (build_hash_[0] != '\0') {
+        snprintf(etag, sizeof(etag), "\"%s%s\"", build_hash_, gzip ? "-gz" : "");
+    }
+
+    AsyncWebServerResponse* response;
+    AsyncWebHeader* match = request->getHeader("If-None-Match");
+    if (etag[0] != '\0' && match != nullptr && match->value().indexOf(etag) >= 0) {
+        response = request->beginResponse(304);
+    } else {
+        response = request->beginResponse(SPIFFS, gzip ? gz_path : path, asset->content_type);
+        if (gzip) {
+            response->addHeader("Content-Encoding", "gzip");
+        }
+    }
+
+    // Cached, but revalidated on every use
+    response->addHeader("Cache-Control", "no-cache");
+    response->addHeader("Vary", "Accept-Encoding");
+    if (etag[0] != '\0') {
+        response->addHeader("ETag", etag);
+    }
+    request->send(response);
+}
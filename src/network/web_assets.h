@@ -0,0 +1,32 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Serves the web UI from SPIFFS (/web). The .gz copy written by
+// scripts/compress_web.py is sent to clients that accept gzip, and every
+// response carries a strong ETag built from the hash in /web/assets.etag,
+// so a reload is answered with 304 Not Modified instead of the files.
+class WebAssetHandler : public AsyncWebHandler {
+public:
+    WebAssetHandler();
+
+    bool canHandle(AsyncWebServerRequest* request) override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+
+private:
+    struct Asset {
+        const char* url;
+        const char* path;
+        const char* content_type;
+    };
+    static const Asset ASSETS[];
+
+    char build_hash_[17];       // Empty when assets.etag is missing
+
+    void loadBuildHash();
+    static const Asset* find(const String& url);
+};
+
+#endif // WEB_ASSETS_H
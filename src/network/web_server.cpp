@@ -4,45 +4,35 @@
 #include "../battery/battery_manager.h"
 #include "../can/can_logger.h"
 #include "../can/can_driver.h"
+#include "../can/can_parser.h"
+#include "../can/can_router.h"
 #include "../utils/remote_log.h"
+#include "../utils/perf_monitor.h"
+#include "mqtt_client.h"
+#include "web_assets.h"
+#include "ws_protocol.h"
 #include <SPIFFS.h>
+#include <memory>
+#include <new>
 
 // Global instance
 WebServer webServer;
 
-// Persistent buffer pool for CAN log API - allocated once, reused forever
-// Protected by mutex for thread safety
+// State of one /api/canlog response, read straight from the logger's ring
 namespace {
-    constexpr size_t CAN_LOG_BUFFER_SIZE = 200;
-    CANMessage* persistent_can_buffer = nullptr;
-    SemaphoreHandle_t can_buffer_mutex = nullptr;
-
-    void initCANLogBuffer() {
-        if (can_buffer_mutex == nullptr) {
-            can_buffer_mutex = xSemaphoreCreateMutex();
-        }
-        // Allocate buffer once on first init (freed never - persistent for lifetime)
-        if (persistent_can_buffer == nullptr) {
-            persistent_can_buffer = new CANMessage[CAN_LOG_BUFFER_SIZE];
-            if (persistent_can_buffer) {
-                LOG_INFO("[WebServer] Persistent CAN buffer allocated: %d messages (%d bytes)",
-                         CAN_LOG_BUFFER_SIZE, CAN_LOG_BUFFER_SIZE * sizeof(CANMessage));
-            } else {
-                LOG_ERROR("[WebServer] Failed to allocate persistent CAN buffer!");
-            }
-        }
-    }
-
-    bool acquireCANBuffer() {
-        if (can_buffer_mutex == nullptr || persistent_can_buffer == nullptr) return false;
-        return xSemaphoreTake(can_buffer_mutex, pdMS_TO_TICKS(100)) == pdTRUE;
-    }
-
-    void releaseCANBuffer() {
-        if (can_buffer_mutex != nullptr) {
-            xSemaphoreGive(can_buffer_mutex);
-        }
-    }
+    constexpr size_t CAN_LOG_DEFAULT_LIMIT = 200;
+
+    struct CANLogPollCursor {
+        uint32_t next;          // Sequence of the next frame to look at
+        uint32_t end;           // Sequence after the newest frame when the request came in
+        uint32_t remaining;     // Frames still allowed by ?limit
+        uint32_t count;         // Frames sent
+        uint32_t lost;          // Frames overwritten before they could be sent
+        uint32_t filter_id;
+        bool filtered;
+        bool reset;             // ?since was ahead of the ring (device rebooted?)
+        uint8_t stage;          // 0 = header, 1 = frames, 2 = footer, 3 = done
+    };
 }
 
 WebServer::WebServer(uint16_t port)
@@ -56,9 +46,18 @@ WebServer::WebServer(uint16_t port)
     , request_count_(0)
     , ws_messages_sent_(0)
     , last_ws_cleanup_(0)
-    , can_batch_count_(0)
+    , json_pool_(JSON_POOL_BUFFERS, JSON_POOL_MAX_SIZE)
+    , ws_client_count_(0)
+    , can_latest_count_(0)
+    , can_delivery_count_(0)
+    , can_flush_(0)
+    , can_changed_flush_(0)
+    , can_ring_dropped_(0)
+    , running_(false)
+    , can_frames_(0)
+    , can_dropped_(0)
     , last_can_flush_(0) {
-    portMUX_INITIALIZE(&can_batch_mux_);
+    portMUX_INITIALIZE(&ws_clients_mux_);
 }
 
 WebServer::~WebServer() {
@@ -74,10 +73,6 @@ bool WebServer::begin(SettingsManager* settings, BatteryManager* batteries, CANL
 
     LOG_INFO("[WebServer] Starting on port %d",port_);
 
-    // Initialize static CAN buffer pool
-    initCANLogBuffer();
-    LOG_INFO("[WebServer] Static CAN buffer pool initialized (%d messages)", CAN_LOG_BUFFER_SIZE);
-
     // Initialize SPIFFS for static files
     if (!SPIFFS.begin(true)) {
         LOG_ERROR("[WebServer] SPIFFS mount failed, no static files will be served");
@@ -95,12 +90,14 @@ bool WebServer::begin(SettingsManager* settings, BatteryManager* batteries, CANL
 
     // Start server
     server_.begin();
+    running_.store(true, std::memory_order_release);
     LOG_INFO("[WebServer] Server started");
 
     return true;
 }
 
 void WebServer::stop() {
+    running_.store(false, std::memory_order_release);
     ws_.closeAll();
     server_.end();
     LOG_INFO("[WebServer] Server stopped");
@@ -130,16 +127,15 @@ void WebServer::setupStaticFiles() {
         LOG_WARN("[WebServer] Failed to open SPIFFS root directory");
     }
 
-    // Serve index.html at root
+    // The web UI (index.html, app.js, style.css), gzipped and with ETags
+    // when uploaded with the .gz files from scripts/compress_web.py
+    server_.addHandler(new WebAssetHandler());
+
+    // Root when the web UI isn't on SPIFFS
     server_.on("/", HTTP_GET, [](AsyncWebServerRequest* request) {
         LOG_INFO("[WebServer] GET / from %s", request->client()->remoteIP().toString().c_str());
 
-        if (SPIFFS.exists("/web/index.html")) {
-            LOG_INFO("[WebServer] Serving /web/index.html");
-            AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/web/index.html", "text/html");
-            response->addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-            request->send(response);
-        } else if (SPIFFS.exists("/index.html")) {
+        if (SPIFFS.exists("/index.html")) {
             LOG_INFO("[WebServer] Serving /index.html");
             AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/index.html", "text/html");
             response->addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
@@ -283,9 +279,6 @@ void WebServer::setupStaticFiles() {
     });
 
     // Serve specific static files (JS, CSS, etc.) from /web directory
-    server_.serveStatic("/app.js", SPIFFS, "/web/app.js");
-    server_.serveStatic("/style.css", SPIFFS, "/web/style.css");
-
     // Serve all files from /static/ path for debugging
     server_.serveStatic("/static/", SPIFFS, "/");
 
@@ -299,6 +292,13 @@ void WebServer::setupAPIEndpoints() {
         handleGetStatus(request);
     });
 
+    // GET /api/batteries/stats - Running statistics of every pack
+    // (registered before /api/batteries, which would also match it)
+    server_.on("/api/batteries/stats", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        request_count_++;
+        handleGetBatteryStats(request);
+    });
+
     // GET /api/batteries - All battery data
     server_.on("/api/batteries", HTTP_GET, [this](AsyncWebServerRequest* request) {
         request_count_++;
@@ -312,6 +312,12 @@ void WebServer::setupAPIEndpoints() {
         handleGetBattery(request, id);
     });
 
+    // GET /api/history?battery=&metric=&res=&points=&format= - Downsampled chart data
+    server_.on("/api/history", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        request_count_++;
+        handleGetHistory(request);
+    });
+
     // GET /api/canlog - CAN message log
     server_.on("/api/canlog", HTTP_GET, [this](AsyncWebServerRequest* request) {
         request_count_++;
@@ -324,6 +330,12 @@ void WebServer::setupAPIEndpoints() {
         handleDownloadCANLog(request);
     });
 
+    // GET /api/canlog/export?id=&from=&to= - Query the CAN log as CSV
+    server_.on("/api/canlog/export", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        request_count_++;
+        handleExportCANLog(request);
+    });
+
     // POST /api/canlog/clear - Clear CAN log
     server_.on("/api/canlog/clear", HTTP_POST, [this](AsyncWebServerRequest* request) {
         request_count_++;
@@ -361,6 +373,13 @@ void WebServer::setupAPIEndpoints() {
         }
     );
 
+    // POST /api/battery/:id/stats/reset - Clear a pack's statistics
+    server_.on("^\\/api\\/battery\\/(\\d+)\\/stats\\/reset$", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        request_count_++;
+        uint8_t id = request->pathArg(0).toInt();
+        handleResetBatteryStats(request, id);
+    });
+
     // POST /api/calibrate/:id - Calibrate current sensor
     server_.on("^\\/api\\/calibrate\\/(\\d+)$", HTTP_POST, [this](AsyncWebServerRequest* request) {
         request_count_++;
@@ -380,12 +399,79 @@ void WebServer::setupAPIEndpoints() {
         handleGetLogs(request);
     });
 
+    // GET /api/diagnostics/perf - Task, queue, latency and heap figures
+    server_.on("/api/diagnostics/perf", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        request_count_++;
+        handleGetPerf(request);
+    });
+
     // GET /api/can/diagnostics - CAN bus diagnostics
     server_.on("/api/can/diagnostics", HTTP_GET, [this](AsyncWebServerRequest* request) {
         request_count_++;
         handleGetCANDiagnostics(request);
     });
 
+    // GET /api/can/values - Last decoded value of every known CAN ID
+    server_.on("/api/can/values", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        request_count_++;
+        handleGetCANValues(request);
+    });
+
+    // POST /api/can/analytics/reset - Restart per-ID timing and bus load figures
+    server_.on("/api/can/analytics/reset", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        request_count_++;
+        handleResetCANAnalytics(request);
+    });
+
+    // GET /api/can/analytics - Per-ID rate, interval/jitter, period deviation and bus load
+    server_.on("/api/can/analytics", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        request_count_++;
+        handleGetCANAnalytics(request);
+    });
+
+    // GET /api/can/filter - Hardware acceptance filter state
+    server_.on("/api/can/filter", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        request_count_++;
+        handleGetCANFilter(request);
+    });
+
+    // POST /api/can/promiscuous - Bypass the acceptance filter ({"enabled": bool})
+    server_.on("/api/can/promiscuous", HTTP_POST,
+        [](AsyncWebServerRequest* request) {},  // Handled in body handler
+        nullptr,
+        [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            if (index == 0) {
+                request_count_++;
+                handlePostCANPromiscuous(request, data, len);
+            }
+        }
+    );
+
+    // POST /api/can/loadtest/stop - End a running load test (its current step is discarded)
+    server_.on("/api/can/loadtest/stop", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        request_count_++;
+        handleStopCANLoadTest(request);
+    });
+
+    // GET /api/can/loadtest - Load test progress and per-step results
+    server_.on("/api/can/loadtest", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        request_count_++;
+        handleGetCANLoadTest(request);
+    });
+
+    // POST /api/can/loadtest - Start synthetic RX traffic
+    // ({"rates": [fps, ...], "step_ms": n, "foreign_pct": n, "loopback": bool})
+    server_.on("/api/can/loadtest", HTTP_POST,
+        [](AsyncWebServerRequest* request) {},  // Handled in body handler
+        nullptr,
+        [this](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+            if (index == 0) {
+                request_count_++;
+                handlePostCANLoadTest(request, data, len);
+            }
+        }
+    );
+
     // Handle 404
     server_.onNotFound([this](AsyncWebServerRequest* request) {
         handleNotFound(request);
@@ -424,138 +510,242 @@ void WebServer::handleGetBattery(AsyncWebServerRequest* request, uint8_t id) {
     sendJSON(request, doc);
 }
 
-void WebServer::handleGetCANLog(AsyncWebServerRequest* request) {
-    if (can_logger_ == nullptr) {
-        sendError(request, 500, "CAN logger not available");
+// One metric of one pack at one resolution, oldest point first. JSON holds
+// the fixed-point values ("scale" converts them, null marks a gap):
+//
+//   {"battery":0,"metric":"voltage","res":"1m","bucket_ms":60000,
+//    "end_ms":..,"now_ms":..,"scale":0.01,"count":2,
+//    "min":[5230,null],"max":[5260,null],"avg":[5241,null]}
+//
+// format=bin sends the same as little-endian binary:
+//   version (1), metric, resolution, reserved
+//   bucket_ms u32, end_ms u32, now_ms u32, scale f32, count u16, reserved u16
+//   count x (min i16, max i16, avg i16), -32768 marks a gap
+void WebServer::handleGetHistory(AsyncWebServerRequest* request) {
+    if (batteries_ == nullptr) {
+        sendError(request, 404, "Battery not found");
         return;
     }
 
-    // Try to acquire static buffer - fast path with no allocations
-    if (!acquireCANBuffer()) {
-        sendError(request, 503, "CAN log busy - try again");
+    uint8_t battery_id = 0;
+    if (request->hasParam("battery")) {
+        battery_id = request->getParam("battery")->value().toInt();
+    }
+    if (battery_id >= batteries_->getActiveBatteryCount()) {
+        sendError(request, 404, "Battery not found");
         return;
     }
 
-    // Parse parameters (avoid String operations)
-    uint32_t filter_id = 0;
-    bool has_filter = false;
-    if (request->hasParam("filter")) {
-        const char* filter_str = request->getParam("filter")->value().c_str();
-        filter_id = strtoul(filter_str, nullptr, 0);
-        has_filter = true;
+    BatteryHistory::Metric metric = BatteryHistory::Metric::VOLTAGE;
+    if (request->hasParam("metric") &&
+        !BatteryHistory::parseMetric(request->getParam("metric")->value().c_str(), metric)) {
+        sendError(request, 400, "Unknown metric (voltage, current, power, soc, temp)");
+        return;
     }
 
-    size_t limit = CAN_LOG_BUFFER_SIZE;  // Use full buffer by default
-    if (request->hasParam("limit")) {
-        int l = request->getParam("limit")->value().toInt();
-        if (l > 0 && l <= CAN_LOG_BUFFER_SIZE) limit = l;
+    BatteryHistory::Resolution res = BatteryHistory::Resolution::MIN_1;
+    if (request->hasParam("res") &&
+        !BatteryHistory::parseResolution(request->getParam("res")->value().c_str(), res)) {
+        sendError(request, 400, "Unknown resolution (1s, 1m, 15m)");
+        return;
     }
 
-    // Use persistent buffer - allocated once, reused forever!
-    size_t count = 0;
-    bool success;
-
-    if (has_filter) {
-        success = can_logger_->getFilteredMessages(persistent_can_buffer, count, limit, filter_id);
-    } else {
-        success = can_logger_->getRecentMessages(persistent_can_buffer, count, limit);
+    size_t max_points = BatteryHistory::capacity(res);
+    if (request->hasParam("points")) {
+        long points = request->getParam("points")->value().toInt();
+        max_points = constrain(points, 1L, static_cast<long>(max_points));
     }
 
-    if (!success) {
-        releaseCANBuffer();
-        sendError(request, 500, "Failed to retrieve messages");
+    bool binary = request->hasParam("format") && request->getParam("format")->value() == "bin";
+
+    // Points are read into the tail of the buffer; the binary form sends
+    // them from there, the JSON form is printed in front of them
+    constexpr size_t BINARY_HEADER = 24;
+    size_t head = binary ? BINARY_HEADER : (256 + max_points * 3 * 7) & ~static_cast<size_t>(1);
+    uint8_t* buffer = json_pool_.acquire(head + max_points * sizeof(BatteryHistory::Point));
+    if (buffer == nullptr) {
+        request->send(503, "text/plain", "Out of memory");
         return;
     }
-
-    // Use AsyncResponseStream for efficient streaming
-    AsyncResponseStream* response = request->beginResponseStream("application/json");
-    response->addHeader("Access-Control-Allow-Origin", "*");
-
-    // Pre-allocate write buffer on stack for batching writes
-    char write_buffer[512];
-    size_t write_pos = 0;
-
-    // Helper to flush write buffer
-    auto flush = [&]() {
-        if (write_pos > 0) {
-            response->write((uint8_t*)write_buffer, write_pos);
-            write_pos = 0;
-        }
-    };
-
-    // Helper to append to write buffer with auto-flush
-    auto append = [&](const char* str, size_t len) {
-        if (write_pos + len >= sizeof(write_buffer)) {
-            flush();
-        }
-        if (len < sizeof(write_buffer)) {
-            memcpy(write_buffer + write_pos, str, len);
-            write_pos += len;
-        } else {
-            // String too large, write directly
-            flush();
-            response->write((uint8_t*)str, len);
+    request->onDisconnect([this, buffer]() { json_pool_.release(buffer); });
+
+    BatteryHistory::Point* points = reinterpret_cast<BatteryHistory::Point*>(buffer + head);
+    uint32_t end_ms = 0;
+    size_t count = batteries_->getHistory().read(battery_id, metric, res, points, max_points, end_ms);
+    uint32_t now_ms = millis();
+    float scale = BatteryHistory::scale(metric);
+
+    AsyncWebServerResponse* response;
+    if (binary) {
+        uint8_t* out = buffer;
+        *out++ = 1;
+        *out++ = static_cast<uint8_t>(metric);
+        *out++ = static_cast<uint8_t>(res);
+        *out++ = 0;
+        out = WSProtocol::putU32(out, BatteryHistory::bucketMs(res));
+        out = WSProtocol::putU32(out, end_ms);
+        out = WSProtocol::putU32(out, now_ms);
+        out = WSProtocol::putF32(out, scale);
+        *out++ = static_cast<uint8_t>(count);
+        *out++ = static_cast<uint8_t>(count >> 8);
+        *out++ = 0;
+        *out++ = 0;
+        // Points follow in place (ESP32 is little-endian)
+        response = request->beginResponse_P(200, "application/octet-stream", buffer,
+                                            BINARY_HEADER + count * sizeof(BatteryHistory::Point));
+    } else {
+        char* text = reinterpret_cast<char*>(buffer);
+        size_t len = snprintf(text, head,
+            "{\"battery\":%u,\"metric\":\"%s\",\"res\":\"%s\",\"bucket_ms\":%u,"
+            "\"end_ms\":%u,\"now_ms\":%u,\"scale\":%g,\"count\":%u",
+            battery_id, BatteryHistory::metricName(metric),
+            BatteryHistory::resolutionName(res),
+            BatteryHistory::bucketMs(res), end_ms, now_ms, scale, (unsigned)count);
+
+        static const char* const FIELDS[] = { "min", "max", "avg" };
+        for (uint8_t f = 0; f < 3; f++) {
+            len += snprintf(text + len, head - len, ",\"%s\":[", FIELDS[f]);
+            for (size_t i = 0; i < count; i++) {
+                const BatteryHistory::Point& point = points[i];
+                int16_t value = f == 0 ? point.min : (f == 1 ? point.max : point.avg);
+                const char* sep = i > 0 ? "," : "";
+                if (point.avg == BatteryHistory::NO_DATA) {
+                    len += snprintf(text + len, head - len, "%snull", sep);
+                } else {
+                    len += snprintf(text + len, head - len, "%s%d", sep, value);
+                }
+            }
+            len += snprintf(text + len, head - len, "]");
         }
-    };
+        len += snprintf(text + len, head - len, "}");
+        response = request->beginResponse_P(200, "application/json", buffer, len);
+    }
 
-    // Start JSON header
-    const char* header = "{\"messages\":[";
-    append(header, strlen(header));
+    response->addHeader("Access-Control-Allow-Origin", "*");
+    request->send(response);
+}
 
-    // Stream messages with zero-copy approach
-    for (size_t i = 0; i < count; i++) {
-        const CANMessage& msg = persistent_can_buffer[i];
-
-        // Build JSON on stack
-        char json_buf[128];
-        char hex_data[17];
-
-        // Format hex data efficiently
-        char* hex_ptr = hex_data;
-        for (int j = 0; j < msg.dlc && j < 8; j++) {
-            uint8_t byte = msg.data[j];
-            *hex_ptr++ = "0123456789ABCDEF"[byte >> 4];
-            *hex_ptr++ = "0123456789ABCDEF"[byte & 0x0F];
-        }
-        *hex_ptr = '\0';
+void WebServer::handleGetCANLog(AsyncWebServerRequest* request) {
+    if (can_logger_ == nullptr) {
+        sendError(request, 500, "CAN logger not available");
+        return;
+    }
 
-        // Format JSON message
-        int len = snprintf(json_buf, sizeof(json_buf),
-            "%s{\"id\":\"0x%03X\",\"dlc\":%u,\"data\":\"%s\",\"timestamp\":%lu,\"extended\":%s}",
-            (i > 0 ? "," : ""),
-            msg.id, msg.dlc, hex_data, msg.timestamp,
-            msg.extended ? "true" : "false");
+    std::shared_ptr<CANLogPollCursor> cursor = std::make_shared<CANLogPollCursor>();
+    memset(cursor.get(), 0, sizeof(CANLogPollCursor));
 
-        if (len > 0 && len < (int)sizeof(json_buf)) {
-            append(json_buf, len);
-        }
+    // Parse parameters (avoid String operations)
+    if (request->hasParam("filter")) {
+        cursor->filter_id = strtoul(request->getParam("filter")->value().c_str(), nullptr, 0);
+        cursor->filtered = true;
+    }
 
-        // Yield every 100 messages to prevent watchdog
-        if (i % 100 == 0) {
-            flush();
-            yield();
+    cursor->remaining = CAN_LOG_DEFAULT_LIMIT;
+    if (request->hasParam("limit")) {
+        long l = request->getParam("limit")->value().toInt();
+        if (l > 0 && (size_t)l <= can_logger_->getMemoryCapacity()) cursor->remaining = l;
+    }
+
+    // Frames from ?since=<seq> on (the "next" of the previous response),
+    // else from the oldest frame still in RAM
+    cursor->end = can_logger_->getNextSequence();
+    uint32_t oldest = can_logger_->getOldestSequence();
+    cursor->next = oldest;
+    if (request->hasParam("since")) {
+        uint32_t since = strtoul(request->getParam("since")->value().c_str(), nullptr, 10);
+        uint32_t behind = cursor->end - since;
+        if (behind <= cursor->end - oldest) {
+            cursor->next = since;
+        } else if (behind < 0x80000000UL) {
+            cursor->lost = oldest - since;  // Overwritten since the last poll
+        } else {
+            cursor->reset = true;           // Ahead of the logger: sequence restarted
         }
     }
 
-    // Write footer
-    char footer[128];
-    int footer_len = snprintf(footer, sizeof(footer),
-        "],\"count\":%u,\"total_logged\":%u,\"dropped\":%u}",
-        count,
-        can_logger_->getMessageCount(),
-        can_logger_->getDroppedCount());
-
-    if (footer_len > 0 && footer_len < (int)sizeof(footer)) {
-        append(footer, footer_len);
-    }
+    // Built chunk by chunk as the client reads, straight from the ring; nothing
+    // is copied up front and concurrent requests don't block each other
+    CANLogger* logger = can_logger_;
+
+    AsyncWebServerResponse* response = request->beginChunkedResponse("application/json",
+        [logger, cursor](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            CANLogPollCursor& c = *cursor;
+            size_t len = 0;
+            char entry[160];
+
+            while (c.stage < 3) {
+                int n = 0;
+
+                if (c.stage == 0) {
+                    n = snprintf(entry, sizeof(entry), "{\"messages\":[");
+                } else if (c.stage == 1) {
+                    if (c.next == c.end || c.remaining == 0) {
+                        c.stage = 2;
+                        continue;
+                    }
+
+                    CANFrame frame;
+                    if (!logger->readFrame(c.next, frame)) {
+                        // Overwritten while this response was being sent
+                        uint32_t oldest = logger->getOldestSequence();
+                        uint32_t skip = oldest - c.next;
+                        if (skip == 0 || skip > c.end - c.next) {
+                            c.stage = 2;    // Log cleared
+                            continue;
+                        }
+                        c.lost += skip;
+                        c.next = oldest;
+                        continue;
+                    }
+
+                    if (c.filtered && frame.id() != c.filter_id) {
+                        c.next++;
+                        continue;
+                    }
+
+                    char hex_data[17];
+                    char* hex_ptr = hex_data;
+                    uint8_t dlc = frame.dlc();
+                    for (uint8_t j = 0; j < dlc; j++) {
+                        *hex_ptr++ = "0123456789ABCDEF"[frame.data[j] >> 4];
+                        *hex_ptr++ = "0123456789ABCDEF"[frame.data[j] & 0x0F];
+                    }
+                    *hex_ptr = '\0';
+
+                    n = snprintf(entry, sizeof(entry),
+                        "%s{\"seq\":%u,\"id\":\"0x%03X\",\"dlc\":%u,\"data\":\"%s\",\"timestamp\":%u,\"extended\":%s}",
+                        (c.count > 0 ? "," : ""),
+                        c.next, frame.id(), dlc, hex_data, frame.timestampMs(),
+                        frame.extended() ? "true" : "false");
+                } else {
+                    n = snprintf(entry, sizeof(entry),
+                        "],\"count\":%u,\"next\":%u,\"lost\":%u,\"reset\":%s,\"total_logged\":%u,\"dropped\":%u}",
+                        c.count, c.next, c.lost, c.reset ? "true" : "false",
+                        logger->getMessageCount(), logger->getDroppedCount());
+                }
 
-    // Final flush
-    flush();
+                if (n <= 0 || (size_t)n > maxLen - len) {
+                    break;  // Rest goes in the next chunk
+                }
+                memcpy(buffer + len, entry, n);
+                len += n;
+
+                if (c.stage == 1) {
+                    c.next++;
+                    c.count++;
+                    c.remaining--;
+                } else {
+                    c.stage++;
+                }
+            }
 
-    // Release buffer ASAP
-    releaseCANBuffer();
+            if (len == 0 && c.stage < 3) {
+                return RESPONSE_TRY_AGAIN;  // Not even one entry fits yet
+            }
+            return len;
+        });
 
-    // Send response
+    response->addHeader("Access-Control-Allow-Origin", "*");
     request->send(response);
 }
 
@@ -572,29 +762,88 @@ void WebServer::handleDownloadCANLog(AsyncWebServerRequest* request) {
     // Flush any pending messages to file first
     can_logger_->flush();
 
-    // Check if file exists and get size
-    if (!SPIFFS.exists("/canlog.csv")) {
-        LOG_ERROR("[WebServer] CAN log file /canlog.csv not found on SPIFFS");
+    size_t logSize = can_logger_->getLogSize();
+    if (logSize == 0) {
+        LOG_ERROR("[WebServer] CAN log is empty");
         LOG_ERROR("[WebServer] Make sure can_log_enabled is true in settings");
         sendError(request, 404, "CAN log file not found - check if CAN logging is enabled");
         return;
     }
 
-    File file = SPIFFS.open("/canlog.csv", "r");
-    if (!file) {
-        LOG_ERROR("[WebServer] Failed to open /canlog.csv for reading");
-        sendError(request, 500, "Failed to open CAN log file");
+    // Raw records on request (?format=bin), e.g. for offline tools
+    bool raw = can_logger_->isBinary() &&
+               request->hasParam("format") && request->getParam("format")->value() == "bin";
+
+    LOG_INFO("[WebServer] Streaming %u CAN log segment(s), %d bytes, as %s",
+             can_logger_->getSegmentCount(), logSize, raw ? "binary" : "CSV");
+
+    sendCANLogStream(request, std::make_shared<CANLogExportCursor>(), raw,
+                     raw ? "canlog.bin" : "canlog.csv");
+}
+
+void WebServer::handleExportCANLog(AsyncWebServerRequest* request) {
+    if (can_logger_ == nullptr) {
+        sendError(request, 500, "CAN logger not available");
+        return;
+    }
+
+    // Queries rely on the segment index of the binary log
+    if (!can_logger_->isBinary()) {
+        sendError(request, 400, "Log queries need the binary log format");
         return;
     }
 
-    size_t fileSize = file.size();
-    file.close();
+    std::shared_ptr<CANLogExportCursor> cursor = std::make_shared<CANLogExportCursor>();
+
+    // ?id= accepts decimal or 0x-prefixed hex; from/to are log timestamps (ms)
+    if (request->hasParam("id")) {
+        cursor->filtered = true;
+        cursor->filter_id = strtoul(request->getParam("id")->value().c_str(), nullptr, 0);
+    }
+    if (request->hasParam("from") || request->hasParam("to")) {
+        cursor->time_filtered = true;
+        cursor->from_ms = request->hasParam("from")
+            ? strtoul(request->getParam("from")->value().c_str(), nullptr, 10) : 0;
+        cursor->to_ms = request->hasParam("to")
+            ? strtoul(request->getParam("to")->value().c_str(), nullptr, 10) : UINT32_MAX;
+        if (cursor->from_ms > cursor->to_ms) {
+            sendError(request, 400, "'from' is after 'to'");
+            return;
+        }
+    }
+
+    can_logger_->flush();
 
-    LOG_INFO("[WebServer] Serving CAN log file: %d bytes from SPIFFS", fileSize);
+    char id_text[12] = "any";
+    if (cursor->filtered) {
+        snprintf(id_text, sizeof(id_text), "0x%03X", cursor->filter_id);
+    }
+    LOG_INFO("[WebServer] CAN log query: ID %s, %u-%u ms", id_text,
+             cursor->from_ms, cursor->time_filtered ? cursor->to_ms : UINT32_MAX);
 
-    // Serve the SPIFFS file directly
-    AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/canlog.csv", "text/csv", true);
-    response->addHeader("Content-Disposition", "attachment; filename=\"canlog.csv\"");
+    sendCANLogStream(request, cursor, false, "canlog_export.csv");
+}
+
+void WebServer::sendCANLogStream(AsyncWebServerRequest* request, std::shared_ptr<CANLogExportCursor> cursor,
+                                 bool raw, const char* filename) {
+    // All segments are read in order as one file, chunk by chunk as the
+    // client reads, so the log is never held in RAM
+    CANLogger* logger = can_logger_;
+
+    AsyncWebServerResponse* response = request->beginChunkedResponse(
+        raw ? "application/octet-stream" : "text/csv",
+        [logger, cursor, raw](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            size_t n = raw ? logger->readRaw(*cursor, buffer, maxLen)
+                           : logger->readCSV(*cursor, buffer, maxLen);
+            if (n == 0 && !cursor->done) {
+                return RESPONSE_TRY_AGAIN;  // Log busy flushing
+            }
+            return n;
+        });
+
+    char disposition[64];
+    snprintf(disposition, sizeof(disposition), "attachment; filename=\"%s\"", filename);
+    response->addHeader("Content-Disposition", disposition);
     request->send(response);
 }
 
@@ -674,6 +923,33 @@ void WebServer::handlePostConfig(AsyncWebServerRequest* request, uint8_t* data,
     if (!doc["mqtt_canmsg_enabled"].isNull()) {
         settings.mqtt_canmsg_enabled = doc["mqtt_canmsg_enabled"].as<bool>();
     }
+    if (!doc["mqtt_can_format"].isNull()) {
+        uint8_t format = doc["mqtt_can_format"] | static_cast<uint8_t>(MQTTCANFormat::BATCH_BINARY);
+        if (format <= static_cast<uint8_t>(MQTTCANFormat::BATCH_JSON)) {
+            settings.mqtt_can_format = static_cast<MQTTCANFormat>(format);
+        }
+    }
+    if (!doc["mqtt_can_batch_ms"].isNull()) {
+        settings.mqtt_can_batch_ms = constrain(doc["mqtt_can_batch_ms"] | DEFAULT_MQTT_CAN_BATCH_MS, 50, 10000);
+    }
+    if (!doc["mqtt_can_batch_bytes"].isNull()) {
+        settings.mqtt_can_batch_bytes = constrain(doc["mqtt_can_batch_bytes"] | DEFAULT_MQTT_CAN_BATCH_BYTES, 128, MQTT_CAN_BATCH_MAX_BYTES);
+    }
+    if (!doc["mqtt_deadband_voltage"].isNull()) {
+        settings.mqtt_deadband.voltage = constrain(doc["mqtt_deadband_voltage"] | DEFAULT_DEADBAND_VOLTAGE, 0.0f, 10.0f);
+    }
+    if (!doc["mqtt_deadband_current"].isNull()) {
+        settings.mqtt_deadband.current = constrain(doc["mqtt_deadband_current"] | DEFAULT_DEADBAND_CURRENT, 0.0f, 50.0f);
+    }
+    if (!doc["mqtt_deadband_soc"].isNull()) {
+        settings.mqtt_deadband.soc = constrain(doc["mqtt_deadband_soc"] | DEFAULT_DEADBAND_SOC, 0, 50);
+    }
+    if (!doc["mqtt_deadband_temp"].isNull()) {
+        settings.mqtt_deadband.temp = constrain(doc["mqtt_deadband_temp"] | DEFAULT_DEADBAND_TEMP, 0.0f, 20.0f);
+    }
+    if (!doc["mqtt_heartbeat_s"].isNull()) {
+        settings.mqtt_deadband.heartbeat_s = constrain(doc["mqtt_heartbeat_s"] | DEFAULT_TELEMETRY_HEARTBEAT_S, 5, 3600);
+    }
     if (!doc["num_batteries"].isNull()) {
         settings.num_batteries = constrain(doc["num_batteries"] | 1, 1, MAX_BATTERY_MODULES);
     }
@@ -735,6 +1011,27 @@ void WebServer::handlePostBatteryConfig(AsyncWebServerRequest* request, uint8_t
     }
 }
 
+void WebServer::handleGetBatteryStats(AsyncWebServerRequest* request) {
+    JsonDocument doc;
+    buildBatteryStatsJSON(doc.to<JsonObject>());
+    sendJSON(request, doc);
+}
+
+void WebServer::handleResetBatteryStats(AsyncWebServerRequest* request, uint8_t id) {
+    if (batteries_ == nullptr || id >= batteries_->getActiveBatteryCount()) {
+        sendError(request, 404, "Battery not found");
+        return;
+    }
+
+    batteries_->resetStats(id);
+
+    JsonDocument doc;
+    doc["success"] = true;
+    doc["battery_id"] = id;
+    doc["message"] = "Statistics reset";
+    sendJSON(request, doc);
+}
+
 void WebServer::handleCalibrate(AsyncWebServerRequest* request, uint8_t id) {
     if (id >= MAX_BATTERY_MODULES) {
         sendError(request, 404, "Battery not found");
@@ -757,6 +1054,11 @@ void WebServer::handleReset(AsyncWebServerRequest* request) {
     doc["message"] = "Rebooting...";
     sendJSON(request, doc);
 
+    // Keep the charge/energy counters accumulated since the last checkpoint
+    if (batteries_ != nullptr) {
+        batteries_->saveStats();
+    }
+
     // Schedule reboot after response is sent
     delay(500);
     ESP.restart();
@@ -786,15 +1088,42 @@ void WebServer::handleGetLogs(AsyncWebServerRequest* request) {
 
     doc["count"] = count;
     doc["buffer_size"] = LOG_BUFFER_SIZE;
+    doc["async"] = remoteLog.isAsync();
+    doc["dropped"] = remoteLog.getDroppedCount();
+    doc["rate_limited"] = remoteLog.getSuppressedCount();
+    doc["coalesced"] = remoteLog.getCoalescedCount();
 
     delete[] logs;
     sendJSON(request, doc);
 }
 
 void WebServer::handleGetCANDiagnostics(AsyncWebServerRequest* request) {
-    char buffer[1024];
+    char buffer[2048];
 
     if (canDriver.getDiagnostics(buffer, sizeof(buffer))) {
+        // Parser side: last-value cache and decoded-frame consumers
+        size_t len = strlen(buffer);
+        int n = snprintf(buffer + len, sizeof(buffer) - len,
+            "\nParser Cache: %u hits, %u misses\n",
+            canRouter.getCacheHits(), canRouter.getCacheMisses());
+        if (n > 0 && len + n < sizeof(buffer) && canRouter.getChannelCount() > 0) {
+            len += n;
+            n = snprintf(buffer + len, sizeof(buffer) - len, "\nBattery Routes:\n");
+            if (n > 0 && len + n < sizeof(buffer)) {
+                len += n;
+                n = canRouter.getDiagnostics(buffer + len, sizeof(buffer) - len);
+            }
+        }
+        const DecodedFrameBus& decodedBus = canParser.getDecodedBus();
+        if (n > 0 && len + n < sizeof(buffer) && decodedBus.getConsumerCount() > 0) {
+            len += n;
+            n = snprintf(buffer + len, sizeof(buffer) - len, "\nDecoded Frame Consumers:\n");
+            if (n > 0 && len + n < sizeof(buffer)) {
+                len += n;
+                decodedBus.getDiagnostics(buffer + len, sizeof(buffer) - len);
+            }
+        }
+
         // Return as plain text for readability
         AsyncWebServerResponse* response = request->beginResponse(200, "text/plain", buffer);
         response->addHeader("Access-Control-Allow-Origin", "*");
@@ -804,6 +1133,287 @@ void WebServer::handleGetCANDiagnostics(AsyncWebServerRequest* request) {
     }
 }
 
+void WebServer::handleGetPerf(AsyncWebServerRequest* request) {
+    JsonDocument doc;
+    buildPerfJSON(doc.to<JsonObject>());
+    sendJSON(request, doc);
+}
+
+void WebServer::handleGetCANValues(AsyncWebServerRequest* request) {
+    static constexpr size_t MAX_VALUES = 32;
+    DecodedFrame* records = new DecodedFrame[MAX_VALUES];
+    if (records == nullptr) {
+        sendError(request, 500, "Out of memory");
+        return;
+    }
+
+    size_t count = canRouter.getAllLastDecoded(records, MAX_VALUES);
+    uint32_t now = millis();
+
+    JsonDocument doc;
+    JsonArray arr = doc["messages"].to<JsonArray>();
+
+    for (size_t i = 0; i < count; i++) {
+        const DecodedFrame& rec = records[i];
+        JsonObject obj = arr.add<JsonObject>();
+
+        char id_str[12];
+        snprintf(id_str, sizeof(id_str), "0x%03X", rec.frame.id);
+        obj["id"] = id_str;
+        obj["age_ms"] = now - rec.frame.timestamp;
+
+        char data_hex[17];
+        for (uint8_t b = 0; b < rec.frame.dlc && b < 8; b++) {
+            snprintf(&data_hex[b * 2], 3, "%02X", rec.frame.data[b]);
+        }
+        data_hex[rec.frame.dlc * 2] = '\0';
+        obj["data"] = data_hex;
+
+        if (rec.battery.valid) {
+            obj["battery_id"] = rec.battery.battery_id;
+        }
+
+        if (rec.message != nullptr) {
+            obj["name"] = rec.message->name;
+            JsonObject fields = obj["fields"].to<JsonObject>();
+            for (uint8_t f = 0; f < rec.value_count; f++) {
+                if (rec.valid_mask & (1 << f)) {
+                    fields[rec.message->fields[f].name] = rec.values[f];
+                }
+            }
+        }
+    }
+
+    doc["count"] = count;
+    doc["cache_hits"] = canRouter.getCacheHits();
+    doc["cache_misses"] = canRouter.getCacheMisses();
+
+    delete[] records;
+    sendJSON(request, doc);
+}
+
+void WebServer::handleGetCANAnalytics(AsyncWebServerRequest* request) {
+    const CANAnalyzer& analyzer = canDriver.getAnalyzer();
+    CANAnalyzer::IdStats* ids = new (std::nothrow) CANAnalyzer::IdStats[CANAnalyzer::MAX_IDS];
+    if (ids == nullptr) {
+        sendError(request, 500, "Out of memory");
+        return;
+    }
+    size_t count = analyzer.getIdStats(ids, CANAnalyzer::MAX_IDS);
+
+    CANAnalyzer::BusStats bus;
+    analyzer.getBusStats(bus);
+
+    JsonDocument doc;
+    doc["bitrate"] = bus.bitrate;
+    doc["utilization"] = roundf(bus.utilization * 10.0f) / 10.0f;
+    doc["peak_utilization"] = roundf(bus.peak_utilization * 10.0f) / 10.0f;
+    doc["frames_per_sec"] = bus.frames_per_sec;
+    doc["frames"] = bus.frames;
+    doc["untracked"] = bus.untracked;
+    doc["window_ms"] = CAN_ANALYZER_WINDOW_MS;
+
+    JsonArray arr = doc["ids"].to<JsonArray>();
+    for (size_t i = 0; i < count; i++) {
+        const CANAnalyzer::IdStats& stats = ids[i];
+        JsonObject obj = arr.add<JsonObject>();
+
+        char id_str[12];
+        snprintf(id_str, sizeof(id_str), stats.extended ? "0x%08X" : "0x%03X", stats.id);
+        obj["id"] = id_str;
+        obj["extended"] = stats.extended;
+        obj["count"] = stats.count;
+        if (stats.count == 0) {
+            obj["expected_ms"] = stats.expected_ms;
+            continue;   // Registered period, never seen
+        }
+
+        obj["dlc"] = stats.dlc;
+        obj["age_ms"] = stats.age_ms;
+        obj["rate_hz"] = roundf(stats.rate_hz * 100.0f) / 100.0f;
+        obj["interval_ms"] = roundf(stats.interval_ms * 100.0f) / 100.0f;
+        obj["jitter_ms"] = roundf(stats.jitter_ms * 100.0f) / 100.0f;
+        obj["min_ms"] = roundf(stats.min_interval_ms * 100.0f) / 100.0f;
+        obj["max_ms"] = roundf(stats.max_interval_ms * 100.0f) / 100.0f;
+        obj["load_pct"] = roundf(stats.load_pct * 100.0f) / 100.0f;
+        if (stats.expected_ms > 0) {
+            obj["expected_ms"] = stats.expected_ms;
+            obj["deviation_pct"] = roundf(stats.deviation_pct * 10.0f) / 10.0f;
+            obj["late"] = stats.late;
+            obj["missed"] = stats.missed;
+        }
+    }
+    doc["count"] = count;
+
+    delete[] ids;
+    sendJSON(request, doc);
+}
+
+void WebServer::handleResetCANAnalytics(AsyncWebServerRequest* request) {
+    canDriver.getAnalyzer().reset();
+
+    JsonDocument doc;
+    doc["success"] = true;
+    doc["message"] = "CAN analytics reset";
+    sendJSON(request, doc);
+}
+
+void WebServer::handleGetCANFilter(AsyncWebServerRequest* request) {
+    CANFilter filter = canDriver.getFilter();
+    char desc[64];
+    filter.describe(desc, sizeof(desc));
+
+    JsonDocument doc;
+    doc["promiscuous"] = canDriver.isPromiscuous();
+    doc["accept_all"] = filter.acceptsAll();
+    doc["single_filter"] = filter.single_filter;
+    doc["extended"] = filter.extended;
+    doc["acceptance_code"] = filter.acceptance_code;
+    doc["acceptance_mask"] = filter.acceptance_mask;
+    doc["accepted_ids"] = filter.accepted_ids;
+    doc["description"] = desc;
+    sendJSON(request, doc);
+}
+
+void WebServer::handlePostCANPromiscuous(AsyncWebServerRequest* request, uint8_t* data, size_t len) {
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, data, len);
+
+    if (error || doc["enabled"].isNull()) {
+        sendError(request, 400, "Expected {\"enabled\": true|false}");
+        return;
+    }
+
+    bool enabled = doc["enabled"] | false;
+    if (!canDriver.setPromiscuous(enabled)) {
+        sendError(request, 500, "Failed to change CAN filter mode");
+        return;
+    }
+
+    JsonDocument resp;
+    resp["success"] = true;
+    resp["promiscuous"] = enabled;
+    resp["message"] = enabled ? "Accepting all CAN frames" : "Hardware filter restored";
+    sendJSON(request, resp);
+}
+
+void WebServer::handleGetCANLoadTest(AsyncWebServerRequest* request) {
+    static const char* const PHASES[] = {"idle", "arming", "generating", "settling"};
+
+    const CANLoadTest& test = canDriver.getLoadTest();
+    CANLoadTest::Status status;
+    test.getStatus(status);
+
+    JsonDocument doc;
+    doc["phase"] = PHASES[static_cast<uint8_t>(status.phase)];
+    doc["loopback"] = status.loopback;
+    doc["aborted"] = status.aborted;
+    if (status.phase != CANLoadTest::Phase::IDLE) {
+        doc["step"] = status.step;
+    }
+    doc["step_count"] = status.step_count;
+    doc["step_ms"] = status.step_ms;
+    doc["settle_ms"] = CAN_LOADTEST_SETTLE_MS;
+    doc["templates"] = status.template_count;
+    doc["foreign_pct"] = status.foreign_pct;
+
+    // Drops per stage and latency (bucket upper bounds, as in
+    // /api/diagnostics/perf) over each step and its settle time
+    JsonArray steps = doc["steps"].to<JsonArray>();
+    CANLoadTest::StepResult result;
+    for (uint8_t i = 0; i < status.steps_done && test.getResult(i, result); i++) {
+        JsonObject obj = steps.add<JsonObject>();
+        obj["rate"] = result.rate;
+        obj["duration_ms"] = result.duration_ms;
+        obj["generated"] = result.generated;
+        obj["lagged"] = result.lagged;
+        obj["parsed"] = result.parsed;
+        obj["generated_fps"] = roundf(result.generated_fps);
+        obj["parsed_fps"] = roundf(result.parsed_fps);
+
+        JsonObject drops = obj["drops"].to<JsonObject>();
+        for (size_t s = 0; s < test.getStageCount(); s++) {
+            drops[test.getStageName(s)] = result.drops[s];
+        }
+
+        JsonObject latency = obj["latency"].to<JsonObject>();
+        for (uint8_t k = 0; k < CANLoadTest::LATENCY_KINDS; k++) {
+            JsonObject entry = latency[PerfMonitor::latencyName(static_cast<PerfMonitor::Latency>(k))].to<JsonObject>();
+            entry["count"] = result.latency_count[k];
+            entry["p50_us"] = result.p50_us[k];
+            entry["p90_us"] = result.p90_us[k];
+            entry["p99_us"] = result.p99_us[k];
+        }
+    }
+
+    sendJSON(request, doc);
+}
+
+void WebServer::handlePostCANLoadTest(AsyncWebServerRequest* request, uint8_t* data, size_t len) {
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, data, len);
+
+    JsonArray rates = doc["rates"];
+    if (error || rates.isNull() || rates.size() == 0 || rates.size() > CANLoadTest::MAX_STEPS) {
+        sendError(request, 400, "Expected {\"rates\": [frames/s, ...]} with 1-8 steps");
+        return;
+    }
+
+    std::unique_ptr<CANLoadTest::Config> config(new (std::nothrow) CANLoadTest::Config());
+    if (!config) {
+        sendError(request, 500, "Out of memory");
+        return;
+    }
+    for (JsonVariant rate : rates) {
+        config->rates[config->step_count++] = rate | 0;
+    }
+    config->step_ms = doc["step_ms"] | CAN_LOADTEST_STEP_MS;
+    int foreign_pct = doc["foreign_pct"] | 0;
+    config->foreign_pct = foreign_pct < 0 || foreign_pct > 100 ? UINT8_MAX : foreign_pct;    // Refused below
+    config->loopback = doc["loopback"] | false;
+
+    CANLoadTest& test = canDriver.getLoadTest();
+    if (test.isActive()) {
+        sendError(request, 409, "Load test already running");
+        return;
+    }
+    if (!canRouter.prepareLoadTest(*config)) {
+        char message[96];
+        snprintf(message, sizeof(message), "Loopback test IDs 0x%03X-0x%03X are used by a configured protocol",
+                 (unsigned)CAN_LOADTEST_FOREIGN_ID, (unsigned)(CAN_LOADTEST_FOREIGN_ID + CANLoadTest::FOREIGN_IDS - 1));
+        sendError(request, 409, message);
+        return;
+    }
+    if (!test.start(*config)) {
+        char message[96];
+        if (config->template_count == 0 && config->foreign_pct < 100) {
+            snprintf(message, sizeof(message), "No protocol messages to generate (use foreign_pct 100)");
+        } else {
+            snprintf(message, sizeof(message), "Invalid load test (rates 1-%u fps, step_ms 1-60000, foreign_pct 0-100)",
+                     CAN_LOADTEST_MAX_RATE);
+        }
+        sendError(request, 400, message);
+        return;
+    }
+
+    JsonDocument resp;
+    resp["success"] = true;
+    resp["steps"] = config->step_count;
+    resp["templates"] = config->template_count;
+    resp["message"] = config->loopback ? "Load test started (loopback: foreign IDs only, sent on the bus)"
+                                       : "Load test started";
+    sendJSON(request, resp);
+}
+
+void WebServer::handleStopCANLoadTest(AsyncWebServerRequest* request) {
+    canDriver.getLoadTest().stop();
+
+    JsonDocument doc;
+    doc["success"] = true;
+    doc["message"] = "Load test stopping";
+    sendJSON(request, doc);
+}
+
 void WebServer::handleNotFound(AsyncWebServerRequest* request) {
     sendError(request, 404, "Not found");
 }
@@ -819,7 +1429,7 @@ void WebServer::onWSEvent(AsyncWebSocket* server, AsyncWebSocketClient* client,
                          client->id(), client->remoteIP().toString().c_str(), free_heap);
 
                 // Limit maximum clients to prevent memory exhaustion
-                if (ws_.count() > 5) {
+                if (ws_.count() > WS_MAX_CLIENTS) {
                     LOG_ERROR("[WebSocket] Rejecting client - too many connections (%u active)", ws_.count());
                     client->text("{\"error\":\"Server full, max 5 clients\"}");
                     client->close();
@@ -834,16 +1444,17 @@ void WebServer::onWSEvent(AsyncWebSocket* server, AsyncWebSocketClient* client,
                     return;
                 }
 
+                addWSClient(client->id());
                 if (client_callback_) {
                     client_callback_(client->id(), true);
                 }
-                // Send initial status to new client
+                // Send initial status to new client (always JSON, it carries
+                // the static fields the binary status leaves out)
                 {
                     JsonDocument doc;
                     buildStatusJSON(doc.to<JsonObject>());
-                    String json;
-                    serializeJson(doc, json);
-                    client->text(json);
+                    AsyncWebSocketMessageBuffer* buffer = makeJSONBuffer(doc);
+                    if (buffer != nullptr) client->text(buffer);
                 }
                 // Send log history to new client
                 sendLogHistory(client);
@@ -852,6 +1463,7 @@ void WebServer::onWSEvent(AsyncWebSocket* server, AsyncWebSocketClient* client,
 
         case WS_EVT_DISCONNECT:
             LOG_DEBUG("[WebSocket] Client #%u disconnected",client->id());
+            removeWSClient(client->id());
             if (client_callback_) {
                 client_callback_(client->id(), false);
             }
@@ -864,7 +1476,7 @@ void WebServer::onWSEvent(AsyncWebSocket* server, AsyncWebSocketClient* client,
                 if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT) {
                     data[len] = 0;  // Null-terminate
                     LOG_DEBUG("[WebSocket] Received: %s",(char*)data);
-                    // Could handle client commands here
+                    handleWSCommand(client, (const char*)data, len);
                 }
             }
             break;
@@ -876,112 +1488,503 @@ void WebServer::onWSEvent(AsyncWebSocket* server, AsyncWebSocketClient* client,
     }
 }
 
+void WebServer::handleWSCommand(AsyncWebSocketClient* client, const char* text, size_t len) {
+    JsonDocument doc;
+    if (deserializeJson(doc, text, len) != DeserializationError::Ok) {
+        return;
+    }
+
+    // {"cmd":"format","format":"binary","version":1} - anything else keeps JSON
+    const char* cmd = doc["cmd"];
+    if (cmd != nullptr && strcmp(cmd, "format") == 0) {
+        const char* format = doc["format"];
+        bool binary = format != nullptr && strcmp(format, "binary") == 0 &&
+                      (doc["version"] | 0) == WSProtocol::VERSION;
+        setWSClientBinary(client->id(), binary);
+        LOG_INFO("[WebSocket] Client #%u uses %s updates", client->id(), binary ? "binary" : "JSON");
+    } else if (cmd != nullptr && strcmp(cmd, "subscribe") == 0) {
+        // Missing "streams" means all of them
+        uint8_t streams = WSProtocol::STREAM_ALL;
+        JsonArray names = doc["streams"];
+        if (!names.isNull()) {
+            streams = 0;
+            for (JsonVariant name : names) {
+                streams |= WSProtocol::streamBit(name.as<const char*>());
+            }
+        }
+
+        WSProtocol::CANSubscription can;
+        memset(&can, 0, sizeof(can));
+        JsonArray filters = doc["can"]["filters"];
+        for (JsonObject filter : filters) {
+            if (can.filter_count >= WSProtocol::CAN_MAX_FILTERS) {
+                LOG_WARN("[WebSocket] Client #%u: only %u CAN filters used", client->id(),
+                         WSProtocol::CAN_MAX_FILTERS);
+                break;
+            }
+            can.ids[can.filter_count] = (filter["id"] | 0UL) & CANFrame::ID_MASK;
+            can.masks[can.filter_count] = (filter["mask"] | (unsigned long)CANFrame::ID_MASK) & CANFrame::ID_MASK;
+            can.filter_count++;
+        }
+        uint32_t rate = doc["can"]["max_rate"] | 0UL;
+        if (rate > WSProtocol::CAN_MAX_RATE) rate = WSProtocol::CAN_MAX_RATE;
+        can.interval_ms = rate > 0 ? 1000 / rate : 0;
+
+        setWSClientSubscription(client->id(), streams, can);
+        LOG_INFO("[WebSocket] Client #%u subscribed: streams 0x%02X, %u CAN filters, max rate %u/s",
+                 client->id(), streams, can.filter_count, rate);
+    }
+}
+
+void WebServer::addWSClient(uint32_t id) {
+    portENTER_CRITICAL(&ws_clients_mux_);
+    if (ws_client_count_ < WS_MAX_CLIENTS) {
+        WSClientInfo& info = ws_clients_[ws_client_count_];
+        memset(&info, 0, sizeof(info));
+        info.id = id;
+        info.binary = false;
+        info.streams = WSProtocol::STREAM_ALL;
+        ws_client_count_++;
+    }
+    portEXIT_CRITICAL(&ws_clients_mux_);
+}
+
+void WebServer::removeWSClient(uint32_t id) {
+    portENTER_CRITICAL(&ws_clients_mux_);
+    for (size_t i = 0; i < ws_client_count_; i++) {
+        if (ws_clients_[i].id == id) {
+            ws_clients_[i] = ws_clients_[--ws_client_count_];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&ws_clients_mux_);
+}
+
+void WebServer::setWSClientBinary(uint32_t id, bool binary) {
+    portENTER_CRITICAL(&ws_clients_mux_);
+    for (size_t i = 0; i < ws_client_count_; i++) {
+        if (ws_clients_[i].id == id) {
+            ws_clients_[i].binary = binary;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&ws_clients_mux_);
+}
+
+void WebServer::setWSClientSubscription(uint32_t id, uint8_t streams,
+                                        const WSProtocol::CANSubscription& can) {
+    portENTER_CRITICAL(&ws_clients_mux_);
+    for (size_t i = 0; i < ws_client_count_; i++) {
+        if (ws_clients_[i].id == id) {
+            ws_clients_[i].streams = streams;
+            ws_clients_[i].can = can;
+            ws_clients_[i].generation++;    // Restarts its CAN view
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&ws_clients_mux_);
+}
+
+size_t WebServer::getWSClients(WSClientInfo* out, uint8_t stream, size_t& binary_count, bool& all) {
+    size_t count = 0;
+    portENTER_CRITICAL(&ws_clients_mux_);
+    for (size_t i = 0; i < ws_client_count_; i++) {
+        if (ws_clients_[i].streams & stream) {
+            out[count++] = ws_clients_[i];
+        }
+    }
+    all = count == ws_client_count_;
+    portEXIT_CRITICAL(&ws_clients_mux_);
+
+    binary_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (out[i].binary) binary_count++;
+    }
+    return count;
+}
+
+void WebServer::sendSnapshot(AsyncWebSocketMessageBuffer* binary, JsonDocument* doc,
+                             const WSClientInfo* clients, size_t count, size_t binary_count, bool all) {
+    // JSON goes into one shared buffer too, instead of a String per update
+    AsyncWebSocketMessageBuffer* text = doc != nullptr ? makeJSONBuffer(*doc) : nullptr;
+
+    if (all && binary_count == count) {
+        if (binary != nullptr) ws_.binaryAll(binary);
+    } else if (all && binary_count == 0) {
+        if (text != nullptr) ws_.textAll(text);
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            AsyncWebSocketClient* client = ws_.client(clients[i].id);
+            if (client == nullptr || client->status() != WS_CONNECTED) continue;
+            if (clients[i].binary) {
+                if (binary != nullptr) client->binary(binary);
+            } else if (text != nullptr) {
+                client->text(text);
+            }
+        }
+    }
+    ws_messages_sent_++;
+}
+
 // Broadcasting
 void WebServer::broadcastBatteryUpdate() {
     if (ws_.count() == 0) return;
 
+    WSClientInfo clients[WS_MAX_CLIENTS];
+    size_t binary_count;
+    bool all;
+    size_t count = getWSClients(clients, WSProtocol::STREAM_BATTERY, binary_count, all);
+    if (count == 0) return;
+
+    AsyncWebSocketMessageBuffer* binary = binary_count > 0 ? buildBatteriesBinary() : nullptr;
+
+    if (binary_count == count) {
+        sendSnapshot(binary, nullptr, clients, count, binary_count, all);
+        return;
+    }
+
     JsonDocument doc;
     doc["type"] = "battery_update";
     buildAllBatteriesJSON(doc["data"].to<JsonObject>());
+    sendSnapshot(binary, &doc, clients, count, binary_count, all);
+}
 
-    String json;
-    serializeJson(doc, json);
-    ws_.textAll(json);
-    ws_messages_sent_++;
+AsyncWebSocketMessageBuffer* WebServer::buildBatteriesBinary() {
+    if (batteries_ == nullptr) return nullptr;
+
+    // Same content as buildAllBatteriesJSON(), from one consistent pass
+    BatterySnapshot packs[MAX_BATTERY_MODULES];
+    BatteryManager::Totals totals;
+    uint8_t active = batteries_->snapshotAll(packs, &totals);
+    uint32_t now = millis();
+
+    size_t size = WSProtocol::BATTERIES_HEADER_SIZE;
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < active; i++) {
+        if (packs[i].enabled) {
+            size += WSProtocol::BATTERY_ENTRY_SIZE + strnlen(batteries_->getBattery(i)->getName(), 255);
+            count++;
+        }
+    }
+
+    AsyncWebSocketMessageBuffer* buffer = ws_.makeBuffer(size);
+    if (!buffer) return nullptr;
+
+    uint8_t* out = buffer->get();
+    *out++ = WSProtocol::TYPE_BATTERIES;
+    *out++ = WSProtocol::VERSION;
+    *out++ = count;
+    *out++ = 0;
+    out = WSProtocol::putU32(out, now);
+    out = WSProtocol::putF32(out, totals.power);
+    out = WSProtocol::putF32(out, totals.current);
+    out = WSProtocol::putF32(out, totals.average_voltage);
+
+    for (uint8_t i = 0; i < active; i++) {
+        const BatterySnapshot& battery = packs[i];
+        if (!battery.enabled) continue;
+
+        const char* name = batteries_->getBattery(i)->getName();
+        size_t name_len = strnlen(name, 255);
+        *out++ = i;
+        *out++ = (battery.error ? WSProtocol::BATTERY_ERROR : 0) |
+                 (battery.has_can_data ? WSProtocol::BATTERY_HAS_CAN_DATA : 0) |
+                 (battery.isFresh(5000, now) ? WSProtocol::BATTERY_DATA_FRESH : 0);
+        *out++ = battery.soc;
+        *out++ = (uint8_t)name_len;
+        out = WSProtocol::putF32(out, battery.voltage);
+        out = WSProtocol::putF32(out, battery.current);
+        out = WSProtocol::putF32(out, battery.power());
+        out = WSProtocol::putF32(out, battery.temp1);
+        out = WSProtocol::putF32(out, battery.temp2);
+        memcpy(out, name, name_len);
+        out += name_len;
+    }
+
+    return buffer;
 }
 
 void WebServer::broadcastCANMessage(uint32_t id, uint8_t dlc, const uint8_t* data) {
-    if (ws_.count() == 0) return;
+    broadcastCANFrame(CANFrame::make(id, false, false, dlc, data, CANFrame::now()));
+}
+
+void WebServer::broadcastCANFrame(const CANFrame& frame) {
+    if (!isRunning() || ws_.count() == 0) return;
 
-    // Buffer the message for batch sending (flushed in loop() every 100ms)
-    // This prevents WebSocket queue overflow when many CAN messages arrive
-    // in a short burst, which causes the library to disconnect clients.
-    portENTER_CRITICAL(&can_batch_mux_);
-    if (can_batch_count_ < CAN_BATCH_MAX) {
-        CANBatchEntry& entry = can_batch_[can_batch_count_++];
-        entry.id = id;
-        entry.dlc = dlc > 8 ? 8 : dlc;
-        memcpy(entry.data, data, entry.dlc);
-        entry.timestamp = millis();
+    // Queue for the next flush (loop(), every 100 ms); a full ring means
+    // the flush is falling behind, which the UI is told about
+    if (!can_ring_.push(frame)) {
+        can_ring_dropped_.fetch_add(1, std::memory_order_relaxed);
     }
-    portEXIT_CRITICAL(&can_batch_mux_);
 }
 
 void WebServer::flushCANBatch() {
-    if (can_batch_count_ == 0 || ws_.count() == 0) return;
-
-    if (ESP.getFreeHeap() < 10000) {
-        // Drop batch under low memory
-        portENTER_CRITICAL(&can_batch_mux_);
-        can_batch_count_ = 0;
-        portEXIT_CRITICAL(&can_batch_mux_);
+    uint32_t ring_dropped = can_ring_dropped_.exchange(0, std::memory_order_relaxed);
+    can_frames_ += ring_dropped;
+    can_dropped_ += ring_dropped;
+
+    size_t pending = can_ring_.size();
+    if (ws_.count() == 0) {
+        can_ring_.clear();
+        can_latest_count_ = 0;
+        can_delivery_count_ = 0;
         return;
     }
+    can_frames_ += pending;
+    can_flush_++;
 
-    // Copy batch under lock, then release immediately
-    CANBatchEntry local_batch[CAN_BATCH_MAX];
-    size_t count;
-
-    portENTER_CRITICAL(&can_batch_mux_);
-    count = can_batch_count_;
-    if (count > 0) {
-        memcpy(local_batch, (const void*)can_batch_, count * sizeof(CANBatchEntry));
-        can_batch_count_ = 0;
+    // Everything updates the latest-per-ID table; the frames themselves
+    // are kept too when they fit one batch
+    bool batched = pending <= CAN_BATCH_FRAMES;
+    size_t batch_count = 0;
+    CANFrame frame;
+    PerfMonitor::Histogram& latency = perfMonitor.latency(PerfMonitor::Latency::WEBSOCKET);
+    for (size_t i = 0; i < pending && can_ring_.pop(frame); i++) {
+        if (batched) can_batch_[batch_count++] = frame;
+        foldCANFrame(frame);
+        latency.record(frame.ageUs());
     }
-    portEXIT_CRITICAL(&can_batch_mux_);
 
-    if (count == 0) return;
+    WSClientInfo clients[WS_MAX_CLIENTS];
+    size_t binary_count;
+    bool all;
+    size_t count = getWSClients(clients, WSProtocol::STREAM_CAN, binary_count, all);
+    syncCANDelivery(clients, count);
 
-    // Calculate exact buffer size
-    // Format: [type:1=0x02][count:1][entries...]
-    // Each entry: [id:4][dlc:1][data:0-8][timestamp:4]
-    size_t buf_size = 2;
+    // Who takes a message this flush
+    uint32_t now = millis();
+    AsyncWebSocketClient* targets[WS_MAX_CLIENTS];
     for (size_t i = 0; i < count; i++) {
-        buf_size += 4 + 1 + local_batch[i].dlc + 4;
+        CANDelivery& state = can_delivery_[i];
+        targets[i] = nullptr;
+        if (state.flush >= can_changed_flush_) {
+            state.flush = can_flush_;       // Nothing new for it
+        } else {
+            targets[i] = canTarget(clients[i], state, now);
+        }
     }
 
-    AsyncWebSocketMessageBuffer* buffer = ws_.makeBuffer(buf_size);
-    if (!buffer) return;
+    bool low_heap = ESP.getFreeHeap() < 10000;
+    for (size_t i = 0; i < count; i++) {
+        if (targets[i] == nullptr) continue;
+
+        const WSProtocol::CANSubscription& sub = clients[i].can;
+        uint32_t since = can_delivery_[i].flush;
+        bool unlimited = sub.interval_ms == 0;
+
+        // Every frame if the client has all earlier ones, else what changed
+        AsyncWebSocketMessageBuffer* buffer;
+        bool built = (batched && unlimited && since + 1 == can_flush_ && !low_heap)
+                         ? buildCANBatch(sub, batch_count, buffer)
+                         : buildCANSummary(sub, since, buffer);
+
+        // Clients at the same point with the same filters share it; on
+        // failure they stay behind and catch up with a later summary
+        for (size_t j = i; j < count; j++) {
+            CANDelivery& state = can_delivery_[j];
+            if (targets[j] == nullptr || state.flush != since ||
+                (clients[j].can.interval_ms == 0) != unlimited || !clients[j].can.sameFilters(sub)) {
+                continue;
+            }
+            if (built) {
+                if (buffer != nullptr) {
+                    targets[j]->binary(buffer);
+                    state.sent = true;
+                    state.sent_ms = now;
+                }
+                state.flush = can_flush_;
+            }
+            targets[j] = nullptr;
+        }
+        if (buffer != nullptr) ws_messages_sent_++;
+    }
+}
 
-    uint8_t* buf = buffer->get();
-    size_t offset = 0;
+void WebServer::foldCANFrame(const CANFrame& frame) {
+    uint32_t key = frame.id_flags & ~CANFrame::FLAG_SHORT;
+    can_changed_flush_ = can_flush_;
+
+    size_t oldest = 0;
+    for (size_t i = 0; i < can_latest_count_; i++) {
+        CANLatest& entry = can_latest_[i];
+        if ((entry.frame.id_flags & ~CANFrame::FLAG_SHORT) == key) {
+            entry.frame = frame;
+            entry.total++;
+            entry.flush = can_flush_;
+            return;
+        }
+        if (entry.flush < can_latest_[oldest].flush) oldest = i;
+    }
 
-    buf[offset++] = 0x02;  // Batch CAN message type
-    buf[offset++] = (uint8_t)count;
+    size_t slot = can_latest_count_;
+    if (slot < WS_CAN_DECIMATE_IDS) {
+        can_latest_count_++;
+    } else if (can_flush_ - can_latest_[oldest].flush >= CAN_ID_IDLE_FLUSHES) {
+        slot = oldest;      // Reuse an ID that went quiet
+    } else {
+        can_dropped_++;     // More active IDs than the table tracks
+        return;
+    }
+    can_latest_[slot].frame = frame;
+    can_latest_[slot].total = 1;
+    can_latest_[slot].flush = can_flush_;
+}
 
+void WebServer::syncCANDelivery(const WSClientInfo* clients, size_t count) {
+    // One state per CAN client, in the order of `clients`; a new client or
+    // a new subscription starts from flush 0 (a summary of everything)
+    CANDelivery states[WS_MAX_CLIENTS];
     for (size_t i = 0; i < count; i++) {
-        const CANBatchEntry& entry = local_batch[i];
+        CANDelivery& state = states[i];
+        state.client = clients[i].id;
+        state.generation = clients[i].generation;
+        state.sent = false;
+        state.flush = 0;
+        state.sent_ms = 0;
+        for (size_t j = 0; j < can_delivery_count_; j++) {
+            if (can_delivery_[j].client == state.client && can_delivery_[j].generation == state.generation) {
+                state = can_delivery_[j];
+                break;
+            }
+        }
+    }
+    memcpy(can_delivery_, states, count * sizeof(CANDelivery));
+    can_delivery_count_ = count;
+}
+
+AsyncWebSocketClient* WebServer::canTarget(const WSClientInfo& info, const CANDelivery& state, uint32_t now) {
+    if (state.sent && info.can.interval_ms > 0 && now - state.sent_ms < info.can.interval_ms) {
+        return nullptr;
+    }
+    AsyncWebSocketClient* client = ws_.client(info.id);
+    if (client == nullptr || client->status() != WS_CONNECTED || client->queueIsFull()) {
+        return nullptr;
+    }
+    return client;
+}
 
-        buf[offset++] = (entry.id >> 0) & 0xFF;
-        buf[offset++] = (entry.id >> 8) & 0xFF;
-        buf[offset++] = (entry.id >> 16) & 0xFF;
-        buf[offset++] = (entry.id >> 24) & 0xFF;
+bool WebServer::buildCANBatch(const WSProtocol::CANSubscription& sub, size_t count,
+                              AsyncWebSocketMessageBuffer*& out) {
+    out = nullptr;
 
-        buf[offset++] = entry.dlc;
-        memcpy(buf + offset, entry.data, entry.dlc);
-        offset += entry.dlc;
+    size_t size = WSProtocol::canBatchSize(sub, can_batch_, count);
+    if (size == 0) return true;
 
-        buf[offset++] = (entry.timestamp >> 0) & 0xFF;
-        buf[offset++] = (entry.timestamp >> 8) & 0xFF;
-        buf[offset++] = (entry.timestamp >> 16) & 0xFF;
-        buf[offset++] = (entry.timestamp >> 24) & 0xFF;
+    AsyncWebSocketMessageBuffer* buffer = ws_.makeBuffer(size);
+    if (!buffer) return false;
+
+    WSProtocol::encodeCANBatch(sub, can_batch_, count, buffer->get());
+    out = buffer;
+    return true;
+}
+
+bool WebServer::buildCANSummary(const WSProtocol::CANSubscription& sub, uint32_t since,
+                                AsyncWebSocketMessageBuffer*& out) {
+    out = nullptr;
+
+    size_t entries = 0;
+    size_t size = WSProtocol::CAN_SUMMARY_HEADER_SIZE;
+    for (size_t i = 0; i < can_latest_count_; i++) {
+        const CANLatest& entry = can_latest_[i];
+        if (entry.flush > since && sub.matches(entry.frame.id())) {
+            size += WSProtocol::CAN_SUMMARY_ENTRY_SIZE + entry.frame.dlc();
+            entries++;
+        }
     }
+    if (entries == 0) return true;
 
-    ws_.binaryAll(buffer);
-    ws_messages_sent_++;
+    AsyncWebSocketMessageBuffer* buffer = ws_.makeBuffer(size);
+    if (!buffer) return false;
+
+    uint8_t* p = buffer->get();
+    *p++ = WSProtocol::TYPE_CAN_SUMMARY;
+    *p++ = WSProtocol::CAN_SUMMARY_VERSION;
+    *p++ = (uint8_t)entries;
+    *p++ = 0;
+    p = WSProtocol::putU32(p, can_frames_);
+    p = WSProtocol::putU32(p, can_dropped_);
+
+    for (size_t i = 0; i < can_latest_count_; i++) {
+        const CANLatest& entry = can_latest_[i];
+        if (entry.flush <= since || !sub.matches(entry.frame.id())) continue;
+        uint8_t dlc = entry.frame.dlc();
+        p = WSProtocol::putU32(p, entry.frame.id());
+        *p++ = dlc;
+        memcpy(p, entry.frame.data, dlc);
+        p += dlc;
+        p = WSProtocol::putU32(p, entry.frame.timestampMs());
+        p = WSProtocol::putU32(p, entry.total);
+    }
+
+    out = buffer;
+    return true;
 }
 
 void WebServer::broadcastSystemStatus() {
     if (ws_.count() == 0) return;
 
+    WSClientInfo clients[WS_MAX_CLIENTS];
+    size_t binary_count;
+    bool all;
+    size_t count = getWSClients(clients, WSProtocol::STREAM_SYSTEM, binary_count, all);
+    if (count == 0) return;
+
+    AsyncWebSocketMessageBuffer* binary = binary_count > 0 ? buildSystemBinary() : nullptr;
+
+    if (binary_count == count) {
+        sendSnapshot(binary, nullptr, clients, count, binary_count, all);
+        return;
+    }
+
     JsonDocument doc;
     doc["type"] = "system_status";
     buildSystemJSON(doc["data"].to<JsonObject>());
+    sendSnapshot(binary, &doc, clients, count, binary_count, all);
+}
 
-    String json;
-    serializeJson(doc, json);
-    ws_.textAll(json);
-    ws_messages_sent_++;
+AsyncWebSocketMessageBuffer* WebServer::buildSystemBinary() {
+    // The changing part of buildSystemJSON(); chip and SDK details only come
+    // with the JSON status sent on connect. The SSID is the configured one
+    // (WiFi.SSID() would allocate a String).
+    bool connected = WiFi.status() == WL_CONNECTED;
+    const char* ssid = (connected && settings_ != nullptr) ? settings_->getSettings().wifi_ssid : "";
+    size_t ssid_len = strnlen(ssid, 32);
+
+    AsyncWebSocketMessageBuffer* buffer = ws_.makeBuffer(WSProtocol::SYSTEM_SIZE + ssid_len);
+    if (!buffer) return nullptr;
+
+    uint32_t can_messages = 0;
+    uint32_t can_dropped = 0;
+    CANLoggerStats log_stats;
+    if (can_logger_ != nullptr) {
+        can_messages = can_logger_->getMessageCount();
+        can_dropped = can_logger_->getDroppedCount();
+        log_stats = can_logger_->getStats();
+    }
+
+    uint8_t* out = buffer->get();
+    *out++ = WSProtocol::TYPE_SYSTEM;
+    *out++ = WSProtocol::VERSION;
+    *out++ = connected ? WSProtocol::SYSTEM_WIFI_CONNECTED : 0;
+    *out++ = (uint8_t)(int8_t)(connected ? WiFi.RSSI() : 0);
+    out = WSProtocol::putU32(out, millis());
+    out = WSProtocol::putU32(out, ESP.getFreeHeap());
+    out = WSProtocol::putU32(out, ESP.getMinFreeHeap());
+    out = WSProtocol::putU32(out, can_messages);
+    out = WSProtocol::putU32(out, can_dropped);
+    out = WSProtocol::putU32(out, log_stats.bytes_per_sec);
+    out = WSProtocol::putU32(out, log_stats.last_flush_us);
+    out = WSProtocol::putU32(out, request_count_);
+    out = WSProtocol::putU32(out, ws_messages_sent_);
+
+    IPAddress ip = connected ? WiFi.localIP() : IPAddress(0, 0, 0, 0);
+    for (uint8_t i = 0; i < 4; i++) {
+        *out++ = ip[i];
+    }
+    *out++ = (uint8_t)ws_.count();
+    WSProtocol::putString(out, ssid, ssid_len);
+
+    return buffer;
 }
 
 void WebServer::broadcastText(const char* message) {
@@ -992,7 +1995,14 @@ void WebServer::broadcastText(const char* message) {
 }
 
 void WebServer::broadcastLog(const LogEntry& entry) {
-    if (ws_.count() == 0) return;
+    if (!isRunning() || ws_.count() == 0) return;
+
+    // Logs are JSON for every client
+    WSClientInfo clients[WS_MAX_CLIENTS];
+    size_t binary_count;
+    bool all;
+    size_t count = getWSClients(clients, WSProtocol::STREAM_LOGS, binary_count, all);
+    if (count == 0) return;
 
     JsonDocument doc;
     doc["type"] = "log";
@@ -1000,10 +2010,24 @@ void WebServer::broadcastLog(const LogEntry& entry) {
     doc["level"] = RemoteLogger::levelToString(entry.level);
     doc["msg"] = entry.message;
 
-    String json;
-    serializeJson(doc, json);
-    ws_.textAll(json);
-    ws_messages_sent_++;
+    sendSnapshot(nullptr, &doc, clients, count, 0, all);
+}
+
+void WebServer::broadcastPerf() {
+    if (ws_.count() == 0) return;
+
+    // Opt-in stream, JSON for every client like logs
+    WSClientInfo clients[WS_MAX_CLIENTS];
+    size_t binary_count;
+    bool all;
+    size_t count = getWSClients(clients, WSProtocol::STREAM_PERF, binary_count, all);
+    if (count == 0) return;
+
+    JsonDocument doc;
+    doc["type"] = "perf";
+    buildPerfJSON(doc["data"].to<JsonObject>());
+
+    sendSnapshot(nullptr, &doc, clients, count, 0, all);
 }
 
 void WebServer::sendLogHistory(AsyncWebSocketClient* client) {
@@ -1040,14 +2064,13 @@ void WebServer::sendLogHistory(AsyncWebSocketClient* client) {
             entry["msg"] = logs[i].message;
         }
 
-        String json;
-        serializeJson(doc, json);
-
-        // Check if the message is too large before sending
-        if (json.length() < 4096) {  // Limit to 4KB
-            client->text(json);
+        // Check if the message is too large before sending (limit to 4KB)
+        AsyncWebSocketMessageBuffer* buffer = makeJSONBuffer(doc, 4095);
+        if (buffer != nullptr) {
+            client->text(buffer);
         } else {
-            LOG_WARN("[WebSocket] Log history too large (%d bytes), skipping", json.length());
+            LOG_WARN("[WebSocket] Log history too large (%u bytes) or out of memory, skipping",
+                     (unsigned)measureJson(doc));
         }
     }
 
@@ -1059,9 +2082,12 @@ uint32_t WebServer::getWSClientCount() const {
 }
 
 void WebServer::loop() {
+    if (!isRunning()) {
+        return;
+    }
     uint32_t now = millis();
 
-    // Flush batched CAN messages every 100ms as a single WebSocket frame
+    // Flush queued CAN frames every 100ms (one batch or one per-ID summary)
     if (now - last_can_flush_ >= 100) {
         flushCANBatch();
         last_can_flush_ = now;
@@ -1091,55 +2117,82 @@ void WebServer::buildStatusJSON(JsonObject obj) {
 void WebServer::buildBatteryJSON(JsonObject obj, uint8_t id) {
     if (batteries_ == nullptr || id >= MAX_BATTERY_MODULES) return;
 
-    const BatteryModule* battery = batteries_->getBattery(id);
-    if (battery == nullptr) return;
+    const BatteryModule* module = batteries_->getBattery(id);
+    if (module == nullptr) return;
 
+    BatterySnapshot battery = module->snapshot();
     obj["id"] = id;
-    obj["name"] = battery->getName();
-    obj["enabled"] = battery->isEnabled();
-    obj["voltage"] = battery->getVoltage();
-    obj["current"] = battery->getCurrent();
-    obj["power"] = battery->getPower();
-    obj["soc"] = battery->getSOC();
-    obj["temp1"] = battery->getTemp1();
-    obj["temp2"] = battery->getTemp2();
-    obj["status_flags"] = battery->getStatusFlags();
-    obj["pack_identifier"] = battery->getPackIdentifier();
-    obj["has_can_data"] = battery->hasCANData();
-    obj["has_error"] = battery->hasError();
-    obj["last_update"] = battery->getLastUpdate();
-    obj["data_fresh"] = battery->isDataFresh(5000);
+    obj["name"] = module->getName();
+    obj["enabled"] = battery.enabled;
+    obj["voltage"] = battery.voltage;
+    obj["current"] = battery.current;
+    obj["power"] = battery.power();
+    obj["soc"] = battery.soc;
+    obj["temp1"] = battery.temp1;
+    obj["temp2"] = battery.temp2;
+    obj["status_flags"] = battery.status_flags;
+    obj["pack_identifier"] = battery.pack_identifier;
+    obj["has_can_data"] = battery.has_can_data;
+    obj["has_error"] = battery.error;
+    obj["last_update"] = battery.last_update;
+    obj["data_fresh"] = battery.isFresh(5000, millis());
 }
 
-void WebServer::buildAllBatteriesJSON(JsonObject obj) {
+void WebServer::buildBatteryStatsJSON(JsonObject obj) {
     if (batteries_ == nullptr) return;
 
     JsonArray arr = obj["batteries"].to<JsonArray>();
-    float total_power = 0;
-    float total_current = 0;
-
     for (uint8_t i = 0; i < batteries_->getActiveBatteryCount(); i++) {
-        const BatteryModule* battery = batteries_->getBattery(i);
-        if (battery != nullptr && battery->isEnabled()) {
+        BatteryStats stats;
+        if (!batteries_->getStats(i, stats)) continue;
+
+        JsonObject battObj = arr.add<JsonObject>();
+        battObj["id"] = i;
+        battObj["samples"] = stats.samples;
+        battObj["voltage_samples"] = stats.voltage_samples;
+        battObj["current_samples"] = stats.current_samples;
+        battObj["duration_s"] = static_cast<uint32_t>(stats.integrated_ms / 1000);
+        battObj["voltage_min"] = stats.voltage_min;
+        battObj["voltage_max"] = stats.voltage_max;
+        battObj["voltage_mean"] = stats.voltageMean();
+        battObj["current_min"] = stats.current_min;
+        battObj["current_max"] = stats.current_max;
+        battObj["current_mean"] = stats.currentMean();
+        battObj["peak_current"] = stats.peakCurrent();
+        battObj["discharge_ah"] = stats.dischargeAh();
+        battObj["charge_ah"] = stats.chargeAh();
+        battObj["discharge_wh"] = stats.dischargeWh();
+        battObj["charge_wh"] = stats.chargeWh();
+    }
+}
+
+void WebServer::buildAllBatteriesJSON(JsonObject obj) {
+    if (batteries_ == nullptr) return;
+
+    BatterySnapshot packs[MAX_BATTERY_MODULES];
+    BatteryManager::Totals totals;
+    uint8_t active = batteries_->snapshotAll(packs, &totals);
+
+    JsonArray arr = obj["batteries"].to<JsonArray>();
+    for (uint8_t i = 0; i < active; i++) {
+        const BatterySnapshot& battery = packs[i];
+        if (battery.enabled) {
             JsonObject battObj = arr.add<JsonObject>();
             battObj["id"] = i;
-            battObj["name"] = battery->getName();
-            battObj["voltage"] = battery->getVoltage();
-            battObj["current"] = battery->getCurrent();
-            battObj["power"] = battery->getPower();
-            battObj["soc"] = battery->getSOC();
-            battObj["temp1"] = battery->getTemp1();
-            battObj["temp2"] = battery->getTemp2();
-            battObj["has_error"] = battery->hasError();
-
-            total_power += battery->getPower();
-            total_current += battery->getCurrent();
+            battObj["name"] = batteries_->getBattery(i)->getName();
+            battObj["voltage"] = battery.voltage;
+            battObj["current"] = battery.current;
+            battObj["power"] = battery.power();
+            battObj["soc"] = battery.soc;
+            battObj["temp1"] = battery.temp1;
+            battObj["temp2"] = battery.temp2;
+            battObj["has_error"] = battery.error;
         }
     }
 
-    obj["total_power"] = total_power;
-    obj["total_current"] = total_current;
-    obj["average_voltage"] = batteries_->getAverageVoltage();
+    obj["total_power"] = totals.power;
+    obj["total_current"] = totals.current;
+    obj["average_voltage"] = totals.average_voltage;
     obj["timestamp"] = millis();
 }
 
@@ -1166,6 +2219,16 @@ void WebServer::buildConfigJSON(JsonObject obj) {
     obj["can_bitrate"] = settings.can_bitrate;
     obj["can_log_enabled"] = settings.can_log_enabled;
     obj["mqtt_canmsg_enabled"] = settings.mqtt_canmsg_enabled;
+    obj["mqtt_can_format"] = static_cast<uint8_t>(settings.mqtt_can_format);
+    obj["mqtt_can_batch_ms"] = settings.mqtt_can_batch_ms;
+    obj["mqtt_can_batch_bytes"] = settings.mqtt_can_batch_bytes;
+
+    // Report-by-exception battery telemetry
+    obj["mqtt_deadband_voltage"] = settings.mqtt_deadband.voltage;
+    obj["mqtt_deadband_current"] = settings.mqtt_deadband.current;
+    obj["mqtt_deadband_soc"] = settings.mqtt_deadband.soc;
+    obj["mqtt_deadband_temp"] = settings.mqtt_deadband.temp;
+    obj["mqtt_heartbeat_s"] = settings.mqtt_deadband.heartbeat_s;
 
     // Batteries
     obj["num_batteries"] = settings.num_batteries;
@@ -1205,6 +2268,15 @@ void WebServer::buildSystemJSON(JsonObject obj) {
     if (can_logger_ != nullptr) {
         obj["can_message_count"] = can_logger_->getMessageCount();
         obj["can_dropped_count"] = can_logger_->getDroppedCount();
+
+        CANLoggerStats log_stats = can_logger_->getStats();
+        obj["can_log_flush_us"] = log_stats.last_flush_us;
+        obj["can_log_flush_max_us"] = log_stats.max_flush_us;
+        obj["can_log_bytes_per_sec"] = log_stats.bytes_per_sec;
+        if (log_stats.bytes_written > 0 && log_stats.record_bytes > 0) {
+            // Record bytes per byte on flash (1.0 when not compressing)
+            obj["can_log_compression"] = (float)log_stats.record_bytes / log_stats.bytes_written;
+        }
     } else {
         obj["can_message_count"] = 0;
         obj["can_dropped_count"] = 0;
@@ -1214,18 +2286,59 @@ void WebServer::buildSystemJSON(JsonObject obj) {
     obj["http_requests"] = request_count_;
     obj["ws_clients"] = ws_.count();
     obj["ws_messages_sent"] = ws_messages_sent_;
+    obj["ws_can_frames"] = can_frames_;
+    obj["ws_can_dropped"] = can_dropped_;
+
+    BufferPool::Stats pool;
+    json_pool_.getStats(pool);
+    obj["json_pool_hits"] = pool.hits;
+    obj["json_pool_misses"] = pool.misses;
+    obj["json_pool_peak"] = pool.peak_size;
+    obj["json_pool_bytes"] = pool.pooled_bytes;
+
+    // MQTT link and store-and-forward backlog
+    MQTTOfflineQueue::Stats queue;
+    mqttClient.getQueueStats(queue);
+    obj["mqtt_connected"] = mqttClient.getState() == MQTTState::CONNECTED;
+    obj["mqtt_queue_depth"] = queue.depth;
+    obj["mqtt_queue_ram_bytes"] = queue.ram_bytes;
+    obj["mqtt_queue_flash_bytes"] = queue.flash_bytes;
+    obj["mqtt_queue_dropped"] = queue.dropped;
+    obj["mqtt_replayed"] = queue.replayed;
+    obj["mqtt_replay_rate"] = mqttClient.getReplayRate();
 }
 
 // Utility functions
 void WebServer::sendJSON(AsyncWebServerRequest* request, JsonDocument& doc, int code) {
-    String json;
-    serializeJson(doc, json);
+    // Serialized into a pooled buffer that the response sends from directly
+    // (beginResponse_P only memcpy()s on ESP32, RAM is fine); the buffer
+    // goes back to the pool once the request is gone
+    size_t len = measureJson(doc);
+    uint8_t* buffer = json_pool_.acquire(len + 1);
+    if (buffer == nullptr) {
+        request->send(503, "text/plain", "Out of memory");
+        return;
+    }
+    serializeJson(doc, (char*)buffer, len + 1);
+    request->onDisconnect([this, buffer]() { json_pool_.release(buffer); });
 
-    AsyncWebServerResponse* response = request->beginResponse(code, "application/json", json);
+    AsyncWebServerResponse* response = request->beginResponse_P(code, "application/json", buffer, len);
     response->addHeader("Access-Control-Allow-Origin", "*");
     request->send(response);
 }
 
+AsyncWebSocketMessageBuffer* WebServer::makeJSONBuffer(JsonDocument& doc, size_t max_len) {
+    size_t len = measureJson(doc);
+    if (len > max_len) return nullptr;
+
+    // makeBuffer() leaves room for the terminator serializeJson() writes
+    AsyncWebSocketMessageBuffer* buffer = ws_.makeBuffer(len);
+    if (buffer != nullptr) {
+        serializeJson(doc, (char*)buffer->get(), len + 1);
+    }
+    return buffer;
+}
+
 void WebServer::sendError(AsyncWebServerRequest* request, int code, const char* message) {
     JsonDocument doc;
     doc["error"] = true;
@@ -1233,3 +2346,71 @@ void WebServer::sendError(AsyncWebServerRequest* request, int code, const char*
     doc["message"] = message;
     sendJSON(request, doc, code);
 }
+
+void WebServer::buildPerfJSON(JsonObject obj) {
+    uint32_t now = millis();
+    obj["uptime_ms"] = now;
+    obj["sample_age_ms"] = now - perfMonitor.getSampleTime();
+    obj["cpu_stats"] = perfMonitor.hasCPUStats();
+
+    PerfMonitor::TaskInfo tasks[PerfMonitor::MAX_TASKS];
+    size_t count = perfMonitor.getTasks(tasks, PerfMonitor::MAX_TASKS);
+    JsonArray task_arr = obj["tasks"].to<JsonArray>();
+    for (size_t i = 0; i < count; i++) {
+        JsonObject task = task_arr.add<JsonObject>();
+        task["name"] = tasks[i].name;
+        task["stack_free"] = tasks[i].stack_free;
+        if (tasks[i].cpu_percent >= 0.0f) {
+            task["cpu"] = roundf(tasks[i].cpu_percent * 10.0f) / 10.0f;    // % of one core
+        }
+    }
+
+    PerfMonitor::QueueInfo queues[PerfMonitor::MAX_QUEUES];
+    count = perfMonitor.getQueues(queues, PerfMonitor::MAX_QUEUES);
+    JsonArray queue_arr = obj["queues"].to<JsonArray>();
+    for (size_t i = 0; i < count; i++) {
+        JsonObject queue = queue_arr.add<JsonObject>();
+        queue["name"] = queues[i].name;
+        queue["depth"] = queues[i].depth;
+        queue["capacity"] = queues[i].capacity;
+        queue["high_water"] = queues[i].high_water;
+    }
+
+    // Latency from frame receipt, in microseconds; percentiles are bucket
+    // upper bounds (powers of two)
+    JsonObject latency = obj["latency"].to<JsonObject>();
+    for (uint8_t i = 0; i < static_cast<uint8_t>(PerfMonitor::Latency::COUNT); i++) {
+        PerfMonitor::Latency which = static_cast<PerfMonitor::Latency>(i);
+        const PerfMonitor::Histogram& histogram = perfMonitor.latency(which);
+        JsonObject entry = latency[PerfMonitor::latencyName(which)].to<JsonObject>();
+        entry["count"] = histogram.count();
+        entry["max_us"] = histogram.maxUs();
+        entry["p50_us"] = histogram.percentileUs(0.50f);
+        entry["p90_us"] = histogram.percentileUs(0.90f);
+        entry["p99_us"] = histogram.percentileUs(0.99f);
+        JsonArray buckets = entry["buckets"].to<JsonArray>();
+        for (uint8_t b = 0; b < PerfMonitor::LATENCY_BUCKETS; b++) {
+            buckets.add(histogram.bucket(b));
+        }
+    }
+
+    // millis() at each startup milestone (null = not reached yet)
+    JsonObject boot = obj["boot_ms"].to<JsonObject>();
+    for (uint8_t i = 0; i < static_cast<uint8_t>(PerfMonitor::BootPhase::COUNT); i++) {
+        PerfMonitor::BootPhase phase = static_cast<PerfMonitor::BootPhase>(i);
+        uint32_t at = perfMonitor.getBootTime(phase);
+        if (at > 0) {
+            boot[PerfMonitor::bootPhaseName(phase)] = at;
+        } else {
+            boot[PerfMonitor::bootPhaseName(phase)] = nullptr;
+        }
+    }
+
+    PerfMonitor::HeapInfo heap;
+    perfMonitor.getHeap(heap);
+    JsonObject heap_obj = obj["heap"].to<JsonObject>();
+    heap_obj["free"] = heap.free;
+    heap_obj["min_free"] = heap.min_free;
+    heap_obj["largest_block"] = heap.largest_block;
+    heap_obj["fragmentation"] = heap.fragmentation;
+}
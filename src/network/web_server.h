@@ -5,12 +5,19 @@
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
 #include <functional>
+#include <memory>
 #include "../utils/remote_log.h"
+#include "../can/can_message.h"
+#include "../utils/spsc_queue.h"
+#include "../utils/buffer_pool.h"
+#include "ws_protocol.h"
+#include "../config/config.h"
 
 // Forward declarations
 class SettingsManager;
 class BatteryManager;
 class CANLogger;
+struct CANLogExportCursor;
 namespace Protocol {
     class Loader;
 }
@@ -38,12 +45,20 @@ public:
     // Stop the server
     void stop();
 
+    // True between begin() and stop(); begin() runs in the network task
+    // while loop() and the frame consumers may already be calling in
+    bool isRunning() const { return running_.load(std::memory_order_acquire); }
+
     // WebSocket broadcasting
     void broadcastBatteryUpdate();
-    void broadcastCANMessage(uint32_t id, uint8_t dlc, const uint8_t* data);
+    // CAN frames for the live view; call from one task only (the "web"
+    // frame-bus consumer)
+    void broadcastCANFrame(const CANFrame& frame);
+    void broadcastCANMessage(uint32_t id, uint8_t dlc, const uint8_t* data);  // Standard ID frame
     void broadcastSystemStatus();
     void broadcastText(const char* message);
     void broadcastLog(const LogEntry& entry);
+    void broadcastPerf();       // "perf" subscribers only (network task)
 
     // Send log history to a specific client (on connect)
     void sendLogHistory(AsyncWebSocketClient* client);
@@ -60,6 +75,9 @@ public:
     // Statistics
     uint32_t getRequestCount() const { return request_count_; }
     uint32_t getWSMessagesSent() const { return ws_messages_sent_; }
+    size_t getCANRingDepth() const { return can_ring_.size(); }
+    size_t getCANRingHighWater() const { return can_ring_.highWater(); }
+    uint32_t getCANDropped() const { return can_dropped_; }     // Ring drops folded in per flush
 
 private:
     AsyncWebServer server_;
@@ -77,21 +95,87 @@ private:
     uint32_t ws_messages_sent_;
     uint32_t last_ws_cleanup_;  // For periodic cleanup/ping
 
-    // CAN message batching - buffer messages and flush periodically
-    // to reduce WebSocket frame count and prevent queue overflow disconnects
-    static constexpr size_t CAN_BATCH_MAX = 25;
-    struct CANBatchEntry {
+    BufferPool json_pool_;      // Serialized HTTP JSON responses
+
+    // Connected WebSocket clients, the format each asked for (JSON until it
+    // negotiates binary) and what it subscribed to (see ws_protocol.h).
+    // Written by the AsyncTCP task.
+    static constexpr size_t WS_MAX_CLIENTS = 5;
+    struct WSClientInfo {
         uint32_t id;
-        uint32_t timestamp;
-        uint8_t dlc;
-        uint8_t data[8];
+        bool binary;
+        uint8_t streams;                // WSProtocol::STREAM_* bits
+        uint16_t generation;            // Bumped by every subscribe
+        WSProtocol::CANSubscription can;
+    };
+    WSClientInfo ws_clients_[WS_MAX_CLIENTS];
+    size_t ws_client_count_;
+    portMUX_TYPE ws_clients_mux_;
+
+    void addWSClient(uint32_t id);
+    void removeWSClient(uint32_t id);
+    void setWSClientBinary(uint32_t id, bool binary);
+    void setWSClientSubscription(uint32_t id, uint8_t streams, const WSProtocol::CANSubscription& can);
+    void handleWSCommand(AsyncWebSocketClient* client, const char* text, size_t len);
+
+    // Clients subscribed to `stream`; `all` is set when that is every client.
+    // sendSnapshot() sends `binary` to the binary ones and `doc` to the
+    // others (either may be null if no client needs it), one shared buffer
+    // per format.
+    size_t getWSClients(WSClientInfo* out, uint8_t stream, size_t& binary_count, bool& all);
+    void sendSnapshot(AsyncWebSocketMessageBuffer* binary, JsonDocument* doc,
+                      const WSClientInfo* clients, size_t count, size_t binary_count, bool all);
+    AsyncWebSocketMessageBuffer* buildBatteriesBinary();
+    AsyncWebSocketMessageBuffer* buildSystemBinary();
+
+    // CAN live view. broadcastCANFrame() queues frames in a lock-free ring
+    // that loop() drains every 100 ms into a table of the latest frame per
+    // ID. A client that had every earlier frame, isn't rate limited and has
+    // room in its send queue gets all new frames matching its filters
+    // (type 0x02) when they fit one batch of WS_CAN_BATCH_BYTES. Any other
+    // client gets, once it is due and has room, the table entries that
+    // changed since its previous message (type 0x05), so a slow or
+    // congested client catches up instead of losing IDs. Clients with the
+    // same filters at the same point share one encoded message.
+    static constexpr size_t CAN_BATCH_FRAMES = (WS_CAN_BATCH_BYTES - 2) / (4 + 1 + 8 + 4);
+    static constexpr uint32_t CAN_ID_IDLE_FLUSHES = 50;    // Table entry may be reused after 5 s
+    static_assert(CAN_BATCH_FRAMES <= 255 && WS_CAN_DECIMATE_IDS <= 255,
+                  "CAN batch and summary counts are one byte");
+    struct CANLatest {
+        CANFrame frame;
+        uint32_t total;         // Frames of this ID since it entered the table
+        uint32_t flush;         // Flush that last updated it
+    };
+    struct CANDelivery {        // Per client, loop() only
+        uint32_t client;
+        uint16_t generation;    // Subscription this state belongs to
+        bool sent;
+        uint32_t flush;         // Newest flush the client has every change of
+        uint32_t sent_ms;       // Last CAN message, for max_rate
     };
-    CANBatchEntry can_batch_[CAN_BATCH_MAX];
-    volatile size_t can_batch_count_;
+    SpscQueue<CANFrame, WS_CAN_RING_SIZE> can_ring_;
+    CANFrame can_batch_[CAN_BATCH_FRAMES];          // Frames of this flush (loop() only)
+    CANLatest can_latest_[WS_CAN_DECIMATE_IDS];
+    size_t can_latest_count_;
+    CANDelivery can_delivery_[WS_MAX_CLIENTS];
+    size_t can_delivery_count_;
+    uint32_t can_flush_;            // Flush counter
+    uint32_t can_changed_flush_;    // Last flush that changed the table
+    std::atomic<uint32_t> can_ring_dropped_;    // Frames rejected by the full ring
+    std::atomic<bool> running_;
+    uint32_t can_frames_;       // Frames queued for the live view
+    uint32_t can_dropped_;      // Frames lost to a full ring or ID table
     uint32_t last_can_flush_;
-    portMUX_TYPE can_batch_mux_;
 
     void flushCANBatch();
+    void foldCANFrame(const CANFrame& frame);
+    void syncCANDelivery(const WSClientInfo* clients, size_t count);
+    AsyncWebSocketClient* canTarget(const WSClientInfo& info, const CANDelivery& state, uint32_t now);
+    // Both set `out` to null when no frame matches; false if out of memory
+    bool buildCANBatch(const WSProtocol::CANSubscription& sub, size_t count,
+                       AsyncWebSocketMessageBuffer*& out);
+    bool buildCANSummary(const WSProtocol::CANSubscription& sub, uint32_t since,
+                         AsyncWebSocketMessageBuffer*& out);
 
     // Setup handlers
     void setupStaticFiles();
@@ -102,16 +186,29 @@ private:
     void handleGetStatus(AsyncWebServerRequest* request);
     void handleGetBatteries(AsyncWebServerRequest* request);
     void handleGetBattery(AsyncWebServerRequest* request, uint8_t id);
+    void handleGetHistory(AsyncWebServerRequest* request);
     void handleGetCANLog(AsyncWebServerRequest* request);
     void handleDownloadCANLog(AsyncWebServerRequest* request);
+    void handleExportCANLog(AsyncWebServerRequest* request);
     void handleClearCANLog(AsyncWebServerRequest* request);
     void handleGetConfig(AsyncWebServerRequest* request);
     void handlePostConfig(AsyncWebServerRequest* request, uint8_t* data, size_t len);
     void handlePostBatteryConfig(AsyncWebServerRequest* request, uint8_t id, uint8_t* data, size_t len);
+    void handleGetBatteryStats(AsyncWebServerRequest* request);
+    void handleResetBatteryStats(AsyncWebServerRequest* request, uint8_t id);
     void handleCalibrate(AsyncWebServerRequest* request, uint8_t id);
     void handleReset(AsyncWebServerRequest* request);
     void handleGetLogs(AsyncWebServerRequest* request);
     void handleGetCANDiagnostics(AsyncWebServerRequest* request);
+    void handleGetPerf(AsyncWebServerRequest* request);
+    void handleGetCANValues(AsyncWebServerRequest* request);
+    void handleGetCANAnalytics(AsyncWebServerRequest* request);
+    void handleResetCANAnalytics(AsyncWebServerRequest* request);
+    void handleGetCANFilter(AsyncWebServerRequest* request);
+    void handlePostCANPromiscuous(AsyncWebServerRequest* request, uint8_t* data, size_t len);
+    void handleGetCANLoadTest(AsyncWebServerRequest* request);
+    void handlePostCANLoadTest(AsyncWebServerRequest* request, uint8_t* data, size_t len);
+    void handleStopCANLoadTest(AsyncWebServerRequest* request);
     void handleNotFound(AsyncWebServerRequest* request);
 
     // Protocol API handlers
@@ -132,12 +229,19 @@ private:
     void buildStatusJSON(JsonObject obj);
     void buildBatteryJSON(JsonObject obj, uint8_t id);
     void buildAllBatteriesJSON(JsonObject obj);
+    void buildBatteryStatsJSON(JsonObject obj);
     void buildConfigJSON(JsonObject obj);
     void buildSystemJSON(JsonObject obj);
+    void buildPerfJSON(JsonObject obj);
 
     // Utility
     void sendJSON(AsyncWebServerRequest* request, JsonDocument& doc, int code = 200);
+    // `doc` serialized straight into a WebSocket text buffer (null if out of
+    // memory or longer than max_len)
+    AsyncWebSocketMessageBuffer* makeJSONBuffer(JsonDocument& doc, size_t max_len = SIZE_MAX);
     void sendError(AsyncWebServerRequest* request, int code, const char* message);
+    void sendCANLogStream(AsyncWebServerRequest* request, std::shared_ptr<CANLogExportCursor> cursor,
+                          bool raw, const char* filename);
 };
 
 // Global instance
@@ -0,0 +1,175 @@
+#ifndef WS_PROTOCOL_H
+#define WS_PROTOCOL_H
+
+#include <stdint.h>
+#include <string.h>
+#include "../can/can_message.h"
+
+// Binary WebSocket messages sent to /ws clients.
+//
+// Every message starts with a type byte. Battery and system messages follow
+// it with a layout version, so the UI can reject layouts it doesn't know.
+// Clients receive JSON text messages until they send
+//
+//   {"cmd":"format","format":"binary","version":1}
+//
+// after which battery updates and system status arrive in binary (log
+// messages stay JSON). CAN batches are binary for every client.
+// All multi-byte values are little-endian, floats are IEEE 754 single.
+//
+// Clients get every stream but "perf" (once per perf sample, JSON) until
+// they pick some with
+//
+//   {"cmd":"subscribe","streams":["battery","system","logs","can","perf"],
+//    "can":{"filters":[{"id":853,"mask":2047}],"max_rate":5}}
+//
+// A CAN frame matches a filter when (id & mask) == (filter id & mask); the
+// mask defaults to all 29 ID bits, and no filters means every ID. max_rate
+// caps CAN messages per second (0 = one per flush, 10 per second). The
+// first CAN message after a subscribe is a summary of the latest frame of
+// every matching ID.
+namespace WSProtocol {
+
+constexpr uint8_t TYPE_CAN_MESSAGE = 0x01;    // Single frame (legacy)
+constexpr uint8_t TYPE_CAN_BATCH = 0x02;      // count, then per frame: id u32, dlc, data, timestamp u32
+constexpr uint8_t TYPE_BATTERIES = 0x03;      // See below
+constexpr uint8_t TYPE_SYSTEM = 0x04;         // See below
+constexpr uint8_t TYPE_CAN_SUMMARY = 0x05;    // See below
+
+constexpr uint8_t VERSION = 1;
+constexpr uint8_t CAN_SUMMARY_VERSION = 2;
+
+constexpr uint8_t STREAM_BATTERY = 0x01;
+constexpr uint8_t STREAM_SYSTEM = 0x02;
+constexpr uint8_t STREAM_LOGS = 0x04;
+constexpr uint8_t STREAM_CAN = 0x08;
+constexpr uint8_t STREAM_ALL = 0x0F;          // Default: every stream except the opt-in ones
+constexpr uint8_t STREAM_PERF = 0x10;         // Opt-in, JSON like logs
+
+constexpr uint8_t CAN_MAX_FILTERS = 8;
+constexpr uint8_t CAN_MAX_RATE = 10;
+
+// TYPE_BATTERIES:
+//   type, version, count, reserved
+//   timestamp u32, total_power f32, total_current f32, average_voltage f32
+//   per enabled battery:
+//     id, BATTERY_* flags, soc, name length
+//     voltage f32, current f32, power f32, temp1 f32, temp2 f32, name bytes
+constexpr size_t BATTERIES_HEADER_SIZE = 4 + 16;
+constexpr size_t BATTERY_ENTRY_SIZE = 4 + 20;     // Plus the name
+
+constexpr uint8_t BATTERY_ERROR = 0x01;
+constexpr uint8_t BATTERY_HAS_CAN_DATA = 0x02;
+constexpr uint8_t BATTERY_DATA_FRESH = 0x04;
+
+// TYPE_SYSTEM:
+//   type, version, SYSTEM_* flags, wifi_rssi i8
+//   uptime_ms, free_heap, min_free_heap, can_message_count,
+//   can_dropped_count, can_log_bytes_per_sec, can_log_flush_us,
+//   http_requests, ws_messages_sent (u32 each)
+//   wifi_ip (4 octets), ws_clients, ssid length, ssid bytes
+constexpr size_t SYSTEM_SIZE = 4 + 36 + 4 + 2;    // Plus the SSID
+
+constexpr uint8_t SYSTEM_WIFI_CONNECTED = 0x01;
+
+// TYPE_CAN_SUMMARY (latest frame of each ID that changed since the client's
+// previous CAN message, sent when it can't have every frame):
+//   type, CAN_SUMMARY_VERSION, count, reserved
+//   frames, dropped (u32 totals since boot)
+//   per ID: id u32, dlc, data, timestamp u32, total u32
+// `total` counts the frames of that ID the server has seen; the difference
+// to the client's own count is how many were folded into this entry.
+constexpr size_t CAN_SUMMARY_HEADER_SIZE = 4 + 8;
+constexpr size_t CAN_SUMMARY_ENTRY_SIZE = 4 + 1 + 4 + 4;  // Plus the data
+
+inline uint8_t streamBit(const char* name) {
+    if (name == nullptr) return 0;
+    if (strcmp(name, "battery") == 0) return STREAM_BATTERY;
+    if (strcmp(name, "system") == 0) return STREAM_SYSTEM;
+    if (strcmp(name, "logs") == 0) return STREAM_LOGS;
+    if (strcmp(name, "can") == 0) return STREAM_CAN;
+    if (strcmp(name, "perf") == 0) return STREAM_PERF;
+    return 0;
+}
+
+// CAN part of a client's subscription
+struct CANSubscription {
+    uint8_t filter_count;       // 0 = every ID
+    uint16_t interval_ms;       // Minimum time between CAN messages (0 = every flush)
+    uint32_t ids[CAN_MAX_FILTERS];
+    uint32_t masks[CAN_MAX_FILTERS];
+
+    bool matches(uint32_t id) const {
+        if (filter_count == 0) return true;
+        for (uint8_t i = 0; i < filter_count; i++) {
+            if ((id & masks[i]) == (ids[i] & masks[i])) return true;
+        }
+        return false;
+    }
+
+    bool sameFilters(const CANSubscription& other) const {
+        return filter_count == other.filter_count &&
+               memcmp(ids, other.ids, filter_count * sizeof(ids[0])) == 0 &&
+               memcmp(masks, other.masks, filter_count * sizeof(masks[0])) == 0;
+    }
+};
+
+inline uint8_t* putU32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    out[2] = static_cast<uint8_t>(value >> 16);
+    out[3] = static_cast<uint8_t>(value >> 24);
+    return out + 4;
+}
+
+inline uint8_t* putF32(uint8_t* out, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return putU32(out, bits);
+}
+
+// Length byte followed by up to 255 bytes of text
+inline uint8_t* putString(uint8_t* out, const char* text, size_t len) {
+    if (len > 255) len = 255;
+    *out++ = static_cast<uint8_t>(len);
+    memcpy(out, text, len);
+    return out + len;
+}
+
+// TYPE_CAN_BATCH of the frames matching `sub`: type, count, then per frame
+// id u32, dlc, data, timestamp u32 (ms). Size is 0 when none match.
+inline size_t canBatchSize(const CANSubscription& sub, const CANFrame* frames, size_t count) {
+    size_t matched = 0;
+    size_t size = 2;
+    for (size_t i = 0; i < count; i++) {
+        if (sub.matches(frames[i].id())) {
+            size += 4 + 1 + frames[i].dlc() + 4;
+            matched++;
+        }
+    }
+    return matched > 0 ? size : 0;
+}
+
+// Writes canBatchSize() bytes; returns the number of frames encoded
+inline size_t encodeCANBatch(const CANSubscription& sub, const CANFrame* frames, size_t count,
+                             uint8_t* out) {
+    uint8_t* p = out + 2;
+    size_t matched = 0;
+    for (size_t i = 0; i < count; i++) {
+        const CANFrame& frame = frames[i];
+        if (!sub.matches(frame.id())) continue;
+        uint8_t dlc = frame.dlc();
+        p = putU32(p, frame.id());
+        *p++ = dlc;
+        memcpy(p, frame.data, dlc);
+        p = putU32(p + dlc, frame.timestampMs());
+        matched++;
+    }
+    out[0] = TYPE_CAN_BATCH;
+    out[1] = static_cast<uint8_t>(matched);
+    return matched;
+}
+
+} // namespace WSProtocol
+
+#endif // WS_PROTOCOL_H
@@ -0,0 +1,204 @@
+#include "adc_manager.h"
+#include "../config/settings.h"
+#include "../battery/battery_manager.h"
+#include <driver/adc.h>
+#include <new>
+
+static const uint8_t CURRENT_PINS[MAX_BATTERY_MODULES] = {
+    PIN_ACS712_BATT1, PIN_ACS712_BATT2, PIN_ACS712_BATT3, PIN_ACS712_BATT4, PIN_ACS712_BATT5
+};
+
+ADCManager::ADCManager()
+    : settings_(nullptr),
+      batteries_(nullptr),
+      channel_count_(0),
+      frame_(nullptr),
+      running_(false),
+      block_start_(0) {
+    memset(channels_, 0, sizeof(channels_));
+    memset(slot_of_, -1, sizeof(slot_of_));
+    memset(&calibration_, 0, sizeof(calibration_));
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+bool ADCManager::begin(SettingsManager* settings, BatteryManager* batteries) {
+    if (settings == nullptr || batteries == nullptr) {
+        Serial.println("ADCManager: Invalid parameters");
+        return false;
+    }
+    settings_ = settings;
+    batteries_ = batteries;
+
+    const Settings& config = settings_->getSettings();
+    for (uint8_t i = 0; i < config.num_batteries && i < MAX_BATTERY_MODULES; i++) {
+        addChannel(CURRENT_PINS[i], i, Input::CURRENT);
+    }
+    addChannel(PIN_VOLTAGE_BATT1, 0, Input::VOLTAGE);
+
+    if (channel_count_ == 0) {
+        Serial.println("ADCManager: No ADC1 inputs to scan");
+        return false;
+    }
+
+    frame_ = new (std::nothrow) uint8_t[ADC_DMA_FRAME_BYTES];
+    if (frame_ == nullptr) {
+        Serial.println("ADCManager: Out of memory");
+        return false;
+    }
+
+    uint16_t mask = 0;
+    adc_digi_pattern_config_t pattern[MAX_CHANNELS];
+    memset(pattern, 0, sizeof(pattern));
+    for (uint8_t i = 0; i < channel_count_; i++) {
+        mask |= 1 << channels_[i].adc_channel;
+        pattern[i].atten = ADC_ATTEN_DB_11;     // 0-3.1 V
+        pattern[i].channel = channels_[i].adc_channel;
+        pattern[i].unit = 0;                    // ADC1
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+
+    adc_digi_init_config_t init_config = {};
+    init_config.max_store_buf_size = ADC_DMA_BUFFER_BYTES;
+    init_config.conv_num_each_intr = ADC_DMA_FRAME_BYTES;
+    init_config.adc1_chan_mask = mask;
+    init_config.adc2_chan_mask = 0;
+    esp_err_t err = adc_digi_initialize(&init_config);
+    if (err != ESP_OK) {
+        Serial.printf("ADCManager: adc_digi_initialize failed (%d)\n", err);
+        return false;
+    }
+
+    adc_digi_configuration_t dig_config = {};
+    dig_config.conv_limit_en = true;            // Required on the ESP32
+    dig_config.conv_limit_num = 250;
+    dig_config.pattern_num = channel_count_;
+    dig_config.adc_pattern = pattern;
+    dig_config.sample_freq_hz = ADC_DMA_SAMPLE_RATE_HZ;
+    dig_config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    dig_config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+    err = adc_digi_controller_configure(&dig_config);
+    if (err != ESP_OK) {
+        Serial.printf("ADCManager: adc_digi_controller_configure failed (%d)\n", err);
+        adc_digi_deinitialize();
+        return false;
+    }
+
+    // Factory calibration (eFuse Vref or two-point) for raw -> mV
+    esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &calibration_);
+
+    err = adc_digi_start();
+    if (err != ESP_OK) {
+        Serial.printf("ADCManager: adc_digi_start failed (%d)\n", err);
+        adc_digi_deinitialize();
+        return false;
+    }
+
+    running_ = true;
+    block_start_ = millis();
+    Serial.printf("ADCManager: Scanning %u input(s) at %u Hz total\n",
+                 channel_count_, ADC_DMA_SAMPLE_RATE_HZ);
+    return true;
+}
+
+bool ADCManager::addChannel(uint8_t pin, uint8_t battery, Input input) {
+    int8_t adc_channel = digitalPinToAnalogChannel(pin);
+    if (adc_channel < 0 || adc_channel >= ADC1_CHANNELS) {
+        Serial.printf("ADCManager: GPIO %u is not an ADC1 pin, skipped\n", pin);
+        return false;
+    }
+    if (slot_of_[adc_channel] >= 0 || channel_count_ >= MAX_CHANNELS) {
+        return false;
+    }
+
+    Channel& channel = channels_[channel_count_];
+    channel.pin = pin;
+    channel.adc_channel = adc_channel;
+    channel.battery = battery;
+    channel.input = input;
+    channel.sum = 0;
+    channel.count = 0;
+    slot_of_[adc_channel] = channel_count_++;
+    return true;
+}
+
+bool ADCManager::process(uint32_t timeout_ms) {
+    if (!running_) {
+        return false;
+    }
+
+    uint32_t length = 0;
+    esp_err_t err = adc_digi_read_bytes(frame_, ADC_DMA_FRAME_BYTES, &length, timeout_ms);
+    if (err == ESP_ERR_INVALID_STATE) {
+        stats_.overruns++;      // Older frames were dropped; this one is still good
+    } else if (err != ESP_OK) {
+        return false;           // Timeout
+    }
+
+    uint32_t start = micros();
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t* sample = reinterpret_cast<const adc_digi_output_data_t*>(frame_ + i);
+        uint8_t adc_channel = sample->type1.channel;
+        if (adc_channel >= ADC1_CHANNELS || slot_of_[adc_channel] < 0) {
+            continue;
+        }
+        Channel& channel = channels_[slot_of_[adc_channel]];
+        channel.sum += sample->type1.data;
+        channel.count++;
+    }
+    stats_.conversions += length / SOC_ADC_DIGI_RESULT_BYTES;
+    stats_.frames++;
+
+    if (millis() - block_start_ >= settings_->getSettings().sample_interval_ms) {
+        publish();
+        block_start_ = millis();
+    }
+
+    stats_.frame_us = micros() - start;
+    return true;
+}
+
+void ADCManager::publish() {
+    const Settings& config = settings_->getSettings();
+
+    for (uint8_t i = 0; i < channel_count_; i++) {
+        Channel& channel = channels_[i];
+        if (channel.count == 0) {
+            continue;
+        }
+        float mv = rawToMillivolts(static_cast<float>(channel.sum) / channel.count);
+        channel.sum = 0;
+        channel.count = 0;
+
+        // CAN readings, when a pack sends them, take precedence
+        BatteryModule* battery = batteries_->getBattery(channel.battery);
+        if (battery == nullptr || !battery->isEnabled()) {
+            continue;
+        }
+
+        const BatteryConfig& cal = config.batteries[channel.battery];
+        if (channel.input == Input::CURRENT) {
+            if (!battery->hasCANField(CANBatteryFields::CURRENT)) {
+                battery->updateCurrent((mv - cal.current_cal_offset) / cal.current_cal_scale);
+            }
+        } else if (!battery->hasCANField(CANBatteryFields::VOLTAGE)) {
+            battery->updateVoltage(mv / 1000.0f * cal.voltage_cal_scale);
+        }
+    }
+    stats_.publishes++;
+}
+
+float ADCManager::rawToMillivolts(float raw) const {
+    // The calibration curve takes whole counts; interpolate between them so
+    // block averages keep their extra resolution
+    uint32_t whole = static_cast<uint32_t>(raw);
+    if (whole >= ADC_RESOLUTION) {
+        return esp_adc_cal_raw_to_voltage(ADC_RESOLUTION, &calibration_);
+    }
+    float low = esp_adc_cal_raw_to_voltage(whole, &calibration_);
+    float high = esp_adc_cal_raw_to_voltage(whole + 1, &calibration_);
+    return low + (raw - whole) * (high - low);
+}
+
+void ADCManager::getStats(Stats& stats) const {
+    stats = stats_;
+}
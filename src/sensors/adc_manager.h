@@ -0,0 +1,87 @@
+#ifndef ADC_MANAGER_H
+#define ADC_MANAGER_H
+
+#include <Arduino.h>
+#include <esp_adc_cal.h>
+#include "../config/config.h"
+
+class SettingsManager;
+class BatteryManager;
+
+// Continuous ADC1 sampling of the analog battery inputs.
+//
+// The ADC scans every configured input in DMA mode at a fixed total rate
+// (ADC_DMA_SAMPLE_RATE_HZ), so the sensor task never waits on single
+// conversions. process() takes one DMA frame at a time and adds each sample
+// to its channel's running sum. Every sample_interval_ms the sums become
+// block averages, which is a decimating boxcar filter, and are published
+// to the battery modules:
+//
+//   current = (mV - current_cal_offset) / current_cal_scale
+//   voltage = V * voltage_cal_scale
+//
+// The cost per frame depends on the sample rate, not on how many channels
+// share it. A pack that delivers CAN data keeps its CAN voltage and current.
+// Only ADC1 pins can be scanned; PIN_VOLTAGE_COMMON (ADC2) is not.
+class ADCManager {
+public:
+    enum class Input : uint8_t {
+        CURRENT,    // ACS712 output
+        VOLTAGE     // Divider output
+    };
+
+    struct Stats {
+        uint32_t conversions;       // Samples taken since begin()
+        uint32_t frames;            // DMA frames processed
+        uint32_t overruns;          // Frames the driver dropped because the task fell behind
+        uint32_t publishes;
+        uint32_t frame_us;          // Time spent on the last frame
+    };
+
+    ADCManager();
+
+    // Scan the current inputs of the configured packs and the pack voltage
+    // input; false if nothing could be started
+    bool begin(SettingsManager* settings, BatteryManager* batteries);
+
+    // Handle the next DMA frame (waits up to timeout_ms for it); call from
+    // the sensor task only
+    bool process(uint32_t timeout_ms);
+
+    bool isRunning() const { return running_; }
+    uint8_t getChannelCount() const { return channel_count_; }
+    void getStats(Stats& stats) const;
+
+private:
+    static constexpr uint8_t ADC1_CHANNELS = 8;
+    static constexpr uint8_t MAX_CHANNELS = MAX_BATTERY_MODULES + 1;
+
+    struct Channel {
+        uint8_t pin;
+        uint8_t adc_channel;
+        uint8_t battery;
+        Input input;
+        uint32_t sum;           // Raw samples in the current block
+        uint32_t count;
+    };
+
+    SettingsManager* settings_;
+    BatteryManager* batteries_;
+
+    Channel channels_[MAX_CHANNELS];
+    uint8_t channel_count_;
+    int8_t slot_of_[ADC1_CHANNELS];     // ADC1 channel -> channels_ index (-1 = not scanned)
+
+    uint8_t* frame_;
+    esp_adc_cal_characteristics_t calibration_;
+    bool running_;
+    uint32_t block_start_;
+
+    Stats stats_;
+
+    bool addChannel(uint8_t pin, uint8_t battery, Input input);
+    void publish();
+    float rawToMillivolts(float raw) const;
+};
+
+#endif // ADC_MANAGER_H
@@ -0,0 +1,91 @@
+#include "buffer_pool.h"
+#include <stdlib.h>
+
+// Slots grow in these steps, so a payload that varies a little doesn't
+// resize its slot every time
+static constexpr size_t GROW_STEP = 256;
+
+BufferPool::BufferPool(size_t count, size_t max_size)
+    : slots(new Slot[count]()), slot_count(count), max_pooled(max_size),
+      hits(0), misses(0), peak_size(0) {
+    portMUX_INITIALIZE(&mux);
+}
+
+BufferPool::~BufferPool() {
+    for (size_t i = 0; i < slot_count; i++) {
+        free(slots[i].data);
+    }
+    delete[] slots;
+}
+
+uint8_t* BufferPool::acquire(size_t size) {
+    Slot* fit = nullptr;        // Smallest free slot that is big enough
+    Slot* spare = nullptr;      // Otherwise a free slot to grow
+
+    portENTER_CRITICAL(&mux);
+    if (size > peak_size) peak_size = size;
+    for (size_t i = 0; i < slot_count; i++) {
+        Slot& slot = slots[i];
+        if (slot.in_use) continue;
+        if (slot.capacity >= size) {
+            if (fit == nullptr || slot.capacity < fit->capacity) fit = &slot;
+        } else if (spare == nullptr) {
+            spare = &slot;
+        }
+    }
+    if (fit != nullptr) {
+        fit->in_use = true;
+        hits++;
+        portEXIT_CRITICAL(&mux);
+        return fit->data;
+    }
+    misses++;
+    if (size > max_pooled) spare = nullptr;
+    if (spare != nullptr) spare->in_use = true;
+    portEXIT_CRITICAL(&mux);
+
+    if (spare == nullptr) {
+        return static_cast<uint8_t*>(malloc(size));
+    }
+
+    // The slot is ours now; resize it outside the critical section (the
+    // heap can't be used with interrupts disabled)
+    size_t capacity = (size + GROW_STEP - 1) / GROW_STEP * GROW_STEP;
+    if (capacity > max_pooled) capacity = size;
+    free(spare->data);
+    uint8_t* data = static_cast<uint8_t*>(malloc(capacity));
+
+    portENTER_CRITICAL(&mux);
+    spare->data = data;
+    spare->capacity = data != nullptr ? capacity : 0;
+    if (data == nullptr) spare->in_use = false;
+    portEXIT_CRITICAL(&mux);
+    return data;
+}
+
+void BufferPool::release(uint8_t* buffer) {
+    if (buffer == nullptr) return;
+
+    portENTER_CRITICAL(&mux);
+    for (size_t i = 0; i < slot_count; i++) {
+        if (slots[i].data == buffer && slots[i].in_use) {
+            slots[i].in_use = false;
+            portEXIT_CRITICAL(&mux);
+            return;
+        }
+    }
+    portEXIT_CRITICAL(&mux);
+    free(buffer);   // One-off block
+}
+
+void BufferPool::getStats(Stats& stats) const {
+    portENTER_CRITICAL(&mux);
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.peak_size = peak_size;
+    stats.pooled_bytes = 0;
+    for (size_t i = 0; i < slot_count; i++) {
+        stats.pooled_bytes += slots[i].capacity;
+    }
+    portEXIT_CRITICAL(&mux);
+}
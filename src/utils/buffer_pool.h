@@ -0,0 +1,48 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <Arduino.h>
+
+// Reusable heap blocks for serialized payloads (HTTP JSON responses).
+//
+// A few slots keep their block between uses and grow to the largest payload
+// they have been asked for, so steady-state requests reuse the same memory
+// instead of fragmenting the heap with a new String per response. When
+// every slot is busy, or a payload is larger than max_size, a one-off
+// block is allocated and freed again on release(). Safe to use from any
+// task.
+class BufferPool {
+public:
+    struct Stats {
+        uint32_t hits;          // Served by a slot that was already big enough
+        uint32_t misses;        // Slot had to grow, or one-off allocation
+        uint32_t peak_size;     // Largest size asked for
+        uint32_t pooled_bytes;  // Memory held by the slots
+    };
+
+    BufferPool(size_t count, size_t max_size);
+    ~BufferPool();
+
+    // A block of at least `size` bytes, or nullptr when out of memory
+    uint8_t* acquire(size_t size);
+    void release(uint8_t* buffer);
+
+    void getStats(Stats& stats) const;
+
+private:
+    struct Slot {
+        uint8_t* data;
+        size_t capacity;
+        bool in_use;
+    };
+
+    Slot* slots;
+    size_t slot_count;
+    size_t max_pooled;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t peak_size;
+    mutable portMUX_TYPE mux;
+};
+
+#endif // BUFFER_POOL_H
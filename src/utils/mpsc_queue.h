@@ -0,0 +1,84 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Lock-free multi-producer/single-consumer queue (bounded, Vyukov style).
+//
+// Any task may call push(); exactly one task may call pop(). Producers claim
+// a slot with a compare-and-swap on head and publish it through the slot's
+// sequence number, so there is no lock a preempted producer could hold. A
+// full queue rejects new items like SpscQueue does.
+// SIZE must be a power of two so indices can wrap with a mask.
+template<typename T, size_t SIZE>
+class MpscQueue {
+    static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "MpscQueue SIZE must be a power of two");
+
+public:
+    MpscQueue() : head(0), tail(0) {
+        for (size_t i = 0; i < SIZE; i++) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Producer side: returns false (item not stored) if the queue is full
+    bool push(const T& item) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & MASK];
+            const size_t seq = cell->seq.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;       // Slot still holds an item from the previous lap
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->item = item;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: returns false if the queue is empty (or the oldest
+    // slot is still being written)
+    bool pop(T& item) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        Cell& cell = cells[t & MASK];
+        if (cell.seq.load(std::memory_order_acquire) != t + 1) {
+            return false;
+        }
+
+        item = cell.item;
+        cell.seq.store(t + SIZE, std::memory_order_release);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Status (approximate while producers are active)
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+    bool isEmpty() const { return size() == 0; }
+    size_t capacity() const { return SIZE; }
+
+private:
+    static constexpr size_t MASK = SIZE - 1;
+
+    struct Cell {
+        std::atomic<size_t> seq;    // pos + 1 once written, pos + SIZE once consumed
+        T item;
+    };
+
+    Cell cells[SIZE];
+    std::atomic<size_t> head;   // Next slot to claim (producers)
+    std::atomic<size_t> tail;   // Next slot to read (consumer only)
+};
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,268 @@
+#include "perf_monitor.h"
+#include <new>
+
+// Global instance
+PerfMonitor perfMonitor;
+
+// uxTaskGetSystemState() with per-task run time needs both options in the
+// FreeRTOS configuration; without them only stacks are reported
+#if defined(configUSE_TRACE_FACILITY) && defined(configGENERATE_RUN_TIME_STATS) && \
+    configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+#define PERF_CPU_STATS 1
+#else
+#define PERF_CPU_STATS 0
+#endif
+
+uint32_t PerfMonitor::Histogram::percentileUs(float fraction) const {
+    uint32_t buckets[LATENCY_BUCKETS];
+    copyBuckets(buckets);
+    return percentileUs(buckets, fraction, maxUs());
+}
+
+uint32_t PerfMonitor::Histogram::percentileUs(const uint32_t* buckets, float fraction, uint32_t max_us) {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+        total += buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint32_t target = static_cast<uint32_t>(total * fraction);
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen > target) {
+            return i + 1 < LATENCY_BUCKETS ? (1UL << (i + 1)) : max_us;
+        }
+    }
+    return max_us;
+}
+
+PerfMonitor::PerfMonitor()
+    : task_count_(0),
+      queue_count_(0),
+      sample_ms_(0),
+      last_total_runtime_(0),
+      system_state_(nullptr),
+      mux_(portMUX_INITIALIZER_UNLOCKED) {
+    memset(tasks_, 0, sizeof(tasks_));
+    memset(gauges_, 0, sizeof(gauges_));
+    memset(queues_, 0, sizeof(queues_));
+    memset(&heap_, 0, sizeof(heap_));
+    for (uint8_t i = 0; i < static_cast<uint8_t>(BootPhase::COUNT); i++) {
+        boot_ms_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+PerfMonitor::~PerfMonitor() {
+#if PERF_CPU_STATS
+    delete[] static_cast<TaskStatus_t*>(system_state_);
+#endif
+}
+
+bool PerfMonitor::begin() {
+#if PERF_CPU_STATS
+    if (system_state_ == nullptr) {
+        system_state_ = new (std::nothrow) TaskStatus_t[PERF_MAX_SYSTEM_TASKS];
+        if (system_state_ == nullptr) {
+            Serial.println("PerfMonitor: Out of memory, CPU stats disabled");
+        }
+    }
+
+    // Idle time per core turns the task shares into a load figure
+    addTask("IDLE0", xTaskGetIdleTaskHandleForCPU(0));
+#if !CONFIG_FREERTOS_UNICORE
+    addTask("IDLE1", xTaskGetIdleTaskHandleForCPU(1));
+#endif
+#endif
+    return true;
+}
+
+bool PerfMonitor::addTask(const char* name, TaskHandle_t handle) {
+    if (handle == nullptr || task_count_ >= MAX_TASKS) {
+        Serial.printf("PerfMonitor: Task '%s' not tracked\n", name ? name : "?");
+        return false;
+    }
+
+    TaskSlot& slot = tasks_[task_count_++];
+    slot.handle = handle;
+    slot.info.name = name;
+    slot.info.stack_free = 0;
+    slot.info.cpu_percent = -1.0f;
+    slot.last_runtime = 0;
+    return true;
+}
+
+bool PerfMonitor::addQueue(const char* name, QueueGauge gauge) {
+    if (gauge == nullptr || queue_count_ >= MAX_QUEUES) {
+        Serial.printf("PerfMonitor: Queue '%s' not tracked\n", name ? name : "?");
+        return false;
+    }
+
+    gauges_[queue_count_] = gauge;
+    queues_[queue_count_].name = name;
+    queue_count_++;
+    return true;
+}
+
+void PerfMonitor::sample() {
+    // Sources first (their getters may take locks), then publish in one go
+    QueueInfo queues[MAX_QUEUES];
+    for (uint8_t i = 0; i < queue_count_; i++) {
+        queues[i] = queues_[i];
+        queues[i].depth = 0;
+        queues[i].capacity = 0;
+        uint32_t previous_peak = queues[i].high_water;
+        queues[i].high_water = 0;
+        gauges_[i](queues[i]);
+
+        // Sources without their own peak are caught at sample time only
+        if (queues[i].depth > queues[i].high_water) queues[i].high_water = queues[i].depth;
+        if (previous_peak > queues[i].high_water) queues[i].high_water = previous_peak;
+    }
+
+    HeapInfo heap;
+    heap.free = ESP.getFreeHeap();
+    heap.min_free = ESP.getMinFreeHeap();
+    heap.largest_block = ESP.getMaxAllocHeap();
+    heap.fragmentation = heap.free > 0 && heap.largest_block < heap.free
+                       ? static_cast<uint8_t>(100 - (uint64_t)heap.largest_block * 100 / heap.free) : 0;
+
+    uint32_t stack_free[MAX_TASKS];
+    for (uint8_t i = 0; i < task_count_; i++) {
+        // StackType_t is a byte on the ESP32, so this is already in bytes
+        stack_free[i] = uxTaskGetStackHighWaterMark(tasks_[i].handle) * sizeof(StackType_t);
+    }
+
+    portENTER_CRITICAL(&mux_);
+    memcpy(queues_, queues, queue_count_ * sizeof(QueueInfo));
+    heap_ = heap;
+    for (uint8_t i = 0; i < task_count_; i++) {
+        tasks_[i].info.stack_free = stack_free[i];
+    }
+    portEXIT_CRITICAL(&mux_);
+
+    sampleCPU();
+    sample_ms_ = millis();
+}
+
+void PerfMonitor::sampleCPU() {
+#if PERF_CPU_STATS
+    if (system_state_ == nullptr) {
+        return;
+    }
+
+    TaskStatus_t* state = static_cast<TaskStatus_t*>(system_state_);
+    uint32_t total_runtime = 0;
+    UBaseType_t count = uxTaskGetSystemState(state, PERF_MAX_SYSTEM_TASKS, &total_runtime);
+    if (count == 0) {
+        return;     // More tasks than PERF_MAX_SYSTEM_TASKS
+    }
+
+    // The run-time counter is one clock for all cores, so a task's share of
+    // its delta is a percentage of one core
+    uint32_t elapsed = total_runtime - last_total_runtime_;
+    last_total_runtime_ = total_runtime;
+
+    float cpu[MAX_TASKS];
+    for (uint8_t i = 0; i < task_count_; i++) {
+        cpu[i] = -1.0f;
+        for (UBaseType_t j = 0; j < count; j++) {
+            if (state[j].xHandle != tasks_[i].handle) {
+                continue;
+            }
+            uint32_t runtime = state[j].ulRunTimeCounter;
+            if (elapsed > 0 && tasks_[i].last_runtime != 0) {
+                cpu[i] = (runtime - tasks_[i].last_runtime) * 100.0f / elapsed;
+            }
+            tasks_[i].last_runtime = runtime;
+            break;
+        }
+    }
+
+    portENTER_CRITICAL(&mux_);
+    for (uint8_t i = 0; i < task_count_; i++) {
+        tasks_[i].info.cpu_percent = cpu[i];
+    }
+    portEXIT_CRITICAL(&mux_);
+#endif
+}
+
+size_t PerfMonitor::getTasks(TaskInfo* out, size_t max) const {
+    if (out == nullptr) {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&mux_);
+    size_t count = task_count_ < max ? task_count_ : max;
+    for (size_t i = 0; i < count; i++) {
+        out[i] = tasks_[i].info;
+    }
+    portEXIT_CRITICAL(&mux_);
+    return count;
+}
+
+size_t PerfMonitor::getQueues(QueueInfo* out, size_t max) const {
+    if (out == nullptr) {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&mux_);
+    size_t count = queue_count_ < max ? queue_count_ : max;
+    memcpy(out, queues_, count * sizeof(QueueInfo));
+    portEXIT_CRITICAL(&mux_);
+    return count;
+}
+
+void PerfMonitor::getHeap(HeapInfo& heap) const {
+    portENTER_CRITICAL(&mux_);
+    heap = heap_;
+    portEXIT_CRITICAL(&mux_);
+}
+
+bool PerfMonitor::hasCPUStats() const {
+    return PERF_CPU_STATS && system_state_ != nullptr;
+}
+
+const char* PerfMonitor::latencyName(Latency which) {
+    switch (which) {
+        case Latency::PARSE:     return "parse";
+        case Latency::WEBSOCKET: return "websocket";
+        case Latency::MQTT:      return "mqtt";
+        default:                 return "unknown";
+    }
+}
+
+void PerfMonitor::markBoot(BootPhase phase) {
+    if (phase >= BootPhase::COUNT) {
+        return;
+    }
+    std::atomic<uint32_t>& slot = boot_ms_[static_cast<uint8_t>(phase)];
+    if (slot.load(std::memory_order_relaxed) != 0) {
+        return;     // Cheap on the frame path once reached
+    }
+    uint32_t now = millis();
+    uint32_t unset = 0;
+    // 0 means "not reached", so a phase at boot tick 0 is stored as 1 ms
+    slot.compare_exchange_strong(unset, now > 0 ? now : 1, std::memory_order_relaxed);
+}
+
+uint32_t PerfMonitor::getBootTime(BootPhase phase) const {
+    return phase < BootPhase::COUNT ? boot_ms_[static_cast<uint8_t>(phase)].load(std::memory_order_relaxed) : 0;
+}
+
+const char* PerfMonitor::bootPhaseName(BootPhase phase) {
+    switch (phase) {
+        case BootPhase::SETTINGS:       return "settings";
+        case BootPhase::CAN_CAPTURE:    return "can_capture";
+        case BootPhase::FIRST_FRAME:    return "first_frame";
+        case BootPhase::SENSORS:        return "sensors";
+        case BootPhase::SETUP_DONE:     return "setup_done";
+        case BootPhase::WIFI_STARTED:   return "wifi_started";
+        case BootPhase::WEB_SERVER:     return "web_server";
+        case BootPhase::NETWORK_READY:  return "network_ready";
+        case BootPhase::WIFI_CONNECTED: return "wifi_connected";
+        default:                        return "unknown";
+    }
+}
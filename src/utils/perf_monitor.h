@@ -0,0 +1,158 @@
+#ifndef PERF_MONITOR_H
+#define PERF_MONITOR_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "../config/config.h"
+
+// Runtime performance figures for /api/diagnostics/perf and the opt-in
+// "perf" WebSocket stream.
+//
+// sample() runs in the network task every PERF_SAMPLE_INTERVAL_MS. It reads
+// the stack high-water mark of every registered task and, when FreeRTOS
+// keeps run-time stats, their CPU share since the previous sample. It also
+// polls the registered queue gauges and the heap. Readers get the latest
+// sample, so requests never walk the task list themselves.
+//
+// Latency histograms are fed on the frame path (one writer task each) and
+// read at any time; counts may be a frame apart.
+//
+// Boot phases record the millis() at which startup reached each milestone
+// (first call wins), so slow bring-up steps show up in diagnostics.
+class PerfMonitor {
+public:
+    static constexpr uint8_t MAX_TASKS = PERF_MAX_TASKS;
+    static constexpr uint8_t MAX_QUEUES = PERF_MAX_QUEUES;
+    static constexpr uint8_t LATENCY_BUCKETS = 21;  // 1 us .. 2^20 us (~1 s), last one open
+
+    struct TaskInfo {
+        const char* name;
+        uint32_t stack_free;    // Bytes never used (high-water mark)
+        float cpu_percent;      // Of one core, since the previous sample (-1 = not available)
+    };
+
+    // Filled by a gauge function
+    struct QueueInfo {
+        const char* name;
+        uint32_t depth;
+        uint32_t capacity;      // 0 = unbounded
+        uint32_t high_water;    // Deepest seen (by the source, or by sampling)
+    };
+    typedef void (*QueueGauge)(QueueInfo& info);
+
+    struct HeapInfo {
+        uint32_t free;
+        uint32_t min_free;
+        uint32_t largest_block;
+        uint8_t fragmentation;  // 100 - largest_block / free, in percent
+    };
+
+    enum class Latency : uint8_t {
+        PARSE = 0,      // RX -> decoded in the CAN task
+        WEBSOCKET,      // RX -> live view batch
+        MQTT,           // RX -> handed to the MQTT client
+        COUNT
+    };
+
+    enum class BootPhase : uint8_t {
+        SETTINGS = 0,   // NVS settings loaded
+        CAN_CAPTURE,    // Driver, parse task and frame consumers running
+        FIRST_FRAME,    // First frame decoded by the CAN task
+        SENSORS,        // ADC scan started
+        SETUP_DONE,     // setup() returned; network bring-up continues
+        WIFI_STARTED,   // STA/AP started (network task)
+        WEB_SERVER,     // HTTP/WebSocket server listening
+        NETWORK_READY,  // MQTT client started, network task looping
+        WIFI_CONNECTED, // First STA connection
+        COUNT
+    };
+
+    // Bucket i counts latencies in [2^i, 2^(i+1)) us (bucket 0 also < 1 us)
+    class Histogram {
+    public:
+        Histogram() : count_(0), max_us_(0) { memset(buckets_, 0, sizeof(buckets_)); }
+
+        // Not thread-safe: one writer task per histogram
+        void record(uint32_t us) {
+            uint8_t bucket = us == 0 ? 0 : 31 - __builtin_clz(us);
+            if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+            buckets_[bucket]++;
+            count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (us > max_us_.load(std::memory_order_relaxed)) {
+                max_us_.store(us, std::memory_order_relaxed);
+            }
+        }
+
+        uint32_t count() const { return count_.load(std::memory_order_relaxed); }
+        uint32_t maxUs() const { return max_us_.load(std::memory_order_relaxed); }
+        uint32_t bucket(uint8_t i) const { return i < LATENCY_BUCKETS ? buckets_[i] : 0; }
+
+        // Upper bound of the bucket holding the given fraction (0..1)
+        uint32_t percentileUs(float fraction) const;
+
+        // Per-bucket counts; the difference of two copies covers the time
+        // between them, and the static percentileUs() reads such a window
+        void copyBuckets(uint32_t* out) const { memcpy(out, buckets_, sizeof(buckets_)); }
+        static uint32_t percentileUs(const uint32_t* buckets, float fraction, uint32_t max_us);
+
+    private:
+        uint32_t buckets_[LATENCY_BUCKETS];
+        std::atomic<uint32_t> count_;
+        std::atomic<uint32_t> max_us_;
+    };
+
+    PerfMonitor();
+    ~PerfMonitor();
+
+    // Registration, during setup (not thread-safe)
+    bool begin();
+    bool addTask(const char* name, TaskHandle_t handle);
+    bool addQueue(const char* name, QueueGauge gauge);
+
+    // Refresh tasks, queues and heap (network task)
+    void sample();
+    uint32_t getSampleTime() const { return sample_ms_; }
+
+    // Latest sample; return the number of entries copied
+    size_t getTasks(TaskInfo* out, size_t max) const;
+    size_t getQueues(QueueInfo* out, size_t max) const;
+    void getHeap(HeapInfo& heap) const;
+    bool hasCPUStats() const;
+
+    Histogram& latency(Latency which) { return latency_[static_cast<uint8_t>(which)]; }
+    const Histogram& latency(Latency which) const { return latency_[static_cast<uint8_t>(which)]; }
+    static const char* latencyName(Latency which);
+
+    // Any task; later calls for a phase already reached are ignored
+    void markBoot(BootPhase phase);
+    uint32_t getBootTime(BootPhase phase) const;    // millis(), 0 = not reached
+    static const char* bootPhaseName(BootPhase phase);
+
+private:
+    struct TaskSlot {
+        TaskHandle_t handle;
+        TaskInfo info;
+        uint32_t last_runtime;
+    };
+
+    TaskSlot tasks_[MAX_TASKS];
+    uint8_t task_count_;
+    QueueGauge gauges_[MAX_QUEUES];
+    QueueInfo queues_[MAX_QUEUES];
+    uint8_t queue_count_;
+    HeapInfo heap_;
+    Histogram latency_[static_cast<uint8_t>(Latency::COUNT)];
+    std::atomic<uint32_t> boot_ms_[static_cast<uint8_t>(BootPhase::COUNT)];
+
+    uint32_t sample_ms_;
+    uint32_t last_total_runtime_;
+    void* system_state_;        // TaskStatus_t[PERF_MAX_SYSTEM_TASKS] (run-time stats only)
+    mutable portMUX_TYPE mux_;
+
+    void sampleCPU();
+};
+
+// Global instance
+extern PerfMonitor perfMonitor;
+
+#endif // PERF_MONITOR_H
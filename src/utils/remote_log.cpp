@@ -1,6 +1,8 @@
 #include "remote_log.h"
+#include <cctype>
 #include <cstdarg>
 #include <cstdio>
+#include <cstring>
 
 // Global instance
 RemoteLogger remoteLog;
@@ -11,7 +13,15 @@ RemoteLogger::RemoteLogger()
     , remote_min_level_(LogLevel::INFO)
     , serial_enabled_(true)
     , broadcast_callback_(nullptr)
-    , mutex_(nullptr) {
+    , mutex_(nullptr)
+    , task_(nullptr)
+    , dropped_(0)
+    , dropped_total_(0)
+    , suppressed_total_(0)
+    , coalesced_total_(0)
+    , queue_peak_(0)
+    , last_site_(nullptr)
+    , repeat_count_(0) {
 }
 
 void RemoteLogger::begin() {
@@ -22,6 +32,25 @@ void RemoteLogger::begin() {
     info("Remote logger initialized");
 }
 
+bool RemoteLogger::startAsync() {
+#if LOG_ASYNC_ENABLED
+    if (task_ != nullptr) {
+        return true;
+    }
+
+    TaskHandle_t handle = nullptr;
+    if (xTaskCreatePinnedToCore(taskFunc, "Log Writer", 4096, this,
+                                LOG_TASK_PRIORITY, &handle, 1) != pdPASS) {
+        Serial.println("[RemoteLog] Warning: Failed to start log task");
+        return false;
+    }
+    task_ = handle;
+    return true;
+#else
+    return false;
+#endif
+}
+
 void RemoteLogger::debug(const char* format, ...) {
     va_list args;
     va_start(args, format);
@@ -57,6 +86,278 @@ void RemoteLogger::log(LogLevel level, const char* format, ...) {
     va_end(args);
 }
 
+bool RemoteLogger::admit(LogSite& site, uint32_t now, uint32_t& suppressed) {
+    suppressed = 0;
+#if LOG_RATE_LIMIT > 0
+    // Boot output (before startAsync()) is bounded, keep all of it
+    if (task_ == nullptr) {
+        return true;
+    }
+
+    uint32_t start = site.window_start.load(std::memory_order_relaxed);
+    if (now - start >= LOG_RATE_WINDOW_MS &&
+        site.window_start.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        site.count.store(0, std::memory_order_relaxed);
+    }
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= LOG_RATE_LIMIT) {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        suppressed_total_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+#endif
+    return true;
+}
+
+void RemoteLogger::submit(const DeferredLog& record) {
+    if (task_ != nullptr) {
+        if (!queue_.push(record)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            dropped_total_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    // Not started yet (setup): handle it on the caller
+    LogEntry entry;
+    entry.timestamp = record.timestamp;
+    entry.level = record.level;
+    formatRecord(record, entry.message, sizeof(entry.message));
+    emit(entry);
+}
+
+void RemoteLogger::capture(DeferredLog& record, const char* value) {
+    Arg& arg = record.args[record.argc];
+    record.kinds[record.argc++] = ArgKind::STR;
+    if (value == nullptr) {
+        value = "(null)";
+    }
+
+    // Copies share the strings area; the last byte always stays a NUL for
+    // arguments that no longer fit
+    const size_t used = record.strings_used;
+    const size_t room = LOG_STRING_BYTES - 1 - used;
+    size_t length = strnlen(value, room);
+    memcpy(record.strings + used, value, length);
+    record.strings[used + length] = '\0';
+    record.strings[LOG_STRING_BYTES - 1] = '\0';
+    arg.str = used;
+    record.strings_used = static_cast<uint8_t>(
+        (used + length + 1 < LOG_STRING_BYTES - 1) ? used + length + 1 : LOG_STRING_BYTES - 1);
+}
+
+size_t RemoteLogger::formatRecord(const DeferredLog& record, char* out, size_t size) {
+    uint8_t next = 0;
+
+    auto kindAt = [&](uint8_t i) { return i < record.argc ? record.kinds[i] : ArgKind::I32; };
+    auto signedArg = [&](uint8_t i) -> int64_t {
+        if (i >= record.argc) return 0;
+        const Arg& a = record.args[i];
+        switch (record.kinds[i]) {
+            case ArgKind::I32:
+            case ArgKind::I64: return a.i;
+            case ArgKind::U32: return static_cast<int32_t>(static_cast<uint32_t>(a.u));
+            case ArgKind::U64: return static_cast<int64_t>(a.u);
+            case ArgKind::F64: return static_cast<int64_t>(a.d);
+            case ArgKind::PTR: return static_cast<int64_t>(reinterpret_cast<intptr_t>(a.p));
+            default:           return 0;
+        }
+    };
+    auto unsignedArg = [&](uint8_t i) -> uint64_t {
+        if (i >= record.argc) return 0;
+        const Arg& a = record.args[i];
+        switch (record.kinds[i]) {
+            case ArgKind::I32: return static_cast<uint32_t>(a.i);     // As printf would show an int
+            case ArgKind::I64: return static_cast<uint64_t>(a.i);
+            case ArgKind::U32:
+            case ArgKind::U64: return a.u;
+            case ArgKind::F64: return static_cast<uint64_t>(a.d);
+            case ArgKind::PTR: return reinterpret_cast<uintptr_t>(a.p);
+            default:           return 0;
+        }
+    };
+    auto doubleArg = [&](uint8_t i) -> double {
+        if (i >= record.argc) return 0.0;
+        switch (record.kinds[i]) {
+            case ArgKind::F64: return record.args[i].d;
+            case ArgKind::U32:
+            case ArgKind::U64: return static_cast<double>(record.args[i].u);
+            case ArgKind::STR:
+            case ArgKind::PTR: return 0.0;
+            default:           return static_cast<double>(record.args[i].i);
+        }
+    };
+
+    // Walk the format one conversion at a time, handing each to snprintf
+    // with its stored argument. Length modifiers come from the stored type,
+    // not the format, so a mismatched %d/%lu can't misread anything.
+    size_t len = 0;
+    const char* p = record.format != nullptr ? record.format : "";
+    while (*p != '\0' && len + 1 < size) {
+        if (*p != '%') {
+            out[len++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[len++] = '%';
+            p += 2;
+            continue;
+        }
+
+        char spec[40];
+        size_t s = 0;
+        spec[s++] = *p++;
+        while (*p != '\0' && strchr("-+ #0", *p) != nullptr && s < 8) {
+            spec[s++] = *p++;
+        }
+        if (*p == '*') {
+            s += snprintf(spec + s, 12, "%d", static_cast<int>(signedArg(next++)));
+            p++;
+        } else {
+            for (uint8_t d = 0; isdigit(static_cast<unsigned char>(*p)) && d < 4; d++) spec[s++] = *p++;
+        }
+        if (*p == '.') {
+            spec[s++] = *p++;
+            if (*p == '*') {
+                s += snprintf(spec + s, 12, "%d", static_cast<int>(signedArg(next++)));
+                p++;
+            } else {
+                for (uint8_t d = 0; isdigit(static_cast<unsigned char>(*p)) && d < 4; d++) spec[s++] = *p++;
+            }
+        }
+        while (*p != '\0' && strchr("hlLjzt", *p) != nullptr) {
+            p++;
+        }
+        const char conversion = *p;
+        if (conversion == '\0') {
+            break;
+        }
+        p++;
+
+        char* dst = out + len;
+        const size_t avail = size - len;
+        int written = 0;
+        switch (conversion) {
+            case 'd':
+            case 'i':
+                memcpy(spec + s, "lld", 4);
+                written = snprintf(dst, avail, spec, static_cast<long long>(signedArg(next++)));
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                spec[s++] = 'l';
+                spec[s++] = 'l';
+                spec[s++] = conversion;
+                spec[s] = '\0';
+                written = snprintf(dst, avail, spec, static_cast<unsigned long long>(unsignedArg(next++)));
+                break;
+            case 'c':
+                memcpy(spec + s, "c", 2);
+                written = snprintf(dst, avail, spec, static_cast<int>(signedArg(next++)));
+                break;
+            case 'f': case 'F': case 'e': case 'E':
+            case 'g': case 'G': case 'a': case 'A':
+                spec[s++] = conversion;
+                spec[s] = '\0';
+                written = snprintf(dst, avail, spec, doubleArg(next++));
+                break;
+            case 's':
+                memcpy(spec + s, "s", 2);
+                written = snprintf(dst, avail, spec,
+                                   kindAt(next) == ArgKind::STR ? record.strings + record.args[next].str : "?");
+                next++;
+                break;
+            case 'p':
+                memcpy(spec + s, "p", 2);
+                written = snprintf(dst, avail, spec,
+                                   reinterpret_cast<void*>(static_cast<uintptr_t>(unsignedArg(next++))));
+                break;
+            default:
+                out[len++] = '?';
+                break;
+        }
+        if (written > 0) {
+            len += (static_cast<size_t>(written) < avail) ? written : avail - 1;
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
+
+void RemoteLogger::taskFunc(void* param) {
+    RemoteLogger* self = static_cast<RemoteLogger*>(param);
+    while (true) {
+        self->drain();
+        vTaskDelay(pdMS_TO_TICKS(LOG_TASK_INTERVAL_MS));
+    }
+}
+
+void RemoteLogger::drain() {
+    DeferredLog record;
+    LogEntry entry;
+    size_t depth = queue_.size();
+    if (depth > queue_peak_) {
+        queue_peak_ = depth;
+    }
+    while (queue_.pop(record)) {
+        entry.timestamp = record.timestamp;
+        entry.level = record.level;
+        size_t len = formatRecord(record, entry.message, sizeof(entry.message));
+        if (record.suppressed > 0 && len < sizeof(entry.message)) {
+            snprintf(entry.message + len, sizeof(entry.message) - len,
+                     " (+%u rate limited)", static_cast<unsigned>(record.suppressed));
+        }
+        coalesce(record.site, entry);
+    }
+
+    const uint32_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        flushRepeats();
+        entry.timestamp = millis();
+        entry.level = LogLevel::WARN;
+        snprintf(entry.message, sizeof(entry.message),
+                 "RemoteLog: %u message(s) dropped, queue full", static_cast<unsigned>(dropped));
+        emit(entry);
+    }
+
+    if (repeat_count_ > 0 && millis() - last_entry_.timestamp >= LOG_COALESCE_MS) {
+        flushRepeats();
+    }
+}
+
+void RemoteLogger::coalesce(const LogSite* site, const LogEntry& entry) {
+    // The same text from the same call site within LOG_COALESCE_MS of its
+    // first appearance is only counted
+    if (site == last_site_ && site != nullptr &&
+        entry.timestamp - last_entry_.timestamp < LOG_COALESCE_MS &&
+        strcmp(entry.message, last_entry_.message) == 0) {
+        repeat_count_++;
+        coalesced_total_++;
+        return;
+    }
+
+    flushRepeats();
+    emit(entry);
+    last_site_ = site;
+    last_entry_ = entry;
+}
+
+void RemoteLogger::flushRepeats() {
+    if (repeat_count_ > 0) {
+        LogEntry entry;
+        entry.timestamp = millis();
+        entry.level = last_entry_.level;
+        snprintf(entry.message, sizeof(entry.message), "Previous message repeated %u more time(s)",
+                 static_cast<unsigned>(repeat_count_));
+        emit(entry);
+        repeat_count_ = 0;
+    }
+    // The next identical message prints again and starts a new window
+    last_site_ = nullptr;
+}
+
 void RemoteLogger::logImpl(LogLevel level, const char* format, va_list args) {
     LogEntry entry;
     entry.timestamp = millis();
@@ -64,6 +365,11 @@ void RemoteLogger::logImpl(LogLevel level, const char* format, va_list args) {
 
     // Format the message
     vsnprintf(entry.message, sizeof(entry.message), format, args);
+    emit(entry);
+}
+
+void RemoteLogger::emit(const LogEntry& entry) {
+    const LogLevel level = entry.level;
 
     // Always output to Serial if enabled
     if (serial_enabled_) {
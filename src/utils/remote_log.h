@@ -2,7 +2,10 @@
 #define REMOTE_LOG_H
 
 #include <Arduino.h>
+#include <atomic>
 #include <functional>
+#include <type_traits>
+#include "mpsc_queue.h"
 
 // Log levels
 enum class LogLevel : uint8_t {
@@ -24,14 +27,36 @@ using LogBroadcastCallback = std::function<void(const LogEntry& entry)>;
 
 // Configuration
 #define LOG_BUFFER_SIZE 50  // Number of recent messages to keep
+#define LOG_ASYNC_ENABLED       true    // LOG_* calls are queued and formatted by the log task
+#define LOG_QUEUE_SIZE          32      // Pending messages (power of two)
+#define LOG_MAX_ARGS            8       // Arguments per LOG_* call
+#define LOG_STRING_BYTES        64      // Room for copied %s arguments per message
+#define LOG_TASK_PRIORITY       1
+#define LOG_TASK_INTERVAL_MS    20      // Queue drain period
+#define LOG_RATE_LIMIT          5       // Messages per call site per window (0 = unlimited)
+#define LOG_RATE_WINDOW_MS      1000
+#define LOG_COALESCE_MS         10000   // Identical repeats within this are counted, not printed
+
+// Per-call-site state of a LOG_* macro (one static instance each)
+struct LogSite {
+    std::atomic<uint32_t> window_start{0};
+    std::atomic<uint32_t> count{0};         // Messages in the current window
+    std::atomic<uint32_t> suppressed{0};    // Rejected since the last admitted message
+};
 
 class RemoteLogger {
 public:
     RemoteLogger();
 
-    // Initialize the logger
+    // Initialize the logger (messages are handled synchronously until
+    // startAsync())
     void begin();
 
+    // Start the log task; from then on LOG_* calls only queue their format
+    // pointer and arguments, and the task formats, prints and broadcasts
+    bool startAsync();
+    bool isAsync() const { return task_ != nullptr; }
+
     // Log methods
     void debug(const char* format, ...);
     void info(const char* format, ...);
@@ -39,6 +64,30 @@ public:
     void error(const char* format, ...);
     void log(LogLevel level, const char* format, ...);
 
+    // LOG_* macro path: rate limited per call site, then queued (or handled
+    // at once before startAsync()). format must outlive the call (string
+    // literal); %s arguments are copied.
+    template<typename... Args>
+    void deferred(LogSite& site, LogLevel level, const char* format, Args... args) {
+        static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "Too many LOG_* arguments");
+        const uint32_t now = millis();
+        uint32_t suppressed;
+        if (!admit(site, now, suppressed)) {
+            return;
+        }
+
+        DeferredLog record;
+        record.timestamp = now;
+        record.format = format;
+        record.site = &site;
+        record.suppressed = suppressed;
+        record.level = level;
+        record.argc = 0;
+        record.strings_used = 0;
+        (capture(record, args), ...);
+        submit(record);
+    }
+
     // Set minimum level for remote output (Serial always gets everything)
     void setRemoteLevel(LogLevel level) { remote_min_level_ = level; }
     LogLevel getRemoteLevel() const { return remote_min_level_; }
@@ -63,8 +112,84 @@ public:
     // Get level name as string
     static const char* levelToString(LogLevel level);
 
+    // Messages lost to a full queue, held back by the rate limit, and
+    // folded into "repeated" summaries
+    uint32_t getDroppedCount() const { return dropped_total_.load(std::memory_order_relaxed); }
+    uint32_t getSuppressedCount() const { return suppressed_total_.load(std::memory_order_relaxed); }
+    uint32_t getCoalescedCount() const { return coalesced_total_; }
+    size_t getQueueDepth() const { return queue_.size(); }
+    size_t getQueueHighWater() const { return queue_peak_; }   // Seen by the log task
+    size_t getQueueCapacity() const { return queue_.capacity(); }
+    TaskHandle_t getTaskHandle() const { return task_; }
+
 private:
+    enum class ArgKind : uint8_t { I32, I64, U32, U64, F64, PTR, STR };
+
+    union Arg {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void* p;
+        uint16_t str;       // Offset into DeferredLog::strings
+    };
+
+    // A LOG_* call as queued: formatted by the log task
+    struct DeferredLog {
+        uint32_t timestamp;
+        const char* format;
+        const LogSite* site;
+        uint32_t suppressed;    // Rate-limited messages of this site before this one
+        LogLevel level;
+        uint8_t argc;
+        uint8_t strings_used;
+        ArgKind kinds[LOG_MAX_ARGS];
+        Arg args[LOG_MAX_ARGS];
+        char strings[LOG_STRING_BYTES];
+    };
+
+    static_assert(LOG_STRING_BYTES <= 255, "strings_used is 8 bit");
+
+    bool admit(LogSite& site, uint32_t now, uint32_t& suppressed);
+    void submit(const DeferredLog& record);
+
+    static void capture(DeferredLog& record, const char* value);
+    static void capture(DeferredLog& record, char* value) { capture(record, static_cast<const char*>(value)); }
+
+    template<typename T>
+    static void capture(DeferredLog& record, T value) {
+        Arg& arg = record.args[record.argc];
+        ArgKind kind;
+        if constexpr (std::is_enum<T>::value) {
+            arg.i = static_cast<int64_t>(value);
+            kind = ArgKind::I32;
+        } else if constexpr (std::is_floating_point<T>::value) {
+            arg.d = value;
+            kind = ArgKind::F64;
+        } else if constexpr (std::is_pointer<T>::value) {
+            arg.p = value;
+            kind = ArgKind::PTR;
+        } else {
+            static_assert(std::is_integral<T>::value, "LOG_* arguments must be numbers, pointers or C strings");
+            if (std::is_signed<T>::value) {
+                arg.i = value;
+                kind = sizeof(T) > 4 ? ArgKind::I64 : ArgKind::I32;
+            } else {
+                arg.u = value;
+                kind = sizeof(T) > 4 ? ArgKind::U64 : ArgKind::U32;
+            }
+        }
+        record.kinds[record.argc++] = kind;
+    }
+
+    static size_t formatRecord(const DeferredLog& record, char* out, size_t size);
+
+    static void taskFunc(void* param);
+    void drain();
+    void coalesce(const LogSite* site, const LogEntry& entry);
+    void flushRepeats();
+
     void logImpl(LogLevel level, const char* format, va_list args);
+    void emit(const LogEntry& entry);
     void addEntry(const LogEntry& entry);
 
     LogEntry buffer_[LOG_BUFFER_SIZE];
@@ -76,15 +201,33 @@ private:
 
     // Mutex for thread safety
     SemaphoreHandle_t mutex_;
+
+    MpscQueue<DeferredLog, LOG_QUEUE_SIZE> queue_;
+    TaskHandle_t task_;
+    std::atomic<uint32_t> dropped_;         // Since the last "dropped" notice
+    std::atomic<uint32_t> dropped_total_;
+    std::atomic<uint32_t> suppressed_total_;
+    uint32_t coalesced_total_;
+    size_t queue_peak_;
+
+    // Coalescing (log task only)
+    const LogSite* last_site_;
+    LogEntry last_entry_;
+    uint32_t repeat_count_;
 };
 
 // Global instance
 extern RemoteLogger remoteLog;
 
-// Convenience macros
-#define LOG_DEBUG(fmt, ...) remoteLog.debug(fmt, ##__VA_ARGS__)
-#define LOG_INFO(fmt, ...)  remoteLog.info(fmt, ##__VA_ARGS__)
-#define LOG_WARN(fmt, ...)  remoteLog.warn(fmt, ##__VA_ARGS__)
-#define LOG_ERROR(fmt, ...) remoteLog.error(fmt, ##__VA_ARGS__)
+// Convenience macros (each expansion has its own rate limit)
+#define LOG_AT(level, fmt, ...) do { \
+        static LogSite log_site_; \
+        remoteLog.deferred(log_site_, level, fmt, ##__VA_ARGS__); \
+    } while (0)
+
+#define LOG_DEBUG(fmt, ...) LOG_AT(LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)  LOG_AT(LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...)  LOG_AT(LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define LOG_ERROR(fmt, ...) LOG_AT(LogLevel::ERROR, fmt, ##__VA_ARGS__)
 
 #endif // REMOTE_LOG_H
@@ -0,0 +1,72 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Lock-free single-producer/single-consumer queue.
+//
+// Exactly one task may call push() and exactly one (other) task may call
+// pop(). Unlike RingBuffer, a full queue rejects new items instead of
+// overwriting the oldest one, so the producer can account for every drop.
+// SIZE must be a power of two so indices can wrap with a mask.
+template<typename T, size_t SIZE>
+class SpscQueue {
+    static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "SpscQueue SIZE must be a power of two");
+
+public:
+    SpscQueue() : head(0), tail(0), peak(0) {}
+
+    // Producer side: returns false (item not stored) if the queue is full
+    bool push(const T& item) {
+        const size_t h = head.load(std::memory_order_relaxed);
+        const size_t t = tail.load(std::memory_order_acquire);
+        if (h - t >= SIZE) {
+            return false;
+        }
+
+        buffer[h & MASK] = item;
+        head.store(h + 1, std::memory_order_release);
+        if (h + 1 - t > peak) {
+            peak = h + 1 - t;
+        }
+        return true;
+    }
+
+    // Consumer side: returns false if the queue is empty
+    bool pop(T& item) {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        const size_t h = head.load(std::memory_order_acquire);
+        if (t == h) {
+            return false;
+        }
+
+        item = buffer[t & MASK];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Status (approximate when called from a third task)
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+    bool isEmpty() const { return size() == 0; }
+    bool isFull() const { return size() >= SIZE; }
+    size_t capacity() const { return SIZE; }
+    size_t highWater() const { return peak; }  // Deepest backlog seen by push()
+
+    // Consumer side: discard everything currently queued
+    void clear() {
+        tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t MASK = SIZE - 1;
+
+    T buffer[SIZE];
+    std::atomic<size_t> head;   // Written by producer only
+    std::atomic<size_t> tail;   // Written by consumer only
+    size_t peak;                // Written by producer only
+};
+
+#endif // SPSC_QUEUE_H